@@ -0,0 +1,173 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy(), memcmp() */
+#include <unistd.h> /* getopt() */
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program measures the memory bandwidth of the byte-swap kernels used
+ * internally by PnetCDF to convert between the native Little Endian
+ * representation and the Big Endian representation required by the CDF file
+ * formats. For element sizes of 2, 4, and 8 bytes, it reports the bandwidth
+ * of
+ *   1. in-place byte swap, as done on user buffers by the put APIs,
+ *   2. copy followed by an in-place byte swap of the copy, and
+ *   3. fused copy-and-swap, as done when packing a user buffer into a
+ *      temporary buffer.
+ * Bandwidths are calculated from the number of bytes of the buffer processed.
+ * Each MPI process runs the benchmark independently and the max timing among
+ * all processes is reported.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -O2 -o byte_swap byte_swap.c -lpnetcdf
+ *
+ *    % mpiexec -n 1 ./byte_swap -l 64 -n 20
+ *    Byte swap of 64 MiB buffer, 20 iterations
+ *    esize   in-place swap   memcpy + swap    fused copy-swap
+ *      2      5.5302 GiB/s     2.8650 GiB/s      4.5516 GiB/s
+ *      4      4.8754 GiB/s     2.4346 GiB/s      3.0425 GiB/s
+ *      8      5.6236 GiB/s     2.5591 GiB/s      3.2535 GiB/s
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* internal PnetCDF subroutines being benchmarked */
+extern void
+ncmpii_in_swapn(void *buf, MPI_Offset nelems, int esize);
+
+extern void
+ncmpii_swapn(void *dst, const void *src, MPI_Offset nelems, int esize);
+
+/*----< benchmark() >---------------------------------------------------------*/
+static int
+benchmark(MPI_Comm    comm,
+          size_t      nbytes,
+          int         esize,
+          int         ntimes,
+          double     *bw)     /* [3] OUT: GiB/s */
+{
+    int i, nerrs=0;
+    size_t j;
+    char *src, *dst, *org;
+    double timing[3], max_t[3], start_t;
+    MPI_Offset nelems = nbytes / esize;
+
+    src = (char*) malloc(nbytes);
+    dst = (char*) malloc(nbytes);
+    org = (char*) malloc(nbytes);
+    for (j=0; j<nbytes; j++) src[j] = (char)(j * 7 + esize);
+    memcpy(org, src, nbytes);
+
+    /* in-place swap, swapped an even number of times */
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<2*ntimes; i++)
+        ncmpii_in_swapn(src, nelems, esize);
+    timing[0] = (MPI_Wtime() - start_t) / 2;
+    if (memcmp(src, org, nbytes)) {
+        printf("Error: in-place byte swap of esize %d is incorrect\n", esize);
+        nerrs++;
+    }
+
+    /* copy first and then swap the copy */
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<ntimes; i++) {
+        memcpy(dst, src, nbytes);
+        ncmpii_in_swapn(dst, nelems, esize);
+    }
+    timing[1] = MPI_Wtime() - start_t;
+
+    /* fused copy and swap */
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<ntimes; i++)
+        ncmpii_swapn(dst, src, nelems, esize);
+    timing[2] = MPI_Wtime() - start_t;
+
+    /* swap back and compare against the original */
+    ncmpii_in_swapn(dst, nelems, esize);
+    if (memcmp(dst, org, nbytes)) {
+        printf("Error: fused copy-swap of esize %d is incorrect\n", esize);
+        nerrs++;
+    }
+
+    MPI_Reduce(timing, max_t, 3, MPI_DOUBLE, MPI_MAX, 0, comm);
+    for (i=0; i<3; i++) {
+        bw[i] = (double)nbytes * ntimes / 1073741824.0;
+        bw[i] = (max_t[i] > 0) ? bw[i] / max_t[i] : 0.0;
+    }
+
+    free(org);
+    free(dst);
+    free(src);
+    return nerrs;
+}
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [-h] | [-q] [-l len] [-n ntimes]\n"
+    "       [-h] Print help\n"
+    "       [-q] Quiet mode\n"
+    "       [-l len]: buffer size in MiB (default 16)\n"
+    "       [-n ntimes]: number of iterations (default 10)\n";
+    fprintf(stderr, help, argv0);
+}
+
+/*----< main() >--------------------------------------------------------------*/
+int main(int argc, char** argv) {
+    int i, rank, verbose=1, nerrs=0, ntimes=0, esize[3]={2, 4, 8};
+    double bw[3][3];
+    MPI_Offset len=0;
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(comm, &rank);
+
+    /* get command-line arguments */
+    while ((i = getopt(argc, argv, "hql:n:")) != EOF)
+        switch(i) {
+            case 'q': verbose = 0;
+                      break;
+            case 'l': len = atoi(optarg);
+                      break;
+            case 'n': ntimes = atoi(optarg);
+                      break;
+            case 'h':
+            default:  if (rank==0) usage(argv[0]);
+                      MPI_Finalize();
+                      return 1;
+        }
+
+    len    = (len    <= 0) ? 16 : len;
+    ntimes = (ntimes <= 0) ? 10 : ntimes;
+
+    for (i=0; i<3; i++)
+        nerrs += benchmark(comm, (size_t)len * 1048576, esize[i], ntimes,
+                           bw[i]);
+
+    if (verbose && rank == 0) {
+        printf("Byte swap of %lld MiB buffer, %d iterations\n", len, ntimes);
+        printf("esize   in-place swap   memcpy + swap    fused copy-swap\n");
+        for (i=0; i<3; i++)
+            printf("  %d    %8.4f GiB/s   %8.4f GiB/s    %8.4f GiB/s\n",
+                   esize[i], bw[i][0], bw[i][1], bw[i][2]);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, comm);
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
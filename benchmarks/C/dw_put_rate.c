@@ -0,0 +1,178 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* strcpy(), strncpy() */
+#include <unistd.h> /* getopt() */
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program measures the rate of small blocking put calls logged by the
+ * DataWarp driver, i.e. the per-call overhead of appending an entry to the
+ * log. Each process makes nputs independent calls to ncmpi_put_vara_int(),
+ * each writing len elements of its row of a 2D integer variable of size
+ * nprocs x (nputs * len). The log is flushed when the file is closed, which
+ * is timed separately. The DataWarp driver is enabled by hint nc_dw, the log
+ * files are stored in the directory of the output file unless hint
+ * nc_dw_dirname is set, e.g. through the environment variable PNETCDF_HINTS.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -O2 -o dw_put_rate dw_put_rate.c -lpnetcdf
+ *
+ *    % mpiexec -n 4 ./dw_put_rate -n 1000000 -l 1 /pvfs2/wkliao/testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define ERR(e) {if((e)!=NC_NOERR){printf("Error at line=%d: %s\n", __LINE__, ncmpi_strerror(e));nerrs++;}}
+
+/*----< benchmark() >---------------------------------------------------------*/
+static int
+benchmark(char       *filename,
+          int         nputs,
+          MPI_Offset  len,
+          double     *timing)  /* [2] */
+{
+    int i, rank, nprocs, nerrs=0, err, ncid, varid, dimid[2], *buf;
+    double start_t;
+    MPI_Offset j, start[2], count[2];
+    MPI_Info info;
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    err = ncmpi_create(comm, filename, NC_CLOBBER | NC_64BIT_DATA, info,
+                       &ncid);
+    if (err != NC_NOERR) {
+        printf("Error at line=%d: ncmpi_create() file %s (%s)\n",
+               __LINE__, filename, ncmpi_strerror(err));
+        MPI_Abort(comm, -1);
+        exit(1);
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "Y", nprocs, &dimid[0]); ERR(err)
+    err = ncmpi_def_dim(ncid, "X", len * nputs, &dimid[1]); ERR(err)
+    err = ncmpi_def_var(ncid, "var", NC_INT, 2, dimid, &varid); ERR(err)
+    err = ncmpi_enddef(ncid); ERR(err)
+
+    buf = (int*) malloc((size_t)len * sizeof(int));
+    for (j=0; j<len; j++) buf[j] = rank;
+
+    err = ncmpi_begin_indep_data(ncid); ERR(err)
+
+    /* put i writes elements [i * len, (i + 1) * len) of this process's row */
+    start[0] = rank;
+    count[0] = 1;
+    count[1] = len;
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<nputs; i++) {
+        start[1] = len * i;
+        err = ncmpi_put_vara_int(ncid, varid, start, count, buf);
+        if (err != NC_NOERR) {
+            ERR(err)
+            break;
+        }
+    }
+    timing[0] = MPI_Wtime() - start_t;
+
+    err = ncmpi_end_indep_data(ncid); ERR(err)
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    err = ncmpi_close(ncid); ERR(err)
+    timing[1] = MPI_Wtime() - start_t;
+
+    free(buf);
+    return nerrs;
+}
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [-h] | [-q] [-n nputs] [-l len] [file_name]\n"
+    "       [-h] Print help\n"
+    "       [-q] Quiet mode\n"
+    "       [-n nputs]: number of put calls per process (default 100000)\n"
+    "       [-l len]: number of elements per put call (default 1)\n"
+    "       [filename]: output netCDF file name (default ./testfile.nc)\n";
+    fprintf(stderr, help, argv0);
+}
+
+/*----< main() >--------------------------------------------------------------*/
+int main(int argc, char** argv) {
+    extern int optind;
+    char filename[256];
+    int i, rank, nprocs, verbose=1, nerrs=0, nputs=0;
+    double timing[2], max_t[2];
+    MPI_Offset len=0;
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    /* get command-line arguments */
+    while ((i = getopt(argc, argv, "hqn:l:")) != EOF)
+        switch(i) {
+            case 'q': verbose = 0;
+                      break;
+            case 'n': nputs = atoi(optarg);
+                      break;
+            case 'l': len = atoll(optarg);
+                      break;
+            case 'h':
+            default:  if (rank==0) usage(argv[0]);
+                      MPI_Finalize();
+                      return 1;
+        }
+    if (argv[optind] == NULL) strcpy(filename, "testfile.nc");
+    else                      snprintf(filename, 256, "%s", argv[optind]);
+
+    nputs = (nputs <= 0) ? 100000 : nputs;
+    len   = (len   <= 0) ?      1 : len;
+
+    nerrs += benchmark(filename, nputs, len, timing);
+
+    MPI_Reduce(timing, max_t, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (verbose && rank == 0) {
+        printf("-----------------------------------------------------------\n");
+        printf("Number of processes             = %d\n", nprocs);
+        printf("Number of puts per process      = %d\n", nputs);
+        printf("Number of elements per put      = %lld\n", len);
+        printf("Max time of put calls           = %16.4f sec\n", max_t[0]);
+        printf("Max time of ncmpi_close         = %16.4f sec\n", max_t[1]);
+        printf("Puts per second per process     = %16.4f K\n",
+               nputs / max_t[0] / 1.0e3);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, comm);
+
+    /* check if there is any PnetCDF internal malloc residue */
+    MPI_Offset malloc_size, sum_size;
+    int err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
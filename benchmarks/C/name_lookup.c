@@ -0,0 +1,189 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* strcpy(), strncpy() */
+#include <unistd.h> /* getopt() */
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program measures the cost of the name lookup tables of dimensions and
+ * variables for files with a large number of variables. For a number of
+ * variables nvars starting from 1000 and growing 10 times each round up to
+ * the number given by command-line option -n, it times
+ *   1. defining nvars 1D variables by ncmpi_def_var(), each checks whether
+ *      the name is in use and adds it to the name table,
+ *   2. ncmpi_enddef() and ncmpi_close() of the new file,
+ *   3. ncmpi_open() of the file, which reads the header and builds the name
+ *      tables of dimensions, variables and attributes, and
+ *   4. nvars calls to ncmpi_inq_varid() in a random order.
+ * The variable names share a long common prefix, as in many applications.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -O2 -o name_lookup name_lookup.c -lpnetcdf
+ *
+ *    % mpiexec -n 4 ./name_lookup -n 1000000 /pvfs2/wkliao/testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define ERR(e) {if((e)!=NC_NOERR){printf("Error at line=%d: %s\n", __LINE__, ncmpi_strerror(e));nerrs++;}}
+
+#define VAR_NAME(name, i) sprintf(name, "atmosphere_model_level_%d", i)
+
+/*----< benchmark() >---------------------------------------------------------*/
+static int
+benchmark(char   *filename,
+          int     nvars,
+          double *timing)  /* [4] */
+{
+    int i, j, rank, nerrs=0, err, ncid, varid, dimid, *order;
+    char name[NC_MAX_NAME];
+    double start_t;
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Comm_rank(comm, &rank);
+
+    err = ncmpi_create(comm, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       MPI_INFO_NULL, &ncid);
+    if (err != NC_NOERR) {
+        printf("Error at line=%d: ncmpi_create() file %s (%s)\n",
+               __LINE__, filename, ncmpi_strerror(err));
+        MPI_Abort(comm, -1);
+        exit(1);
+    }
+    err = ncmpi_def_dim(ncid, "X", 4, &dimid); ERR(err)
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<nvars; i++) {
+        VAR_NAME(name, i);
+        err = ncmpi_def_var(ncid, name, NC_INT, 1, &dimid, &varid);
+        if (err != NC_NOERR) {
+            ERR(err)
+            break;
+        }
+    }
+    timing[0] = MPI_Wtime() - start_t;
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    err = ncmpi_enddef(ncid); ERR(err)
+    err = ncmpi_close(ncid); ERR(err)
+    timing[1] = MPI_Wtime() - start_t;
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    err = ncmpi_open(comm, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); ERR(err)
+    timing[2] = MPI_Wtime() - start_t;
+
+    /* look up the names in a random order */
+    order = (int*) malloc((size_t)nvars * sizeof(int));
+    for (i=0; i<nvars; i++) order[i] = i;
+    srand(rank + 1);
+    for (i=nvars-1; i>0; i--) {
+        int tmp;
+        j = rand() % (i + 1);
+        tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+    }
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<nvars; i++) {
+        VAR_NAME(name, order[i]);
+        err = ncmpi_inq_varid(ncid, name, &varid);
+        if (err != NC_NOERR || varid != order[i]) {
+            printf("Error at line=%d: variable %s expect ID %d but got %d (%s)\n",
+                   __LINE__, name, order[i], varid, ncmpi_strerror(err));
+            nerrs++;
+            break;
+        }
+    }
+    timing[3] = MPI_Wtime() - start_t;
+
+    err = ncmpi_close(ncid); ERR(err)
+
+    free(order);
+    return nerrs;
+}
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [-h] | [-q] [-n nvars] [file_name]\n"
+    "       [-h] Print help\n"
+    "       [-q] Quiet mode\n"
+    "       [-n nvars]: max number of variables (default 100000)\n"
+    "       [filename]: output netCDF file name (default ./testfile.nc)\n";
+    fprintf(stderr, help, argv0);
+}
+
+/*----< main() >--------------------------------------------------------------*/
+int main(int argc, char** argv) {
+    extern int optind;
+    char filename[256];
+    int i, rank, nprocs, verbose=1, nerrs=0, nvars, max_nvars=0;
+    double timing[4], max_t[4];
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    /* get command-line arguments */
+    while ((i = getopt(argc, argv, "hqn:")) != EOF)
+        switch(i) {
+            case 'q': verbose = 0;
+                      break;
+            case 'n': max_nvars = atoi(optarg);
+                      break;
+            case 'h':
+            default:  if (rank==0) usage(argv[0]);
+                      MPI_Finalize();
+                      return 1;
+        }
+    if (argv[optind] == NULL) strcpy(filename, "testfile.nc");
+    else                      snprintf(filename, 256, "%s", argv[optind]);
+
+    max_nvars = (max_nvars <= 0) ? 100000 : max_nvars;
+
+    if (verbose && rank == 0) {
+        printf("Number of processes = %d\n", nprocs);
+        printf("%10s %14s %14s %14s %14s\n", "nvars", "def_var (sec)",
+               "close (sec)", "open (sec)", "inq_varid (sec)");
+    }
+
+    for (nvars=1000; nvars<=max_nvars; nvars*=10) {
+        nerrs += benchmark(filename, nvars, timing);
+        if (nerrs > 0) break;
+
+        MPI_Reduce(timing, max_t, 4, MPI_DOUBLE, MPI_MAX, 0, comm);
+        if (verbose && rank == 0)
+            printf("%10d %14.4f %14.4f %14.4f %14.4f\n", nvars, max_t[0],
+                   max_t[1], max_t[2], max_t[3]);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, comm);
+
+    /* check if there is any PnetCDF internal malloc residue */
+    MPI_Offset malloc_size, sum_size;
+    int err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,174 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* strcpy(), strncpy() */
+#include <unistd.h> /* getopt() */
+
+#include <mpi.h>
+#include <pnetcdf.h>
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program measures the cost of ncmpi_wait_all() when the pending
+ * nonblocking requests are interleaved in the file, which requires PnetCDF to
+ * break down all requests into offset-length segments and sort them. Each
+ * process posts nreqs nonblocking requests to a 2D integer variable of size
+ * (nprocs * len) x nreqs. Request i writes column i of the process's len rows,
+ * i.e. len segments of one element each. Thus, each process has nreqs * len
+ * segments in total, made of nreqs sorted runs interleaving one another.
+ * When len is at least 16, the runs interleave in lockstep and are described
+ * by MPI vector datatypes without being expanded into segments. A smaller len
+ * makes PnetCDF expand and sort the segments, in which case use a small nreqs
+ * (e.g. 10) to test the k-way merge of sorted runs and a large nreqs (e.g.
+ * 1000) to test the radix sort.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -O2 -o wait_all_segs wait_all_segs.c -lpnetcdf
+ *
+ *    % mpiexec -n 1 ./wait_all_segs -n 1000 -l 10000 /pvfs2/wkliao/testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define ERR(e) {if((e)!=NC_NOERR){printf("Error at line=%d: %s\n", __LINE__, ncmpi_strerror(e));nerrs++;}}
+
+/*----< benchmark() >---------------------------------------------------------*/
+static int
+benchmark(char       *filename,
+          int         nreqs,
+          MPI_Offset  len,
+          double     *timing)  /* [2] */
+{
+    int i, rank, nprocs, nerrs=0, err, ncid, varid, dimid[2], *buf, *reqs;
+    double start_t;
+    MPI_Offset j, start[2], count[2];
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    err = ncmpi_create(comm, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       MPI_INFO_NULL, &ncid);
+    if (err != NC_NOERR) {
+        printf("Error at line=%d: ncmpi_create() file %s (%s)\n",
+               __LINE__, filename, ncmpi_strerror(err));
+        MPI_Abort(comm, -1);
+        exit(1);
+    }
+    err = ncmpi_def_dim(ncid, "Y", len * nprocs, &dimid[0]); ERR(err)
+    err = ncmpi_def_dim(ncid, "X", nreqs, &dimid[1]); ERR(err)
+    err = ncmpi_def_var(ncid, "var", NC_INT, 2, dimid, &varid); ERR(err)
+    err = ncmpi_enddef(ncid); ERR(err)
+
+    buf  = (int*) malloc((size_t)len * nreqs * sizeof(int));
+    reqs = (int*) malloc((size_t)nreqs * sizeof(int));
+    for (j=0; j<len * nreqs; j++) buf[j] = rank;
+
+    /* request i writes column i of this process's rows */
+    start[0] = len * rank;
+    count[0] = len;
+    count[1] = 1;
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    for (i=0; i<nreqs; i++) {
+        start[1] = i;
+        err = ncmpi_iput_vara_int(ncid, varid, start, count, buf + len * i,
+                                  &reqs[i]);
+        ERR(err)
+    }
+    timing[0] = MPI_Wtime() - start_t;
+
+    MPI_Barrier(comm);
+    start_t = MPI_Wtime();
+    err = ncmpi_wait_all(ncid, nreqs, reqs, NULL); ERR(err)
+    timing[1] = MPI_Wtime() - start_t;
+
+    err = ncmpi_close(ncid); ERR(err)
+
+    free(reqs);
+    free(buf);
+    return nerrs;
+}
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [-h] | [-q] [-n nreqs] [-l len] [file_name]\n"
+    "       [-h] Print help\n"
+    "       [-q] Quiet mode\n"
+    "       [-n nreqs]: number of nonblocking requests (default 100)\n"
+    "       [-l len]: number of segments per request (default 1000)\n"
+    "       [filename]: output netCDF file name (default ./testfile.nc)\n";
+    fprintf(stderr, help, argv0);
+}
+
+/*----< main() >--------------------------------------------------------------*/
+int main(int argc, char** argv) {
+    extern int optind;
+    char filename[256];
+    int i, rank, nprocs, verbose=1, nerrs=0, nreqs=0;
+    double timing[2], max_t[2];
+    MPI_Offset len=0;
+    MPI_Comm comm=MPI_COMM_WORLD;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    /* get command-line arguments */
+    while ((i = getopt(argc, argv, "hqn:l:")) != EOF)
+        switch(i) {
+            case 'q': verbose = 0;
+                      break;
+            case 'n': nreqs = atoi(optarg);
+                      break;
+            case 'l': len = atoll(optarg);
+                      break;
+            case 'h':
+            default:  if (rank==0) usage(argv[0]);
+                      MPI_Finalize();
+                      return 1;
+        }
+    if (argv[optind] == NULL) strcpy(filename, "testfile.nc");
+    else                      snprintf(filename, 256, "%s", argv[optind]);
+
+    nreqs = (nreqs <= 0) ?  100 : nreqs;
+    len   = (len   <= 0) ? 1000 : len;
+
+    nerrs += benchmark(filename, nreqs, len, timing);
+
+    MPI_Reduce(timing, max_t, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (verbose && rank == 0) {
+        double nsegs = (double)nreqs * len;
+        printf("-----------------------------------------------------------\n");
+        printf("Number of processes             = %d\n", nprocs);
+        printf("Number of requests per process  = %d\n", nreqs);
+        printf("Number of segments per process  = %.0f\n", nsegs);
+        printf("Max time of posting requests    = %16.4f sec\n", max_t[0]);
+        printf("Max time of ncmpi_wait_all      = %16.4f sec\n", max_t[1]);
+        printf("Segments per second per process = %16.4f M\n",
+               nsegs / max_t[1] / 1.0e6);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, comm);
+
+    /* check if there is any PnetCDF internal malloc residue */
+    MPI_Offset malloc_size, sum_size;
+    int err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -580,6 +580,45 @@ NcmpiVar NcmpiGroup::addVar(const string& name, const NcmpiType& ncmpiType, cons
   return NcmpiVar(*this,varId);
 }
 
+// Add a set of new netCDF variables.
+vector<NcmpiVar> NcmpiGroup::addVars(const vector<string>& names, const vector<NcmpiType>& ncmpiTypes, const vector< vector<NcmpiDim> >& ncmpiDims) const {
+  ncmpiCheckDefineMode(myId);
+
+  int nvars = names.size();
+  if(ncmpiTypes.size() != names.size() || ncmpiDims.size() != names.size())
+    throw NcmpiException("Attempt to invoke NcmpiGroup::addVars with vectors of different sizes",__FILE__,__LINE__);
+
+  // check NcmpiType and NcmpiDim objects are valid, and collect their IDs
+  vector<char*> namePtrs(nvars);
+  vector<nc_type> typeIds(nvars);
+  vector<int> ndims(nvars);
+  vector< vector<int> > dimIds(nvars);
+  vector<int*> dimIdsPtrs(nvars);
+  for (int i=0; i<nvars; i++) {
+    if(ncmpiTypes[i].isNull()) throw NcNullType("Attempt to invoke NcmpiGroup::addVars with a Null NcmpiType object",__FILE__,__LINE__);
+    namePtrs[i] = const_cast<char*>(names[i].c_str());
+    typeIds[i] = ncmpiTypes[i].getId();
+    ndims[i] = ncmpiDims[i].size();
+    dimIds[i].reserve(ndims[i]);
+    for (int j=0; j<ndims[i]; j++) {
+      if(ncmpiDims[i][j].isNull()) throw NcNullDim("Attempt to invoke NcmpiGroup::addVars with a Null NcmpiDim object",__FILE__,__LINE__);
+      dimIds[i].push_back(ncmpiDims[i][j].getId());
+    }
+    dimIdsPtrs[i] = dimIds[i].empty() ? 0 : &dimIds[i][0];
+  }
+
+  // define all new netCDF variables at once
+  vector<int> varIds(nvars);
+  if (nvars > 0)
+    ncmpiCheck(ncmpi_def_vars(myId,nvars,&namePtrs[0],&typeIds[0],&ndims[0],&dimIdsPtrs[0],&varIds[0]),__FILE__,__LINE__);
+
+  // return NcmpiVar objects for the new variables
+  vector<NcmpiVar> vars;
+  vars.reserve(nvars);
+  for (int i=0; i<nvars; i++) vars.push_back(NcmpiVar(*this,varIds[i]));
+  return vars;
+}
+
 
 // /////////////
 // NcmpiAtt-related methods
@@ -968,6 +1007,26 @@ NcmpiGroupAtt NcmpiGroup::putAtt(const string& name, const NcmpiType& type, MPI_
   return getAtt(name);
 }
 
+// Creates or changes a set of group attributes in one call.
+void NcmpiGroup::putAtts(const vector<string>& names, const vector<NcmpiType>& types, const vector<MPI_Offset>& lens, const vector<const void*>& dataValues) const {
+  ncmpiCheckDefineMode(myId);
+
+  int natts = names.size();
+  if(types.size() != names.size() || lens.size() != names.size() || dataValues.size() != names.size())
+    throw NcmpiException("Attempt to invoke NcmpiGroup::putAtts with vectors of different sizes",__FILE__,__LINE__);
+  if (natts == 0) return;
+
+  vector<char*> namePtrs(natts);
+  vector<nc_type> typeIds(natts);
+  vector<void*> bufs(natts);
+  for (int i=0; i<natts; i++) {
+    namePtrs[i] = const_cast<char*>(names[i].c_str());
+    typeIds[i] = types[i].getId();
+    bufs[i] = const_cast<void*>(dataValues[i]);
+  }
+  ncmpiCheck(ncmpi_put_atts(myId,NC_GLOBAL,natts,&namePtrs[0],&typeIds[0],&lens[0],&bufs[0]),__FILE__,__LINE__);
+}
+
 
 
 // /////////////
@@ -274,6 +274,18 @@ namespace PnetCDF
     */
     NcmpiVar addVar(const std::string& name, const NcmpiType& ncmpiType, const std::vector<NcmpiDim>& ncmpiDimVector) const;
 
+    /*!
+      Adds a set of new netCDF variables in one call.
+      The vectors must be of the same size. The NcmpiType and NcmpiDim objects must be non-null.
+      An NcNullType exception is thrown if any of the NcmpiType objects are invalid.
+      An NcNullDim exception is thrown if any of the the NcmpiDim objects are invalid.
+      \param    names       Variable names.
+      \param    ncmpiTypes  NcmpiType objects, one per variable.
+      \param    ncmpiDims   Vectors of NcmpiDim objects, one per variable.
+      \return               The NcmpiVar objects for the new netCDF variables.
+    */
+    std::vector<NcmpiVar> addVars(const std::vector<std::string>& names, const std::vector<NcmpiType>& ncmpiTypes, const std::vector< std::vector<NcmpiDim> >& ncmpiDims) const;
+
     // /////////////
     // NcmpiGroupAtt-related methods
     // /////////////
@@ -395,6 +407,16 @@ namespace PnetCDF
     */
     NcmpiGroupAtt putAtt(const std::string& name, const NcmpiType& type, MPI_Offset len, const void* dataValues) const ;
 
+    /*!
+      Creates a set of new NetCDF group attributes or changes the values of existing ones in one call.
+      The vectors must be of the same size. The type of data values of each attribute must match its attribute type.
+      \param names       Names of attributes.
+      \param types       The attribute types.
+      \param lens        The lengths of the attributes.
+      \param dataValues  Data Values to put into the attributes.
+    */
+    void putAtts(const std::vector<std::string>& names, const std::vector<NcmpiType>& types, const std::vector<MPI_Offset>& lens, const std::vector<const void*>& dataValues) const ;
+
 
 
     // /////////////
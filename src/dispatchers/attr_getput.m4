@@ -280,3 +280,65 @@ foreach(`putget', (get, put),
                  `GETPUT_ATT(putget, iType)
 ')')
 
+
+/*----< ncmpi_put_atts() >---------------------------------------------------*/
+/* This is a collective subroutine, all arguments should be consistent among
+ * all processes.
+ *
+ * It puts natts attributes of the same variable in one call, so the driver
+ * can grow its name lookup table once and, in data mode, write the file
+ * header once. The user buffer data type of each attribute matches its
+ * external type defined in file. If an error other than NC_ERANGE occurs,
+ * the attributes before it have been put.
+ */
+int
+ncmpi_put_atts(int                ncid,
+               int                varid,
+               int                natts,
+               char*       const *names,
+               const nc_type     *xtypes,
+               const MPI_Offset  *nelems,  /* [natts] number of elements */
+               void*       const *bufs)
+{
+    int i, err=NC_NOERR;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (natts < 0 || (natts > 0 && (names == NULL || xtypes == NULL ||
+                                    nelems == NULL || bufs == NULL)))
+        DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
+
+    if (pncp->flag & NC_MODE_SAFE) {
+        int minE, mpireturn;
+
+        TRACE_COMM(MPI_Allreduce)(&err, &minE, 1, MPI_INT, MPI_MIN, pncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        err = minE;
+    }
+    if (err != NC_NOERR) return err;
+
+    /* sanity check for arguments of all attributes */
+    for (i=0; i<natts; i++) {
+        MPI_Datatype itype=ncmpii_nc2mpitype(xtypes[i]);
+
+        err = sanity_check_put(pncp, varid, names[i], nelems[i], bufs[i]);
+
+        /* check NC_EBADTYPE/NC_ECHAR */
+        if (err == NC_NOERR) err = check_EBADTYPE_ECHAR(pncp, itype, xtypes[i]);
+
+        if (pncp->flag & NC_MODE_SAFE) /* put APIs are collective */
+            err = check_consistency_put(pncp->comm, varid, names[i], xtypes[i],
+                                        nelems[i], bufs[i], itype, err);
+        if (err != NC_NOERR) return err;
+    }
+
+    if (natts == 0) return NC_NOERR;
+
+    /* calling the subroutine that implements ncmpi_put_atts() */
+    return pncp->driver->put_atts(pncp->ncp, varid, natts, names, xtypes,
+                                  nelems, bufs);
+}
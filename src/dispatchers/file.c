@@ -224,6 +224,80 @@ combine_env_hints(MPI_Info  user_info,
     /* return no error as all hints are advisory */
 }
 
+/*----< construct_PNC_vars() >-----------------------------------------------*/
+/* construct pncp->vars[] from the variables defined in an opened file */
+static int
+construct_PNC_vars(PNC *pncp)
+{
+    int i, err, nalloc;
+    PNC_driver *driver=pncp->driver;
+
+    /* inquire number of dimensions, variables defined and rec dim ID */
+    err = driver->inq(pncp->ncp, &pncp->ndims, &pncp->nvars, NULL,
+                      &pncp->unlimdimid);
+    if (err != NC_NOERR) return err;
+
+    if (pncp->nvars == 0) return NC_NOERR; /* no variable defined */
+
+    /* allocate chunk size for pncp->vars[] */
+    nalloc = _RNDUP(pncp->nvars, PNC_VARS_CHUNK);
+    pncp->vars = NCI_Malloc(nalloc * sizeof(PNC_var));
+    if (pncp->vars == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+
+    /* construct array of PNC_var for all variables */
+    for (i=0; i<pncp->nvars; i++) {
+        nc_type xtype;
+        int ndims;
+        err = driver->inq_var(pncp->ncp, i, NULL, &xtype, &ndims,
+                              NULL, NULL, NULL, NULL, NULL);
+        if (err != NC_NOERR) return err;
+        pncp->vars[i].xtype  = xtype;
+        pncp->vars[i].ndims  = ndims;
+        pncp->vars[i].recdim = -1;   /* if fixed-size variable */
+        pncp->vars[i].shape  = NULL;
+        if (ndims > 0) {
+            int j, *dimids;
+            pncp->vars[i].shape = (MPI_Offset*)
+                                   NCI_Malloc(ndims * SIZEOF_MPI_OFFSET);
+            dimids = (int*) NCI_Malloc(ndims * SIZEOF_INT);
+            err = driver->inq_var(pncp->ncp, i, NULL, NULL, NULL,
+                                  dimids, NULL, NULL, NULL, NULL);
+            if (err != NC_NOERR) return err;
+            if (dimids[0] == pncp->unlimdimid)
+                pncp->vars[i].recdim = pncp->unlimdimid;
+            for (j=0; j<ndims; j++) {
+                /* obtain size of dimension j */
+                err = driver->inq_dim(pncp->ncp, dimids[j], NULL,
+                                      pncp->vars[i].shape+j);
+                if (err != NC_NOERR) return err;
+            }
+            NCI_Free(dimids);
+        }
+    }
+    return NC_NOERR;
+}
+
+/*----< rebuild_PNC_vars() >-------------------------------------------------*/
+/* Driver's enddef returns NC_EMULTIDEFINE after exiting define mode with its
+ * variables taken from root's, e.g. in root-define mode when a def_var call
+ * failed only at root. Rebuild pncp->vars[] to match the driver's.
+ */
+static int
+rebuild_PNC_vars(PNC *pncp)
+{
+    int i;
+
+    for (i=0; i<pncp->nvars; i++)
+        if (pncp->vars[i].shape != NULL)
+            NCI_Free(pncp->vars[i].shape);
+    if (pncp->vars != NULL)
+        NCI_Free(pncp->vars);
+    pncp->vars  = NULL;
+    pncp->nvars = 0;
+
+    return construct_PNC_vars(pncp);
+}
+
 /*----< ncmpi_create() >-----------------------------------------------------*/
 /* This is a collective subroutine. */
 int
@@ -393,6 +467,79 @@ ncmpi_create(MPI_Comm    comm,
     return status;
 }
 
+/*----< ncmpi_create_from_template() >----------------------------------------*/
+/* This is a collective subroutine. It creates a new file whose header, i.e.
+ * dimensions, variables, and attributes, is a copy of the header of an opened
+ * file, template_ncid, which must be in data mode. The new file is returned
+ * in data mode, skipping all define-mode calls and the consistency check of
+ * enddef, as the template's header has already been checked. The file format
+ * of the new file is the template's, overwriting the format bits in cmode.
+ * Both files must use the same I/O driver. As in a newly created file, the
+ * new file is in no-fill mode and has no record written.
+ */
+int
+ncmpi_create_from_template(MPI_Comm    comm,
+                           const char *path,
+                           int         cmode,
+                           int         template_ncid,
+                           MPI_Info    info,
+                           int        *ncidp)
+{
+    int status, err;
+    PNC *pncp, *tpncp;
+
+    /* check if template_ncid is valid */
+    err = PNC_check_id(template_ncid, &tpncp);
+    if (err != NC_NOERR) return err;
+
+    /* the template's header must have been committed by enddef */
+    if (tpncp->flag & NC_MODE_DEF) DEBUG_RETURN_ERROR(NC_EINDEFINE)
+
+    /* use the template's file format */
+    fClr(cmode, NC_64BIT_OFFSET | NC_64BIT_DATA);
+    if (tpncp->format == NC_FORMAT_CDF5)
+        fSet(cmode, NC_64BIT_DATA);
+    else if (tpncp->format == NC_FORMAT_CDF2)
+        fSet(cmode, NC_64BIT_OFFSET);
+
+    status = ncmpi_create(comm, path, cmode, info, ncidp);
+    if (status != NC_NOERR && status != NC_EMULTIDEFINE_CMODE) return status;
+
+    err = PNC_check_id(*ncidp, &pncp);
+    if (err != NC_NOERR) return err;
+
+    /* the driver copies the header from an object of its own kind, e.g. one
+     * of the two files is opened with DataWarp driver enabled by a hint and
+     * the other is not */
+    if (pncp->driver != tpncp->driver) {
+        ncmpi_abort(*ncidp); /* delete the new file and ignore error */
+        *ncidp = -1;
+        DEBUG_RETURN_ERROR(NC_EINVAL)
+    }
+    pncp->format = tpncp->format;
+
+    /* calling the subroutine that copies the header and enters data mode */
+    err = pncp->driver->enddef_from(pncp->ncp, tpncp->ncp);
+    if (err != NC_NOERR) {
+        ncmpi_abort(*ncidp); /* delete the new file and ignore error */
+        *ncidp = -1;
+        return err;
+    }
+
+    fClr(pncp->flag, NC_MODE_INDEP); /* default enters collective data mode */
+    fClr(pncp->flag, NC_MODE_DEF);
+
+    /* construct pncp->vars[] */
+    err = construct_PNC_vars(pncp);
+    if (err != NC_NOERR) {
+        ncmpi_close(*ncidp); /* close file and ignore error */
+        *ncidp = -1;
+        return err;
+    }
+
+    return status;
+}
+
 /*----< ncmpi_open() >-------------------------------------------------------*/
 /* This is a collective subroutine. */
 int
@@ -402,7 +549,7 @@ ncmpi_open(MPI_Comm    comm,
            MPI_Info    info,
            int        *ncidp)  /* OUT */
 {
-    int i, nalloc, rank, format, msg[2], status=NC_NOERR, err;
+    int rank, format, msg[2], status=NC_NOERR, err;
     int enable_foo_driver=0, enable_dw_driver=0;
     int safe_mode=0, mpireturn, root_omode;
     char *env_str;
@@ -578,52 +725,7 @@ ncmpi_open(MPI_Comm    comm,
     if (err != NC_NOERR) goto fn_exit;
 
     /* construct pncp->vars[] */
-
-    /* inquire number of dimensions, variables defined and rec dim ID */
-    err = driver->inq(pncp->ncp, &pncp->ndims, &pncp->nvars, NULL,
-                      &pncp->unlimdimid);
-    if (err != NC_NOERR) goto fn_exit;
-
-    if (pncp->nvars == 0) return status; /* no variable defined */
-
-    /* allocate chunk size for pncp->vars[] */
-    nalloc = _RNDUP(pncp->nvars, PNC_VARS_CHUNK);
-    pncp->vars = NCI_Malloc(nalloc * sizeof(PNC_var));
-    if (pncp->vars == NULL) {
-        DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
-        goto fn_exit;
-    }
-
-    /* construct array of PNC_var for all variables */
-    for (i=0; i<pncp->nvars; i++) {
-        nc_type xtype;
-        int ndims;
-        err = driver->inq_var(pncp->ncp, i, NULL, &xtype, &ndims,
-                              NULL, NULL, NULL, NULL, NULL);
-        if (err != NC_NOERR) return err;
-        pncp->vars[i].xtype  = xtype;
-        pncp->vars[i].ndims  = ndims;
-        pncp->vars[i].recdim = -1;   /* if fixed-size variable */
-        pncp->vars[i].shape  = NULL;
-        if (ndims > 0) {
-            int j, *dimids;
-            pncp->vars[i].shape = (MPI_Offset*)
-                                   NCI_Malloc(ndims * SIZEOF_MPI_OFFSET);
-            dimids = (int*) NCI_Malloc(ndims * SIZEOF_INT);
-            err = driver->inq_var(pncp->ncp, i, NULL, NULL, NULL,
-                                  dimids, NULL, NULL, NULL, NULL);
-            if (err != NC_NOERR) goto fn_exit;
-            if (dimids[0] == pncp->unlimdimid)
-                pncp->vars[i].recdim = pncp->unlimdimid;
-            for (j=0; j<ndims; j++) {
-                /* obtain size of dimension j */
-                err = driver->inq_dim(pncp->ncp, dimids[j], NULL,
-                                      pncp->vars[i].shape+j);
-                if (err != NC_NOERR) goto fn_exit;
-            }
-            NCI_Free(dimids);
-        }
-    }
+    err = construct_PNC_vars(pncp);
 
 fn_exit:
     if (err != NC_NOERR) {
@@ -673,7 +775,7 @@ ncmpi_close(int ncid)
 /* This is a collective subroutine. */
 int
 ncmpi_enddef(int ncid) {
-    int err=NC_NOERR;
+    int err=NC_NOERR, status=NC_NOERR;
     PNC *pncp;
 
     /* check if ncid is valid */
@@ -694,11 +796,16 @@ ncmpi_enddef(int ncid) {
 
     /* calling the subroutine that implements ncmpi_enddef() */
     err = pncp->driver->enddef(pncp->ncp);
+    if (err == NC_EMULTIDEFINE) {
+        /* driver has exited define mode with root's variables */
+        status = err;
+        err = rebuild_PNC_vars(pncp);
+    }
     if (err != NC_NOERR) return err;
 
     fClr(pncp->flag, NC_MODE_INDEP); /* default enters collective data mode */
     fClr(pncp->flag, NC_MODE_DEF);
-    return NC_NOERR;
+    return status;
 }
 
 /*----< ncmpi__enddef() >----------------------------------------------------*/
@@ -710,7 +817,7 @@ ncmpi__enddef(int        ncid,
               MPI_Offset v_minfree,
               MPI_Offset r_align)
 {
-    int err=NC_NOERR;
+    int err=NC_NOERR, status=NC_NOERR;
     PNC *pncp;
 
     /* check if ncid is valid */
@@ -765,11 +872,16 @@ err_check:
     /* calling the subroutine that implements ncmpi__enddef() */
     err = pncp->driver->_enddef(pncp->ncp, h_minfree, v_align,
                                            v_minfree, r_align);
+    if (err == NC_EMULTIDEFINE) {
+        /* driver has exited define mode with root's variables */
+        status = err;
+        err = rebuild_PNC_vars(pncp);
+    }
     if (err != NC_NOERR) return err;
 
     fClr(pncp->flag, NC_MODE_INDEP); /* default enters collective data mode */
     fClr(pncp->flag, NC_MODE_DEF);
-    return NC_NOERR;
+    return status;
 }
 
 /*----< ncmpi_redef() >------------------------------------------------------*/
@@ -18,55 +18,45 @@
 #include <pnc_debug.h>
 #include <common.h>
 
-/*----< ncmpi_def_var() >----------------------------------------------------*/
-/* this API is collective, and must be called in define mode */
-int
-ncmpi_def_var(int         ncid,    /* IN:  file ID */
-              const char *name,    /* IN:  name of variable */
-              nc_type     type,
-              int         ndims,
-              const int  *dimids,
-              int        *varidp)
+/*----< check_def_var_args() >----------------------------------------------*/
+/* check the arguments of a variable to be defined, except for whether its
+ * name is already in use */
+static int
+check_def_var_args(PNC        *pncp,
+                   const char *name,
+                   nc_type     type,
+                   int         ndims,
+                   const int  *dimids)
 {
-    int i, err;
-    PNC *pncp;
-
-    /* check if ncid is valid */
-    err = PNC_check_id(ncid, &pncp);
-    if (err != NC_NOERR) return err;
-
-    if (!(pncp->flag & NC_MODE_DEF)) { /* must be called in define mode */
-        DEBUG_ASSIGN_ERROR(err, NC_ENOTINDEFINE)
-        goto err_check;
-    }
+    int i, err=NC_NOERR;
 
     if (name == NULL || *name == 0) { /* name cannot be NULL or NULL string */
         DEBUG_ASSIGN_ERROR(err, NC_EBADNAME)
-        goto err_check;
+        return err;
     }
 
     if (strlen(name) > NC_MAX_NAME) { /* name length */
         DEBUG_ASSIGN_ERROR(err, NC_EMAXNAME)
-        goto err_check;
+        return err;
     }
 
     /* check if the name string is legal for netcdf format */
     err = ncmpii_check_name(name, pncp->format);
     if (err != NC_NOERR) {
         DEBUG_TRACE_ERROR(err)
-        goto err_check;
+        return err;
     }
 
     /* the max data type supported by CDF-5 is NC_UINT64 */
     if (type <= 0 || type > NC_UINT64) {
         DEBUG_ASSIGN_ERROR(err, NC_EBADTYPE)
-        goto err_check;
+        return err;
     }
 
     /* For CDF-1 and CDF-2 files, only classic types are allowed. */
     if (pncp->format < NC_FORMAT_CDF5 && type > NC_DOUBLE) {
         DEBUG_ASSIGN_ERROR(err, NC_ESTRICTCDF2)
-        goto err_check;
+        return err;
     }
 
     /* Argument ndims is of type "int". Its max value will be less than
@@ -79,14 +69,54 @@ ncmpi_def_var(int         ncid,    /* IN:  file ID */
 #if NC_MAX_VAR_DIMS < INT_MAX
     if (ndims > NC_MAX_VAR_DIMS) {
         DEBUG_ASSIGN_ERROR(err, NC_EMAXDIMS)
-        goto err_check;
+        return err;
     }
 #endif
     if (ndims < 0) {
         DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
+        return err;
+    }
+
+    /* check dimids[] */
+    if (ndims > 0 && dimids == NULL) { /* for non-scalar variable */
+        DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
+        return err;
+    }
+    for (i=0; i<ndims; i++) {
+        if (dimids[i] < 0 || pncp->ndims == 0 || dimids[i] >= pncp->ndims) {
+            DEBUG_ASSIGN_ERROR(err, NC_EBADDIM)
+            return err;
+        }
+    }
+
+    return NC_NOERR;
+}
+
+/*----< ncmpi_def_var() >----------------------------------------------------*/
+/* this API is collective, and must be called in define mode */
+int
+ncmpi_def_var(int         ncid,    /* IN:  file ID */
+              const char *name,    /* IN:  name of variable */
+              nc_type     type,
+              int         ndims,
+              const int  *dimids,
+              int        *varidp)
+{
+    int i, err;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (!(pncp->flag & NC_MODE_DEF)) { /* must be called in define mode */
+        DEBUG_ASSIGN_ERROR(err, NC_ENOTINDEFINE)
         goto err_check;
     }
 
+    err = check_def_var_args(pncp, name, type, ndims, dimids);
+    if (err != NC_NOERR) goto err_check;
+
     /* Note we no longer limit the number of variables, as CDF file formats
      * impose no such limit. Thus, the value of NC_MAX_VARS has been changed
      * to NC_MAX_INT, as argument nvars is of type signed int in API
@@ -107,18 +137,6 @@ ncmpi_def_var(int         ncid,    /* IN:  file ID */
     else
         err = NC_NOERR;
 
-    /* check dimids[] */
-    if (ndims > 0 && dimids == NULL) { /* for non-scalar variable */
-        DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
-        goto err_check;
-    }
-    for (i=0; i<ndims; i++) {
-        if (dimids[i] < 0 || pncp->ndims == 0 || dimids[i] >= pncp->ndims) {
-            DEBUG_ASSIGN_ERROR(err, NC_EBADDIM)
-            goto err_check;
-        }
-    }
-
 err_check:
     if (pncp->flag & NC_MODE_SAFE) {
         int root_name_len, root_ndims, minE, rank, mpireturn;
@@ -226,6 +244,217 @@ err_check:
     return NC_NOERR;
 }
 
+/*----< ncmpi_def_vars() >---------------------------------------------------*/
+/* This API is collective, and must be called in define mode. It defines nvars
+ * variables in one call, so the drivers can grow their metadata once, and in
+ * safe mode the consistency of all arguments is checked with a single
+ * broadcast. On error, none of the variables is defined.
+ */
+int
+ncmpi_def_vars(int             ncid,    /* IN:  file ID */
+               int             nvars,   /* IN:  number of variables */
+               char*   const  *names,   /* IN:  [nvars] names of variables */
+               const nc_type  *types,   /* IN:  [nvars] data types */
+               const int      *ndims,   /* IN:  [nvars] numbers of dimensions */
+               int*    const  *dimids,  /* IN:  [nvars][ndims[i]] dim IDs */
+               int            *varids)  /* OUT: [nvars] variable IDs */
+{
+    int i, j, err, nvars_old;
+    PNC *pncp;
+
+    /* check if ncid is valid */
+    err = PNC_check_id(ncid, &pncp);
+    if (err != NC_NOERR) return err;
+
+    if (!(pncp->flag & NC_MODE_DEF)) { /* must be called in define mode */
+        DEBUG_ASSIGN_ERROR(err, NC_ENOTINDEFINE)
+        goto err_check;
+    }
+
+    if (nvars < 0) {
+        DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
+        goto err_check;
+    }
+
+    if (nvars > 0 && (names == NULL || types == NULL || ndims == NULL)) {
+        DEBUG_ASSIGN_ERROR(err, NC_EINVAL)
+        goto err_check;
+    }
+
+    if (pncp->nvars > NC_MAX_VARS - nvars) {
+        DEBUG_ASSIGN_ERROR(err, NC_EMAXVARS)
+        goto err_check;
+    }
+
+    /* names already in use, including duplicates among names[], are checked
+     * in the driver, as it can search its name lookup table once per name */
+    for (i=0; i<nvars; i++) {
+        err = check_def_var_args(pncp, names[i], types[i], ndims[i],
+                                 (ndims[i] > 0 && dimids != NULL) ? dimids[i]
+                                                                  : NULL);
+        if (err != NC_NOERR) goto err_check;
+    }
+
+err_check:
+    if (pncp->flag & NC_MODE_SAFE) {
+        int minE, rank, mpireturn, nints, root_nints, name_len, root_name_len;
+        int *ints;
+        char *str, *root_str;
+
+        /* first check the error code across processes */
+        TRACE_COMM(MPI_Allreduce)(&err, &minE, 1, MPI_INT, MPI_MIN, pncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        if (minE != NC_NOERR) return minE;
+
+        MPI_Comm_rank(pncp->comm, &rank);
+
+        /* pack nvars and, of all variables, type, ndims, and dimids into an
+         * int array, and all names into a string */
+        nints = 1 + 2 * nvars;
+        name_len = 0;
+        for (i=0; i<nvars; i++) {
+            nints += ndims[i];
+            name_len += strlen(names[i]) + 1;
+        }
+
+        /* check if the sizes of both are consistent among all processes */
+        root_nints = nints;
+        root_name_len = name_len;
+        TRACE_COMM(MPI_Bcast)(&root_nints, 1, MPI_INT, 0, pncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        TRACE_COMM(MPI_Bcast)(&root_name_len, 1, MPI_INT, 0, pncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+
+        ints = (int*) NCI_Malloc((size_t)MAX(nints, root_nints) * SIZEOF_INT);
+        str  = (char*)NCI_Malloc((size_t)name_len + root_name_len + 1);
+        root_str = str + name_len;
+
+        ints[0] = nvars;
+        for (j=1, i=0; i<nvars; i++) {
+            ints[j++] = types[i];
+            ints[j++] = ndims[i];
+            if (ndims[i] > 0) {
+                memcpy(ints + j, dimids[i], (size_t)ndims[i] * SIZEOF_INT);
+                j += ndims[i];
+            }
+        }
+        for (name_len=0, i=0; i<nvars; i++) {
+            strcpy(str + name_len, names[i]);
+            name_len += strlen(names[i]) + 1;
+        }
+        if (rank == 0) memcpy(root_str, str, (size_t)root_name_len);
+
+        /* compare the arguments of each variable with root's, ints[] and
+         * str[] are copied so they can be received in place */
+        {
+            int *root_ints = (int*) NCI_Malloc((size_t)root_nints * SIZEOF_INT);
+            if (rank == 0) memcpy(root_ints, ints, (size_t)root_nints*SIZEOF_INT);
+
+            TRACE_COMM(MPI_Bcast)(root_ints, root_nints, MPI_INT, 0, pncp->comm);
+            if (mpireturn != MPI_SUCCESS) {
+                NCI_Free(root_ints);
+                NCI_Free(ints);
+                NCI_Free(str);
+                return ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+            }
+            TRACE_COMM(MPI_Bcast)(root_str, root_name_len, MPI_CHAR, 0, pncp->comm);
+            if (mpireturn != MPI_SUCCESS) {
+                NCI_Free(root_ints);
+                NCI_Free(ints);
+                NCI_Free(str);
+                return ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+            }
+
+            if (root_ints[0] != nvars)
+                DEBUG_ASSIGN_ERROR(err, NC_EMULTIDEFINE_VAR_NUM)
+            else {
+                int k=1, nlen=0;
+                for (j=1, i=0; i<nvars; i++) {
+                    if (strcmp(root_str + nlen, str + nlen)) {
+                        DEBUG_ASSIGN_ERROR(err, NC_EMULTIDEFINE_VAR_NAME)
+                        break;
+                    }
+                    nlen += strlen(names[i]) + 1;
+                    if (root_ints[k++] != ints[j++]) {
+                        DEBUG_ASSIGN_ERROR(err, NC_EMULTIDEFINE_VAR_TYPE)
+                        break;
+                    }
+                    if (root_ints[k++] != ints[j++]) {
+                        DEBUG_ASSIGN_ERROR(err, NC_EMULTIDEFINE_VAR_NDIMS)
+                        break;
+                    }
+                    if (ndims[i] > 0 && memcmp(root_ints + k, ints + j,
+                                               (size_t)ndims[i] * SIZEOF_INT)) {
+                        DEBUG_ASSIGN_ERROR(err, NC_EMULTIDEFINE_VAR_DIMIDS)
+                        break;
+                    }
+                    k += ndims[i];
+                    j += ndims[i];
+                }
+            }
+            NCI_Free(root_ints);
+        }
+        NCI_Free(ints);
+        NCI_Free(str);
+
+        /* find min error code across processes */
+        TRACE_COMM(MPI_Allreduce)(&err, &minE, 1, MPI_INT, MPI_MIN, pncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        if (minE != NC_NOERR) return minE;
+    }
+
+    if (err != NC_NOERR) return err;
+
+    if (nvars == 0) return NC_NOERR;
+
+    /* calling the subroutine that implements ncmpi_def_vars() */
+    err = pncp->driver->def_vars(pncp->ncp, nvars, names, types, ndims, dimids,
+                                 varids);
+    if (err != NC_NOERR) return err;
+
+    /* the driver's variable IDs must follow the dispatcher's, they can
+     * differ in root-define mode when a define call failed only at root */
+    nvars_old = pncp->nvars;
+    if (varids != NULL && varids[0] != nvars_old)
+        DEBUG_RETURN_ERROR(NC_EMULTIDEFINE)
+
+    /* add new variables into pnc-vars[], grow it once to a multiple of
+     * PNC_VARS_CHUNK */
+    if ((nvars_old + PNC_VARS_CHUNK - 1) / PNC_VARS_CHUNK <
+        (nvars_old + nvars + PNC_VARS_CHUNK - 1) / PNC_VARS_CHUNK) {
+        size_t alloc_size = (size_t)nvars_old + nvars + PNC_VARS_CHUNK - 1;
+        alloc_size -= alloc_size % PNC_VARS_CHUNK;
+        pncp->vars = NCI_Realloc(pncp->vars, alloc_size * sizeof(PNC_var));
+    }
+
+    for (i=0; i<nvars; i++) {
+        PNC_var *pvarp = pncp->vars + nvars_old + i;
+        pvarp->ndims  = ndims[i];
+        pvarp->xtype  = types[i];
+        pvarp->recdim = -1;   /* if fixed-size variable */
+        pvarp->shape  = NULL;
+        if (ndims[i] > 0) {
+            if (dimids[i][0] == pncp->unlimdimid) /* record variable */
+                pvarp->recdim = pncp->unlimdimid;
+
+            pvarp->shape = (MPI_Offset*)NCI_Malloc(ndims[i] * SIZEOF_MPI_OFFSET);
+            for (j=0; j<ndims[i]; j++) {
+                /* obtain size of dimension j */
+                err = pncp->driver->inq_dim(pncp->ncp, dimids[i][j], NULL,
+                                            pvarp->shape+j);
+                if (err != NC_NOERR) return err;
+            }
+        }
+        pncp->nvars++;
+    }
+
+    return NC_NOERR;
+}
+
 /*----< ncmpi_def_var_fill() >-----------------------------------------------*/
 /* this API is collective, and must be called in define mode */
 int
@@ -129,49 +129,112 @@ Or
 
 */
 
-/*----< ncmpii_in_swapn() >--------------------------------------------------*/
-/* in-place byte swap */
+#ifndef WORDS_BIGENDIAN
+/* The byte-swap kernels below process SWAPLOOPCNT elements at a time. Each
+ * block is first copied into a properly aligned local array, swapped there
+ * by a simple loop that compilers turn into byte shuffle instructions
+ * (pshufb/vpshufb on x86), and then copied to the destination. Copying
+ * through the local array makes the kernels safe for buffers not aligned to
+ * the element size and allows src and dst to be the same buffer. When the
+ * compiler supports it, SWAP_TARGET_CLONES builds AVX-512, AVX2, and
+ * baseline variants of the kernels, selected at run time for the CPU.
+ */
+#define SWAPLOOPCNT 512
+
+#ifdef HAVE_ATTRIBUTE_TARGET_CLONES
+#define SWAP_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define SWAP_TARGET_CLONES
+#endif
+
+#define SWAP2(a) ( (((a) & 0xff) << 8) | \
+                   (((a) >> 8) & 0xff) )
+
+#define SWAP4(a) ( ((a) << 24) | \
+                  (((a) <<  8) & 0x00ff0000) | \
+                  (((a) >>  8) & 0x0000ff00) | \
+                  (((a) >> 24) & 0x000000ff) )
+
+#define SWAP8(a) ( (((a) & 0x00000000000000FFULL) << 56) | \
+                   (((a) & 0x000000000000FF00ULL) << 40) | \
+                   (((a) & 0x0000000000FF0000ULL) << 24) | \
+                   (((a) & 0x00000000FF000000ULL) <<  8) | \
+                   (((a) & 0x000000FF00000000ULL) >>  8) | \
+                   (((a) & 0x0000FF0000000000ULL) >> 24) | \
+                   (((a) & 0x00FF000000000000ULL) >> 40) | \
+                   (((a) & 0xFF00000000000000ULL) >> 56) )
+
+dnl
+dnl SWAPN_KERNEL(nbits)
+dnl
+define(`SWAPN_KERNEL',dnl
+`dnl
+/*----< swapn$1() >----------------------------------------------------------*/
+/* byte swap nelems $1-bit elements from src to dst, src can be dst */
+SWAP_TARGET_CLONES static void
+swapn$1(void       *dst,
+        const void *src,
+        size_t      nelems)
+{
+    size_t i;
+    uint$1_t tmp[SWAPLOOPCNT];
+    char *op = (char*)dst;
+    const char *ip = (const char*)src;
+
+    /* full blocks, fixed trip count for the compiler to vectorize */
+    for (; nelems >= SWAPLOOPCNT; nelems -= SWAPLOOPCNT) {
+        memcpy(tmp, ip, sizeof(tmp));
+        for (i=0; i<SWAPLOOPCNT; i++)
+            tmp[i] = (uint$1_t)SWAP`'eval($1/8)(tmp[i]);
+        memcpy(op, tmp, sizeof(tmp));
+        ip += sizeof(tmp);
+        op += sizeof(tmp);
+    }
+
+    /* remaining elements */
+    memcpy(tmp, ip, nelems * sizeof(uint$1_t));
+    for (i=0; i<nelems; i++)
+        tmp[i] = (uint$1_t)SWAP`'eval($1/8)(tmp[i]);
+    memcpy(op, tmp, nelems * sizeof(uint$1_t));
+}
+')dnl
+
+SWAPN_KERNEL(16)
+SWAPN_KERNEL(32)
+SWAPN_KERNEL(64)
+#endif
+
+/*----< ncmpii_swapn() >-----------------------------------------------------*/
+/* Out-of-place byte swap: copy nelems elements of size esize from src to dst
+ * and swap their bytes in the same pass. dst and src can be the same buffer,
+ * but must not otherwise overlap. On Big Endian machines, this is simply a
+ * copy.
+ */
 void
-ncmpii_in_swapn(void       *buf,
-                MPI_Offset  nelems,  /* number of elements in buf[] */
-                int         esize)   /* byte size of each element */
+ncmpii_swapn(void       *dst,
+             const void *src,
+             MPI_Offset  nelems,  /* number of elements in src[] */
+             int         esize)   /* byte size of each element */
 {
+    if (nelems <= 0) return;
+
 #ifdef WORDS_BIGENDIAN
-    return;
+    if (dst != src) memcpy(dst, src, (size_t)(nelems * esize));
 #else
-    size_t i;
+    if (esize == 4) /* this is the most common case */
+        swapn32(dst, src, (size_t)nelems);
+    else if (esize == 8)
+        swapn64(dst, src, (size_t)nelems);
+    else if (esize == 2)
+        swapn16(dst, src, (size_t)nelems);
+    else {
+        int i;
+        uchar tmp, *op = (uchar*)dst;
 
-    if (esize <= 1 || nelems <= 0) return;  /* no need */
+        if (dst != src) memcpy(dst, src, (size_t)(nelems * esize));
+        if (esize <= 1) return;
 
-    if (esize == 4) { /* this is the most common case */
-        uint32_t *dest = (uint32_t*) buf;
-        for (i=0; i<nelems; i++)
-            dest[i] =  ((dest[i]) << 24)
-                    | (((dest[i]) & 0x0000ff00) << 8)
-                    | (((dest[i]) & 0x00ff0000) >> 8)
-                    | (((dest[i]) >> 24));
-    }
-    else if (esize == 8) {
-        uint64_t *dest = (uint64_t*) buf;
-        for (i=0; i<nelems; i++)
-            dest[i] = ((dest[i] & 0x00000000000000FFULL) << 56) |
-                      ((dest[i] & 0x000000000000FF00ULL) << 40) |
-                      ((dest[i] & 0x0000000000FF0000ULL) << 24) |
-                      ((dest[i] & 0x00000000FF000000ULL) <<  8) |
-                      ((dest[i] & 0x000000FF00000000ULL) >>  8) |
-                      ((dest[i] & 0x0000FF0000000000ULL) >> 24) |
-                      ((dest[i] & 0x00FF000000000000ULL) >> 40) |
-                      ((dest[i] & 0xFF00000000000000ULL) >> 56);
-    }
-    else if (esize == 2) {
-        uint16_t *dest = (uint16_t*) buf;
-        for (i=0; i<nelems; i++)
-            dest[i] = (uint16_t)(((dest[i] & 0xff) << 8) |
-                                 ((dest[i] >> 8) & 0xff));
-    }
-    else {
-        uchar tmp, *op = (uchar*)buf;
-        /* for esize is not 1, 2, or 4 */
+        /* for esize is not 1, 2, 4, or 8 */
         while (nelems-- > 0) {
             for (i=0; i<esize/2; i++) {
                 tmp           = op[i];
@@ -184,6 +247,22 @@ ncmpii_in_swapn(void       *buf,
 #endif
 }
 
+/*----< ncmpii_in_swapn() >--------------------------------------------------*/
+/* in-place byte swap */
+void
+ncmpii_in_swapn(void       *buf,
+                MPI_Offset  nelems,  /* number of elements in buf[] */
+                int         esize)   /* byte size of each element */
+{
+#ifdef WORDS_BIGENDIAN
+    return;
+#else
+    if (esize <= 1 || nelems <= 0) return;  /* no need */
+
+    ncmpii_swapn(buf, buf, nelems, esize);
+#endif
+}
+
 dnl
 dnl PUTN_XTYPE(xtype)
 dnl
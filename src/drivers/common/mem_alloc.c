@@ -43,6 +43,17 @@ static void   *ncmpii_mem_root;
 static size_t  ncmpii_mem_alloc;
 static size_t  ncmpii_max_mem_alloc;
 
+#ifdef ENABLE_DW_ASYNC_FLUSH
+#include <pthread.h>
+/* DataWarp driver may allocate memory from a background thread */
+static pthread_mutex_t ncmpii_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+#define MEM_LOCK   pthread_mutex_lock(&ncmpii_mem_lock);
+#define MEM_UNLOCK pthread_mutex_unlock(&ncmpii_mem_lock);
+#else
+#define MEM_LOCK
+#define MEM_UNLOCK
+#endif
+
 #if 0
 /*----< ncmpii_init_malloc_tracing() >----------------------------------------*/
 void ncmpii_init_malloc_tracing(void)
@@ -103,14 +114,17 @@ void ncmpii_add_mem_entry(void       *buf,
     node->filename[strlen(filename)] = '\0';
 
     /* search and add a new item */
+    MEM_LOCK
     void *ret = tsearch(node, &ncmpii_mem_root, ncmpii_cmp);
     if (ret == NULL) {
+        MEM_UNLOCK
         fprintf(stderr, "Error at line %d file %s: tsearch()\n",
                 __LINE__,__FILE__);
         return;
     }
     ncmpii_mem_alloc += size;
     ncmpii_max_mem_alloc = MAX(ncmpii_max_mem_alloc, ncmpii_mem_alloc);
+    MEM_UNLOCK
 }
 
 /*----< ncmpii_del_mem_entry() >---------------------------------------------*/
@@ -119,12 +133,14 @@ static
 void ncmpii_del_mem_entry(void *buf)
 {
     /* use C tsearch utility */
+    MEM_LOCK
     if (ncmpii_mem_root != NULL) {
         ncmpii_mem_entry node;
         node.buf  = buf;
         void *ret = tfind(&node, &ncmpii_mem_root, ncmpii_cmp);
         ncmpii_mem_entry **found = (ncmpii_mem_entry**) ret;
         if (ret == NULL) {
+            MEM_UNLOCK
             fprintf(stderr, "Error at line %d file %s: tfind() buf=%p\n",
                     __LINE__,__FILE__,buf);
             return;
@@ -137,6 +153,7 @@ void ncmpii_del_mem_entry(void *buf)
         ncmpii_mem_alloc -= (*found)->size;
         void *tmp = (*found)->self;
         ret = tdelete(&node, &ncmpii_mem_root, ncmpii_cmp);
+        MEM_UNLOCK
         if (ret == NULL) {
             fprintf(stderr, "Error at line %d file %s: tdelete() buf=%p\n",
                     __LINE__,__FILE__,buf);
@@ -144,9 +161,11 @@ void ncmpii_del_mem_entry(void *buf)
         }
         free(tmp);
     }
-    else
+    else {
+        MEM_UNLOCK
         fprintf(stderr, "Error at line %d file %s: ncmpii_mem_root is NULL\n",
                 __LINE__,__FILE__);
+    }
 }
 #endif
 
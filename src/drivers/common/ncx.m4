@@ -261,6 +261,21 @@ define(`FillDefaultValue', `ifelse(
 #endif
 #endif /* _SX */
 
+/* On Little Endian machines, the ncmpix_getn_* and ncmpix_putn_* subroutines
+ * for multi-byte external types convert data in blocks of VECLOOPCNT
+ * elements. Each block is byte-swapped, range-checked, and type-casted by
+ * loops that compilers can vectorize. VEC_TARGET_CLONES, when supported,
+ * builds AVX-512, AVX2, and baseline (SSE2) variants of those kernels and
+ * lets the loader pick the best one for the running CPU.
+ */
+#define VECLOOPCNT 256
+
+#ifdef HAVE_ATTRIBUTE_TARGET_CLONES
+#define VEC_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define VEC_TARGET_CLONES
+#endif
+
 /* Note nada[] is used to fill the padding. However, CDF file format
  * specifications require different contents between header and data sections.
  * It says "Header padding uses null (\x00) bytes. In data, padding uses
@@ -341,8 +356,10 @@ swapn2b(void *dst, const void *src, IntType nn)
 inline static void
 swap4b(void *dst, const void *src)
 {
-    /* copy over, make the below swap in-place */
-    uint32_t tmp = *(uint32_t*)src;
+    /* copy over, make the below swap in-place. Use memcpy, as src may point
+     * to a float and dereferencing it as uint32_t breaks strict-aliasing */
+    uint32_t tmp;
+    memcpy(&tmp, src, 4);
     tmp = SWAP4(tmp);
     memcpy(dst, &tmp, 4);
 
@@ -457,7 +474,8 @@ swap8b(void *dst, const void *src)
     op = (uint32_t*)((char*)dst+4);
     *op = SWAP4(*op);
 #else
-    uint64_t tmp = *(uint64_t*)src;
+    uint64_t tmp;
+    memcpy(&tmp, src, 8);
     tmp = SWAP8(tmp);
     memcpy(dst, &tmp, 8);
 
@@ -2623,10 +2641,127 @@ APIPrefix`x_pad_getn_'NC_TYPE($1)_$2(const void **xpp, IntType nelems, $2 *tp)
 ')dnl
 dnl dnl dnl
 dnl
+dnl Helper macros for the vectorized block conversion kernels
+dnl
+define(`IsFloatType', `ifelse(`$1', `float', `1', `$1', `double', `1', `0')')dnl
+define(`VecUint', `ifelse(`$1', `short',  `uint16_t', `$1', `ushort', `uint16_t',
+                          `$1', `int',    `uint32_t', `$1', `uint',   `uint32_t',
+                          `$1', `float',  `uint32_t', `uint64_t')')dnl
+define(`VecSwap', `ifelse(`$1', `short',  `SWAP2', `$1', `ushort', `SWAP2',
+                          `$1', `int',    `SWAP4', `$1', `uint',   `SWAP4',
+                          `$1', `float',  `SWAP4', `SWAP8')')dnl
+dnl
+dnl VecCond(xtype) is the C preprocessor condition for the kernels to be used
+dnl
+define(`VecCond', `ifelse(IsFloatType($1), `1',
+`!defined(WORDS_BIGENDIAN) && Xsizeof($1) == Isizeof($1) && !defined(NO_IEEE_FLOAT)',
+`!defined(WORDS_BIGENDIAN) && Xsizeof($1) == IXsizeof($1)')')dnl
+dnl
+dnl VecInRange(srctype, dsttype, value, dstmin, dstmax) is a C expression that
+dnl is true when value can be type-casted to dsttype with neither NC_ERANGE
+dnl nor any special treatment by the per-element subroutines. It may be false
+dnl for some legal values (e.g. NaN or a boundary value), in which case the
+dnl block falls back to the per-element subroutines.
+dnl
+define(`VecInRange',
+`ifelse(IsFloatType($2), `1', `ifelse(IsFloatType($1), `1', `($3 >= $4 && $3 <= $5)', `1')',
+        IsFloatType($1), `1', `($3 >= ($1)$4 && $3 < ($1)$5)',
+        index(`$1',`u'), 0,   `((ulonglong)$3 <= (ulonglong)$5)',
+        index(`$2',`u'), 0,   `($3 >= 0 && (ulonglong)$3 <= (ulonglong)$5)',
+                              `((longlong)$3 >= (longlong)$4 && (longlong)$3 <= (longlong)$5)')')dnl
+dnl
+define(`GetInRange', `ifelse(`$1$2', `floatdouble', `1',
+       `VecInRange($1, $2, $3, ifelse(index(`$2',`u'), 0, `0', `Imin($2)'), Imax($2))')')dnl
+define(`PutInRange',
+       `VecInRange($2, $1, $3, ifelse(index(`$1',`u'), 0, `0', `Xmin($1)'), Xmax($1))')dnl
+dnl
+dnl VecNeedRange(srctype, dsttype, srcmax, dstmax) is the C preprocessor
+dnl condition for the range test to be needed, or 1 if it is always needed.
+dnl Signed integral types have symmetric ranges, so comparing the maximums is
+dnl sufficient, like the scalar kernels do. A signed source always needs the
+dnl test when the destination is unsigned.
+dnl
+define(`VecNeedRange', `ifelse(IsFloatType($1), `1', `1', IsFloatType($2), `1', `1',
+       index(`$1',`u'), 0, `$3 > $4', index(`$2',`u'), 0, `1', `$3 > $4')')dnl
+dnl
+dnl VecRangeTest(cond, test) counts in nbad the elements failing test, skipped
+dnl by the C preprocessor when cond is false
+dnl
+define(`VecRangeTest', `ifelse(`$1', `1', `
+    for (i=0; i<VECLOOPCNT; i++)
+        nbad += !$2;
+', `
+`#'if $1
+    for (i=0; i<VECLOOPCNT; i++)
+        nbad += !$2;
+`#'endif
+')')dnl
+dnl
+dnl NCX_GETN_VEC(xtype, itype)
+dnl
+define(`NCX_GETN_VEC',dnl
+`dnl
+`#'if VecCond($1)
+/* Convert a block of VECLOOPCNT elements. Return 0 without modifying tp if
+ * any element in the block must be converted by the per-element subroutine.
+ */
+VEC_TARGET_CLONES static int
+APIPrefix`x_vgetn_'NC_TYPE($1)_$2(const void *xp, $2 *tp)
+{
+    int i, nbad=0;
+    VecUint($1) ux[VECLOOPCNT];
+    ix_$1 xx[VECLOOPCNT];
+
+    memcpy(ux, xp, sizeof(ux));
+    for (i=0; i<VECLOOPCNT; i++)
+        ux[i] = (VecUint($1)) VecSwap($1)(ux[i]);
+    memcpy(xx, ux, sizeof(xx));
+ifelse(GetInRange($1, $2, xx[i]), `1', ,
+       `VecRangeTest(VecNeedRange($1, $2, IXmax($1), Imax($2)), GetInRange($1, $2, xx[i]))')dnl
+    if (nbad) return 0;
+
+    for (i=0; i<VECLOOPCNT; i++)
+        tp[i] = ($2) xx[i];
+    return 1;
+}
+`#'endif
+')dnl
+dnl
+dnl NCX_PUTN_VEC(xtype, itype)
+dnl
+define(`NCX_PUTN_VEC',dnl
+`dnl
+`#'if VecCond($1)
+/* Convert a block of VECLOOPCNT elements. Return 0 without modifying xp if
+ * any element in the block must be converted by the per-element subroutine.
+ */
+VEC_TARGET_CLONES static int
+APIPrefix`x_vputn_'NC_TYPE($1)_$2(void *xp, const $2 *tp)
+{
+    int i, nbad=0;
+    VecUint($1) ux[VECLOOPCNT];
+    ix_$1 xx[VECLOOPCNT];
+ifelse(PutInRange($1, $2, tp[i]), `1', ,
+       `VecRangeTest(VecNeedRange($2, $1, Imax($2), Xmax($1)), PutInRange($1, $2, tp[i]))')dnl
+    if (nbad) return 0;
+
+    for (i=0; i<VECLOOPCNT; i++)
+        xx[i] = (ix_$1) tp[i];
+    memcpy(ux, xx, sizeof(ux));
+    for (i=0; i<VECLOOPCNT; i++)
+        ux[i] = (VecUint($1)) VecSwap($1)(ux[i]);
+    memcpy(xp, ux, sizeof(ux));
+    return 1;
+}
+`#'endif
+')dnl
+dnl dnl dnl
+dnl
 dnl NCX_GETN(xtype, itype)
 dnl
 define(`NCX_GETN',dnl
 `dnl
+NCX_GETN_VEC($1, $2)
 int
 APIPrefix`x_getn_'NC_TYPE($1)_$2(const void **xpp, IntType nelems, $2 *tp)
 {
@@ -2680,6 +2815,22 @@ APIPrefix`x_getn_'NC_TYPE($1)_$2(const void **xpp, IntType nelems, $2 *tp)
 	const char *xp = (const char *) *xpp;
 	int status = NC_NOERR;
 
+`#'if VecCond($1)
+	for ( ; nelems >= VECLOOPCNT; nelems -= VECLOOPCNT) {
+		int i;
+		if (APIPrefix`x_vgetn_'NC_TYPE($1)_$2(xp, tp)) {
+			xp += VECLOOPCNT * Xsizeof($1);
+			tp += VECLOOPCNT;
+			continue;
+		}
+		/* this block contains elements that need special treatment */
+		for (i=0; i<VECLOOPCNT; i++, xp += Xsizeof($1), tp++) {
+			const int lstatus = APIPrefix`x_get_'NC_TYPE($1)_$2(xp, tp);
+			if (status == NC_NOERR) /* report the first encountered error */
+				status = lstatus;
+		}
+	}
+`#'endif
 	for( ; nelems != 0; nelems--, xp += Xsizeof($1), tp++)
 	{
 		const int lstatus = APIPrefix`x_get_'NC_TYPE($1)_$2(xp, tp);
@@ -2818,6 +2969,7 @@ dnl NCX_PUTN(xtype, itype)
 dnl
 define(`NCX_PUTN',dnl
 `dnl
+NCX_PUTN_VEC($1, $2)
 int
 APIPrefix`x_putn_'NC_TYPE($1)_$2(void **xpp, IntType nelems, const $2 *tp, void *fillp)
 {
@@ -2889,6 +3041,22 @@ ifelse( $1$2, intfloat,dnl
 	char *xp = (char *) *xpp;
 	int status = NC_NOERR;
 
+`#'if VecCond($1)
+	for ( ; nelems >= VECLOOPCNT; nelems -= VECLOOPCNT) {
+		int i;
+		if (APIPrefix`x_vputn_'NC_TYPE($1)_$2(xp, tp)) {
+			xp += VECLOOPCNT * Xsizeof($1);
+			tp += VECLOOPCNT;
+			continue;
+		}
+		/* this block contains elements that need special treatment */
+		for (i=0; i<VECLOOPCNT; i++, xp += Xsizeof($1), tp++) {
+			int lstatus = APIPrefix`x_put_'NC_TYPE($1)_$2(xp, tp, fillp);
+			if (status == NC_NOERR) /* report the first encountered error */
+				status = lstatus;
+		}
+	}
+`#'endif
 	for( ; nelems != 0; nelems--, xp += Xsizeof($1), tp++)
 	{
 		int lstatus = APIPrefix`x_put_'NC_TYPE($1)_$2(xp, tp, fillp);
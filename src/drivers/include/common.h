@@ -136,6 +136,9 @@ ncmpii_need_convert(int format, nc_type xtype, MPI_Datatype mpitype);
 extern void
 ncmpii_in_swapn(void *buf, MPI_Offset nelems, int esize);
 
+extern void
+ncmpii_swapn(void *dst, const void *src, MPI_Offset nelems, int esize);
+
 extern int
 ncmpii_putn_NC_CHAR  (void *xbuf, const void *buf, MPI_Offset nelems,
                       MPI_Datatype datatype);
@@ -15,6 +15,7 @@
  * ncmpi_del_att()     : dispatcher->inq_del_att()
  * ncmpi_get_att()     : dispatcher->inq_get_att()
  * ncmpi_put_att()     : dispatcher->inq_put_arr()
+ * ncmpi_put_atts()    : dispatcher->put_atts()
  *
  */
 
@@ -39,6 +40,9 @@ ncdwio_inq_attname(void *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_attname(ncdwp->ncp, varid, attid, name);
     if (err != NC_NOERR) return err;
 
@@ -54,6 +58,9 @@ ncdwio_inq_attid(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_attid(ncdwp->ncp, varid, name, attidp);
     if (err != NC_NOERR) return err;
 
@@ -70,6 +77,9 @@ ncdwio_inq_att(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_att(ncdwp->ncp, varid, name, datatypep, lenp);
     if (err != NC_NOERR) return err;
 
@@ -85,6 +95,9 @@ ncdwio_rename_att(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->rename_att(ncdwp->ncp, varid, name, newname);
     if (err != NC_NOERR) return err;
 
@@ -103,6 +116,10 @@ ncdwio_copy_att(void       *ncdp_in,
     NC_dw *ncdwp_in  = (NC_dw*)ncdp_in;
     NC_dw *ncdwp_out = (NC_dw*)ncdp_out;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp_in);
+    ncdwio_log_join(ncdwp_out);
+
     err = ncdwp_in->ncmpio_driver->copy_att(ncdwp_in->ncp,  varid_in, name,
                                    ncdwp_out->ncp, varid_out);
     if (err != NC_NOERR) return err;
@@ -118,6 +135,9 @@ ncdwio_del_att(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->del_att(ncdwp->ncp, varid, name);
     if (err != NC_NOERR) return err;
 
@@ -134,6 +154,9 @@ ncdwio_get_att(void         *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->get_att(ncdwp->ncp, varid, name, buf, itype);
     if (err != NC_NOERR) return err;
 
@@ -152,9 +175,34 @@ ncdwio_put_att(void         *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->put_att(ncdwp->ncp, varid, name, xtype, nelems, buf,
                                itype);
     if (err != NC_NOERR) return err;
 
     return NC_NOERR;
 }
+
+int
+ncdwio_put_atts(void              *ncdp,
+                int                varid,
+                int                natts,
+                char*       const *names,
+                const nc_type     *xtypes,
+                const MPI_Offset  *nelems,
+                void*       const *bufs)
+{
+    int err;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
+    err = ncdwp->ncmpio_driver->put_atts(ncdwp->ncp, varid, natts, names,
+                                         xtypes, nelems, bufs);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
@@ -17,9 +17,132 @@
 #include <common.h>
 #include <pnetcdf.h>
 #include <ncdwio_driver.h>
+#ifdef ENABLE_DW_ASYNC_FLUSH
+#include <pthread.h>
+#endif
 
 #define BUFSIZE 8388608
 
+#ifdef ENABLE_DW_ASYNC_FLUSH
+/* Write-behind state of a buffered file
+ * The buffers form a ring, f->buffer is the one being filled
+ * Full buffers are written by a background thread in the order they are filled
+ * Only the thread touches the shared file while there are full buffers
+ */
+typedef struct NC_dw_writebehind {
+    NC_dw_sharedfile *fd;
+    size_t bsize;
+    int nbuf;               // Number of buffers in the ring
+    char **buffers;         // Buffers in the ring
+    size_t *bstart;         // Start of data to write in each full buffer
+    int cur;                // Buffer being filled
+    int head;               // Oldest full buffer not yet written
+    int nfull;              // Number of full buffers not yet written
+    int stop;               // If the thread should exit
+    int status;             // First error of the writes not yet reported
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+} NC_dw_writebehind;
+
+/*
+ * Background writer, write full buffers in order until asked to stop
+ * Once a write fails, the following buffers are dropped as their file
+ * position is no longer correct
+ */
+static void *writebehind_thread(void *arg){
+    int i, err, failed;
+    NC_dw_writebehind *wp = (NC_dw_writebehind*)arg;
+
+    pthread_mutex_lock(&(wp->lock));
+    for(;;){
+        while (wp->nfull == 0 && !wp->stop){
+            pthread_cond_wait(&(wp->cond), &(wp->lock));
+        }
+        if (wp->nfull == 0){
+            break;
+        }
+        i = wp->head;
+        failed = (wp->status != NC_NOERR);
+        pthread_mutex_unlock(&(wp->lock));
+
+        err = NC_NOERR;
+        if (!failed){
+            err = ncdwio_sharedfile_write(wp->fd, wp->buffers[i] + wp->bstart[i], wp->bsize - wp->bstart[i]);
+        }
+
+        pthread_mutex_lock(&(wp->lock));
+        if (err != NC_NOERR && wp->status == NC_NOERR){
+            wp->status = err;
+        }
+        wp->head = (i + 1) % wp->nbuf;
+        wp->nfull--;
+        pthread_cond_broadcast(&(wp->cond));
+    }
+    pthread_mutex_unlock(&(wp->lock));
+
+    return NULL;
+}
+
+/*
+ * Hand the full buffer to the writer and continue with the next one
+ * Block until the next buffer is written if all buffers are full
+ * IN       f:    File handle
+ */
+static int writebehind_post(NC_dw_bufferedfile *f){
+    int err;
+    NC_dw_writebehind *wp = (NC_dw_writebehind*)f->wb;
+
+    pthread_mutex_lock(&(wp->lock));
+    wp->bstart[wp->cur] = f->bunused;
+    wp->nfull++;
+    pthread_cond_broadcast(&(wp->cond));
+    wp->cur = (wp->cur + 1) % wp->nbuf;
+    while (wp->nfull == wp->nbuf){
+        pthread_cond_wait(&(wp->cond), &(wp->lock));
+    }
+    err = wp->status;
+    wp->status = NC_NOERR;
+    pthread_mutex_unlock(&(wp->lock));
+
+    f->buffer = wp->buffers[wp->cur];
+    f->bused = 0;
+    f->bunused = 0;
+
+    return err;
+}
+
+/*
+ * Stop the writer after all full buffers are written and free the buffers
+ * IN       f:    File handle
+ */
+static int writebehind_free(NC_dw_bufferedfile *f){
+    int i, err;
+    NC_dw_writebehind *wp = (NC_dw_writebehind*)f->wb;
+
+    pthread_mutex_lock(&(wp->lock));
+    wp->stop = 1;
+    pthread_cond_broadcast(&(wp->cond));
+    pthread_mutex_unlock(&(wp->lock));
+    pthread_join(wp->thread, NULL);
+    err = wp->status;
+
+    pthread_cond_destroy(&(wp->cond));
+    pthread_mutex_destroy(&(wp->lock));
+    for (i = 0; i < wp->nbuf; i++){
+        NCI_Free(wp->buffers[i]);
+    }
+    NCI_Free(wp->buffers);
+    NCI_Free(wp->bstart);
+    NCI_Free(wp);
+
+    f->wb = NULL;
+    f->buffer = NULL;
+
+    return err;
+}
+#endif
+
 /*
  * Open buffered file
  * IN      comm:    MPI communicator of processes sharing the file
@@ -44,6 +167,7 @@ int ncdwio_bufferedfile_open(MPI_Comm comm, char *path, int flag, MPI_Info info,
     f->bused = 0;
     f->bunused = 0;
     f->fsize = 0;
+    f->wb = NULL;
     // Allocate the buffer
     if (f->bsize > 0){
         f->buffer = NCI_Malloc(BUFSIZE);
@@ -67,12 +191,124 @@ int ncdwio_bufferedfile_open(MPI_Comm comm, char *path, int flag, MPI_Info info,
     return NC_NOERR;
 }
 
+/*
+ * Write full buffers in the background
+ * IN       f:    File handle
+ * IN    nbuf:    Number of buffers, the application fills one while the others are written
+ *
+ * Without write-behind, a write that fills the buffer blocks until the buffer
+ * is written to the file, and aligned sections of a write go to the file
+ * directly. With write-behind, all data is copied into the buffers, a full
+ * buffer is queued to a background thread and the next buffer is filled. The
+ * write blocks only when all buffers are full.
+ * The file stays synchronous if there is no buffer or the thread can not be
+ * created
+ */
+int ncdwio_bufferedfile_writebehind(NC_dw_bufferedfile *f, int nbuf) {
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    int i, err;
+    NC_dw_writebehind *wp;
+
+    if (f->buffer == NULL || f->wb != NULL || nbuf < 2){
+        return NC_NOERR;
+    }
+
+    wp = (NC_dw_writebehind*)NCI_Malloc(sizeof(NC_dw_writebehind));
+    if (wp == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    wp->buffers = (char**)NCI_Malloc(sizeof(char*) * nbuf);
+    wp->bstart = (size_t*)NCI_Malloc(sizeof(size_t) * nbuf);
+    if (wp->buffers == NULL || wp->bstart == NULL){
+        NCI_Free(wp->buffers);
+        NCI_Free(wp->bstart);
+        NCI_Free(wp);
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+
+    // The current buffer keeps its data and is the first in the ring
+    wp->buffers[0] = f->buffer;
+    for (i = 1; i < nbuf; i++){
+        wp->buffers[i] = (char*)NCI_Malloc(f->bsize);
+        if (wp->buffers[i] == NULL){
+            for (i--; i > 0; i--){
+                NCI_Free(wp->buffers[i]);
+            }
+            NCI_Free(wp->buffers);
+            NCI_Free(wp->bstart);
+            NCI_Free(wp);
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+    }
+
+    wp->fd = f->fd;
+    wp->bsize = f->bsize;
+    wp->nbuf = nbuf;
+    wp->cur = 0;
+    wp->head = 0;
+    wp->nfull = 0;
+    wp->stop = 0;
+    wp->status = NC_NOERR;
+    pthread_mutex_init(&(wp->lock), NULL);
+    pthread_cond_init(&(wp->cond), NULL);
+
+    err = pthread_create(&(wp->thread), NULL, writebehind_thread, wp);
+    if (err != 0){
+        pthread_cond_destroy(&(wp->cond));
+        pthread_mutex_destroy(&(wp->lock));
+        for (i = 1; i < nbuf; i++){
+            NCI_Free(wp->buffers[i]);
+        }
+        NCI_Free(wp->buffers);
+        NCI_Free(wp->bstart);
+        NCI_Free(wp);
+        return NC_NOERR;
+    }
+
+    f->wb = wp;
+#endif
+
+    return NC_NOERR;
+}
+
+/*
+ * Wait for the buffers queued to the background writer to be written
+ * The shared file can be accessed after this returns
+ * Return the error of the background writes since the last report
+ * IN       f:    File handle
+ */
+int ncdwio_bufferedfile_sync(NC_dw_bufferedfile *f) {
+    int err = NC_NOERR;
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    NC_dw_writebehind *wp = (NC_dw_writebehind*)f->wb;
+
+    if (wp != NULL){
+        pthread_mutex_lock(&(wp->lock));
+        while (wp->nfull > 0){
+            pthread_cond_wait(&(wp->cond), &(wp->lock));
+        }
+        err = wp->status;
+        wp->status = NC_NOERR;
+        pthread_mutex_unlock(&(wp->lock));
+    }
+#endif
+
+    return err;
+}
+
 /*
  * Close buffered file
  * OUT       fd:    File handler
  */
 int ncdwio_bufferedfile_close(NC_dw_bufferedfile *f) {
-    int err;
+    int err, status = NC_NOERR;
+
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    // Stop the background writer, it frees the buffers
+    if (f->wb != NULL){
+        status = writebehind_free(f);
+    }
+#endif
 
     /* Close file */
     err = ncdwio_sharedfile_close(f->fd);
@@ -87,7 +323,7 @@ int ncdwio_bufferedfile_close(NC_dw_bufferedfile *f) {
     }
     NCI_Free(f);
 
-    return NC_NOERR;
+    return status;
 }
 
 /*
@@ -131,6 +367,40 @@ int ncdwio_bufferedfile_write(NC_dw_bufferedfile *f, void *buf, size_t count){
     int err;
     size_t midstart, midend;    // Start and end offset of the mid section related the file position
 
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    if (f->wb != NULL){
+        /*
+        * With write-behind, all data goes through the buffers
+        * Buffer maps to an aligned block, it is full when the write reaches the block boundary
+        */
+        size_t pos = f->pos, remain = count;
+        char *ptr = (char*)buf;
+
+        while (remain > 0){
+            midend = f->bsize - f->bused;
+            if (midend > remain){
+                midend = remain;
+            }
+            memcpy(f->buffer + f->bused, ptr, midend);
+            f->bused += midend;
+            ptr += midend;
+            remain -= midend;
+            pos += midend;
+            if (f->bused == f->bsize){
+                err = writebehind_post(f);
+                if (err != NC_NOERR){
+                    // Data up to the failed buffer is accounted for
+                    f->pos = pos;
+                    if (f->fsize < f->pos){
+                        f->fsize = f->pos;
+                    }
+                    return err;
+                }
+            }
+        }
+    }
+    else
+#endif
     if (f->buffer != NULL){
         /*
         * The start position of mid section can be calculated as the first position on the block boundary after current file position
@@ -228,6 +498,14 @@ int ncdwio_bufferedfile_write(NC_dw_bufferedfile *f, void *buf, size_t count){
  * pwrite is not buffered, we write directly to the file
  */
 int ncdwio_bufferedfile_pwrite(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset){
+    int err;
+
+    // Wait for the background writes before accessing the file
+    err = ncdwio_bufferedfile_sync(f);
+    if (err != NC_NOERR){
+        return err;
+    }
+
     // Record the file size as the largest location ever reach by IO operation
     if (f->fsize < offset + count){
         f->fsize = offset + count;
@@ -246,24 +524,21 @@ int ncdwio_bufferedfile_pwrite(NC_dw_bufferedfile *f, void *buf, size_t count, o
  * IN   count:    Number of bytes to read
  * IN  offset:    Starting read position
  *
- * We flush the buffer before read so data in the buffer can be reflected
- * Read is not buffered, we read directly from the file
+ * Data in the buffer is the region right before current file position
+ * The part of the read region falling into the buffer is copied from the buffer
+ * The rest is not buffered, we read directly from the file
+ * We do not flush the buffer here, flushing a partial block would move the
+ * physical file position away from the block containing current position
  */
 int ncdwio_bufferedfile_pread(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset){
     int err;
+    size_t bstart, lo, hi;  // Buffered region and its overlap with the read region
+    size_t uoff;            // Read offset, checked not negative
 
-    if (f->buffer != NULL){
-        // Flush the buffer
-        if (f->bused - f->bunused > 0){
-            // Write data to file, skipping unused part
-            err = ncdwio_sharedfile_write(f->fd, f->buffer + f->bunused, f->bsize - f->bunused);
-            if (err != NC_NOERR){
-                return err;
-            }
-            // Reset buffer status
-            f->bused = 0;
-            f->bunused = 0;
-        }
+    // Wait for the background writes before accessing the file
+    err = ncdwio_bufferedfile_sync(f);
+    if (err != NC_NOERR){
+        return err;
     }
 
     // Record the file size as the largest location ever reach by IO operation
@@ -271,6 +546,35 @@ int ncdwio_bufferedfile_pread(NC_dw_bufferedfile *f, void *buf, size_t count, of
         f->fsize = offset + count;
     }
 
+    if (f->buffer != NULL && f->bused > f->bunused){
+        if (offset < 0){
+            DEBUG_RETURN_ERROR(NC_EINVAL);
+        }
+        uoff = (size_t)offset;
+
+        // Buffered data covers [bstart, f->pos) in the file space
+        bstart = f->pos - (f->bused - f->bunused);
+        if (uoff < f->pos && uoff + count > bstart){
+            lo = (uoff > bstart) ? uoff : bstart;
+            hi = (uoff + count < f->pos) ? uoff + count : f->pos;
+            memcpy((char*)buf + (lo - uoff), f->buffer + f->bunused + (lo - bstart), hi - lo);
+
+            // Read the part after the buffered region from the file
+            if (uoff + count > hi){
+                err = ncdwio_sharedfile_pread(f->fd, (char*)buf + (hi - uoff), uoff + count - hi, (off_t)hi);
+                if (err != NC_NOERR){
+                    return err;
+                }
+            }
+
+            // Part before the buffered region
+            count = lo - uoff;
+            if (count == 0){
+                return NC_NOERR;
+            }
+        }
+    }
+
     // Read directly
     return ncdwio_sharedfile_pread(f->fd, buf, count, offset);
 }
@@ -313,6 +617,12 @@ int ncdwio_bufferedfile_read(NC_dw_bufferedfile *f, void *buf, size_t count){
 int ncdwio_bufferedfile_seek(NC_dw_bufferedfile *f, off_t offset, int whence){
     int err;
 
+    // Wait for the background writes before accessing the file
+    err = ncdwio_bufferedfile_sync(f);
+    if (err != NC_NOERR){
+        return err;
+    }
+
     // Update file position
     switch (whence){
         case SEEK_SET:  // Offset from begining of the file
@@ -334,8 +644,8 @@ int ncdwio_bufferedfile_seek(NC_dw_bufferedfile *f, off_t offset, int whence){
         * When current position changes, buffer must be flushed
         */
         if (f->bused - f->bunused > 0){
-            // Write data to file, skipping unused part
-            err = ncdwio_sharedfile_write(f->fd, f->buffer + f->bunused, f->bsize - f->bunused);
+            // Write data to file, skipping unused part, data after the position may be live when the log wraps
+            err = ncdwio_sharedfile_write(f->fd, f->buffer + f->bunused, f->bused - f->bunused);
             if (err != NC_NOERR){
                 return err;
             }
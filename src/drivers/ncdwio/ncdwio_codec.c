@@ -0,0 +1,280 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+/*
+ * Codecs of the data log entries
+ *
+ * NC_LOG_CODEC_LZ is a byte oriented LZ77 codec. The compressed data is a
+ * sequence of sequences, each made of
+ *   token:     1 byte, high 4 bits are the number of literals, low 4 bits are
+ *              the match length minus NC_DW_LZ_MINMATCH, 15 means the value
+ *              continues in the following bytes, each adding up to 255
+ *   literals:  bytes copied as is
+ *   offset:    2 bytes little endian, distance back to the match
+ * The last sequence has only literals and ends at the end of the data.
+ *
+ * Before compressing, the data can be shuffled. The i-th bytes of all
+ * elements are grouped together, so bytes that change slowly across
+ * elements, such as sign and exponent of floating point numbers, become long
+ * runs the LZ codec compresses well.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnc_debug.h>
+#include <common.h>
+#include <pnetcdf.h>
+#include <ncdwio_driver.h>
+
+#define NC_DW_LZ_MINMATCH 4
+#define NC_DW_LZ_MAXOFF 65535
+#define NC_DW_LZ_HASHLOG 13
+
+#define LZ_READ32(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | \
+                      ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/*
+ * Write a length continued in the following bytes
+ * Return the new output position or NULL if the output is full
+ */
+static unsigned char *lz_put_len(unsigned char *op, unsigned char *oend, size_t len) {
+    while (len >= 255) {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (unsigned char)len;
+
+    return op;
+}
+
+/*
+ * Write a sequence of literals [lit, lit + nlit) and a match
+ * mlen is 0 for the last sequence which has no match
+ * Return the new output position or NULL if the output is full
+ */
+static unsigned char *lz_put_seq(unsigned char *op, unsigned char *oend,
+                                 const unsigned char *lit, size_t nlit,
+                                 size_t off, size_t mlen) {
+    unsigned char *token;
+
+    if (op >= oend) return NULL;
+    token = op++;
+    *token = (unsigned char)((nlit >= 15 ? 15 : nlit) << 4);
+    if (nlit >= 15) {
+        op = lz_put_len(op, oend, nlit - 15);
+        if (op == NULL) return NULL;
+    }
+    if ((size_t)(oend - op) < nlit) return NULL;
+    memcpy(op, lit, nlit);
+    op += nlit;
+
+    if (mlen > 0) {
+        if (oend - op < 2) return NULL;
+        *op++ = (unsigned char)(off & 0xff);
+        *op++ = (unsigned char)(off >> 8);
+        mlen -= NC_DW_LZ_MINMATCH;
+        *token |= (unsigned char)(mlen >= 15 ? 15 : mlen);
+        if (mlen >= 15) {
+            op = lz_put_len(op, oend, mlen - 15);
+        }
+    }
+
+    return op;
+}
+
+/*
+ * Compress len bytes of in to out of outsize bytes
+ * Return the compressed size or 0 if it does not fit in out
+ */
+static size_t lz_encode(const unsigned char *in, size_t len,
+                        unsigned char *out, size_t outsize) {
+    int hashlog;
+    size_t ip, anchor, ref, mlen, step, miss = 0;
+    uint32_t seq, h, table[1 << NC_DW_LZ_HASHLOG];  // Latest position + 1 of each hashed 4 bytes
+    unsigned char *op = out, *oend = out + outsize;
+
+    // Smaller table for short data, the table is cleared on every call
+    for (hashlog = 8; hashlog < NC_DW_LZ_HASHLOG && ((size_t)1 << hashlog) < len; hashlog++);
+    memset(table, 0, sizeof(uint32_t) << hashlog);
+
+    ip = anchor = 0;
+    while (ip + NC_DW_LZ_MINMATCH <= len) {
+        seq = LZ_READ32(in + ip);
+        h = (seq * 2654435761U) >> (32 - hashlog);
+        ref = table[h];
+        table[h] = (uint32_t)(ip + 1);
+        if (ref > 0 && ip - (ref - 1) <= NC_DW_LZ_MAXOFF &&
+            LZ_READ32(in + ref - 1) == seq) {
+            ref--;
+            mlen = NC_DW_LZ_MINMATCH;
+            while (ip + mlen < len && in[ref + mlen] == in[ip + mlen]) {
+                mlen++;
+            }
+            op = lz_put_seq(op, oend, in + anchor, ip - anchor, ip - ref, mlen);
+            if (op == NULL) return 0;
+            ip += mlen;
+            anchor = ip;
+            miss = 0;
+        }
+        else {
+            // Skip faster over data that does not compress
+            step = 1 + (miss++ >> 6);
+            ip += step;
+        }
+    }
+
+    op = lz_put_seq(op, oend, in + anchor, len - anchor, 0, 0);
+    if (op == NULL) return 0;
+
+    return (size_t)(op - out);
+}
+
+/*
+ * Read a length continued in the following bytes
+ * Return the new input position or NULL if the input ends
+ */
+static const unsigned char *lz_get_len(const unsigned char *ip,
+                                       const unsigned char *iend, size_t *len) {
+    unsigned char b;
+
+    do {
+        if (ip >= iend) return NULL;
+        b = *ip++;
+        *len += b;
+    } while (b == 255);
+
+    return ip;
+}
+
+/*
+ * Decompress zlen bytes of in to exactly len bytes of out
+ */
+static int lz_decode(const unsigned char *in, size_t zlen,
+                     unsigned char *out, size_t len) {
+    size_t nlit, mlen, off;
+    const unsigned char *ip = in, *iend = in + zlen;
+    unsigned char *op = out, *oend = out + len;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        nlit = token >> 4;
+        if (nlit == 15) {
+            ip = lz_get_len(ip, iend, &nlit);
+            if (ip == NULL) DEBUG_RETURN_ERROR(NC_EBADLOG);
+        }
+        if ((size_t)(iend - ip) < nlit || (size_t)(oend - op) < nlit) {
+            DEBUG_RETURN_ERROR(NC_EBADLOG);
+        }
+        memcpy(op, ip, nlit);
+        ip += nlit;
+        op += nlit;
+
+        // The last sequence has no match
+        if (ip == iend) break;
+
+        if (iend - ip < 2) DEBUG_RETURN_ERROR(NC_EBADLOG);
+        off = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        mlen = token & 15;
+        if (mlen == 15) {
+            ip = lz_get_len(ip, iend, &mlen);
+            if (ip == NULL) DEBUG_RETURN_ERROR(NC_EBADLOG);
+        }
+        mlen += NC_DW_LZ_MINMATCH;
+        if (off == 0 || off > (size_t)(op - out) || (size_t)(oend - op) < mlen) {
+            DEBUG_RETURN_ERROR(NC_EBADLOG);
+        }
+        // The match can overlap the bytes being written
+        for (; mlen > 0; mlen--, op++) {
+            *op = *(op - off);
+        }
+    }
+
+    if (op != oend) DEBUG_RETURN_ERROR(NC_EBADLOG);
+
+    return NC_NOERR;
+}
+
+/*
+ * Group the i-th bytes of all elements, trailing bytes are copied as is
+ */
+static void shuffle(const char *in, size_t len, int elsize, char *out) {
+    size_t i, n = len / elsize;
+    int b;
+
+    for (b = 0; b < elsize; b++) {
+        for (i = 0; i < n; i++) {
+            out[b * n + i] = in[i * elsize + b];
+        }
+    }
+    memcpy(out + n * elsize, in + n * elsize, len - n * elsize);
+}
+
+static void unshuffle(const char *in, size_t len, int elsize, char *out) {
+    size_t i, n = len / elsize;
+    int b;
+
+    for (b = 0; b < elsize; b++) {
+        for (i = 0; i < n; i++) {
+            out[i * elsize + b] = in[b * n + i];
+        }
+    }
+    memcpy(out + n * elsize, in + n * elsize, len - n * elsize);
+}
+
+/*
+ * Compress data of a log entry
+ * IN    codec:    NC_LOG_CODEC_LZ or NC_LOG_CODEC_SHUFFLE_LZ
+ * IN    elsize:    element size the bytes are shuffled by
+ * IN    in:    data to compress
+ * IN    len:    size of the data
+ * OUT   out:    compressed data, len bytes
+ * IN    work:    work space of len bytes used by shuffle
+ * Return the compressed size, or 0 if the data does not shrink
+ */
+size_t ncdwio_codec_encode(int codec, int elsize, const char *in, size_t len,
+                           char *out, char *work) {
+    if (codec == NC_LOG_CODEC_SHUFFLE_LZ && elsize > 1) {
+        shuffle(in, len, elsize, work);
+        in = work;
+    }
+
+    return lz_encode((const unsigned char*)in, len, (unsigned char*)out, len - 1);
+}
+
+/*
+ * Decompress data of a log entry
+ * IN    codec:    codec of the entry
+ * IN    elsize:    element size the bytes are shuffled by
+ * IN    in:    compressed data
+ * IN    zlen:    size of compressed data
+ * OUT   out:    data, len bytes
+ * IN    len:    size of the data
+ * IN    work:    work space of len bytes used by shuffle
+ */
+int ncdwio_codec_decode(int codec, int elsize, const char *in, size_t zlen,
+                        char *out, size_t len, char *work) {
+    int err;
+
+    if (codec == NC_LOG_CODEC_SHUFFLE_LZ && elsize > 1) {
+        err = lz_decode((const unsigned char*)in, zlen, (unsigned char*)work, len);
+        if (err != NC_NOERR) return err;
+        unshuffle(work, len, elsize, out);
+        return NC_NOERR;
+    }
+    if (codec == NC_LOG_CODEC_LZ || codec == NC_LOG_CODEC_SHUFFLE_LZ) {
+        return lz_decode((const unsigned char*)in, zlen, (unsigned char*)out, len);
+    }
+
+    DEBUG_RETURN_ERROR(NC_EBADLOG);
+}
@@ -35,6 +35,9 @@ ncdwio_def_dim(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->def_dim(ncdwp->ncp, name, size, dimidp);
     if (err != NC_NOERR) return err;
 
@@ -57,6 +60,9 @@ ncdwio_inq_dimid(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_dimid(ncdwp->ncp, name, dimid);
     if (err != NC_NOERR) return err;
 
@@ -72,6 +78,9 @@ ncdwio_inq_dim(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_dim(ncdwp->ncp, dimid, name, sizep);
     if (err != NC_NOERR) return err;
 
@@ -96,6 +105,9 @@ ncdwio_rename_dim(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->rename_dim(ncdwp->ncp, dimid, newname);
     if (err != NC_NOERR) return err;
 
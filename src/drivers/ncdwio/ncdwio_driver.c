@@ -18,6 +18,7 @@ static PNC_driver ncdwio_driver = {
     ncdwio_close,
     ncdwio_enddef,
     ncdwio__enddef,
+    ncdwio_enddef_from,
     ncdwio_redef,
     ncdwio_sync,
     ncdwio_abort,
@@ -43,9 +44,11 @@ static PNC_driver ncdwio_driver = {
     ncdwio_del_att,
     ncdwio_get_att,
     ncdwio_put_att,
+    ncdwio_put_atts,
 
     /* VARIABLE APIs */
     ncdwio_def_var,
+    ncdwio_def_vars,
     ncdwio_def_var_fill,
     ncdwio_fill_var_rec,
     ncdwio_inq_var,
@@ -31,6 +31,20 @@
 #define NC_LOG_API_KIND_VAR1 2
 #define NC_LOG_API_KIND_VARA 3
 #define NC_LOG_API_KIND_VARS 4
+/* A varn entry writes num subarrays, the entry header is followed by num and
+ * then start and count of each subarray, data of the subarrays are stored
+ * one after another
+ */
+#define NC_LOG_API_KIND_VARN 5
+/* Or-ed into api_kind of an entry in the metadata log when the request is
+ * canceled, the entry is skipped by recovery
+ */
+#define NC_LOG_API_KIND_CANCELED 0x100
+
+/* Codecs of the data of a log entry in the data log */
+#define NC_LOG_CODEC_NONE 0
+#define NC_LOG_CODEC_LZ 1
+#define NC_LOG_CODEC_SHUFFLE_LZ 2   /* Bytes of the elements are grouped before LZ */
 
 #define NC_LOG_MAGIC_SIZE 8
 #define NC_LOG_MAGIC "PnetCDF0"
@@ -51,6 +65,20 @@
 #define NC_LOG_HINT_LOG_OVERWRITE 0x20
 #define NC_LOG_HINT_LOG_CHECK 0x40
 #define NC_LOG_HINT_LOG_SHARE 0x80
+#define NC_LOG_HINT_ASYNC_FLUSH 0x100
+#define NC_LOG_HINT_NODE_REPLAY 0x200
+#define NC_LOG_HINT_RECOVER 0x400
+
+/* Size of the blocks of a log file shared by processes on a node, block i of
+ * the file belongs to process i % (number of processes sharing the file)
+ */
+#define NC_LOG_SHARED_BSIZE 8388608
+
+/* Data offset of an entry gathered from several data logs carries the index
+ * of the data log holding the data above these bits
+ */
+#define NC_DW_REPLAY_SRC_SHIFT 48
+#define NC_DW_REPLAY_SRC_MASK ((((size_t)1) << NC_DW_REPLAY_SRC_SHIFT) - 1)
 
 /* PATH_MAX after padding to 4 byte allignment */
 #if PATH_MAX % 4 == 0
@@ -93,6 +121,9 @@ typedef struct NC_dw_metadataentry {
     int ndims;
     MPI_Offset data_off;
     MPI_Offset data_len;
+    int codec;  /* Codec of the data in the data log */
+    int codec_elsize;   /* Element size the bytes are grouped by */
+    MPI_Offset zdata_len;   /* Size of the data in the data log, data_len if not compressed */
 } NC_dw_metadataentry;
 
 typedef struct NC_dw_metadataptr {
@@ -128,6 +159,21 @@ typedef struct NC_dw_intvector {
     int *values;
 } NC_dw_intvector;
 
+/* Range of a log entry along the first dimension of its variable */
+typedef struct NC_dw_interval {
+    MPI_Offset lo;  // First index written
+    MPI_Offset hi;  // Last index written, less than lo if nothing is written
+    int entry;      // Index of the entry in the metadata index
+} NC_dw_interval;
+
+/* Log entries of a variable, sorted by the start of their range */
+typedef struct NC_dw_varindex {
+    NC_dw_interval *intervals;
+    int nalloc;
+    int nused;
+    MPI_Offset maxlen;  // Largest hi - lo of the entries, bounds the search
+} NC_dw_varindex;
+
 /* Put_req structure */
 typedef struct NC_dw_put_req {
     int valid;  // If this request object is in use (corresponding to some nonblocking request)
@@ -145,6 +191,16 @@ typedef struct NC_dw_put_list {
     int nused;  // Number of ids issued
 } NC_dw_put_list;
 
+/* Per variable information used by the put path */
+typedef struct NC_dw_varinfo {
+    int ndims;  // Number of dimensions
+    int isrec;  // If the first dimension is the record dimension
+    nc_type xtype;  // External type
+    MPI_Datatype buftype;   // Last buffer type written to the variable
+    int itype;  // Log type of buftype
+    int elsize; // Size of an element of buftype
+} NC_dw_varinfo;
+
 /* Shared file object */
 typedef struct NC_dw_sharedfile {
     int fd; // POSIX file descriptor
@@ -166,6 +222,7 @@ typedef struct NC_dw_bufferedfile {
     size_t bused;     // Buffer used region
     size_t bsize;   // Buffer size, also write block size
     size_t fsize;   // Current file size
+    void *wb;   // Write-behind state, NULL if full buffers are written synchronously
 } NC_dw_bufferedfile;
 
 /* Log structure */
@@ -182,20 +239,38 @@ typedef struct NC_dw {
     int hints;
     int isindep;
     size_t datalogsize;
+    size_t datasize;   /* Size of data in the log before compression */
     NC_dw_buffer metadata; /* In memory metadata buffer that mirrors the metadata log */
     NC_dw_metadataidx metaidx;
+    NC_dw_varindex *varentries;    /* Index of log entries of each variable */
+    int nvarentries;
+    NC_dw_varinfo *varinfo;   /* Information of each variable, built in data mode */
+    int nvarinfo;
     NC_dw_sizevector entrydatasize;    /* Array of metadata entries */
     int isflushing;   /* If log is flushing */
     MPI_Offset max_ndims;
     NC_dw_put_list putlist;
     MPI_Offset recdimsize;
     MPI_Offset flushbuffersize;
+    MPI_Offset maxlogsize;  /* Size of the data log that triggers a flush, 0 means unlimited */
+    int logstart;           /* Oldest entry in the metadata index not yet replayed */
+    int wrapidx;            /* First entry logged after the data log wrapped, -1 if not wrapped */
+    int writebehind;        /* Number of data log buffers written in the background */
+    int codec;              /* Codec used to compress the data log entries */
+    NC_dw_buffer codecbuf;  /* Compressed data and work space of the codec */
     MPI_Offset maxentrysize;
+    int recover;            /* If logs left by an aborted run are replayed when the log is created */
+    int async;              /* If the log is replayed in the background */
+    MPI_Comm drain_comm;    /* Communicator used by the background replay */
+    void *drain;            /* Background replay in progress */
+    int drain_status;       /* Error of the last background replay */
 #ifdef PNETCDF_PROFILING
     /* Profiling information */
     MPI_Offset total_data;
+    MPI_Offset total_zdata;     /* Data written to the data log after compression */
     MPI_Offset total_meta;
     MPI_Offset max_buffer;
+    MPI_Offset num_full_flush;  /* Flushes of the log when it is full */
     double total_time;
     double create_time;
     double enddef_time;
@@ -204,11 +279,14 @@ typedef struct NC_dw {
     double close_time;
     double flush_replay_time;
     double flush_data_rd_time;
+    double flush_data_rd_wait_time;
     double flush_put_time;
     double flush_wait_time;
     double put_data_wr_time;
     double put_meta_wr_time;
     double put_num_wr_time;
+    double put_compress_time;
+    double flush_decompress_time;
 #endif
 
     int                mode;        /* file _open/_create mode */
@@ -217,6 +295,7 @@ typedef struct NC_dw {
     char              *path;        /* path name */
     MPI_Comm           comm;        /* MPI communicator */
     MPI_Comm           logcomm;        /* MPI communicator */
+    MPI_Comm           nodecomm;    /* Processes whose logs are replayed by the node leader */
     MPI_Info           info;
     void              *ncp;         /* pointer to driver's internal object */
     struct PNC_driver *ncmpio_driver;
@@ -228,11 +307,25 @@ char* ncdwio_log_buffer_alloc(NC_dw_buffer *bp, size_t size);
 int ncdwio_log_sizearray_init(NC_dw_sizevector *sp);
 void ncdwio_log_sizearray_free(NC_dw_sizevector *sp);
 int ncdwio_log_sizearray_append(NC_dw_sizevector *sp, size_t size);
-int log_flush(NC_dw *ncdwp);
+int log_flush(NC_dw *ncdwp, int nentries);
+int log_flush_node(NC_dw *ncdwp);
+int log_replay_merged(NC_dw *ncdwp, char *metadata, size_t metasize, NC_dw_sharedfile *srcs, size_t datasize, size_t maxentrysize);
+int ncdwio_log_reset(NC_dw *ncdwp);
+int ncdwio_log_release(NC_dw *ncdwp, int nentries);
+int ncdwio_log_drain(NC_dw *ncdwp);
+void ncdwio_log_join(NC_dw *ncdwp);
 int ncdwio_log_create(NC_dw *ncdwp, MPI_Info info);
+int ncdwio_log_recover(NC_dw *ncdwp, char *logbase, char *basename);
 int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[], const MPI_Offset count[], const MPI_Offset stride[], void *buf, MPI_Datatype buftype, MPI_Offset *putsize);
+int ncdwio_log_put_varn(NC_dw *ncdwp, int varid, int num, MPI_Offset* const *starts, MPI_Offset* const *counts, void *buf, MPI_Datatype buftype, MPI_Offset *putsize);
+int ncdwio_log_put_vard(NC_dw *ncdwp, int varid, MPI_Datatype filetype, void *buf, MPI_Offset bufcount, MPI_Datatype buftype);
+MPI_Offset ncdwio_log_entry_nranges(NC_dw_metadataentry *entryp);
+void ncdwio_log_entry_range(NC_dw_metadataentry *entryp, MPI_Offset r, MPI_Offset **start, MPI_Offset **count, MPI_Offset **stride);
 int ncdwio_log_close(NC_dw *ncdwp);
+int ncdwio_log_abort(NC_dw *ncdwp);
 int ncdwio_log_flush(NC_dw *ncdwp);
+int ncdwio_log_flush_all(NC_dw *ncdwp);
+int ncdwio_log_reserve(NC_dw *ncdwp, MPI_Offset size, int reqMode);
 int ncdwio_log_enddef(NC_dw *ncdwp);
 
 int ncdwio_put_list_init(NC_dw *ncdwp);
@@ -247,6 +340,11 @@ int ncdwio_cancel_all_put_req(NC_dw *ncdwp);
 int ncdwio_metaidx_init(NC_dw *ncdwp);
 int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *entry);
 int ncdwio_metaidx_free(NC_dw *ncdwp);
+int ncdwio_varindex_find(NC_dw_varindex *vp, MPI_Offset lo, MPI_Offset hi, int *entries);
+int ncdwio_varinfo_init(NC_dw *ncdwp);
+void ncdwio_varinfo_free(NC_dw *ncdwp);
+int ncdwio_log_get_var(NC_dw *ncdwp, int varid, const MPI_Offset start[], const MPI_Offset count[], const MPI_Offset stride[], const MPI_Offset imap[], void *buf, MPI_Offset bufcount, MPI_Datatype buftype, int reqMode);
+int logtype2mpitype(int type, MPI_Datatype *buftype);
 int ncdwio_log_intvector_init(NC_dw_intvector *vp);
 void ncdwio_log_intvector_free(NC_dw_intvector *vp);
 int ncdwio_log_intvector_append(NC_dw_intvector *vp, int size);
@@ -266,6 +364,10 @@ int ncdwio_bufferedfile_write(NC_dw_bufferedfile *f, void *buf, size_t count);
 int ncdwio_bufferedfile_pread(NC_dw_bufferedfile *f, void *buf, size_t count, off_t offset);
 int ncdwio_bufferedfile_read(NC_dw_bufferedfile *f, void *buf, size_t count);
 int ncdwio_bufferedfile_seek(NC_dw_bufferedfile *f, off_t offset, int whence);
+int ncdwio_bufferedfile_writebehind(NC_dw_bufferedfile *f, int nbuf);
+size_t ncdwio_codec_encode(int codec, int elsize, const char *in, size_t len, char *out, char *work);
+int ncdwio_codec_decode(int codec, int elsize, const char *in, size_t zlen, char *out, size_t len, char *work);
+int ncdwio_bufferedfile_sync(NC_dw_bufferedfile *f);
 
 void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info);
 void ncdwio_export_hint(NC_dw *ncdwp, MPI_Info info);
@@ -285,6 +387,9 @@ ncdwio_enddef(void *ncdp);
 extern int
 ncdwio__enddef(void *ncdp, MPI_Offset h_minfree, MPI_Offset v_align, MPI_Offset v_minfree, MPI_Offset r_align);
 
+extern int
+ncdwio_enddef_from(void *ncdp, void *tmpl_ncdp);
+
 extern int
 ncdwio_redef(void *ncdp);
 
@@ -356,9 +461,15 @@ ncdwio_get_att(void *ncdp, int varid, const char *name, void *value, MPI_Datatyp
 extern int
 ncdwio_put_att(void *ncdp, int varid, const char *name, nc_type xtype, MPI_Offset nelems, const void *value, MPI_Datatype itype);
 
+extern int
+ncdwio_put_atts(void *ncdp, int varid, int natts, char* const *names, const nc_type *xtypes, const MPI_Offset *nelems, void* const *values);
+
 extern int
 ncdwio_def_var(void *ncdp, const char *name, nc_type type, int ndims, const int *dimids, int *varidp);
 
+extern int
+ncdwio_def_vars(void *ncdp, int nvars, char* const *names, const nc_type *xtypes, const int *ndims, int* const *dimids, int *varids);
+
 extern int
 ncdwio_def_var_fill(void *ncdp, int varid, int nofill, const void *fill_value);
 
@@ -12,6 +12,7 @@
  * ncmpi_close()            : dispatcher->close()
  * ncmpi_enddef()           : dispatcher->enddef()
  * ncmpi__enddef()          : dispatcher->_enddef()
+ * ncmpi_create_from_template() : dispatcher->enddef_from()
  * ncmpi_redef()            : dispatcher->redef()
  * ncmpi_begin_indep_data() : dispatcher->begin_indep_data()
  * ncmpi_end_indep_data()   : dispatcher->end_indep_data()
@@ -86,6 +87,18 @@ ncdwio_create(MPI_Comm     comm,
     MPI_Comm_dup(comm, &(ncdwp->comm));
     MPI_Info_dup(info, &(ncdwp->info));
     ncdwio_extract_hint(ncdwp, info);   // Translate MPI hint into hint flags
+    ncdwp->async = 0;   // Log is replayed in the background
+    ncdwp->recover = 0; // A new file has no log to recover
+    ncdwp->drain = NULL;
+    ncdwp->drain_status = NC_NOERR;
+    ncdwp->varinfo = NULL;  // Variable information is built in data mode
+    ncdwp->nvarinfo = 0;
+    // Processes on the node whose logs are replayed by the node leader
+    ncdwp->nodecomm = MPI_COMM_NULL;
+    if (ncdwp->hints & NC_LOG_HINT_NODE_REPLAY){
+        MPI_Comm_split_type(ncdwp->comm, MPI_COMM_TYPE_SHARED, 0,
+                            MPI_INFO_NULL, &(ncdwp->nodecomm));
+    }
 
     /* Log init delayed to enddef */
     ncdwp->inited = 0;
@@ -142,6 +155,19 @@ ncdwio_open(MPI_Comm     comm,
     MPI_Comm_dup(comm, &(ncdwp->comm));
     MPI_Info_dup(info, &(ncdwp->info));
     ncdwio_extract_hint(ncdwp, info);   // Translate MPI hint into hint flags
+    ncdwp->async = 0;   // Log is replayed in the background
+    // Replay logs left by an aborted run if the file is opened for writing
+    ncdwp->recover = (ncdwp->hints & NC_LOG_HINT_RECOVER) && omode != NC_NOWRITE;
+    ncdwp->drain = NULL;
+    ncdwp->drain_status = NC_NOERR;
+    ncdwp->varinfo = NULL;  // Variable information is built in data mode
+    ncdwp->nvarinfo = 0;
+    // Processes on the node whose logs are replayed by the node leader
+    ncdwp->nodecomm = MPI_COMM_NULL;
+    if (ncdwp->hints & NC_LOG_HINT_NODE_REPLAY){
+        MPI_Comm_split_type(ncdwp->comm, MPI_COMM_TYPE_SHARED, 0,
+                            MPI_INFO_NULL, &(ncdwp->nodecomm));
+    }
 
     /* Opened file is in data mode
      * We must initialize the log for if file is not opened for read only
@@ -163,6 +189,11 @@ ncdwio_open(MPI_Comm     comm,
         if (err != NC_NOERR) {
             return err;
         }
+        // Cache variable information used by the put path
+        err = ncdwio_varinfo_init(ncdwp);
+        if (err != NC_NOERR) {
+            return err;
+        }
         // Mark as initialized
         ncdwp->inited = 1;
     }
@@ -190,6 +221,9 @@ ncdwio_close(void *ncdp)
      * Putlist and metadata index also needs to be cleaned up
      */
     if (ncdwp->inited){
+        // Wait for the background replay
+        ncdwio_log_join(ncdwp);
+        status = ncdwp->drain_status;
         // Close log file
         err = ncdwio_log_close(ncdwp);
         if (status == NC_NOERR) {
@@ -199,6 +233,8 @@ ncdwio_close(void *ncdp)
         ncdwio_put_list_free(ncdwp);
         // Clean up metadata index
         ncdwio_metaidx_free(ncdwp);
+        // Clean up variable information
+        ncdwio_varinfo_free(ncdwp);
     }
 
     // Call ncmpio driver
@@ -208,6 +244,12 @@ ncdwio_close(void *ncdp)
     }
 
     // Cleanup NC-dw object
+    if (ncdwp->async) {
+        MPI_Comm_free(&(ncdwp->drain_comm));
+    }
+    if (ncdwp->nodecomm != MPI_COMM_NULL) {
+        MPI_Comm_free(&(ncdwp->nodecomm));
+    }
     MPI_Comm_free(&(ncdwp->comm));
     MPI_Info_free(&(ncdwp->info));
     NCI_Free(ncdwp->path);
@@ -224,12 +266,17 @@ ncdwio_close(void *ncdp)
 int
 ncdwio_enddef(void *ncdp)
 {
-    int err;
+    int err, status=NC_NOERR;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     // Call ncmpio enddef
     err = ncdwp->ncmpio_driver->enddef(ncdwp->ncp);
-    if (err != NC_NOERR) return err;
+    // NC_EMULTIDEFINE means ncmpio has exited define mode with root's header
+    if (err == NC_EMULTIDEFINE) status = err;
+    else if (err != NC_NOERR) return err;
 
     /* If logfile are not initialized, we initialize the logfile
      * The file is newly created
@@ -261,7 +308,11 @@ ncdwio_enddef(void *ncdp)
         ncdwp->inited = 1;
     }
 
-    return NC_NOERR;
+    // Variables may have been added in define mode
+    err = ncdwio_varinfo_init(ncdwp);
+    if (err != NC_NOERR) return err;
+
+    return status;
 }
 
 /*
@@ -276,13 +327,18 @@ ncdwio__enddef(void       *ncdp,
               MPI_Offset  v_minfree,
               MPI_Offset  r_align)
 {
-    int err;
+    int err, status=NC_NOERR;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     // Call ncmpio enddef
     err = ncdwp->ncmpio_driver->_enddef(ncdwp->ncp, h_minfree, v_align, v_minfree,
                                r_align);
-    if (err != NC_NOERR) return err;
+    // NC_EMULTIDEFINE means ncmpio has exited define mode with root's header
+    if (err == NC_EMULTIDEFINE) status = err;
+    else if (err != NC_NOERR) return err;
 
     /* If logfile are not initialized, we initialize the logfile
      * The file is newly created
@@ -314,6 +370,55 @@ ncdwio__enddef(void       *ncdp,
         ncdwp->inited = 1;
     }
 
+    // Variables may have been added in define mode
+    err = ncdwio_varinfo_init(ncdwp);
+    if (err != NC_NOERR) return err;
+
+    return status;
+}
+
+int
+ncdwio_enddef_from(void *ncdp,
+                   void *tmpl_ncdp)
+{
+    int i, err, nvars;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+    NC_dw *tmplp = (NC_dw*)tmpl_ncdp;
+
+    // Copy the header of the template and enter data mode
+    err = ncdwp->ncmpio_driver->enddef_from(ncdwp->ncp, tmplp->ncp);
+    if (err != NC_NOERR) return err;
+
+    // Dimensions and variables are not defined through this driver
+    err = ncdwp->ncmpio_driver->inq(ncdwp->ncp, NULL, &nvars, NULL,
+                                    &ncdwp->recdimid);
+    if (err != NC_NOERR) return err;
+    for (i = 0; i < nvars; i++){
+        int ndims;
+        err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, i, NULL, NULL, &ndims,
+                                            NULL, NULL, NULL, NULL, NULL);
+        if (err != NC_NOERR) return err;
+        if (ndims > ncdwp->max_ndims){
+            ncdwp->max_ndims = ndims;
+        }
+    }
+
+    /* The file is newly created, initialize the logfile */
+    err = ncdwio_log_create(ncdwp, ncdwp->info);
+    if (err != NC_NOERR) {
+        return err;
+    }
+    // Initialize put list for nonblocking put operation
+    ncdwio_put_list_init(ncdwp);
+    // Initialize metadata index for log entries
+    ncdwio_metaidx_init(ncdwp);
+    // Mark as initialized
+    ncdwp->inited = 1;
+
+    // Cache variable information used by the put path
+    err = ncdwio_varinfo_init(ncdwp);
+    if (err != NC_NOERR) return err;
+
     return NC_NOERR;
 }
 
@@ -333,6 +438,9 @@ ncdwio_redef(void *ncdp)
     }
     */
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->redef(ncdwp->ncp);
     if (err != NC_NOERR) return err;
 
@@ -345,6 +453,9 @@ ncdwio_begin_indep_data(void *ncdp)
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->begin_indep_data(ncdwp->ncp);
     if (err != NC_NOERR) return err;
 
@@ -362,6 +473,9 @@ ncdwio_end_indep_data(void *ncdp)
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->end_indep_data(ncdwp->ncp);
     if (err != NC_NOERR) return err;
 
@@ -381,9 +495,29 @@ ncdwio_abort(void *ncdp)
 
     if (ncdwp == NULL) DEBUG_RETURN_ERROR(NC_EBADID)
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
+    /* The log is not flushed, the log files are left for recovery
+     * Putlist and metadata index are cleaned up
+     */
+    if (ncdwp->inited){
+        ncdwio_log_abort(ncdwp);
+        ncdwio_put_list_free(ncdwp);
+        ncdwio_metaidx_free(ncdwp);
+        ncdwio_varinfo_free(ncdwp);
+    }
+
     err = ncdwp->ncmpio_driver->abort(ncdwp->ncp);
 
+    if (ncdwp->async) {
+        MPI_Comm_free(&(ncdwp->drain_comm));
+    }
+    if (ncdwp->nodecomm != MPI_COMM_NULL) {
+        MPI_Comm_free(&(ncdwp->nodecomm));
+    }
     MPI_Comm_free(&(ncdwp->comm));
+    MPI_Info_free(&(ncdwp->info));
     NCI_Free(ncdwp->path);
     NCI_Free(ncdwp);
 
@@ -400,6 +534,9 @@ ncdwio_inq(void *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq(ncdwp->ncp, ndimsp, nvarsp, nattsp, xtendimp);
     if (err != NC_NOERR) return err;
 
@@ -427,6 +564,9 @@ ncdwio_inq_misc(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_misc(ncdwp->ncp, pathlen, path, num_fix_varsp,
                                 num_rec_varsp, striping_size, striping_count,
                                 header_size, header_extent, recsize, put_size,
@@ -439,8 +579,22 @@ ncdwio_inq_misc(void       *ncdp,
     if (ncdwp->inited) {
         /* Add the size of data log to reflect pending put in the log */
         if (put_size != NULL){
-            *put_size += (MPI_Offset)ncdwp->datalogsize - 8;
+            *put_size += (MPI_Offset)ncdwp->datasize;
+
+            /* Root process will write the new number of records to the file header when the log is flushed */
+            if (ncdwp->rank == 0 && ncdwp->recdimid >= 0){
+                MPI_Offset nrecs;
+
+                err = ncdwp->ncmpio_driver->inq_dim(ncdwp->ncp, ncdwp->recdimid, NULL, &nrecs);
+                if (err != NC_NOERR) return err;
+                if (nrecs < ncdwp->recdimsize){
+                    int format;
 
+                    err = ncmpi_inq_format(ncdwp->ncid, &format);
+                    if (err != NC_NOERR) return err;
+                    *put_size += (format == NC_FORMAT_CDF5) ? 8 : 4;
+                }
+            }
         }
 
         /* Add number of write requests to nreqs */
@@ -502,6 +656,7 @@ ncdwio_cancel(void *ncdp,
         }
         // Cancel all get requests
         if (num_req == NC_REQ_ALL || num_req == NC_GET_REQ_ALL){
+            ncdwio_log_join(ncdwp);
             err = ncdwp->ncmpio_driver->cancel(ncdwp->ncp, num_req, NULL, NULL);
             if (status == NC_NOERR){
                 status = err;
@@ -569,6 +724,7 @@ ncdwio_cancel(void *ncdp,
             req_ids[i] /= 2;
         }
         // Call ncmpio cancel
+        ncdwio_log_join(ncdwp);
         err = ncdwp->ncmpio_driver->cancel(ncdwp->ncp, num_req - nput, req_ids + nput, statuses + nput);
         if (status == NC_NOERR){
             status = err;
@@ -653,6 +809,24 @@ ncdwio_wait(void *ncdp,
     int *swapidx;   // Swap target
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    /* Collective wait starts replaying the log in the background
+     * Pending put requests complete with the replay, so they are ready below
+     */
+    if (ncdwp->inited && ncdwp->async && fIsSet(reqMode, NC_REQ_COLL)){
+        err = ncdwio_log_drain(ncdwp);
+        if (status == NC_NOERR){
+            status = err;
+        }
+    }
+    /* Collective wait replays the logs of the node by the node leader */
+    else if (ncdwp->inited && ncdwp->nodecomm != MPI_COMM_NULL &&
+             fIsSet(reqMode, NC_REQ_COLL)){
+        err = ncdwio_log_flush_all(ncdwp);
+        if (status == NC_NOERR){
+            status = err;
+        }
+    }
+
    /*
     * If num_reqs is one of all requests, we don't need to handle request ids
     */
@@ -666,6 +840,7 @@ ncdwio_wait(void *ncdp,
         }
         // Cancel all get requests
         if (num_reqs == NC_REQ_ALL || num_reqs == NC_GET_REQ_ALL){
+            ncdwio_log_join(ncdwp);
             err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, num_reqs, NULL, NULL, reqMode);
             if (status == NC_NOERR){
                 status = err;
@@ -791,6 +966,9 @@ ncdwio_set_fill(void *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->set_fill(ncdwp->ncp, fill_mode, old_fill_mode);
     if (err != NC_NOERR) return err;
 
@@ -805,6 +983,9 @@ ncdwio_fill_var_rec(void      *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->fill_var_rec(ncdwp->ncp, varid, recno);
     if (err != NC_NOERR) return err;
 
@@ -820,6 +1001,9 @@ ncdwio_def_var_fill(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->def_var_fill(ncdwp->ncp, varid, no_fill, fill_value);
     if (err != NC_NOERR) return err;
 
@@ -832,6 +1016,9 @@ ncdwio_sync_numrecs(void *ncdp)
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->sync_numrecs(ncdwp->ncp);
     if (err != NC_NOERR) return err;
 
@@ -846,7 +1033,7 @@ ncdwio_sync(void *ncdp)
 
     /* Flush on sync */
     if (ncdwp->inited) {
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_flush_all(ncdwp);
         if (err != NC_NOERR) return err;
     }
 
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -213,6 +214,14 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
         return err;
     }
 
+    /* Initialize buffer of the codec */
+    if (ncdwp->codec != NC_LOG_CODEC_NONE){
+        err = ncdwio_log_buffer_init(&(ncdwp->codecbuf));
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
     /* Set log file descriptor to NULL */
 
 #ifdef PNETCDF_PROFILING
@@ -225,12 +234,17 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
     ncdwp->close_time = 0;
     ncdwp->flush_replay_time = 0;
     ncdwp->flush_data_rd_time = 0;
+    ncdwp->flush_data_rd_wait_time = 0;
     ncdwp->flush_put_time = 0;
     ncdwp->flush_wait_time = 0;
     ncdwp->put_data_wr_time = 0;
     ncdwp->put_meta_wr_time = 0;
     ncdwp->put_num_wr_time = 0;
+    ncdwp->put_compress_time = 0;
+    ncdwp->flush_decompress_time = 0;
+    ncdwp->total_zdata = 0;
     ncdwp->max_buffer = 0;
+    ncdwp->num_full_flush = 0;
 #endif
 
     /* Misc */
@@ -274,6 +288,16 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
     headerp->entry_begin = ncdwp->metadata.nused;
     headerp->basenamelen = strlen(basename);
 
+    /* Logs of the file left by an aborted run are replayed before the log
+     * files are created, as they may have the same name
+     */
+    if (ncdwp->recover){
+        err = ncdwio_log_recover(ncdwp, logbase, basename);
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
     /* Create log files */
     flag = O_RDWR | O_CREAT;
     if (!(ncdwp->hints & NC_LOG_HINT_LOG_OVERWRITE)) {
@@ -291,6 +315,14 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
         return err;
     }
 
+    /* Write full buffers of the data log in the background */
+    if (ncdwp->writebehind > 0) {
+        err = ncdwio_bufferedfile_writebehind(ncdwp->datalog_fd, ncdwp->writebehind);
+        if (err != NC_NOERR) {
+            return err;
+        }
+    }
+
     /* Write metadata header to file
      * Write from the memory buffer to file
      */
@@ -308,6 +340,28 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
     }
 
     ncdwp->datalogsize = 8;
+    ncdwp->datasize = 0;
+    ncdwp->logstart = 0;
+    ncdwp->wrapidx = -1;
+
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    /* Replay the log in the background only if every process can call MPI
+     * from the replaying thread
+     */
+    if (ncdwp->hints & NC_LOG_HINT_ASYNC_FLUSH){
+        int provided;
+
+        MPI_Query_thread(&provided);
+        err = MPI_Allreduce(MPI_IN_PLACE, &provided, 1, MPI_INT, MPI_MIN, ncdwp->comm);
+        if (err != MPI_SUCCESS){
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
+        }
+        if (provided == MPI_THREAD_MULTIPLE){
+            MPI_Comm_dup(ncdwp->comm, &(ncdwp->drain_comm));
+            ncdwp->async = 1;
+        }
+    }
+#endif
 
 #ifdef PNETCDF_PROFILING
     t2 = MPI_Wtime();
@@ -316,6 +370,7 @@ int ncdwio_log_create(NC_dw* ncdwp, MPI_Info info) {
 
     ncdwp->total_meta += headersize;
     ncdwp->total_data += 8;
+    ncdwp->total_zdata += 8;
 #endif
 
     return NC_NOERR;
@@ -378,8 +433,10 @@ int ncdwio_log_close(NC_dw *ncdwp) {
 #ifdef PNETCDF_PROFILING
     double t1, t2;
     unsigned long long total_data;
+    unsigned long long total_zdata;
     unsigned long long total_meta;
     unsigned long long buffer_size;
+    unsigned long long num_full_flush;
     double total_time;
     double create_time;
     double enddef_time;
@@ -388,11 +445,14 @@ int ncdwio_log_close(NC_dw *ncdwp) {
     double close_time;
     double flush_replay_time;
     double flush_data_rd_time;
+    double flush_data_rd_wait_time;
     double flush_put_time;
     double flush_wait_time;
     double put_data_wr_time;
     double put_meta_wr_time;
     double put_num_wr_time;
+    double put_compress_time;
+    double flush_decompress_time;
 #endif
     NC_dw_metadataheader* headerp;
 
@@ -404,9 +464,24 @@ int ncdwio_log_close(NC_dw *ncdwp) {
 
     /* If log file is created, flush the log */
     if (ncdwp->metalog_fd >= 0){
-        /* Commit to CDF file */
-        if (headerp->num_entries > 0){
-            log_flush(ncdwp);
+        /* Commit to CDF file
+         * In collective mode, processes with an empty log join the replay
+         * of others
+         */
+        err = NC_NOERR;
+        if (!ncdwp->isindep && ncdwp->nodecomm != MPI_COMM_NULL){
+            err = log_flush_node(ncdwp);
+        }
+        else if (headerp->num_entries > 0 || !ncdwp->isindep){
+            err = log_flush(ncdwp, ncdwp->metaidx.nused);
+        }
+
+        /* Log files kept after close are marked as flushed, so they are not
+         * recovered at the next open
+         */
+        if (err == NC_NOERR && !(ncdwp->hints & NC_LOG_HINT_DEL_ON_CLOSE) &&
+            headerp->num_entries > 0){
+            ncdwio_log_reset(ncdwp);
         }
 
         /* Close log file */
@@ -429,6 +504,9 @@ int ncdwio_log_close(NC_dw *ncdwp) {
     /* Free meta data buffer and metadata offset list*/
     ncdwio_log_buffer_free(&(ncdwp->metadata));
     ncdwio_log_sizearray_free(&(ncdwp->entrydatasize));
+    if (ncdwp->codec != NC_LOG_CODEC_NONE){
+        ncdwio_log_buffer_free(&(ncdwp->codecbuf));
+    }
 
 #ifdef PNETCDF_PROFILING
     t2 = MPI_Wtime();
@@ -453,6 +531,8 @@ int ncdwio_log_close(NC_dw *ncdwp) {
                 MPI_MAX, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->flush_data_rd_time), &flush_data_rd_time, 1,
                 MPI_DOUBLE, MPI_MAX, 0, ncdwp->comm);
+    MPI_Reduce(&(ncdwp->flush_data_rd_wait_time), &flush_data_rd_wait_time, 1,
+                MPI_DOUBLE, MPI_MAX, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->flush_put_time), &flush_put_time, 1, MPI_DOUBLE,
                 MPI_MAX, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->flush_wait_time), &flush_wait_time, 1, MPI_DOUBLE,
@@ -463,23 +543,37 @@ int ncdwio_log_close(NC_dw *ncdwp) {
                 MPI_MAX, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->put_num_wr_time), &put_num_wr_time, 1, MPI_DOUBLE,
                 MPI_MAX, 0, ncdwp->comm);
+    MPI_Reduce(&(ncdwp->put_compress_time), &put_compress_time, 1, MPI_DOUBLE,
+                MPI_MAX, 0, ncdwp->comm);
+    MPI_Reduce(&(ncdwp->flush_decompress_time), &flush_decompress_time, 1,
+                MPI_DOUBLE, MPI_MAX, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->total_meta), &total_meta, 1, MPI_UNSIGNED_LONG_LONG,
                 MPI_SUM, 0, ncdwp->comm);
+    MPI_Reduce(&(ncdwp->total_zdata), &total_zdata, 1, MPI_UNSIGNED_LONG_LONG,
+                MPI_SUM, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->total_data), &total_data, 1, MPI_UNSIGNED_LONG_LONG,
                 MPI_SUM, 0, ncdwp->comm);
     MPI_Reduce(&(ncdwp->flushbuffersize), &buffer_size, 1,
                 MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, ncdwp->comm);
+    MPI_Reduce(&(ncdwp->num_full_flush), &num_full_flush, 1,
+                MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, ncdwp->comm);
 
     if (ncdwp->rank == 0){
         printf("==========================================================\n");
         printf("File: %s\n", ncdwp->path);
         printf("Data writen to variable: %llu\n", total_data);
+        printf("Data written to data log: %llu\n", total_zdata);
+        if (total_zdata > 0){
+            printf("Data compression ratio: %lf\n", (double)total_data / total_zdata);
+        }
         printf("Metadata generated: %llu\n", total_meta);
         printf("Flush buffer size: %llu\n", buffer_size);
+        printf("Flushes of full log: %llu\n", num_full_flush);
         printf("Time in log: %lf\n", total_time);
         printf("\tTime in log_create: %lf\n", create_time);
         printf("\tTime in log_enddef: %lf\n", enddef_time);
         printf("\tTime in log_put: %lf\n", put_time);
+        printf("\t\tTime compressing data: %lf\n", put_compress_time);
         printf("\t\tTime writing data log: %lf\n", put_data_wr_time);
         printf("\t\tTime writing metadata log: %lf\n", put_meta_wr_time);
         printf("\t\tTime updating numrecs: %lf\n", put_num_wr_time);
@@ -487,6 +581,8 @@ int ncdwio_log_close(NC_dw *ncdwp) {
         printf("\tTime in log_close: %lf\n", close_time);
         printf("\tTime replaying the log: %lf\n", flush_replay_time);
         printf("\t\tTime reading data log: %lf\n", flush_data_rd_time);
+        printf("\t\tTime waiting for data log reads: %lf\n", flush_data_rd_wait_time);
+        printf("\t\tTime decompressing data: %lf\n", flush_decompress_time);
         printf("\t\tTime calling iput: %lf\n", flush_put_time);
         printf("\t\tTime calling wait: %lf\n", flush_wait_time);
         printf("==========================================================\n");
@@ -498,32 +594,73 @@ int ncdwio_log_close(NC_dw *ncdwp) {
 }
 
 /*
- * Commit the log into cdf file and delete the log
- * User can call this to force a commit without closing
- * It work by flush and re-initialize the log structure
+ * Close the log without flushing it
+ * Log files are kept, so the log is recovered at the next open of the file
+ * Used by ncmpi_abort()
  * IN    ncdwp:    log structure
  */
-int ncdwio_log_flush(NC_dw* ncdwp) {
-    int err, status = NC_NOERR;
+int ncdwio_log_abort(NC_dw *ncdwp) {
+    int err, status;
+    NC_dw_bufferedfile *f = ncdwp->datalog_fd;
+
+    // Write out the buffer of the data log, the entries it holds are logged
+    status = ncdwio_bufferedfile_seek(f, f->pos, SEEK_SET);
+
+    err = ncdwio_sharedfile_close(ncdwp->metalog_fd);
+    if (status == NC_NOERR){
+        status = err;
+    }
+    err = ncdwio_bufferedfile_close(ncdwp->datalog_fd);
+    if (status == NC_NOERR){
+        status = err;
+    }
+
+    ncdwio_log_buffer_free(&(ncdwp->metadata));
+    ncdwio_log_sizearray_free(&(ncdwp->entrydatasize));
+    if (ncdwp->codec != NC_LOG_CODEC_NONE){
+        ncdwio_log_buffer_free(&(ncdwp->codecbuf));
+    }
+
+    return status;
+}
+
+/*
+ * Flush the log
+ * IN    ncdwp:    log structure
+ * IN    coll:    if all processes flush, then an empty log is replayed too
+ */
+static int log_flush_common(NC_dw* ncdwp, int coll) {
+    int err, status;
 #ifdef PNETCDF_PROFILING
     double t1, t2;
 #endif
-    //NC_req *putlist;
     NC_dw_metadataheader *headerp;
 
 #ifdef PNETCDF_PROFILING
     t1 = MPI_Wtime();
 #endif
 
+    /* Wait for the background replay and report its error */
+    ncdwio_log_join(ncdwp);
+    status = ncdwp->drain_status;
+    ncdwp->drain_status = NC_NOERR;
+
     headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
 
     /* Nothing to replay if nothing have been written */
-    if (headerp->num_entries == 0){
-        return NC_NOERR;
+    if (headerp->num_entries == 0 && !coll){
+        return status;
     }
 
-    /* Replay log file */
-    err = log_flush(ncdwp);
+    /* Replay log file
+     * The node leader replays the logs of the node when every process flushes
+     */
+    if (coll && ncdwp->nodecomm != MPI_COMM_NULL){
+        err = log_flush_node(ncdwp);
+    }
+    else{
+        err = log_flush(ncdwp, ncdwp->metaidx.nused);
+    }
     if (err != NC_NOERR) {
         if (status == NC_NOERR){
             DEBUG_ASSIGN_ERROR(status, err);
@@ -531,15 +668,295 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
     }
 
     /* Reset log status */
+    err = ncdwio_log_reset(ncdwp);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->total_time += t2 - t1;
+    ncdwp->flush_time += t2 - t1;
+#endif
+
+    return status;
+}
+
+/*
+ * Commit the log into cdf file and delete the log
+ * User can call this to force a commit without closing
+ * It work by flush and re-initialize the log structure
+ * IN    ncdwp:    log structure
+ */
+int ncdwio_log_flush(NC_dw* ncdwp) {
+    return log_flush_common(ncdwp, 0);
+}
+
+/*
+ * Same as ncdwio_log_flush, but must be called by all processes in
+ * collective mode
+ * Processes with an empty log join the collective replay of others instead
+ * of returning at once
+ * IN    ncdwp:    log structure
+ */
+int ncdwio_log_flush_all(NC_dw* ncdwp) {
+    return log_flush_common(ncdwp, !ncdwp->isindep);
+}
+
+/*
+ * Offset in the data log an entry of size bytes is logged at if the entries
+ * before entry k in the metadata index are replayed
+ * Live data spans from the oldest entry to the end of the data log, after
+ * the data log wraps, new entries are logged from its beginning up to the
+ * oldest entry
+ * IN    ncdwp:    log structure
+ * IN    k:    oldest entry left in the log
+ * IN    size:    size of data of the entry
+ * Return -1 if the entry does not fit in the size limit
+ */
+static MPI_Offset log_room(NC_dw *ncdwp, int k, MPI_Offset size) {
+    MPI_Offset head, tail;
+    NC_dw_metadataentry *entryp;
+
+    if (k >= ncdwp->metaidx.nused){
+        return 8;   // The log is empty
+    }
+
+    entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + (size_t)ncdwp->metaidx.entries[k].ptr);
+    head = entryp->data_off;
+    tail = (MPI_Offset)ncdwp->datalogsize;
+
+    if (k < ncdwp->wrapidx){
+        return (tail + size <= head) ? tail : -1;
+    }
+    if (tail + size <= ncdwp->maxlogsize){
+        return tail;
+    }
+    return (8 + size <= head) ? 8 : -1;
+}
+
+/*
+ * Replay the oldest entries of the log and reuse their space
+ * IN    ncdwp:    log structure
+ * IN    nentries:    entries before this one in the metadata index are replayed
+ */
+static int log_flush_head(NC_dw *ncdwp, int nentries) {
+    int err, status;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+
+    t1 = MPI_Wtime();
+#endif
+
+    /* Wait for the background replay and report its error */
+    ncdwio_log_join(ncdwp);
+    status = ncdwp->drain_status;
+    ncdwp->drain_status = NC_NOERR;
+
+    err = log_flush(ncdwp, nentries);
+    if (err != NC_NOERR) {
+        if (status == NC_NOERR){
+            DEBUG_ASSIGN_ERROR(status, err);
+        }
+    }
+
+    err = ncdwio_log_release(ncdwp, nentries);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->total_time += t2 - t1;
+    ncdwp->flush_time += t2 - t1;
+#endif
+
+    return status;
+}
+
+/*
+ * Make room in the data log for size more bytes before an entry is logged
+ * If the entry does not fit in the size limit of hint nc_dw_max_log_size,
+ * the oldest entries are replayed until it does, the data log is used as a
+ * ring, new entries are logged in the space of the replayed ones
+ * An entry larger than the limit is logged into the empty log
+ * A collective call replays the log of all processes if any of them is full
+ * An independent call in collective data mode, such as a nonblocking put,
+ * can not replay the log alone, the entry is then logged beyond the limit
+ * and the log is flushed by the next collective call
+ * IN    ncdwp:    log structure
+ * IN    size:    size of data of the entry, before compression
+ * IN    reqMode:    mode of the put call
+ */
+int ncdwio_log_reserve(NC_dw *ncdwp, MPI_Offset size, int reqMode) {
+    int i, k, full, err;
+    MPI_Offset off, end;
+    NC_dw_metadataentry *entryp;
+
+    if (ncdwp->maxlogsize == 0){
+        return NC_NOERR;
+    }
+
+    /* Oldest entries to replay to make room */
+    k = ncdwp->logstart;
+    while (log_room(ncdwp, k, size) < 0){
+        k++;
+    }
+    full = (k > ncdwp->logstart);
+
+    if (fIsSet(reqMode, NC_REQ_COLL)){
+        err = MPI_Allreduce(MPI_IN_PLACE, &full, 1, MPI_INT, MPI_LOR,
+                            ncdwp->comm);
+        if (err != MPI_SUCCESS){
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
+        }
+    }
+    else if (!ncdwp->isindep){
+        full = 0;
+    }
+
+    if (full){
+#ifdef PNETCDF_PROFILING
+        ncdwp->num_full_flush++;
+#endif
+        // Processes with room join the collective replay of others
+        err = log_flush_head(ncdwp, k);
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
+    off = log_room(ncdwp, ncdwp->logstart, size);
+    if (off < 0){
+        /* The log can not be replayed, the entry goes after all live data */
+        off = (MPI_Offset)ncdwp->datalogsize;
+        if (ncdwp->logstart < ncdwp->wrapidx){
+            for (i = ncdwp->logstart; i < ncdwp->metaidx.nused; i++){
+                entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + (size_t)ncdwp->metaidx.entries[i].ptr);
+                end = entryp->data_off + entryp->zdata_len;
+                if (off < end){
+                    off = end;
+                }
+            }
+        }
+    }
+    else if (off == 8 && ncdwp->logstart < ncdwp->metaidx.nused){
+        ncdwp->wrapidx = ncdwp->metaidx.nused;
+    }
+
+    if (off != (MPI_Offset)ncdwp->datalogsize){
+        err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, off, SEEK_SET);
+        if (err != NC_NOERR){
+            return err;
+        }
+        ncdwp->datalogsize = off;
+    }
+
+    return NC_NOERR;
+}
+
+/*
+ * Drop the oldest entries of the log once they are replayed
+ * The metadata log read by the recovery starts from the oldest entry left,
+ * its entries are moved to the beginning of the metadata log when the
+ * replayed entries take more space than them
+ * IN    ncdwp:    log structure
+ * IN    nentries:    entries before this one in the metadata index are replayed
+ */
+int ncdwio_log_release(NC_dw *ncdwp, int nentries) {
+    int i, j, n, err;
+    size_t begin, end, shift;
+    MPI_Offset hdr[3];
+    NC_dw_varindex *vp;
+    NC_dw_metadataheader *headerp;
+
+    if (nentries >= ncdwp->metaidx.nused){
+        return ncdwio_log_reset(ncdwp);
+    }
+    if (nentries <= ncdwp->logstart){
+        return NC_NOERR;
+    }
+
+    headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
+
+    for (i = ncdwp->logstart; i < nentries; i++){
+        ncdwp->metaidx.entries[i].valid = 0;
+        ncdwp->datasize -= ncdwp->entrydatasize.values[i];
+    }
+    headerp->num_entries -= nentries - ncdwp->logstart;
+    ncdwp->logstart = nentries;
+
+    /* Released entries are dropped from the index of each variable */
+    for (i = 0; i < ncdwp->nvarentries; i++){
+        vp = ncdwp->varentries + i;
+        for (j = n = 0; j < vp->nused; j++){
+            if (vp->intervals[j].entry >= nentries){
+                vp->intervals[n++] = vp->intervals[j];
+            }
+        }
+        vp->nused = n;
+    }
+
+    /* The entries left do not overlap their new location, the metadata log
+     * stays valid until the header points to it
+     */
+    begin = (size_t)ncdwp->metaidx.entries[nentries].ptr;
+    end = ncdwp->metadata.nused;
+    shift = begin - headerp->entry_begin;
+    if (shift >= end - begin){
+        memcpy((char*)ncdwp->metadata.buffer + headerp->entry_begin,
+               (char*)ncdwp->metadata.buffer + begin, end - begin);
+        err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd,
+                                       (char*)ncdwp->metadata.buffer + headerp->entry_begin,
+                                       end - begin, headerp->entry_begin);
+        if (err != NC_NOERR){
+            return err;
+        }
+        for (i = nentries; i < ncdwp->metaidx.nused; i++){
+            ncdwp->metaidx.entries[i].ptr = (NC_dw_metadataentry*)((size_t)ncdwp->metaidx.entries[i].ptr - shift);
+        }
+        ncdwp->metadata.nused -= shift;
+        begin = headerp->entry_begin;
+    }
+
+    /* Update entry_begin, max_ndims, and num_entries in one write */
+    hdr[0] = (MPI_Offset)begin;
+    hdr[1] = headerp->max_ndims;
+    hdr[2] = headerp->num_entries;
+    err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, hdr, sizeof(hdr),
+                                   offsetof(NC_dw_metadataheader, entry_begin));
+    if (err != NC_NOERR){
+        return err;
+    }
+
+    return NC_NOERR;
+}
+
+/*
+ * Empty the log after all entries are replayed
+ * IN    ncdwp:    log structure
+ */
+int ncdwio_log_reset(NC_dw *ncdwp) {
+    int i, err;
+    NC_dw_metadataheader *headerp;
+
+    headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
 
     /* Set num_entries to 0 */
     headerp->num_entries = 0;
 
     /* Overwrite num_entries
      * This marks the completion of flush
+     * entry_begin is restored if the oldest entries were released
      */
-    err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, &headerp->num_entries,
-                            SIZEOF_MPI_OFFSET, 56);
+    if (ncdwp->logstart > 0){
+        err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, &headerp->entry_begin,
+                                SIZEOF_MPI_OFFSET * 3, 40);
+    }
+    else{
+        err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, &headerp->num_entries,
+                                SIZEOF_MPI_OFFSET, 56);
+    }
     if (err != NC_NOERR){
         return err;
     }
@@ -548,6 +965,10 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
     ncdwp->metadata.nused = headerp->entry_begin;
     ncdwp->entrydatasize.nused = 0;
     ncdwp->metaidx.nused = 0;
+    for (i = 0; i < ncdwp->nvarentries; i++) {
+        ncdwp->varentries[i].nused = 0;
+        ncdwp->varentries[i].maxlen = 0;
+    }
 
     /* Rewind data log file descriptors and reset the size */
     err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, 8, SEEK_SET);
@@ -556,12 +977,9 @@ int ncdwio_log_flush(NC_dw* ncdwp) {
     }
 
     ncdwp->datalogsize = 8;
+    ncdwp->datasize = 0;
+    ncdwp->logstart = 0;
+    ncdwp->wrapidx = -1;
 
-#ifdef PNETCDF_PROFILING
-    t2 = MPI_Wtime();
-    ncdwp->total_time += t2 - t1;
-    ncdwp->flush_time += t2 - t1;
-#endif
-
-    return status;
+    return NC_NOERR;
 }
@@ -24,11 +24,13 @@
 #include <stdio.h>
 #include <ncdwio_driver.h>
 #include <mpi.h>
+#ifdef ENABLE_DW_ASYNC_FLUSH
+#include <pthread.h>
+#endif
 
 /* Convert from log type to MPI type used by pnetcdf library
  * Log spec has different enum of types than MPI
  */
-int logtype2mpitype(int type, MPI_Datatype *buftype);
 int logtype2mpitype(int type, MPI_Datatype *buftype){
     /* Convert from log type to MPI type used by pnetcdf library
      * Log spec has different enum of types than MPI
@@ -73,179 +75,929 @@ int logtype2mpitype(int type, MPI_Datatype *buftype){
     return NC_NOERR;
 }
 
+/* Stride of a subarray along dimension i, stride is NULL or 0 for vara */
+#define RANGE_STRIDE(stride, i) \
+    (((stride) == NULL || (stride)[i] == 0) ? 1 : (stride)[i])
+
+/* Largest number of pairs of subarrays compared between two log entries
+ * Entries writing more subarrays are assumed to overlap and not to cover
+ * each other
+ */
+#define NC_DW_REPLAY_RANGE_PAIRS 65536
+
 /*
- * Commit log file into CDF file
- * Meta data is stored in memory, metalog is only used for restoration after abnormal shutdown
- * IN    ncdwp:    log structure
+ * Check if the bounding boxes of two subarrays overlap
  */
-int log_flush(NC_dw *ncdwp) {
-    int i, j, lb, ub, err, status = NC_NOERR;
-    int *reqids, *stats;
-    int ready, ready_all;
-    size_t databufferused, databuffersize, dataread;
-    NC_dw_metadataentry *entryp;
+static int range_overlap(int ndims, MPI_Offset *astart, MPI_Offset *acount,
+                         MPI_Offset *astride, MPI_Offset *bstart,
+                         MPI_Offset *bcount, MPI_Offset *bstride) {
+    int i;
+    MPI_Offset alast, blast;
+
+    for (i = 0; i < ndims; i++) {
+        if (acount[i] == 0 || bcount[i] == 0) {
+            return 0;
+        }
+        alast = astart[i] + (acount[i] - 1) * RANGE_STRIDE(astride, i);
+        blast = bstart[i] + (bcount[i] - 1) * RANGE_STRIDE(bstride, i);
+        if (alast < bstart[i] || blast < astart[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Check if the bounding boxes of two log entries of the same variable overlap
+ * Overlapping entries can not be replayed in the same batch, as the order of
+ * overlapping nonblocking requests in a wait call is not defined
+ */
+static int entry_overlap(NC_dw_metadataentry *a, NC_dw_metadataentry *b) {
+    MPI_Offset i, j, na, nb;
+    MPI_Offset *astart, *acount, *astride, *bstart, *bcount, *bstride;
+
+    if (a->varid != b->varid) {
+        return 0;
+    }
+
+    na = ncdwio_log_entry_nranges(a);
+    nb = ncdwio_log_entry_nranges(b);
+    if (na * nb > NC_DW_REPLAY_RANGE_PAIRS) {
+        return 1;
+    }
+
+    for (i = 0; i < na; i++) {
+        ncdwio_log_entry_range(a, i, &astart, &acount, &astride);
+        for (j = 0; j < nb; j++) {
+            ncdwio_log_entry_range(b, j, &bstart, &bcount, &bstride);
+            if (range_overlap(a->ndims, astart, acount, astride, bstart,
+                              bcount, bstride)) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Check if a log entry intersects a bounding box
+ * IN    e:    log entry
+ * IN    lo, hi:    first and last index of the box in each dimension
+ */
+static int entry_box_overlap(NC_dw_metadataentry *e, MPI_Offset *lo,
+                             MPI_Offset *hi) {
+    int i;
+    MPI_Offset r, nranges, *start, *count, *stride, last;
+
+    nranges = ncdwio_log_entry_nranges(e);
+    for (r = 0; r < nranges; r++) {
+        ncdwio_log_entry_range(e, r, &start, &count, &stride);
+        for (i = 0; i < e->ndims; i++) {
+            if (count[i] == 0) {
+                break;
+            }
+            last = start[i] + (count[i] - 1) * RANGE_STRIDE(stride, i);
+            if (last < lo[i] || hi[i] < start[i]) {
+                break;
+            }
+        }
+        if (i == e->ndims) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Grow a bounding box to include a log entry
+ * IN    e:    log entry
+ * INOUT lo, hi:    first and last index of the box in each dimension
+ * INOUT set:    if the box is set
+ */
+static void entry_box_add(NC_dw_metadataentry *e, MPI_Offset *lo,
+                          MPI_Offset *hi, char *set) {
+    int i;
+    MPI_Offset r, nranges, *start, *count, *stride, last;
+
+    nranges = ncdwio_log_entry_nranges(e);
+    for (r = 0; r < nranges; r++) {
+        ncdwio_log_entry_range(e, r, &start, &count, &stride);
+        for (i = 0; i < e->ndims; i++) {
+            if (count[i] == 0) {
+                break;
+            }
+        }
+        if (i < e->ndims) {
+            continue; // No element written
+        }
+
+        for (i = 0; i < e->ndims; i++) {
+            last = start[i] + (count[i] - 1) * RANGE_STRIDE(stride, i);
+            if (!(*set) || start[i] < lo[i]) {
+                lo[i] = start[i];
+            }
+            if (!(*set) || last > hi[i]) {
+                hi[i] = last;
+            }
+        }
+        *set = 1;
+    }
+}
+
+/*
+ * Check if subarray b contains every element of subarray a
+ */
+static int range_cover(int ndims, MPI_Offset *astart, MPI_Offset *acount,
+                       MPI_Offset *astride, MPI_Offset *bstart,
+                       MPI_Offset *bcount, MPI_Offset *bstride) {
+    int i;
+    MPI_Offset ast, bst, alast, blast;
+
+    for (i = 0; i < ndims; i++) {
+        if (acount[i] == 0) {
+            return 1;   // a writes nothing
+        }
+    }
+
+    for (i = 0; i < ndims; i++) {
+        if (bcount[i] == 0) {
+            return 0;
+        }
+        ast = RANGE_STRIDE(astride, i);
+        bst = RANGE_STRIDE(bstride, i);
+        alast = astart[i] + (acount[i] - 1) * ast;
+        blast = bstart[i] + (bcount[i] - 1) * bst;
+        if (astart[i] < bstart[i] || alast > blast) {
+            return 0;
+        }
+        /* Elements of a must be on the stride of b */
+        if (bst > 1) {
+            if ((astart[i] - bstart[i]) % bst != 0) {
+                return 0;
+            }
+            if (acount[i] > 1 && ast % bst != 0) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Check if log entry b writes every element written by log entry a
+ * If so, a is superseded by b when b is replayed after a
+ * Each subarray of a must be contained in a subarray of b
+ */
+static int entry_cover(NC_dw_metadataentry *a, NC_dw_metadataentry *b) {
+    MPI_Offset i, j, na, nb;
+    MPI_Offset *astart, *acount, *astride, *bstart, *bcount, *bstride;
+
+    if (a->varid != b->varid || a->ndims != b->ndims) {
+        return 0;
+    }
+
+    na = ncdwio_log_entry_nranges(a);
+    nb = ncdwio_log_entry_nranges(b);
+    if (na * nb > NC_DW_REPLAY_RANGE_PAIRS) {
+        return 0;
+    }
+
+    for (i = 0; i < na; i++) {
+        ncdwio_log_entry_range(a, i, &astart, &acount, &astride);
+        for (j = 0; j < nb; j++) {
+            ncdwio_log_entry_range(b, j, &bstart, &bcount, &bstride);
+            if (range_cover(a->ndims, astart, acount, astride, bstart, bcount,
+                            bstride)) {
+                break;
+            }
+        }
+        if (j == nb) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Check if log entry e writes a single subarray without stride
+ */
+static int entry_vara(NC_dw_metadataentry *e) {
+    int i;
     MPI_Offset *start, *count, *stride;
-    MPI_Datatype buftype;
-    char *databuffer, *databufferoff;
-    NC_dw_metadataheader *headerp;
-    NC_dw_metadataptr *ip;
-#ifdef PNETCDF_PROFILING
-    double t1, t2, t3, t4;
 
-    t1 = MPI_Wtime();
-#endif
+    if (e->api_kind == NC_LOG_API_KIND_VARN) {
+        return 0;
+    }
+    ncdwio_log_entry_range(e, 0, &start, &count, &stride);
+    for (i = 0; i < e->ndims; i++) {
+        if (RANGE_STRIDE(stride, i) > 1) {
+            return 0;
+        }
+    }
 
-    /* Read datalog in to memory */
-    /*
-     * Prepare data buffer
-     * We determine the data buffer size according to:
-     * hints, size of data log, the largest size of single record
-     * 0 in hint means no limit
-     * (Buffer size) = max((largest size of single record), min((size of data log), (size specified in hint)))
-     */
-    databuffersize = ncdwp->datalogsize;
-    if (ncdwp->flushbuffersize > 0 && databuffersize > ncdwp->flushbuffersize){
-        databuffersize = ncdwp->flushbuffersize;
+    return 1;
+}
+
+/*
+ * Check if log entry e can be appended to the subarray (start, count) of a
+ * vara request, so that both are written by one vara request whose data is
+ * the data of the subarray followed by the data of e
+ * This is the case if they differ only in dimension k, where e immediately
+ * follows the subarray, and both have one element in the dimensions before k
+ * IN    varid, itype:    variable and log type of the request
+ * IN    ndims:    number of dimensions of the request
+ * INOUT start, count:    subarray of the request, extended to include e
+ * IN    e:    log entry
+ */
+static int entry_merge(int varid, int itype, int ndims, MPI_Offset *start,
+                       MPI_Offset *count, NC_dw_metadataentry *e) {
+    int i, k;
+    MPI_Offset *estart, *ecount;
+
+    if (e->varid != varid || e->itype != itype || e->ndims != ndims ||
+        ndims == 0) {
+        return 0;
     }
-    if (databuffersize < ncdwp->maxentrysize){
-        databuffersize = ncdwp->maxentrysize;
+
+    estart = (MPI_Offset*)(e + 1);
+    ecount = estart + ndims;
+
+    if (!entry_vara(e)) {
+        return 0;
+    }
+    for (i = 0; i < ndims; i++) {
+        if (ecount[i] == 0) {
+            return 0;
+        }
     }
 
-#ifdef PNETCDF_PROFILING
-    if (ncdwp->max_buffer < databuffersize){
-        ncdwp->max_buffer = databuffersize;
+    for (k = 0; k < ndims; k++) {
+        if (start[k] != estart[k]) {
+            break;
+        }
+    }
+    if (k == ndims || estart[k] != start[k] + count[k]) {
+        return 0;
+    }
+    for (i = 0; i < k; i++) {
+        if (count[i] != 1 || ecount[i] != 1) {
+            return 0;
+        }
     }
+    for (i = k + 1; i < ndims; i++) {
+        if (start[i] != estart[i] || count[i] != ecount[i]) {
+            return 0;
+        }
+    }
+
+    count[k] += ecount[k];
+
+    return 1;
+}
+
+/* Log entries to replay and where to read their data
+ * The entries are either the live metadata index or a snapshot of it taken
+ * for the background replay
+ */
+typedef struct NC_dw_replay {
+    char *metadata;                 // Metadata buffer, entry pointers are offsets into it
+    NC_dw_metadataptr *entries;     // Entries to replay
+    int nentries;
+    NC_dw_sharedfile *fd;           // Data log file
+    NC_dw_sharedfile *srcs;         // Data log of each process on the node, NULL if all data is in fd
+    char *tail;                     // Data log content not yet written to the file
+    size_t tailoff;                 // Offset of the tail in the data log
+    size_t tailsize;
+    size_t buffersize;              // Size of each data buffer
+    int isindep;                    // Replay in independent mode
+    int nodeaggr;                   // Aggregate the collective writes at the node leaders
+    int setstat;                    // Update status of nonblocking requests
+    MPI_Comm comm;                  // Communicator to sync replay progress
+    char *keep;                     // Entries to write, valid and not superseded
+    int nvars;                      // 1 + largest variable id of the entries to write
+    int maxndims;                   // Largest ndims of the entries to write
+    size_t zbufsize;                // Space to read and decompress a compressed entry to write
+    MPI_Offset *bbox;               // Bounding box of the entries of each variable in the batch being planned
+    char *bboxset;                  // If the bounding box of a variable is set
+} NC_dw_replay;
+
+/* Number of data buffers in the replay pipeline, data of the next batches
+ * is read while the current batch is written to the CDF file
+ */
+#define NC_DW_REPLAY_NBUF 2
+
+/* A batch of log entries whose data is read into one data buffer */
+typedef struct NC_dw_replay_batch {
+    NC_dw *ncdwp;
+    NC_dw_replay *rp;
+    int lb;                         // First entry in the batch
+    int ub;                         // Entry after the last one in the batch
+    char *buffer;                   // Data of entries to write in the batch
+    char *zbuf;                     // Compressed data of an entry and work space of the codec
+    int status;                     // Result of reading the data
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    pthread_t thread;               // Thread reading the data
+    int threaded;
 #endif
+} NC_dw_replay_batch;
 
-    /* Allocate buffer */
-    databuffer = (char*)NCI_Malloc(databuffersize);
-    if(databuffer == NULL){
-        DEBUG_RETURN_ERROR(NC_ENOMEM);
+/* Number of later entries checked for superseding an entry */
+#define NC_DW_REPLAY_DEDUP_WINDOW 64
+
+#define REPLAY_ENTRY(rp, i) \
+    ((NC_dw_metadataentry*)((rp)->metadata + (size_t)(rp)->entries[i].ptr))
+
+/*
+ * Determine the size of each data buffer according to:
+ * hints, size of data log, the largest size of single record
+ * 0 in hint means no limit
+ * The memory is split among the NC_DW_REPLAY_NBUF buffers of the pipeline
+ * (Buffer size) = max((largest size of single record), min((size of data log), (size specified in hint)) / NC_DW_REPLAY_NBUF)
+ */
+static size_t replay_buffer_size(NC_dw *ncdwp, size_t datasize,
+                                 size_t maxentrysize) {
+    size_t databuffersize;
+
+    // Size of the data log as if it was not compressed, including its header
+    databuffersize = datasize + 8;
+    if (ncdwp->flushbuffersize > 0 &&
+        (MPI_Offset)databuffersize > ncdwp->flushbuffersize){
+        databuffersize = (size_t)ncdwp->flushbuffersize;
+    }
+    databuffersize /= NC_DW_REPLAY_NBUF;
+    if (databuffersize < maxentrysize){
+        databuffersize = maxentrysize;
     }
 
-    /* Seek to the start position of first data record */
-    err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, 8, SEEK_SET);
-    if (err != NC_NOERR){
-        return err;
+    return databuffersize;
+}
+
+/*
+ * Read <count> bytes of the data log at <offset>
+ * The part in [tailoff, tailoff + tailsize) is copied from the tail, entries
+ * logged before the data log wrapped may lie after the tail
+ * Data of entries gathered by the node leader is read from the data log of
+ * the process that wrote it
+ */
+static int replay_read(NC_dw_replay *rp, char *buf, size_t count, size_t offset) {
+    int err;
+    size_t lo, hi;
+
+    if (rp->srcs != NULL){
+        return ncdwio_sharedfile_pread(rp->srcs + (offset >> NC_DW_REPLAY_SRC_SHIFT),
+                                       buf, count, offset & NC_DW_REPLAY_SRC_MASK);
+    }
+    if (rp->tail != NULL && offset + count > rp->tailoff &&
+        offset < rp->tailoff + rp->tailsize){
+        lo = (offset > rp->tailoff) ? offset : rp->tailoff;
+        hi = (offset + count < rp->tailoff + rp->tailsize) ? offset + count : rp->tailoff + rp->tailsize;
+        memcpy(buf + (lo - offset), rp->tail + (lo - rp->tailoff), hi - lo);
+        if (offset + count > hi){
+            err = ncdwio_sharedfile_pread(rp->fd, buf + (hi - offset), offset + count - hi, hi);
+            if (err != NC_NOERR){
+                return err;
+            }
+        }
+        count = lo - offset;
+    }
+    if (count > 0){
+        return ncdwio_sharedfile_pread(rp->fd, buf, count, offset);
     }
 
-    /* Initialize buffer status */
-    databufferused = 0;
-    dataread = 0;
+    return NC_NOERR;
+}
 
-    reqids = (int*)NCI_Malloc(ncdwp->entrydatasize.nused * SIZEOF_INT);
-    stats = (int*)NCI_Malloc(ncdwp->entrydatasize.nused * SIZEOF_INT);
+/*
+ * Determine the entries of the batch starting at lb
+ * A batch ends when the data buffer is full or an entry overlaps a previous
+ * entry in the batch, as the order of overlapping nonblocking requests in a
+ * wait call is not defined
+ * The previous entries are only compared when the entry intersects the
+ * bounding box of the entries of its variable in the batch, so entries
+ * written in increasing order are planned in linear time
+ * IN    rp:    entries to replay
+ * IN    lb:    first entry of the batch
+ * Return the entry after the last one in the batch
+ */
+static int replay_plan(NC_dw_replay *rp, int lb) {
+    int i, ub;
+    size_t databufferused = 0;
+    MPI_Offset *lo, *hi;
+    NC_dw_metadataentry *entryp;
 
-    /*
-     * Iterate through meta log entries
-     */
-    headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
-    entryp = (NC_dw_metadataentry*)(((char*)ncdwp->metadata.buffer) + headerp->entry_begin);
-    for (lb = 0; lb < ncdwp->metaidx.nused;){
-        for (ub = lb; ub < ncdwp->metaidx.nused; ub++) {
-            if (ncdwp->metaidx.entries[ub].valid){
-                if(ncdwp->entrydatasize.values[ub] + databufferused > databuffersize) {
-                    break;  // Buffer full
-                }
-                else{
-                    databufferused += ncdwp->entrydatasize.values[ub]; // Record size of entry
+    if (rp->nvars > 0) {
+        memset(rp->bboxset, 0, rp->nvars);
+    }
+
+    for (ub = lb; ub < rp->nentries; ub++) {
+        // Skip canceled and superseded entries
+        if (!rp->keep[ub]){
+            continue;
+        }
+        entryp = REPLAY_ENTRY(rp, ub);
+        if (entryp->data_len + databufferused > rp->buffersize) {
+            break;  // Buffer full
+        }
+        lo = rp->bbox + (size_t)entryp->varid * 2 * rp->maxndims;
+        hi = lo + rp->maxndims;
+        // Start a new batch if overlapping a previous entry in this batch
+        if (rp->bboxset[entryp->varid] && entry_box_overlap(entryp, lo, hi)) {
+            for (i = lb; i < ub; i++) {
+                if (rp->keep[i] &&
+                    entry_overlap(REPLAY_ENTRY(rp, i), entryp)) {
+                    break;
                 }
             }
-            else{
-                // We encounter a canceled record
-                // Read unread data into data buffer and jump through the gap
-                /*
-                 * Read data to buffer
-                 * We read only what needed by pending requests
-                 */
-                if (dataread < databufferused){
-#ifdef PNETCDF_PROFILING
-                    t2 = MPI_Wtime();
-#endif
-                    err = ncdwio_bufferedfile_read(ncdwp->datalog_fd, databuffer + dataread, databufferused - dataread);
-                    if (err != NC_NOERR){
-                        return err;
-                    }
+            if (i < ub) {
+                break;
+            }
+        }
+        entry_box_add(entryp, lo, hi, rp->bboxset + entryp->varid);
+        databufferused += entryp->data_len; // Record size of entry
+    }
+
+    return ub;
+}
+
+/*
+ * Read data of the entries to write in a batch to its buffer
+ * Data of consecutive entries are read at once, gaps left by canceled
+ * entries are skipped
+ * IN    bp:    batch to read
+ */
+static int replay_fill(NC_dw_replay_batch *bp) {
+    int i, err;
+    size_t databufferused = 0, readoff = 0, readlen = 0;
+    NC_dw_replay *rp = bp->rp;
+    NC_dw_metadataentry *entryp;
 #ifdef PNETCDF_PROFILING
-                    t3 = MPI_Wtime();
-                    ncdwp->flush_data_rd_time += t3 - t2;
+    double t1, t2, t3, tdecode = 0;
+
+    t1 = MPI_Wtime();
 #endif
-                    dataread = databufferused;
-                }
 
-                // Skip canceled entry
-                err = ncdwio_bufferedfile_seek(ncdwp->datalog_fd, ncdwp->entrydatasize.values[ub], SEEK_CUR);
-                if (err != NC_NOERR){
-                    return err;
-                }
+    for (i = bp->lb; i < bp->ub; i++) {
+        if (!rp->keep[i]){
+            continue;
+        }
+        entryp = REPLAY_ENTRY(rp, i);
+        if (readlen > 0 && (readoff + readlen != (size_t)entryp->data_off ||
+                            entryp->codec != NC_LOG_CODEC_NONE)){
+            err = replay_read(rp, bp->buffer + databufferused - readlen, readlen, readoff);
+            if (err != NC_NOERR){
+                return err;
             }
+            readlen = 0;
         }
-
-        /*
-         * Read data to buffer
-         * We read only what needed by pending requests
-         */
-        if (dataread < databufferused){
+        if (entryp->codec != NC_LOG_CODEC_NONE){
+            // Compressed data is read on its own and decompressed into place
+            err = replay_read(rp, bp->zbuf, entryp->zdata_len, entryp->data_off);
+            if (err != NC_NOERR){
+                return err;
+            }
 #ifdef PNETCDF_PROFILING
-            t2 = MPI_Wtime();
+            t3 = MPI_Wtime();
 #endif
-            err = ncdwio_bufferedfile_read(ncdwp->datalog_fd, databuffer + dataread, databufferused - dataread);
+            err = ncdwio_codec_decode(entryp->codec, entryp->codec_elsize,
+                                      bp->zbuf, entryp->zdata_len,
+                                      bp->buffer + databufferused,
+                                      entryp->data_len,
+                                      bp->zbuf + entryp->zdata_len);
             if (err != NC_NOERR){
                 return err;
             }
 #ifdef PNETCDF_PROFILING
-            t3 = MPI_Wtime();
-            ncdwp->flush_data_rd_time += t3 - t2;
+            tdecode += MPI_Wtime() - t3;
+#endif
+            databufferused += entryp->data_len;
+            continue;
+        }
+        if (readlen == 0){
+            readoff = entryp->data_off;
+        }
+        readlen += entryp->data_len;
+        databufferused += entryp->data_len;
+    }
+    if (readlen > 0){
+        err = replay_read(rp, bp->buffer + databufferused - readlen, readlen, readoff);
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    bp->ncdwp->flush_data_rd_time += t2 - t1 - tdecode;
+    bp->ncdwp->flush_decompress_time += tdecode;
+#endif
+
+    return NC_NOERR;
+}
+
+#ifdef ENABLE_DW_ASYNC_FLUSH
+static void *fill_thread(void *arg) {
+    NC_dw_replay_batch *bp = (NC_dw_replay_batch*)arg;
+
+    bp->status = replay_fill(bp);
+
+    return NULL;
+}
+#endif
+
+/*
+ * Start reading the data of a batch
+ * The data is read by a thread when available, so the read overlaps with
+ * writing the batches before it, otherwise it is read here
+ * IN    bp:    batch to read
+ * IN    overlap:    if there are batches being written
+ */
+static void replay_fill_start(NC_dw_replay_batch *bp, int overlap) {
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
 #endif
-            dataread = databufferused;
+
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    bp->threaded = 0;
+    if (overlap){
+        bp->threaded = (pthread_create(&(bp->thread), NULL, fill_thread, bp) == 0);
+        if (bp->threaded){
+            return;
         }
+    }
+#endif
 
-        // Pointer points to the data of current entry
-        databufferoff = databuffer;
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
 
-        j = 0;
-        for(i = lb; i < ub; i++){
-            ip = ncdwp->metaidx.entries + i;
+    bp->status = replay_fill(bp);
 
-            if (ip->valid) {
-                /* start, count, stride */
-                start = (MPI_Offset*)(entryp + 1);
-                count = start + entryp->ndims;
-                stride = count + entryp->ndims;
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    bp->ncdwp->flush_data_rd_wait_time += t2 - t1;
+#endif
+}
 
-                // Convert from log type to MPI type
-                err = logtype2mpitype(entryp->itype, &buftype);
-                if (err != NC_NOERR){
-                    return err;
-                }
+/*
+ * Wait for the data of a batch to be read
+ * Time blocked on reading is counted in flush_data_rd_wait_time, the part of
+ * flush_data_rd_time not overlapped with writing
+ * IN    bp:    batch to wait for
+ */
+static int replay_fill_finish(NC_dw_replay_batch *bp) {
+#ifdef ENABLE_DW_ASYNC_FLUSH
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
 
-                /* Determine API_Kind */
-                if (entryp->api_kind == NC_LOG_API_KIND_VARA){
-                    stride = NULL;
-                }
+    t1 = MPI_Wtime();
+#endif
+
+    if (bp->threaded){
+        pthread_join(bp->thread, NULL);
+        bp->threaded = 0;
+    }
 
 #ifdef PNETCDF_PROFILING
-                t2 = MPI_Wtime();
+    t2 = MPI_Wtime();
+    bp->ncdwp->flush_data_rd_wait_time += t2 - t1;
+#endif
 #endif
 
-                /* Replay event with non-blocking call */
-                err = ncdwp->ncmpio_driver->iput_var(ncdwp->ncp, entryp->varid, start, count, stride, NULL, (void*)(databufferoff), -1, buftype, reqids + j, NC_REQ_WR | NC_REQ_NBI | NC_REQ_HL);
-                if (status == NC_NOERR) {
-                    status = err;
-                }
+    return bp->status;
+}
+
+/*
+ * Select the entries to write
+ * An entry is dropped if it is canceled or if a later entry writes every
+ * element it writes, as its data would be overwritten in the file anyway
+ * Only the last NC_DW_REPLAY_DEDUP_WINDOW entries written after an entry are
+ * checked to bound the cost
+ * IN    rp:    entries to replay, rp->keep, rp->nvars, and rp->maxndims
+ *              are set
+ */
+static void replay_dedup(NC_dw_replay *rp) {
+    int i, k, nkept = 0;
+    int window[NC_DW_REPLAY_DEDUP_WINDOW];  // Ring of the latest entries to write
+    NC_dw_metadataentry *entryp;
+
+    rp->nvars = 0;
+    rp->maxndims = 0;
+    rp->zbufsize = 0;
+    for (i = rp->nentries - 1; i >= 0; i--) {
+        rp->keep[i] = 0;
+        if (!rp->entries[i].valid) {
+            continue;
+        }
+        entryp = REPLAY_ENTRY(rp, i);
+        for (k = 0; k < nkept && k < NC_DW_REPLAY_DEDUP_WINDOW; k++) {
+            if (entry_cover(entryp, REPLAY_ENTRY(rp, window[k]))) {
+                break;
+            }
+        }
+        if (k < nkept && k < NC_DW_REPLAY_DEDUP_WINDOW) {
+            continue;   // Superseded
+        }
+        rp->keep[i] = 1;
+        window[nkept++ % NC_DW_REPLAY_DEDUP_WINDOW] = i;
+        if (entryp->varid >= rp->nvars) {
+            rp->nvars = entryp->varid + 1;
+        }
+        if (entryp->ndims > rp->maxndims) {
+            rp->maxndims = entryp->ndims;
+        }
+        if (entryp->codec != NC_LOG_CODEC_NONE &&
+            (size_t)(entryp->zdata_len + entryp->data_len) > rp->zbufsize) {
+            rp->zbufsize = (size_t)(entryp->zdata_len + entryp->data_len);
+        }
+    }
+}
+
+/*
+ * Issue a nonblocking request replaying a subarray
+ * IN    ncdwp:    log structure
+ * IN    entryp:    first log entry of the request
+ * IN    start, count, stride:    subarray of the request
+ * IN    buf:    data of the request
+ * OUT   reqid:    id of the request
+ */
+static int replay_iput(NC_dw *ncdwp, NC_dw_metadataentry *entryp,
+                       MPI_Offset *start, MPI_Offset *count,
+                       MPI_Offset *stride, char *buf, int *reqid) {
+    int err;
+    MPI_Datatype buftype;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+#endif
+
+    // Convert from log type to MPI type
+    err = logtype2mpitype(entryp->itype, &buftype);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
+
+    /* Replay event with non-blocking call */
+    err = ncdwp->ncmpio_driver->iput_var(ncdwp->ncp, entryp->varid, start, count, stride, NULL, (void*)buf, -1, buftype, reqid, NC_REQ_WR | NC_REQ_NBI | NC_REQ_HL);
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->flush_put_time += t2 - t1;
+#endif
+
+    return err;
+}
+
+/*
+ * Issue a nonblocking request replaying a varn log entry
+ * IN    ncdwp:    log structure
+ * IN    entryp:    log entry
+ * IN    buf:    data of the entry
+ * OUT   reqid:    id of the request
+ */
+static int replay_iput_varn(NC_dw *ncdwp, NC_dw_metadataentry *entryp,
+                            char *buf, int *reqid) {
+    int err;
+    MPI_Offset r, num, **starts, **counts, *stride;
+    MPI_Datatype buftype;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+#endif
+
+    // Convert from log type to MPI type
+    err = logtype2mpitype(entryp->itype, &buftype);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+    num = ncdwio_log_entry_nranges(entryp);
+    starts = (MPI_Offset**)NCI_Malloc(num * 2 * sizeof(MPI_Offset*));
+    if (starts == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    counts = starts + num;
+    for (r = 0; r < num; r++){
+        ncdwio_log_entry_range(entryp, r, starts + r, counts + r, &stride);
+    }
+
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
+
+    /* Replay event with non-blocking call */
+    err = ncdwp->ncmpio_driver->iput_varn(ncdwp->ncp, entryp->varid, (int)num, starts, counts, (void*)buf, -1, buftype, reqid, NC_REQ_WR | NC_REQ_NBI | NC_REQ_HL);
 
 #ifdef PNETCDF_PROFILING
-                t3 = MPI_Wtime();
-                ncdwp->flush_put_time += t3 - t2;
+    t2 = MPI_Wtime();
+    ncdwp->flush_put_time += t2 - t1;
 #endif
 
+    NCI_Free(starts);
+
+    return err;
+}
+
+/*
+ * Replay log entries to the CDF file
+ * Entries are replayed in batches limited by the data buffer size
+ * The replay is pipelined over NC_DW_REPLAY_NBUF data buffers, the data of
+ * the next batches is read from the data log while the current batch is
+ * written to the CDF file
+ * IN    ncdwp:    log structure
+ * IN    rp:    entries to replay
+ */
+static int log_replay(NC_dw *ncdwp, NC_dw_replay *rp) {
+    int i, j, k, m, mlb, err, status = NC_NOERR;
+    int next, nplanned, ndone;
+    int *reqids, *stats, *reqidx;
+    int ready = 1, ready_all = 1, collmode;
+    NC_dw_replay_batch batches[NC_DW_REPLAY_NBUF], *bp;
+    NC_dw_metadataentry *entryp = NULL, *mentryp = NULL;
+    NC_dw_put_req *req;
+    MPI_Offset *start, *count, *stride;
+    MPI_Offset *mstart, *mcount, *mstride = NULL;
+    char *databufferoff, *mbuf = NULL;
+#ifdef PNETCDF_PROFILING
+    double t1, t2, t3, t4;
+
+    t1 = MPI_Wtime();
+
+    if (ncdwp->max_buffer < rp->buffersize * NC_DW_REPLAY_NBUF){
+        ncdwp->max_buffer = rp->buffersize * NC_DW_REPLAY_NBUF;
+    }
+#endif
+
+    // Mode of the collective waits
+    collmode = rp->nodeaggr ? (NC_REQ_COLL | NC_REQ_NODE) : NC_REQ_COLL;
+
+    /* Allocate buffers */
+    for (i = 0; i < NC_DW_REPLAY_NBUF; i++){
+        batches[i].ncdwp = ncdwp;
+        batches[i].rp = rp;
+        batches[i].buffer = (char*)NCI_Malloc(rp->buffersize);
+        if (batches[i].buffer == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+    }
+
+    reqids = (int*)NCI_Malloc(rp->nentries * SIZEOF_INT);
+    stats = (int*)NCI_Malloc(rp->nentries * SIZEOF_INT);
+    reqidx = (int*)NCI_Malloc(rp->nentries * SIZEOF_INT);
+
+    /* Drop entries overwritten by later entries */
+    rp->keep = (char*)NCI_Malloc(rp->nentries);
+    replay_dedup(rp);
+    mstart = (MPI_Offset*)NCI_Malloc(rp->maxndims * 2 * SIZEOF_MPI_OFFSET);
+    mcount = mstart + rp->maxndims;
+    rp->bbox = (MPI_Offset*)NCI_Malloc((size_t)rp->nvars * rp->maxndims * 2 * SIZEOF_MPI_OFFSET);
+    rp->bboxset = (char*)NCI_Malloc(rp->nvars);
+    for (i = 0; i < NC_DW_REPLAY_NBUF; i++){
+        batches[i].zbuf = NULL;
+        if (rp->zbufsize > 0){
+            batches[i].zbuf = (char*)NCI_Malloc(rp->zbufsize);
+            if (batches[i].zbuf == NULL){
+                DEBUG_RETURN_ERROR(NC_ENOMEM);
+            }
+        }
+    }
+
+    /* Requests whose data are overwritten are completed */
+    if (rp->setstat){
+        for(i = 0; i < rp->nentries; i++){
+            if (rp->entries[i].valid && !rp->keep[i] && rp->entries[i].reqid >= 0) {
+                req = ncdwp->putlist.reqs + rp->entries[i].reqid;
+                req->status = NC_NOERR;
+                req->ready = 1;
+            }
+        }
+    }
+
+    /*
+     * Iterate through meta log entries
+     * next: first entry not yet in a batch
+     * nplanned: number of batches whose data is being read or is read
+     * ndone: number of batches written, batch i uses buffer i % NC_DW_REPLAY_NBUF
+     */
+    next = 0;
+    nplanned = 0;
+    ndone = 0;
+    for (;;){
+        // Read ahead as long as there are free buffers
+        while (nplanned < ndone + NC_DW_REPLAY_NBUF && next < rp->nentries){
+            bp = batches + (nplanned % NC_DW_REPLAY_NBUF);
+            bp->lb = next;
+            bp->ub = next = replay_plan(rp, next);
+            replay_fill_start(bp, nplanned > ndone);
+            nplanned++;
+        }
+        if (ndone == nplanned){
+            break;  // All batches are written
+        }
+
+        bp = batches + (ndone % NC_DW_REPLAY_NBUF);
+
+        /* A batch whose data can not be read is not written, we still
+         * participate the collective wait
+         */
+        j = 0;
+        err = replay_fill_finish(bp);
+        if (err != NC_NOERR){
+            if (status == NC_NOERR){
+                status = err;
+            }
+            for(i = bp->lb; i < bp->ub; i++){
+                reqidx[i] = err;
+            }
+        }
+        else{
+            /* Entries continuing the subarray of the previous entry are
+             * merged into one request
+             * m: number of entries in the request being merged
+             * mlb: first entry of the request being merged
+             * reqidx[i]: the request entry i is in, or the error code if
+             * the request can not be posted
+             */
+            m = 0;
+            databufferoff = bp->buffer;
+            for(i = bp->lb; i <= bp->ub; i++){
+                if (i < bp->ub){
+                    if (!rp->keep[i]) {
+                        continue;
+                    }
+                    entryp = REPLAY_ENTRY(rp, i);
+
+                    if (m > 0 && mstride == NULL &&
+                        entry_merge(mentryp->varid, mentryp->itype,
+                                    mentryp->ndims, mstart, mcount, entryp)){
+                        reqidx[i] = j;
+                        m++;
+                        databufferoff += entryp->data_len;
+                        continue;
+                    }
+                }
+
+                // Post the request being merged
+                if (m > 0){
+                    err = replay_iput(ncdwp, mentryp, mstart, mcount, mstride, mbuf, reqids + j);
+                    if (status == NC_NOERR) {
+                        status = err;
+                    }
+                    // The request is still posted on NC_ERANGE
+                    if (err == NC_NOERR || err == NC_ERANGE){
+                        j++;
+                    }
+                    else{
+                        for(k = mlb; k < i; k++){
+                            reqidx[k] = err;
+                        }
+                    }
+                    m = 0;
+                }
+                if (i == bp->ub){
+                    break;
+                }
+
+                // A varn entry is replayed by a request of its own
+                if (entryp->api_kind == NC_LOG_API_KIND_VARN){
+                    err = replay_iput_varn(ncdwp, entryp, databufferoff, reqids + j);
+                    if (status == NC_NOERR) {
+                        status = err;
+                    }
+                    if (err == NC_NOERR || err == NC_ERANGE){
+                        reqidx[i] = j++;
+                    }
+                    else{
+                        reqidx[i] = err;
+                    }
+                    databufferoff += entryp->data_len;
+                    continue;
+                }
+
+                /* start, count, stride */
+                start = (MPI_Offset*)(entryp + 1);
+                count = start + entryp->ndims;
+                stride = count + entryp->ndims;
+
+                // Start a new request from this entry
+                m = 1;
+                mlb = i;
+                mentryp = entryp;
+                memcpy(mstart, start, entryp->ndims * SIZEOF_MPI_OFFSET);
+                memcpy(mcount, count, entryp->ndims * SIZEOF_MPI_OFFSET);
+                mstride = entry_vara(entryp) ? NULL : stride;
+                mbuf = databufferoff;
+                reqidx[i] = j;
+
                 // Move to next data location
                 databufferoff += entryp->data_len;
-                j++;
             }
-
-            /* Move to next position */
-            entryp = (NC_dw_metadataentry*)(((char*)entryp) + entryp->esize);
         }
 
 #ifdef PNETCDF_PROFILING
@@ -254,11 +1006,11 @@ int log_flush(NC_dw *ncdwp) {
         /*
          * Wait must be called first or previous data will be corrupted
          */
-        if (ncdwp->isindep) {
+        if (rp->isindep) {
             err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, j, reqids, stats, NC_REQ_INDEP);
         }
         else{
-            err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, j, reqids, stats, NC_REQ_COLL);
+            err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, j, reqids, stats, collmode);
         }
         if (status == NC_NOERR) {
             status = err;
@@ -270,29 +1022,24 @@ int log_flush(NC_dw *ncdwp) {
 #endif
 
         // Fill up the status for nonblocking request
-        for(i = lb; i < ub; i++){
-            ip = ncdwp->metaidx.entries + i;
-            j = 0;
-            if (ip->valid) {
-                if (ip->reqid >= 0){
-                    ncdwp->putlist.reqs[ip->reqid].status = stats[j];
-                    ncdwp->putlist.reqs[ip->reqid].ready = 1;
+        if (rp->setstat){
+            for(i = bp->lb; i < bp->ub; i++){
+                if (rp->keep[i] && rp->entries[i].reqid >= 0) {
+                    req = ncdwp->putlist.reqs + rp->entries[i].reqid;
+                    req->status = (reqidx[i] >= 0) ? stats[reqidx[i]] : reqidx[i];
+                    req->ready = 1;
                 }
-                j++;
             }
         }
 
-        /* Update batch status */
-        databufferused = 0;
-
         // Mark as complete
-        lb = ub;
+        ndone++;
 
         /*
          * In case of collective flush, we sync our status with other processes
          */
-        if (!ncdwp->isindep){
-            if (lb >= ncdwp->metaidx.nused){
+        if (!rp->isindep){
+            if (ndone == nplanned && next >= rp->nentries){
                 ready = 1;
             }
             else{
@@ -300,7 +1047,7 @@ int log_flush(NC_dw *ncdwp) {
             }
 
             // Sync status
-            err = MPI_Allreduce(&ready, &ready_all, 1, MPI_INT, MPI_LAND, ncdwp->comm);
+            err = MPI_Allreduce(&ready, &ready_all, 1, MPI_INT, MPI_LAND, rp->comm);
             if (err != MPI_SUCCESS){
                 DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
             }
@@ -310,26 +1057,40 @@ int log_flush(NC_dw *ncdwp) {
     /*
      * In case of collective flush, we must continue to call wait until every process is ready
      */
-    if (!ncdwp->isindep){
+    if (!rp->isindep){
+        // Processes with nothing to replay join the batches of others
+        if (rp->nentries == 0){
+            ready_all = 0;
+        }
         while(!ready_all){
             // Participate collective wait
-            err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, 0, NULL, NULL, NC_REQ_COLL);
+            err = ncdwp->ncmpio_driver->wait(ncdwp->ncp, 0, NULL, NULL, collmode);
             if (status == NC_NOERR) {
                 status = err;
             }
 
             // Sync status
-            err = MPI_Allreduce(&ready, &ready_all, 1, MPI_INT, MPI_LAND, ncdwp->comm);
+            err = MPI_Allreduce(&ready, &ready_all, 1, MPI_INT, MPI_LAND, rp->comm);
             if (err != MPI_SUCCESS){
                 DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
             }
         }
     }
 
-    /* Free the data buffer */
-    NCI_Free(databuffer);
+    /* Free the data buffers */
+    for (i = 0; i < NC_DW_REPLAY_NBUF; i++){
+        NCI_Free(batches[i].buffer);
+        if (batches[i].zbuf != NULL){
+            NCI_Free(batches[i].zbuf);
+        }
+    }
     NCI_Free(reqids);
     NCI_Free(stats);
+    NCI_Free(reqidx);
+    NCI_Free(mstart);
+    NCI_Free(rp->keep);
+    NCI_Free(rp->bbox);
+    NCI_Free(rp->bboxset);
 
 #ifdef PNETCDF_PROFILING
     t4 = MPI_Wtime();
@@ -339,4 +1100,462 @@ int log_flush(NC_dw *ncdwp) {
     return status;
 }
 
+/*
+ * Commit log file into CDF file
+ * Meta data is stored in memory, metalog is only used for restoration after abnormal shutdown
+ * Data not yet written to the data log is read from the buffer of the data log
+ * IN    ncdwp:    log structure
+ * IN    nentries:    entries before this one in the metadata index are replayed
+ */
+int log_flush(NC_dw *ncdwp, int nentries) {
+    int i, err, status;
+    size_t datasize = 0;
+    NC_dw_replay replay;
+    NC_dw_bufferedfile *f = ncdwp->datalog_fd;
+
+    /* Data queued to the background writer must reach the data log before it
+     * is read, the replay goes on after an error to match other processes
+     */
+    err = ncdwio_bufferedfile_sync(f);
 
+    // Entries before logstart are replayed already
+    if (nentries < ncdwp->logstart){
+        nentries = ncdwp->logstart;
+    }
+    for (i = ncdwp->logstart; i < nentries; i++){
+        datasize += ncdwp->entrydatasize.values[i];
+    }
+
+    replay.metadata = (char*)ncdwp->metadata.buffer;
+    replay.entries = ncdwp->metaidx.entries + ncdwp->logstart;
+    replay.nentries = nentries - ncdwp->logstart;
+    replay.fd = f->fd;
+    replay.srcs = NULL;
+    replay.tail = NULL;
+    replay.tailoff = ncdwp->datalogsize;
+    replay.tailsize = 0;
+    if (f->buffer != NULL && f->bused > f->bunused){
+        // Buffered data covers [pos - tailsize, pos) in the data log
+        replay.tail = f->buffer + f->bunused;
+        replay.tailsize = f->bused - f->bunused;
+        replay.tailoff = f->pos - replay.tailsize;
+    }
+    replay.buffersize = replay_buffer_size(ncdwp, datasize,
+                                           ncdwp->maxentrysize);
+    replay.isindep = ncdwp->isindep;
+    replay.nodeaggr = 0;
+    replay.setstat = 1;
+    replay.comm = ncdwp->comm;
+
+    status = log_replay(ncdwp, &replay);
+
+    return (err != NC_NOERR) ? err : status;
+}
+
+/*
+ * Replay log entries gathered from the logs of several processes
+ * The data offset of an entry carries the index in srcs of the data log
+ * holding its data above bit NC_DW_REPLAY_SRC_SHIFT
+ * Entries are ordered by variable, so the subarrays written by different
+ * processes are merged into larger requests, entries of a variable keep the
+ * order they are in the metadata buffer
+ * Must be called by all processes in collective mode, processes with
+ * nothing to replay join the collective wait of others
+ * IN    ncdwp:    log structure
+ * IN    metadata:    metadata entries
+ * IN    metasize:    size of the metadata entries
+ * IN    srcs:    data log of each process
+ * IN    datasize:    size of data of the entries before compression
+ * IN    maxentrysize:    size of data of the largest entry
+ */
+int log_replay_merged(NC_dw *ncdwp, char *metadata, size_t metasize,
+                      NC_dw_sharedfile *srcs, size_t datasize,
+                      size_t maxentrysize) {
+    int i, err, nvars = 0, *varstart;
+    size_t off;
+    NC_dw_replay replay;
+    NC_dw_metadataentry *entryp;
+    NC_dw_metadataptr *ip;
+
+    replay.metadata = metadata;
+    replay.entries = NULL;
+    replay.nentries = 0;
+    replay.fd = NULL;
+    replay.srcs = srcs;
+    replay.tail = NULL;
+    replay.tailoff = 0;
+    replay.tailsize = 0;
+    replay.buffersize = replay_buffer_size(ncdwp, datasize, maxentrysize);
+    replay.isindep = 0;
+    /* Only the node leaders have entries to write when the logs of a node are
+     * replayed by its leader, the ncmpio driver aggregates the collective
+     * writes at the node leaders as with hint nc_node_aggr
+     */
+    replay.nodeaggr = (ncdwp->nodecomm != MPI_COMM_NULL);
+    replay.setstat = 0; // Requests of other processes are not in our put list
+    replay.comm = ncdwp->comm;
+
+    for (off = 0; off < metasize; off += entryp->esize){
+        entryp = (NC_dw_metadataentry*)(metadata + off);
+        if (entryp->varid >= nvars){
+            nvars = entryp->varid + 1;
+        }
+        replay.nentries++;
+    }
+
+    /* Order entries by variable */
+    varstart = (int*)NCI_Malloc((nvars + 1) * SIZEOF_INT);
+    memset(varstart, 0, (nvars + 1) * SIZEOF_INT);
+    for (off = 0; off < metasize; off += entryp->esize){
+        entryp = (NC_dw_metadataentry*)(metadata + off);
+        varstart[entryp->varid + 1]++;
+    }
+    for (i = 0; i < nvars; i++){
+        varstart[i + 1] += varstart[i];
+    }
+    if (replay.nentries > 0){
+        replay.entries = (NC_dw_metadataptr*)NCI_Malloc(replay.nentries * sizeof(NC_dw_metadataptr));
+        if (replay.entries == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+    }
+    for (off = 0; off < metasize; off += entryp->esize){
+        entryp = (NC_dw_metadataentry*)(metadata + off);
+        ip = replay.entries + varstart[entryp->varid]++;
+        ip->ptr = (NC_dw_metadataentry*)off;
+        ip->valid = 1;
+        ip->reqid = -1;
+    }
+    NCI_Free(varstart);
+
+    err = log_replay(ncdwp, &replay);
+
+    if (replay.entries != NULL){
+        NCI_Free(replay.entries);
+    }
+
+    return err;
+}
+
+/*
+ * Commit the logs of the processes on a node into CDF file by the node leader
+ * The leader gathers the metadata of the valid entries on the node and reads
+ * their data from the data log of each process
+ * Other processes join the collective wait with nothing to write
+ * Must be called by all processes in collective mode
+ * IN    ncdwp:    log structure
+ */
+int log_flush_node(NC_dw *ncdwp) {
+    int i, k, err, status, noderank, nodesize, shared;
+    int metasize, *lens = NULL, *displs = NULL;
+    char *sendbuf = NULL, *recvbuf = NULL, *paths = NULL;
+    size_t off, datasize = 0, maxentrysize = 0;
+    MPI_Offset sizes[3], *allsizes = NULL;
+    NC_dw_metadataentry *entryp;
+    NC_dw_metadataptr *ip;
+    NC_dw_sharedfile *srcs = NULL;
+    NC_dw_put_req *req;
+    NC_dw_bufferedfile *f = ncdwp->datalog_fd;
+
+    MPI_Comm_rank(ncdwp->nodecomm, &noderank);
+    MPI_Comm_size(ncdwp->nodecomm, &nodesize);
+
+    /* The data log file must hold all data before the leader reads it
+     * Seeking to current position writes out the buffer of the data log
+     */
+    status = ncdwio_bufferedfile_seek(f, f->pos, SEEK_SET);
+
+    /* Metadata of valid entries, canceled entries are left out */
+    metasize = 0;
+    for (i = 0; i < ncdwp->metaidx.nused; i++){
+        ip = ncdwp->metaidx.entries + i;
+        if (ip->valid){
+            entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + (size_t)ip->ptr);
+            metasize += entryp->esize;
+        }
+    }
+    if (metasize > 0){
+        sendbuf = (char*)NCI_Malloc(metasize);
+        if (sendbuf == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        off = 0;
+        for (i = 0; i < ncdwp->metaidx.nused; i++){
+            ip = ncdwp->metaidx.entries + i;
+            if (ip->valid){
+                entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + (size_t)ip->ptr);
+                memcpy(sendbuf + off, entryp, entryp->esize);
+                off += entryp->esize;
+            }
+        }
+    }
+
+    /* Gather metadata size, data size, and largest entry of each process */
+    sizes[0] = metasize;
+    sizes[1] = ncdwp->datasize;
+    sizes[2] = ncdwp->maxentrysize;
+    if (noderank == 0){
+        allsizes = (MPI_Offset*)NCI_Malloc(nodesize * 3 * SIZEOF_MPI_OFFSET);
+        lens = (int*)NCI_Malloc(nodesize * 2 * SIZEOF_INT);
+        displs = lens + nodesize;
+    }
+    err = MPI_Gather(sizes, 3, MPI_OFFSET, allsizes, 3, MPI_OFFSET, 0,
+                     ncdwp->nodecomm);
+    if (err != MPI_SUCCESS){
+        DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Gather"));
+    }
+    if (noderank == 0){
+        metasize = 0;
+        for (k = 0; k < nodesize; k++){
+            lens[k] = (int)allsizes[k * 3];
+            displs[k] = metasize;
+            metasize += lens[k];
+            datasize += allsizes[k * 3 + 1];
+            if (maxentrysize < (size_t)allsizes[k * 3 + 2]){
+                maxentrysize = (size_t)allsizes[k * 3 + 2];
+            }
+        }
+        recvbuf = (char*)NCI_Malloc(metasize + 1);
+    }
+    else{
+        metasize = 0;   // Nothing to replay
+    }
+    err = MPI_Gatherv(sendbuf, (int)sizes[0], MPI_BYTE, recvbuf, lens,
+                      displs, MPI_BYTE, 0, ncdwp->nodecomm);
+    if (err != MPI_SUCCESS){
+        DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Gatherv"));
+    }
+
+    /* Data logs of the node are in one shared file if logs are shared,
+     * otherwise the leader opens the data log of each process
+     */
+    shared = (ncdwp->logcomm != MPI_COMM_SELF);
+    if (!shared){
+        if (noderank == 0){
+            paths = (char*)NCI_Malloc((size_t)nodesize * PATH_MAX);
+        }
+        err = MPI_Gather(ncdwp->datalogpath, PATH_MAX, MPI_CHAR, paths,
+                         PATH_MAX, MPI_CHAR, 0, ncdwp->nodecomm);
+        if (err != MPI_SUCCESS){
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(err, "MPI_Gather"));
+        }
+    }
+
+    if (noderank == 0){
+        /* Tag the data offset with the process holding the data */
+        for (k = 0; k < nodesize; k++){
+            for (off = displs[k]; off < (size_t)(displs[k] + lens[k]); off += entryp->esize){
+                entryp = (NC_dw_metadataentry*)(recvbuf + off);
+                entryp->data_off |= ((MPI_Offset)k) << NC_DW_REPLAY_SRC_SHIFT;
+            }
+        }
+
+        /* Data log of each process on the node */
+        srcs = (NC_dw_sharedfile*)NCI_Malloc(nodesize * sizeof(NC_dw_sharedfile));
+        for (k = 0; k < nodesize; k++){
+            srcs[k] = *(f->fd);
+            if (shared){
+                srcs[k].chanel = k;
+            }
+            else if (k > 0){
+                // Entries are not written if their data can not be read
+                srcs[k].fd = open(paths + (size_t)k * PATH_MAX, O_RDONLY);
+                if (srcs[k].fd < 0){
+                    err = ncmpii_error_posix2nc("open");
+                    if (status == NC_NOERR){
+                        DEBUG_ASSIGN_ERROR(status, err);
+                    }
+                }
+            }
+        }
+    }
+
+    err = log_replay_merged(ncdwp, recvbuf, (size_t)metasize, srcs, datasize,
+                            maxentrysize);
+
+    /* Result of the replay of the node */
+    MPI_Bcast(&err, 1, MPI_INT, 0, ncdwp->nodecomm);
+    if (status == NC_NOERR){
+        status = err;
+    }
+
+    /* Pending requests complete with the replay of the node */
+    for (i = 0; i < ncdwp->metaidx.nused; i++){
+        ip = ncdwp->metaidx.entries + i;
+        if (ip->valid && ip->reqid >= 0){
+            req = ncdwp->putlist.reqs + ip->reqid;
+            req->status = err;
+            req->ready = 1;
+        }
+    }
+
+    if (noderank == 0){
+        for (k = 1; k < nodesize && !shared; k++){
+            if (srcs[k].fd >= 0){
+                close(srcs[k].fd);
+            }
+        }
+        NCI_Free(srcs);
+        NCI_Free(recvbuf);
+        NCI_Free(lens);
+        NCI_Free(allsizes);
+        if (paths != NULL){
+            NCI_Free(paths);
+        }
+    }
+    if (sendbuf != NULL){
+        NCI_Free(sendbuf);
+    }
+
+    return status;
+}
+
+#ifdef ENABLE_DW_ASYNC_FLUSH
+/* Background replay of a snapshot of the log */
+typedef struct NC_dw_drain {
+    NC_dw *ncdwp;
+    NC_dw_replay replay;
+    NC_dw_sharedfile fd;    // Private copy of the data log file handle
+    pthread_t thread;
+    int threaded;           // If the replay runs in a thread
+    int status;
+} NC_dw_drain;
+
+static void *drain_thread(void *arg) {
+    NC_dw_drain *dp = (NC_dw_drain*)arg;
+
+    dp->status = log_replay(dp->ncdwp, &(dp->replay));
+
+    return NULL;
+}
+#endif
+
+/*
+ * Start replaying the log in the background
+ * Must be called collectively, every process drains the same number of times
+ * so the collective operations of the replay match across processes
+ * Pending put requests complete with the replay, errors of the replay are
+ * reported by the next call to drain or flush
+ * The log data is left in place until the replay is joined
+ * IN    ncdwp:    log structure
+ */
+int ncdwio_log_drain(NC_dw *ncdwp) {
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    int i, err, status;
+    size_t tailsize;
+    NC_dw_drain *dp;
+    NC_dw_bufferedfile *f = ncdwp->datalog_fd;
+    NC_dw_put_list *lp = &(ncdwp->putlist);
+
+    /* Wait for the previous replay */
+    ncdwio_log_join(ncdwp);
+    status = ncdwp->drain_status;
+    ncdwp->drain_status = NC_NOERR;
+
+    /* The snapshot reads the data log, wait for the background writer */
+    err = ncdwio_bufferedfile_sync(f);
+    if (status == NC_NOERR){
+        status = err;
+    }
+
+    dp = (NC_dw_drain*)NCI_Malloc(sizeof(NC_dw_drain));
+    if (dp == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+
+    /* Snapshot of the log, the main thread keeps appending to it */
+    dp->ncdwp = ncdwp;
+    dp->replay.metadata = (char*)NCI_Malloc(ncdwp->metadata.nused);
+    memcpy(dp->replay.metadata, ncdwp->metadata.buffer, ncdwp->metadata.nused);
+    dp->replay.nentries = ncdwp->metaidx.nused;
+    dp->replay.entries = NULL;
+    if (dp->replay.nentries > 0){
+        dp->replay.entries = (NC_dw_metadataptr*)NCI_Malloc(dp->replay.nentries * sizeof(NC_dw_metadataptr));
+        memcpy(dp->replay.entries, ncdwp->metaidx.entries, dp->replay.nentries * sizeof(NC_dw_metadataptr));
+    }
+    dp->fd = *(f->fd);
+    dp->replay.fd = &(dp->fd);
+    dp->replay.srcs = NULL;
+    dp->replay.tail = NULL;
+    dp->replay.tailoff = ncdwp->datalogsize;
+    dp->replay.tailsize = 0;
+    if (f->buffer != NULL && f->bused > f->bunused){
+        tailsize = f->bused - f->bunused;
+        dp->replay.tail = (char*)NCI_Malloc(tailsize);
+        memcpy(dp->replay.tail, f->buffer + f->bunused, tailsize);
+        dp->replay.tailsize = tailsize;
+        dp->replay.tailoff = f->pos - tailsize;
+    }
+    dp->replay.buffersize = replay_buffer_size(ncdwp, ncdwp->datasize,
+                                               ncdwp->maxentrysize);
+    dp->replay.isindep = 0;
+    dp->replay.nodeaggr = 0;
+    dp->replay.setstat = 0; // The put list is not thread safe
+    dp->replay.comm = ncdwp->drain_comm;
+    dp->status = NC_NOERR;
+
+    /* Requests in the snapshot complete with the replay */
+    for (i = 0; i < lp->nalloc; i++){
+        if (lp->reqs[i].valid && !lp->reqs[i].ready){
+            lp->reqs[i].ready = 1;
+            lp->reqs[i].status = NC_NOERR;
+        }
+    }
+
+    /* Replay in place if the thread can not be created, other processes
+     * are still matched as the replay uses the same communicators
+     */
+    err = pthread_create(&(dp->thread), NULL, drain_thread, dp);
+    dp->threaded = (err == 0);
+    if (!dp->threaded){
+        drain_thread(dp);
+    }
+
+    ncdwp->drain = dp;
+
+    return status;
+#else
+    return NC_NOERR;
+#endif
+}
+
+/*
+ * Wait for the background replay to finish
+ * Replayed entries are released, the log is reset if nothing is appended
+ * during the replay
+ * Error of the replay is kept in drain_status
+ * IN    ncdwp:    log structure
+ */
+void ncdwio_log_join(NC_dw *ncdwp) {
+#ifdef ENABLE_DW_ASYNC_FLUSH
+    int err;
+    NC_dw_drain *dp = (NC_dw_drain*)ncdwp->drain;
+
+    if (dp == NULL){
+        return;
+    }
+
+    if (dp->threaded){
+        pthread_join(dp->thread, NULL);
+    }
+    ncdwp->drain = NULL;
+    if (ncdwp->drain_status == NC_NOERR){
+        ncdwp->drain_status = dp->status;
+    }
+
+    /* Replayed entries are now in the CDF file, their space is reused */
+    err = ncdwio_log_release(ncdwp, dp->replay.nentries);
+    if (err != NC_NOERR && ncdwp->drain_status == NC_NOERR){
+        ncdwp->drain_status = err;
+    }
+
+    NCI_Free(dp->replay.metadata);
+    if (dp->replay.entries != NULL){
+        NCI_Free(dp->replay.entries);
+    }
+    if (dp->replay.tail != NULL){
+        NCI_Free(dp->replay.tail);
+    }
+    NCI_Free(dp);
+#endif
+}
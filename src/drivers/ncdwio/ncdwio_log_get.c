@@ -0,0 +1,439 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnc_debug.h>
+#include <common.h>
+#include <pnetcdf.h>
+#include <ncdwio_driver.h>
+
+/*
+ * Match a read region against a log entry along one dimension
+ * IN    rstart, rcount, rstride:    read region along the dimension
+ * IN    estart, ecount, estride:    entry region along the dimension
+ * OUT   ridx:    index of matched elements within the read region
+ * OUT   eidx:    index of matched elements within the entry
+ * Return the number of matched elements
+ */
+static MPI_Offset
+match_dim(MPI_Offset rstart, MPI_Offset rcount, MPI_Offset rstride,
+          MPI_Offset estart, MPI_Offset ecount, MPI_Offset estride,
+          MPI_Offset *ridx, MPI_Offset *eidx)
+{
+    MPI_Offset i, x, lo, hi, n = 0;
+
+    if (rcount == 0 || ecount == 0) return 0;
+
+    /* Skip the entry if the intervals do not overlap */
+    lo = estart;
+    hi = estart + (ecount - 1) * estride;
+    if (rstart > hi || rstart + (rcount - 1) * rstride < lo) return 0;
+
+    for (i = 0; i < rcount; i++) {
+        x = rstart + i * rstride;
+        if (x < lo) continue;
+        if (x > hi) break;
+        if ((x - estart) % estride) continue;
+        ridx[n] = i;
+        eidx[n++] = (x - estart) / estride;
+    }
+
+    return n;
+}
+
+/*
+ * Match a read region against a subarray written by a log entry
+ * IN    ndims:    number of dimensions of the variable
+ * IN    start, count, stride:    read region
+ * IN    estart, ecount, estride:    subarray of the log entry, estride is
+ *                                   NULL or 0 for vara entries
+ * OUT   nmatch:    number of matched elements along each dimension
+ * OUT   ridx, eidx:    matched elements along each dimension, see match_dim
+ * Return 1 if the subarray overlaps the read region, 0 otherwise
+ */
+static int
+match_entry(int ndims, const MPI_Offset *start, const MPI_Offset *count,
+            const MPI_Offset *stride, const MPI_Offset *estart,
+            const MPI_Offset *ecount, const MPI_Offset *estride,
+            MPI_Offset *nmatch, MPI_Offset **ridx, MPI_Offset **eidx)
+{
+    int i;
+
+    for (i = 0; i < ndims; i++) {
+        nmatch[i] = match_dim(start[i], count[i],
+                              (stride == NULL) ? 1 : stride[i], estart[i],
+                              ecount[i], (estride == NULL || estride[i] == 0) ?
+                              1 : estride[i], ridx[i], eidx[i]);
+        if (nmatch[i] == 0) return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Copy matched elements of a log entry to the read buffer
+ * Matched elements along the last dimension that are consecutive in both the
+ * read region and the entry are copied as one run
+ * IN    ndims:    number of dimensions of the variable
+ * IN    count:    count of the read region
+ * IN    ecount:    count of the subarray of the log entry
+ * IN    nmatch, ridx, eidx:    matched elements, see match_entry
+ * IN    elsize:    element size in byte
+ * IN    ebuf:    data of the log entry, NULL to only mark the coverage
+ * OUT   buf:    read buffer
+ * INOUT covered:    bitmap of read elements covered by log entries
+ * Return the number of newly covered elements
+ */
+static MPI_Offset
+overlay_entry(int ndims, const MPI_Offset *count, const MPI_Offset *ecount,
+              const MPI_Offset *nmatch, MPI_Offset **ridx, MPI_Offset **eidx,
+              int elsize, const char *ebuf, char *buf, unsigned char *covered)
+{
+    int i, last = ndims - 1;
+    MPI_Offset j, k, run, roff, eoff, ncovered = 0, *pos;
+
+    /* A scalar has one element */
+    if (ndims == 0) {
+        if (ebuf != NULL) {
+            memcpy(buf, ebuf, elsize);
+        }
+        if (covered[0] & 1) return 0;
+        covered[0] |= 1;
+        return 1;
+    }
+
+    pos = (MPI_Offset*)NCI_Calloc(ndims + 1, SIZEOF_MPI_OFFSET);
+
+    for (;;) {
+        /* Offset of the row along the last dimension in the read region and
+         * in the entry
+         */
+        roff = eoff = 0;
+        for (i = 0; i < last; i++) {
+            roff = roff * count[i] + ridx[i][pos[i]];
+            eoff = eoff * ecount[i] + eidx[i][pos[i]];
+        }
+        roff *= count[last];
+        eoff *= ecount[last];
+
+        for (j = 0; j < nmatch[last]; j += run) {
+            for (run = 1; j + run < nmatch[last] &&
+                 ridx[last][j + run] == ridx[last][j] + run &&
+                 eidx[last][j + run] == eidx[last][j] + run; run++);
+
+            for (k = roff + ridx[last][j]; k < roff + ridx[last][j] + run; k++) {
+                if (!(covered[k / 8] & (1 << (k % 8)))) {
+                    covered[k / 8] |= (unsigned char)(1 << (k % 8));
+                    ncovered++;
+                }
+            }
+            if (ebuf != NULL) {
+                memcpy(buf + (roff + ridx[last][j]) * elsize,
+                       ebuf + (eoff + eidx[last][j]) * elsize, run * elsize);
+            }
+        }
+
+        /* Move to the next row */
+        for (i = last - 1; i >= 0; i--) {
+            if (++pos[i] < nmatch[i]) break;
+            pos[i] = 0;
+        }
+        if (i < 0) break;
+    }
+
+    NCI_Free(pos);
+
+    return ncovered;
+}
+
+/*
+ * Read the data of a log entry from the data log
+ * Compressed data is read to a temporary buffer and decompressed
+ * IN    ncdwp:    log structure
+ * IN    entryp:    the entry
+ * OUT   ebuf:    data of the entry, data_len bytes
+ */
+static int
+read_entry_data(NC_dw *ncdwp, NC_dw_metadataentry *entryp, char *ebuf)
+{
+    int err;
+    char *zbuf;
+
+    if (entryp->codec == NC_LOG_CODEC_NONE) {
+        return ncdwio_bufferedfile_pread(ncdwp->datalog_fd, ebuf,
+                                         entryp->data_len, entryp->data_off);
+    }
+
+    /* Compressed data followed by the work space of the codec */
+    zbuf = (char*)NCI_Malloc(entryp->zdata_len + entryp->data_len);
+    if (zbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM);
+
+    err = ncdwio_bufferedfile_pread(ncdwp->datalog_fd, zbuf,
+                                    entryp->zdata_len, entryp->data_off);
+    if (err == NC_NOERR) {
+        err = ncdwio_codec_decode(entryp->codec, entryp->codec_elsize, zbuf,
+                                  entryp->zdata_len, ebuf, entryp->data_len,
+                                  zbuf + entryp->zdata_len);
+    }
+    NCI_Free(zbuf);
+
+    return err;
+}
+
+/*
+ * Read a subarray of a variable, serving the part written to the log by this
+ * process from the data log instead of flushing the log
+ * Arguments are the same as get_var of the driver
+ *
+ * Log entries of the variable are looked up in the per variable index, sorted
+ * by the start of the entries along the first dimension
+ * If the read is fully covered by pending log entries, it is served from the
+ * data log
+ * In independent mode, a partially covered read is served from the file and
+ * then log data is copied over in the order entries were logged
+ * Otherwise, we fall back to flushing the log before the read
+ * Log data is kept in the type of user buffer at the time of put, so log
+ * entries are only used when both the log entry and the read buffer are of
+ * the native type of the variable, no type conversion is done here
+ * In collective mode, the decision is made collectively so all processes
+ * either flush or not
+ */
+int ncdwio_log_get_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
+                       const MPI_Offset count[], const MPI_Offset stride[],
+                       const MPI_Offset imap[], void *buf, MPI_Offset bufcount,
+                       MPI_Datatype buftype, int reqMode)
+{
+    int i, j, err, status = NC_NOERR, ndims, elsize = 0, noverlap = 0;
+    int typematch, usable, pending = 0, inrange = 1, flags[2], *overlap = NULL;
+    int matched, nfound;
+    char *ebuf;
+    unsigned char *covered = NULL;
+    nc_type xtype;
+    MPI_Offset nelems = 1, ncovered = 0, nrecs;
+    MPI_Offset *nmatch = NULL, **ridx = NULL, **eidx = NULL;
+    MPI_Offset r, nranges, rsize, eoff, rlo, rhi, *estart, *ecount, *estride;
+    MPI_Datatype etype;
+    NC_dw_varindex *vp;
+    NC_dw_metadataentry *entryp;
+    NC_dw_metadataheader *headerp;
+
+    /* Variable information is cached when the file enters data mode */
+    if (varid < 0 || varid >= ncdwp->nvarinfo) DEBUG_RETURN_ERROR(NC_ENOTVAR)
+    xtype = ncdwp->varinfo[varid].xtype;
+    ndims = ncdwp->varinfo[varid].ndims;
+
+    for (i = 0; i < ndims; i++) {
+        nelems *= count[i];
+    }
+
+    /* Only high-level APIs reading in the native type are served from log */
+    typematch = (imap == NULL && bufcount == -1 &&
+                 buftype == ncmpii_nc2mpitype(xtype));
+    usable = typematch;
+
+    vp = (varid < ncdwp->nvarentries) ? ncdwp->varentries + varid : NULL;
+    if (!typematch && nelems > 0 && vp != NULL && vp->nused > 0) {
+        /* Assume the read overlaps the pending entries of the variable */
+        pending = 1;
+    }
+    else if (nelems > 0 && vp != NULL && vp->nused > 0) {
+        MPI_Offset total = 0;
+
+        MPI_Type_size(buftype, &elsize);
+
+        /* Space for matched elements along each dimension */
+        for (i = 0; i < ndims; i++) {
+            total += count[i];
+        }
+        nmatch = (MPI_Offset*)NCI_Malloc((ndims + 1) * SIZEOF_MPI_OFFSET);
+        ridx = (MPI_Offset**)NCI_Malloc((ndims + 1) * 2 * sizeof(MPI_Offset*));
+        if (ridx != NULL) {
+            ridx[0] = (MPI_Offset*)NCI_Malloc((total + 1) * 2 * SIZEOF_MPI_OFFSET);
+        }
+        covered = (unsigned char*)NCI_Calloc(nelems / 8 + 1, 1);
+        overlap = (int*)NCI_Malloc(vp->nused * SIZEOF_INT);
+
+        if (nmatch == NULL || ridx == NULL || ridx[0] == NULL ||
+            covered == NULL || overlap == NULL) {
+            DEBUG_ASSIGN_ERROR(status, NC_ENOMEM);
+            if (ncdwp->isindep) {
+                goto fn_exit;
+            }
+            /* Processes in collective mode still join the collective calls
+             * below, the log is not used
+             */
+            usable = 0;
+            nfound = 0;
+        }
+        else {
+            eidx = ridx + ndims + 1;
+            eidx[0] = ridx[0] + total + 1;
+            for (i = 1; i < ndims; i++) {
+                ridx[i] = ridx[i - 1] + count[i - 1];
+                eidx[i] = eidx[i - 1] + count[i - 1];
+            }
+
+            /* Find pending entries overlapping the read region along the
+             * first dimension, then match them in all dimensions
+             */
+            rlo = rhi = 0;
+            if (ndims > 0) {
+                rlo = start[0];
+                rhi = start[0] + (count[0] - 1) * ((stride == NULL) ? 1 : stride[0]);
+            }
+            nfound = ncdwio_varindex_find(vp, rlo, rhi, overlap);
+        }
+        for (j = 0; j < nfound; j++) {
+            NC_dw_metadataptr *ip = ncdwp->metaidx.entries + overlap[j];
+
+            if (!ip->valid) continue; /* Canceled */
+
+            entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer +
+                     (size_t)ip->ptr);
+            nranges = ncdwio_log_entry_nranges(entryp);
+            matched = 0;
+            for (r = 0; r < nranges; r++) {
+                ncdwio_log_entry_range(entryp, r, &estart, &ecount, &estride);
+                if (!match_entry(ndims, start, count, stride, estart, ecount,
+                                 estride, nmatch, ridx, eidx)) continue;
+
+                if (!matched) {
+                    matched = pending = 1;
+                    err = logtype2mpitype(entryp->itype, &etype);
+                    if (err != NC_NOERR || etype != buftype) {
+                        /* Data in the log needs type conversion */
+                        usable = 0;
+                        break;
+                    }
+                    overlap[noverlap++] = overlap[j];
+                }
+
+                ncovered += overlay_entry(ndims, count, ecount, nmatch, ridx,
+                                          eidx, elsize, NULL, NULL, covered);
+            }
+            if (!usable) break;
+        }
+    }
+
+    /* Records not yet flushed are beyond the number of records in the file */
+    if (usable && noverlap > 0 && ncovered < nelems &&
+        ncdwp->varinfo[varid].isrec) {
+        ncdwio_log_join(ncdwp);
+        err = ncdwp->ncmpio_driver->inq_dim(ncdwp->ncp, ncdwp->recdimid,
+                                            NULL, &nrecs);
+        if (err == NC_NOERR && start[0] + (count[0] - 1) *
+            ((stride == NULL) ? 1 : stride[0]) >= nrecs) {
+            inrange = 0;
+        }
+    }
+
+    headerp = (NC_dw_metadataheader*)ncdwp->metadata.buffer;
+
+    /* flags[0]: read needs data from the file
+     * flags[1]: log needs to be flushed before reading the file
+     */
+    flags[0] = !(usable && ncovered == nelems);
+    if (ncdwp->isindep) {
+        flags[1] = flags[0] && pending && (!usable || !inrange);
+    }
+    else {
+        /* Data written by other processes may be in their logs, if any
+         * process reads from the file, all pending logs are flushed
+         */
+        flags[1] = headerp->num_entries > 0;
+        err = MPI_Allreduce(MPI_IN_PLACE, flags, 2, MPI_INT, MPI_MAX,
+                            ncdwp->comm);
+        if (err != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(err, "MPI_Allreduce");
+            DEBUG_ASSIGN_ERROR(status, err);
+            goto fn_exit;
+        }
+        flags[1] = flags[0] && flags[1];
+    }
+
+    if (flags[1]) {
+        /* Fall back to flush on read */
+        err = ncdwio_log_flush_all(ncdwp);
+        if (status == NC_NOERR) {
+            status = err;
+        }
+        noverlap = 0;
+    }
+
+    if (flags[0]) {
+        /* Entries replayed in the background are read from the file */
+        ncdwio_log_join(ncdwp);
+
+        err = ncdwp->ncmpio_driver->get_var(ncdwp->ncp, varid, start, count,
+                                            stride, imap, buf, bufcount,
+                                            buftype, reqMode);
+        if (status == NC_NOERR) {
+            status = err;
+        }
+    }
+
+    /* Copy log data over, later entries overwrite earlier ones */
+    for (j = 0; j < noverlap && status == NC_NOERR; j++) {
+        if (!ncdwp->metaidx.entries[overlap[j]].valid) {
+            continue;
+        }
+        entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer +
+                 (size_t)ncdwp->metaidx.entries[overlap[j]].ptr);
+
+        ebuf = (char*)NCI_Malloc(entryp->data_len);
+        if (ebuf == NULL) {
+            DEBUG_ASSIGN_ERROR(status, NC_ENOMEM);
+            break;
+        }
+        err = read_entry_data(ncdwp, entryp, ebuf);
+        if (err == NC_NOERR) {
+            /* Data of a subarray follows the data of the previous one */
+            eoff = 0;
+            nranges = ncdwio_log_entry_nranges(entryp);
+            for (r = 0; r < nranges; r++) {
+                ncdwio_log_entry_range(entryp, r, &estart, &ecount, &estride);
+                if (match_entry(ndims, start, count, stride, estart, ecount,
+                                estride, nmatch, ridx, eidx)) {
+                    overlay_entry(ndims, count, ecount, nmatch, ridx, eidx,
+                                  elsize, ebuf + eoff, (char*)buf, covered);
+                }
+                rsize = elsize;
+                for (i = 0; i < ndims; i++) {
+                    rsize *= ecount[i];
+                }
+                eoff += rsize;
+            }
+        }
+        else {
+            status = err;
+        }
+        NCI_Free(ebuf);
+    }
+
+fn_exit:
+    if (overlap != NULL) {
+        NCI_Free(overlap);
+    }
+    if (covered != NULL) {
+        NCI_Free(covered);
+    }
+    if (ridx != NULL) {
+        if (ridx[0] != NULL) {
+            NCI_Free(ridx[0]);
+        }
+        NCI_Free(ridx);
+    }
+    if (nmatch != NULL) {
+        NCI_Free(nmatch);
+    }
+
+    return status;
+}
@@ -25,175 +25,160 @@
 #include <pnetcdf.h>
 #include <ncdwio_driver.h>
 
+/* Entries smaller than this are not worth compressing */
+#define NC_DW_CODEC_MIN_SIZE 256
+
 /*
- * Prepare a single log entry to be write to log
- * Used by ncmpii_getput_varm
- * IN    ncdwp:    log structure to log this entry
- * IN    varp:    NC_var structure associate to this entry
- * IN    start: start in put_var* call
- * IN    count: count in put_var* call
- * IN    stride: stride in put_var* call
- * IN    bur:    buffer of data to write
- * IN    buftype:    buftype from upper layer
- * IN    packedsize:    size of buf in byte
+ * Convert from MPI type to log type
+ * Log spec has different enum of types than MPI
+ * IN    buftype:    MPI type of the buffer
+ * OUT   itype:    type used in the log
  */
-int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
-                       const MPI_Offset count[], const MPI_Offset stride[],
-                       void *buf, MPI_Datatype buftype, MPI_Offset *putsize){
-    int err, i, dim, elsize;
-    int itype;    /* Type used in log file */
-    int *dimids;
-    char *buffer;
-#ifdef PNETCDF_PROFILING
-    double t1, t2, t3, t4, t5;
-#endif
-    MPI_Offset esize, dataoff, recsize;
-    MPI_Offset *Start, *Count, *Stride;
-    MPI_Offset size;
-    NC_dw_metadataentry *entryp;
-    NC_dw_metadataheader *headerp;
-
-#ifdef PNETCDF_PROFILING
-    t1 = MPI_Wtime();
-#endif
-
-    /* Calculate data size */
-    /* Get ndims */
-    err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, &dim,
-                                        NULL, NULL, NULL, NULL, NULL);
-    if (err != NC_NOERR){
-        return err;
-    }
-
-    /* Calcalate submatrix size */
-    MPI_Type_size(buftype, &elsize);
-    size = (MPI_Offset)elsize;
-    for(i = 0; i < dim; i++){
-        size *= count[i];
-    }
-
-    /* Return size */
-    if (putsize != NULL){
-        *putsize = size;
-    }
-
-    /* Record largest entry size */
-    if (ncdwp->maxentrysize < size){
-        ncdwp->maxentrysize = size;
-    }
-
-    /* Update record dimension size if is record variable */
-    /* Get dimids */
-    dimids = NCI_Malloc(SIZEOF_INT * dim);
-    err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, NULL,
-                                        dimids, NULL, NULL, NULL, NULL);
-    if (err != NC_NOERR){
-        return err;
-    }
-    /* Update recdimsize if first dim is unlimited */
-    if (dim > 0 && dimids[0] == ncdwp->recdimid) {
-        /* Dim size after the put operation */
-        if (stride == NULL) {
-            recsize = start[0] + count[0];
-        }
-        else {
-            recsize = start[0] + (count[0] - 1) * stride[0] + 1;
-        }
-        if (recsize > ncdwp->recdimsize) {
-            ncdwp->recdimsize = recsize;
-        }
-    }
-    NCI_Free(dimids);
-
-    /* Convert to log types
-     * Log spec has different enum of types than MPI
-     */
+static int mpitype2logtype(MPI_Datatype buftype, int *itype) {
     if (buftype == MPI_CHAR) {   /* put_*_text */
-        itype = NC_LOG_TYPE_TEXT;
+        *itype = NC_LOG_TYPE_TEXT;
     }
     else if (buftype == MPI_SIGNED_CHAR) {    /* put_*_schar */
-        itype = NC_LOG_TYPE_SCHAR;
+        *itype = NC_LOG_TYPE_SCHAR;
     }
     else if (buftype == MPI_UNSIGNED_CHAR) {    /* put_*_uchar */
-        itype = NC_LOG_TYPE_UCHAR;
+        *itype = NC_LOG_TYPE_UCHAR;
     }
     else if (buftype == MPI_SHORT) { /* put_*_ushort */
-        itype = NC_LOG_TYPE_SHORT;
+        *itype = NC_LOG_TYPE_SHORT;
     }
     else if (buftype == MPI_UNSIGNED_SHORT) { /* put_*_ushort */
-        itype = NC_LOG_TYPE_USHORT;
+        *itype = NC_LOG_TYPE_USHORT;
     }
     else if (buftype == MPI_INT) { /* put_*_int */
-        itype = NC_LOG_TYPE_INT;
+        *itype = NC_LOG_TYPE_INT;
     }
     else if (buftype == MPI_UNSIGNED) { /* put_*_uint */
-        itype = NC_LOG_TYPE_UINT;
+        *itype = NC_LOG_TYPE_UINT;
     }
     else if (buftype == MPI_FLOAT) { /* put_*_float */
-        itype = NC_LOG_TYPE_FLOAT;
+        *itype = NC_LOG_TYPE_FLOAT;
     }
     else if (buftype == MPI_DOUBLE) { /* put_*_double */
-        itype = NC_LOG_TYPE_DOUBLE;
+        *itype = NC_LOG_TYPE_DOUBLE;
     }
     else if (buftype == MPI_LONG_LONG_INT) { /* put_*_longlong */
-        itype = NC_LOG_TYPE_LONGLONG;
+        *itype = NC_LOG_TYPE_LONGLONG;
     }
     else if (buftype == MPI_UNSIGNED_LONG_LONG) { /* put_*_ulonglong */
-        itype = NC_LOG_TYPE_ULONGLONG;
+        *itype = NC_LOG_TYPE_ULONGLONG;
     }
     else { /* Unrecognized type */
         DEBUG_RETURN_ERROR(NC_EINVAL);
     }
 
-    /* Prepare metadata entry header */
+    return NC_NOERR;
+}
+
+/*
+ * Allocate a log entry in the metadata buffer and fill up its header
+ * IN    ncdwp:    log structure to log this entry
+ * IN    varid:    variable written by the entry
+ * IN    api_kind:    api kind of the entry
+ * IN    buftype:    buftype from upper layer
+ * IN    esize:    size of the entry, including start, count, and stride
+ * IN    size:    size of data in byte
+ * OUT   entryp:    the entry allocated
+ */
+static int log_entry_alloc(NC_dw *ncdwp, int varid, int api_kind,
+                           MPI_Datatype buftype, MPI_Offset esize,
+                           MPI_Offset size, NC_dw_metadataentry **entryp){
+    int err;
+    NC_dw_varinfo *varp;
+
+    /* Variable information is cached when the file enters data mode */
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        DEBUG_RETURN_ERROR(NC_ENOTVAR);
+    }
+    varp = ncdwp->varinfo + varid;
+
+    /* Convert to log types
+     * A variable is usually written with the same buffer type, the type of
+     * the last put is cached
+     */
+    if (buftype != varp->buftype) {
+        err = mpitype2logtype(buftype, &(varp->itype));
+        if (err != NC_NOERR){
+            varp->buftype = MPI_DATATYPE_NULL;
+            return err;
+        }
+        MPI_Type_size(buftype, &(varp->elsize));
+        varp->buftype = buftype;
+    }
 
+    /* Record largest entry size */
+    if (ncdwp->maxentrysize < size){
+        ncdwp->maxentrysize = size;
+    }
+
+    /* Allocate space for metadata entry header */
+    *entryp = (NC_dw_metadataentry*)ncdwio_log_buffer_alloc(&(ncdwp->metadata), esize);
+    if (*entryp == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    (*entryp)->esize = esize; /* Entry size */
+    (*entryp)->api_kind = api_kind;
+    (*entryp)->itype = varp->itype; /* Variable type */
+    (*entryp)->varid = varid;  /* Variable id */
+    (*entryp)->ndims = varp->ndims;  /* Number of dimensions of the variable*/
+    /* The size of data in bytes. The size that will be write to data log */
+    (*entryp)->data_len = size;
     /* Find out the location of data in datalog
      * Which is current possition in data log
      * Datalog descriptor should always points to the end of file
      * Position must be recorded first before writing
      */
-    dataoff = (MPI_Offset)ncdwp->datalogsize;
+    (*entryp)->data_off = (MPI_Offset)ncdwp->datalogsize;
+    /* Data is stored as is unless it is compressed when committed */
+    (*entryp)->codec = NC_LOG_CODEC_NONE;
+    (*entryp)->codec_elsize = varp->elsize;
+    (*entryp)->zdata_len = size;
 
-    /* Size of metadata entry
-     * Include metadata entry header and variable size additional data
-     * (start, count, stride)
-     */
-    esize = sizeof(NC_dw_metadataentry) + dim * 3 * SIZEOF_MPI_OFFSET;
-    /* Allocate space for metadata entry header */
-    buffer = (char*)ncdwio_log_buffer_alloc(&(ncdwp->metadata), esize);
-    entryp = (NC_dw_metadataentry*)buffer;
-    entryp->esize = esize; /* Entry size */
-    entryp->itype = itype; /* Variable type */
-    entryp->varid = varid;  /* Variable id */
-    entryp->ndims = dim;  /* Number of dimensions of the variable*/
-    /* The size of data in bytes. The size that will be write to data log */
-	entryp->data_len = size;
-    entryp->data_off = dataoff;
+    return NC_NOERR;
+}
 
-    /* Determine the api kind of original call
-     * If stride is NULL, we log it as a vara call, otherwise, a vars call
-     * Upper layer translates var1 and var to vara  and vars
-     */
-    if (stride == NULL){
-        entryp->api_kind = NC_LOG_API_KIND_VARA;
-    }
-    else{
-        entryp->api_kind = NC_LOG_API_KIND_VARS;
-    }
+/*
+ * Write a log entry allocated by log_entry_alloc and its data to the log
+ * IN    ncdwp:    log structure to log this entry
+ * IN    entryp:    the entry, header, start, count, and stride filled up
+ * IN    buf:    data of the entry
+ */
+static int log_entry_commit(NC_dw *ncdwp, NC_dw_metadataentry *entryp,
+                            void *buf){
+    int err;
+    MPI_Offset esize = entryp->esize, size = entryp->data_len;
+    NC_dw_metadataheader *headerp;
+#ifdef PNETCDF_PROFILING
+    double t1, t2, t3, t4, t5;
 
-    /* Calculate location of start, count, stride in metadata buffer */
-    Start = (MPI_Offset*)(buffer + sizeof(NC_dw_metadataentry));
-    Count = Start + dim;
-    Stride = Count + dim;
+    t1 = MPI_Wtime();
+#endif
 
-    /* Fill up start, count, and stride */
-    memcpy(Start, start, dim * SIZEOF_MPI_OFFSET);
-    memcpy(Count, count, dim * SIZEOF_MPI_OFFSET);
-    if(stride != NULL){
-        memcpy(Stride, stride, dim * SIZEOF_MPI_OFFSET);
-    }
-    else{
-        memset(Stride, 0, dim * SIZEOF_MPI_OFFSET);
+    /* Compress the data, it is stored as is if it does not shrink
+     * The codec buffer holds the compressed data followed by the work space
+     */
+    if (ncdwp->codec != NC_LOG_CODEC_NONE && size >= NC_DW_CODEC_MIN_SIZE){
+        char *zbuf;
+        size_t zsize;
+
+        ncdwp->codecbuf.nused = 0;
+        zbuf = ncdwio_log_buffer_alloc(&(ncdwp->codecbuf), 2 * (size_t)size);
+        if (zbuf == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        zsize = ncdwio_codec_encode(ncdwp->codec, entryp->codec_elsize,
+                                    (char*)buf, size, zbuf, zbuf + size);
+        if (zsize > 0){
+            entryp->codec = ncdwp->codec;
+            entryp->zdata_len = zsize;
+            buf = zbuf;
+            size = zsize;
+        }
     }
 
     /* Increase number of entry
@@ -207,6 +192,7 @@ int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
 
     //We only increase datalogsize by amount actually write
     ncdwp->datalogsize += size;
+    ncdwp->datasize += entryp->data_len;
 
     /* Record data size */
     ncdwio_log_sizearray_append(&(ncdwp->entrydatasize), entryp->data_len);
@@ -217,6 +203,7 @@ int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
 
 #ifdef PNETCDF_PROFILING
     t2 = MPI_Wtime();
+    ncdwp->put_compress_time += t2 - t1;
 #endif
 
     /* Writing to data log
@@ -235,20 +222,14 @@ int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
     t3 = MPI_Wtime();
 #endif
 
-    /* Seek to the head of metadata
+    /* Write meta data log at the head of metadata
      * Note: EOF may not be the place for next entry after a flush
      * Note: metadata size will be updated after allocating metadata buffer
      *       space, substract esize for original location
+     * Positional write saves a seek per entry
      */
-
-    err = ncdwio_sharedfile_seek(ncdwp->metalog_fd, ncdwp->metadata.nused - esize,
-                           SEEK_SET);
-    if (err != NC_NOERR){
-        return err;
-    }
-
-    /* Write meta data log */
-    err = ncdwio_sharedfile_write(ncdwp->metalog_fd, buffer, esize);
+    err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, entryp, esize,
+                                   ncdwp->metadata.nused - esize);
     if (err != NC_NOERR){
         return err;
     }
@@ -271,12 +252,723 @@ int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
     ncdwp->put_data_wr_time += t3 - t2;
     ncdwp->put_meta_wr_time += t4 - t3;
     ncdwp->put_num_wr_time += t5 - t4;
-    ncdwp->total_time += t5 - t1;
-    ncdwp->put_time += t5 - t1;
 
-    ncdwp->total_data += size;
+    ncdwp->total_data += entryp->data_len;
+    ncdwp->total_zdata += size;
     ncdwp->total_meta += esize;
 #endif
 
     return NC_NOERR;
 }
+
+/*
+ * Prepare a single log entry to be write to log
+ * Used by ncmpii_getput_varm
+ * IN    ncdwp:    log structure to log this entry
+ * IN    varp:    NC_var structure associate to this entry
+ * IN    start: start in put_var* call
+ * IN    count: count in put_var* call
+ * IN    stride: stride in put_var* call
+ * IN    bur:    buffer of data to write
+ * IN    buftype:    buftype from upper layer
+ * IN    packedsize:    size of buf in byte
+ */
+int ncdwio_log_put_var(NC_dw *ncdwp, int varid, const MPI_Offset start[],
+                       const MPI_Offset count[], const MPI_Offset stride[],
+                       void *buf, MPI_Datatype buftype, MPI_Offset *putsize){
+    int err, i, dim, elsize;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+#endif
+    MPI_Offset esize, recsize;
+    MPI_Offset *Start, *Count, *Stride;
+    MPI_Offset size;
+    NC_dw_metadataentry *entryp;
+
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
+
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        DEBUG_RETURN_ERROR(NC_ENOTVAR);
+    }
+    dim = ncdwp->varinfo[varid].ndims;
+
+    /* Calcalate submatrix size */
+    MPI_Type_size(buftype, &elsize);
+    size = (MPI_Offset)elsize;
+    for(i = 0; i < dim; i++){
+        size *= count[i];
+    }
+
+    /* Return size */
+    if (putsize != NULL){
+        *putsize = size;
+    }
+
+    /* Update recdimsize if first dim is unlimited */
+    if (ncdwp->varinfo[varid].isrec) {
+        /* Dim size after the put operation */
+        if (stride == NULL) {
+            recsize = start[0] + count[0];
+        }
+        else {
+            recsize = start[0] + (count[0] - 1) * stride[0] + 1;
+        }
+        if (recsize > ncdwp->recdimsize) {
+            ncdwp->recdimsize = recsize;
+        }
+    }
+
+    /* Size of metadata entry
+     * Include metadata entry header and variable size additional data
+     * (start, count, stride)
+     * Determine the api kind of original call
+     * If stride is NULL, we log it as a vara call, otherwise, a vars call
+     * Upper layer translates var1 and var to vara  and vars
+     */
+    esize = sizeof(NC_dw_metadataentry) + dim * 3 * SIZEOF_MPI_OFFSET;
+    err = log_entry_alloc(ncdwp, varid, (stride == NULL) ?
+                          NC_LOG_API_KIND_VARA : NC_LOG_API_KIND_VARS,
+                          buftype, esize, size, &entryp);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+    /* Calculate location of start, count, stride in metadata buffer */
+    Start = (MPI_Offset*)(entryp + 1);
+    Count = Start + dim;
+    Stride = Count + dim;
+
+    /* Fill up start, count, and stride */
+    memcpy(Start, start, dim * SIZEOF_MPI_OFFSET);
+    memcpy(Count, count, dim * SIZEOF_MPI_OFFSET);
+    if(stride != NULL){
+        memcpy(Stride, stride, dim * SIZEOF_MPI_OFFSET);
+    }
+    else{
+        memset(Stride, 0, dim * SIZEOF_MPI_OFFSET);
+    }
+
+    err = log_entry_commit(ncdwp, entryp, buf);
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->total_time += t2 - t1;
+    ncdwp->put_time += t2 - t1;
+#endif
+
+    return err;
+}
+
+/*
+ * Log a varn call as a single log entry
+ * Subarrays with no element are not recorded
+ * IN    ncdwp:    log structure to log this entry
+ * IN    varid:    variable id
+ * IN    num:    number of subarrays
+ * IN    starts: starts in put_varn call
+ * IN    counts: counts in put_varn call, NULL means 1 element each
+ * IN    buf:    contiguous buffer of data to write
+ * IN    buftype:    MPI primitive type of buf
+ * OUT   putsize:    size of data logged in byte
+ */
+int ncdwio_log_put_varn(NC_dw *ncdwp, int varid, int num,
+                        MPI_Offset* const *starts, MPI_Offset* const *counts,
+                        void *buf, MPI_Datatype buftype, MPI_Offset *putsize){
+    int err, i, j, dim, elsize, nranges = 0;
+#ifdef PNETCDF_PROFILING
+    double t1, t2;
+#endif
+    MPI_Offset esize, recsize, rsize, size = 0;
+    MPI_Offset *Range;
+    NC_dw_metadataentry *entryp;
+
+#ifdef PNETCDF_PROFILING
+    t1 = MPI_Wtime();
+#endif
+
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        DEBUG_RETURN_ERROR(NC_ENOTVAR);
+    }
+    dim = ncdwp->varinfo[varid].ndims;
+
+    /* Size of data and number of subarrays to record */
+    MPI_Type_size(buftype, &elsize);
+    for(i = 0; i < num; i++){
+        rsize = (MPI_Offset)elsize;
+        if (counts != NULL){
+            for(j = 0; j < dim; j++){
+                rsize *= counts[i][j];
+            }
+        }
+        if (rsize > 0){
+            nranges++;
+            size += rsize;
+        }
+        /* Update recdimsize if first dim is unlimited */
+        if (rsize > 0 && ncdwp->varinfo[varid].isrec) {
+            recsize = starts[i][0] + ((counts == NULL) ? 1 : counts[i][0]);
+            if (recsize > ncdwp->recdimsize) {
+                ncdwp->recdimsize = recsize;
+            }
+        }
+    }
+
+    /* Return size */
+    if (putsize != NULL){
+        *putsize = size;
+    }
+
+    if (nranges == 0){
+        return NC_NOERR;
+    }
+
+    /* Size of metadata entry
+     * Include metadata entry header, number of subarrays, and start and
+     * count of each subarray
+     */
+    esize = sizeof(NC_dw_metadataentry) +
+            (1 + (MPI_Offset)nranges * dim * 2) * SIZEOF_MPI_OFFSET;
+    err = log_entry_alloc(ncdwp, varid, NC_LOG_API_KIND_VARN, buftype, esize,
+                          size, &entryp);
+    if (err != NC_NOERR){
+        return err;
+    }
+
+    /* Fill up number of subarrays, start, and count */
+    Range = (MPI_Offset*)(entryp + 1);
+    *(Range++) = nranges;
+    for(i = 0; i < num; i++){
+        if (counts != NULL){
+            for(j = 0; j < dim; j++){
+                if (counts[i][j] == 0){
+                    break;
+                }
+            }
+            if (j < dim){
+                continue;   // No element in this subarray
+            }
+            memcpy(Range + dim, counts[i], dim * SIZEOF_MPI_OFFSET);
+        }
+        else{
+            for(j = 0; j < dim; j++){
+                Range[dim + j] = 1;
+            }
+        }
+        memcpy(Range, starts[i], dim * SIZEOF_MPI_OFFSET);
+        Range += 2 * dim;
+    }
+
+    err = log_entry_commit(ncdwp, entryp, buf);
+
+#ifdef PNETCDF_PROFILING
+    t2 = MPI_Wtime();
+    ncdwp->total_time += t2 - t1;
+    ncdwp->put_time += t2 - t1;
+#endif
+
+    return err;
+}
+
+/* Contiguous byte segments of a filetype, in the order of its type map */
+typedef struct NC_dw_segments {
+    MPI_Offset *segs;   // Offset and length of each segment
+    size_t nused;
+    size_t nalloc;
+} NC_dw_segments;
+
+/*
+ * Append a byte segment, merging it with the last one if they are adjacent
+ */
+static int segments_append(NC_dw_segments *sp, MPI_Offset off,
+                           MPI_Offset len){
+    MPI_Offset *segs;
+
+    if (len == 0){
+        return NC_NOERR;
+    }
+    if (sp->nused > 0 && sp->segs[2 * sp->nused - 2] +
+        sp->segs[2 * sp->nused - 1] == off){
+        sp->segs[2 * sp->nused - 1] += len;
+        return NC_NOERR;
+    }
+    if (sp->nused == sp->nalloc){
+        sp->nalloc = (sp->nalloc == 0) ? 64 : sp->nalloc * 2;
+        segs = (MPI_Offset*)NCI_Realloc(sp->segs,
+                                        sp->nalloc * 2 * SIZEOF_MPI_OFFSET);
+        if (segs == NULL){
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        sp->segs = segs;
+    }
+    sp->segs[2 * sp->nused] = off;
+    sp->segs[2 * sp->nused + 1] = len;
+    sp->nused++;
+
+    return NC_NOERR;
+}
+
+static int type_flatten(MPI_Datatype type, MPI_Offset disp,
+                        NC_dw_segments *sp);
+
+/*
+ * Flatten n copies of a datatype placed stride bytes apart
+ */
+static int type_flatten_block(MPI_Datatype type, MPI_Offset disp,
+                              MPI_Offset n, MPI_Offset stride,
+                              NC_dw_segments *sp){
+    int err, size;
+    MPI_Offset k;
+    MPI_Aint lb, extent;
+
+    /* Copies of a contiguous type next to each other are one segment */
+    MPI_Type_size(type, &size);
+    MPI_Type_get_true_extent(type, &lb, &extent);
+    if (size == extent && size == stride){
+        return segments_append(sp, disp + lb, n * size);
+    }
+
+    for (k = 0; k < n; k++){
+        err = type_flatten(type, disp + k * stride, sp);
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
+    return NC_NOERR;
+}
+
+/*
+ * Flatten a datatype into contiguous byte segments
+ * Datatypes are decoded with MPI_Type_get_contents, datatypes built by
+ * constructors not handled here return NC_ENOTSUPPORT
+ * IN    type:    datatype to flatten
+ * IN    disp:    displacement of the datatype in byte
+ * INOUT sp:    segments, the segments of type are appended
+ */
+static int type_flatten(MPI_Datatype type, MPI_Offset disp,
+                        NC_dw_segments *sp){
+    int i, k, err = NC_NOERR, size, ni, na, nd, combiner;
+    int *ints;
+    MPI_Aint lb, extent, tlb, textent, *aints;
+    MPI_Datatype *types;
+
+    MPI_Type_size(type, &size);
+    if (size < 0){
+        DEBUG_RETURN_ERROR(NC_EINTOVERFLOW);
+    }
+    if (size == 0){
+        return NC_NOERR;
+    }
+
+    /* A datatype without hole is a single segment */
+    MPI_Type_get_true_extent(type, &tlb, &textent);
+    if (size == textent){
+        return segments_append(sp, disp + tlb, size);
+    }
+
+    MPI_Type_get_envelope(type, &ni, &na, &nd, &combiner);
+    if (combiner == MPI_COMBINER_NAMED){
+        DEBUG_RETURN_ERROR(NC_ENOTSUPPORT);
+    }
+
+    ints = (int*)NCI_Malloc((ni + 1) * SIZEOF_INT);
+    aints = (MPI_Aint*)NCI_Malloc((na + 1) * sizeof(MPI_Aint));
+    types = (MPI_Datatype*)NCI_Malloc((nd + 1) * sizeof(MPI_Datatype));
+    MPI_Type_get_contents(type, ni, na, nd, ints, aints, types);
+
+    /* Displacements in the constructors are in the extent of the old type */
+    MPI_Type_get_extent(types[0], &lb, &extent);
+
+    switch (combiner){
+#ifdef HAVE_DECL_MPI_COMBINER_DUP
+        case MPI_COMBINER_DUP:
+#endif
+#ifdef HAVE_DECL_MPI_COMBINER_RESIZED
+        case MPI_COMBINER_RESIZED:
+#endif
+            err = type_flatten(types[0], disp, sp);
+            break;
+        case MPI_COMBINER_CONTIGUOUS:
+            err = type_flatten_block(types[0], disp, ints[0], extent, sp);
+            break;
+        case MPI_COMBINER_VECTOR:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                err = type_flatten_block(types[0], disp + (MPI_Offset)i *
+                                         ints[2] * extent, ints[1], extent,
+                                         sp);
+            }
+            break;
+        case MPI_COMBINER_HVECTOR:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                err = type_flatten_block(types[0], disp + (MPI_Offset)i *
+                                         aints[0], ints[1], extent, sp);
+            }
+            break;
+        case MPI_COMBINER_INDEXED:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                err = type_flatten_block(types[0], disp +
+                                         (MPI_Offset)ints[1 + ints[0] + i] *
+                                         extent, ints[1 + i], extent, sp);
+            }
+            break;
+        case MPI_COMBINER_HINDEXED:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                err = type_flatten_block(types[0], disp + aints[i],
+                                         ints[1 + i], extent, sp);
+            }
+            break;
+#ifdef HAVE_DECL_MPI_COMBINER_INDEXED_BLOCK
+        case MPI_COMBINER_INDEXED_BLOCK:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                err = type_flatten_block(types[0], disp +
+                                         (MPI_Offset)ints[2 + i] * extent,
+                                         ints[1], extent, sp);
+            }
+            break;
+#endif
+        case MPI_COMBINER_STRUCT:
+            for (i = 0; i < ints[0] && err == NC_NOERR; i++){
+                MPI_Type_get_extent(types[i], &lb, &extent);
+                err = type_flatten_block(types[i], disp + aints[i],
+                                         ints[1 + i], extent, sp);
+            }
+            break;
+#ifdef HAVE_DECL_MPI_COMBINER_SUBARRAY
+        case MPI_COMBINER_SUBARRAY: {
+            /* ints: ndims, sizes, subsizes, starts, order */
+            int ndims = ints[0], d, fast;
+            int *sizes = ints + 1, *subsizes = sizes + ndims;
+            int *starts = subsizes + ndims, *idx;
+            MPI_Offset off, *pitch;
+
+            for (d = 0; d < ndims; d++){
+                if (subsizes[d] == 0){
+                    break;
+                }
+            }
+            if (d < ndims){
+                break;  // No element
+            }
+
+            /* Element pitch of each dimension, fast is the dimension whose
+             * index varies the fastest in the type map
+             */
+            pitch = (MPI_Offset*)NCI_Malloc(ndims * SIZEOF_MPI_OFFSET);
+            idx = (int*)NCI_Calloc(ndims, SIZEOF_INT);
+            if (ints[1 + 3 * ndims] == MPI_ORDER_C){
+                fast = ndims - 1;
+                pitch[fast] = 1;
+                for (d = fast - 1; d >= 0; d--){
+                    pitch[d] = pitch[d + 1] * sizes[d + 1];
+                }
+            }
+            else{
+                fast = 0;
+                pitch[fast] = 1;
+                for (d = 1; d < ndims; d++){
+                    pitch[d] = pitch[d - 1] * sizes[d - 1];
+                }
+            }
+
+            /* One run of subsizes[fast] elements per index of the other
+             * dimensions
+             */
+            for (;;){
+                off = starts[fast] * pitch[fast];
+                for (d = 0; d < ndims; d++){
+                    if (d != fast){
+                        off += (starts[d] + idx[d]) * pitch[d];
+                    }
+                }
+                err = type_flatten_block(types[0], disp + off * extent,
+                                         subsizes[fast], extent, sp);
+                if (err != NC_NOERR){
+                    break;
+                }
+
+                /* Next index, dimensions next to fast vary faster */
+                if (fast == 0){
+                    for (d = 1; d < ndims; d++){
+                        if (++idx[d] < subsizes[d]) break;
+                        idx[d] = 0;
+                    }
+                    if (d == ndims) break;
+                }
+                else{
+                    for (d = fast - 1; d >= 0; d--){
+                        if (++idx[d] < subsizes[d]) break;
+                        idx[d] = 0;
+                    }
+                    if (d < 0) break;
+                }
+            }
+
+            NCI_Free(idx);
+            NCI_Free(pitch);
+            break;
+        }
+#endif
+        default:
+            DEBUG_ASSIGN_ERROR(err, NC_ENOTSUPPORT);
+            break;
+    }
+
+    /* Free the datatypes returned by MPI_Type_get_contents */
+    for (k = 0; k < nd; k++){
+        int ni2, na2, nd2, combiner2;
+
+        MPI_Type_get_envelope(types[k], &ni2, &na2, &nd2, &combiner2);
+        if (combiner2 != MPI_COMBINER_NAMED){
+            MPI_Type_free(types + k);
+        }
+    }
+    NCI_Free(types);
+    NCI_Free(aints);
+    NCI_Free(ints);
+
+    return err;
+}
+
+/*
+ * Log a vard call as a varn entry
+ * The filetype is flattened into byte segments relative to the beginning of
+ * the variable, which are then split into subarrays of the variable
+ * IN    ncdwp:    log structure to log this entry
+ * IN    varid:    variable id
+ * IN    filetype:    access layout to the variable in the file
+ * IN    buf:    buffer of data to write
+ * IN    bufcount:    number of buftype in buf
+ * IN    buftype:    data type of the buffer, MPI_DATATYPE_NULL means the
+ *                   buffer is in the element type of filetype
+ * Return NC_ENOTSUPPORT if the request is not logged, it must be written by
+ * the ncmpio driver, which also reports invalid requests
+ */
+int ncdwio_log_put_vard(NC_dw *ncdwp, int varid, MPI_Datatype filetype,
+                        void *buf, MPI_Offset bufcount, MPI_Datatype buftype){
+    int i, d, err, ndims, elsize, itype, iscontig = 1, *dimids = NULL;
+    MPI_Offset j, a, n, cnt, off, len, take, recsize = 0, varsize;
+    MPI_Offset fnelems, bnelems, nelems = 0, nboxes = 0, nalloc = 0;
+    MPI_Offset *boxes = NULL, *shape = NULL, *pitch, *idx, *box;
+    MPI_Offset **starts = NULL, **counts;
+    MPI_Datatype ftype, ptype;
+    void *cbuf = buf;
+    NC_dw_segments seg = {NULL, 0, 0};
+    NC_dw_varinfo *varp;
+
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        DEBUG_RETURN_ERROR(NC_ENOTVAR);
+    }
+    varp = ncdwp->varinfo + varid;
+    ndims = varp->ndims;
+
+    /* Zero-length request */
+    if (filetype == MPI_DATATYPE_NULL ||
+        (bufcount == 0 && buftype != MPI_DATATYPE_NULL)){
+        return NC_NOERR;
+    }
+
+    /* Element type of filetype must be the external type of the variable,
+     * the buffer must contain the same number of elements
+     */
+    err = ncmpii_dtype_decode(filetype, &ftype, &elsize, &fnelems, NULL, NULL);
+    if (err != NC_NOERR || ndims == 0 ||
+        ftype != ncmpii_nc2mpitype(varp->xtype)){
+        DEBUG_RETURN_ERROR(NC_ENOTSUPPORT);
+    }
+    if (fnelems == 0){
+        return NC_NOERR;
+    }
+    if (buftype == MPI_DATATYPE_NULL){
+        ptype = ftype;
+    }
+    else{
+        err = ncmpii_dtype_decode(buftype, &ptype, NULL, &bnelems, NULL,
+                                  &iscontig);
+        if (err != NC_NOERR || bnelems * bufcount != fnelems ||
+            (varp->xtype == NC_CHAR) != (ptype == MPI_CHAR)){
+            DEBUG_RETURN_ERROR(NC_ENOTSUPPORT);
+        }
+    }
+    if (mpitype2logtype(ptype, &itype) != NC_NOERR){
+        DEBUG_RETURN_ERROR(NC_ENOTSUPPORT);
+    }
+
+    /* Shape of the variable and number of elements after each dimension */
+    dimids = (int*)NCI_Malloc(ndims * SIZEOF_INT);
+    shape = (MPI_Offset*)NCI_Malloc(ndims * 3 * SIZEOF_MPI_OFFSET);
+    if (dimids == NULL || shape == NULL){
+        DEBUG_ASSIGN_ERROR(err, NC_ENOMEM);
+        goto fn_exit;
+    }
+    pitch = shape + ndims;
+    idx = pitch + ndims;
+    ncdwio_log_join(ncdwp); // The replay may be using the NC object
+    err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, NULL,
+                                        dimids, NULL, NULL, NULL, NULL);
+    for (d = 0; d < ndims && err == NC_NOERR; d++){
+        err = ncdwp->ncmpio_driver->inq_dim(ncdwp->ncp, dimids[d], NULL,
+                                            shape + d);
+    }
+    if (err != NC_NOERR){
+        goto fn_exit;
+    }
+    pitch[ndims - 1] = 1;
+    for (d = ndims - 2; d >= 0; d--){
+        pitch[d] = pitch[d + 1] * shape[d + 1];
+    }
+
+    /* Size of the variable, or of one record of a record variable, records
+     * of a record variable are recsize bytes apart
+     */
+    varsize = pitch[0] * elsize;
+    if (varp->isrec){
+        err = ncdwp->ncmpio_driver->inq_misc(ncdwp->ncp, NULL, NULL, NULL,
+                                             NULL, NULL, NULL, NULL, NULL,
+                                             &recsize, NULL, NULL, NULL, NULL,
+                                             NULL, NULL);
+        if (err != NC_NOERR){
+            goto fn_exit;
+        }
+    }
+    else{
+        varsize *= shape[0];
+    }
+
+    err = type_flatten(filetype, 0, &seg);
+    if (err != NC_NOERR){
+        DEBUG_ASSIGN_ERROR(err, NC_ENOTSUPPORT);
+        goto fn_exit;
+    }
+
+    /* Translate each segment into runs of consecutive elements of the
+     * variable and each run into subarrays
+     */
+    err = NC_ENOTSUPPORT;
+    for (j = 0; j < (MPI_Offset)seg.nused; j++){
+        off = seg.segs[2 * j];
+        len = seg.segs[2 * j + 1];
+        if (off < 0 || off % elsize != 0 || len % elsize != 0){
+            goto fn_exit;   // Not aligned to elements
+        }
+        while (len > 0){
+            if (varp->isrec){
+                if (recsize <= 0 || off % recsize >= varsize){
+                    goto fn_exit;   // Not in the variable
+                }
+                take = varsize - off % recsize;
+                if (take > len){
+                    take = len;
+                }
+                a = (off / recsize) * pitch[0] + (off % recsize) / elsize;
+            }
+            else{
+                if (off + len > varsize){
+                    goto fn_exit;   // Not in the variable
+                }
+                take = len;
+                a = off / elsize;
+            }
+            n = take / elsize;
+            nelems += n;
+            off += take;
+            len -= take;
+
+            /* Elements [a, a + n) as subarrays */
+            while (n > 0){
+                /* Index of element a */
+                cnt = a;
+                for (d = ndims - 1; d > 0; d--){
+                    idx[d] = cnt % shape[d];
+                    cnt /= shape[d];
+                }
+                idx[0] = cnt;
+
+                /* Take as many slices of the outermost dimension d as
+                 * possible, a must be at the beginning of a slice
+                 */
+                for (d = 0; d < ndims; d++){
+                    for (i = d + 1; i < ndims && idx[i] == 0; i++);
+                    if (i < ndims){
+                        continue;
+                    }
+                    cnt = n / pitch[d];
+                    if ((d > 0 || !varp->isrec) && cnt > shape[d] - idx[d]){
+                        cnt = shape[d] - idx[d];
+                    }
+                    if (cnt > 0){
+                        break;
+                    }
+                }
+
+                if (nboxes == nalloc){
+                    nalloc = (nalloc == 0) ? 64 : nalloc * 2;
+                    box = (MPI_Offset*)NCI_Realloc(boxes, nalloc * 2 * ndims *
+                                                   SIZEOF_MPI_OFFSET);
+                    if (box == NULL){
+                        DEBUG_ASSIGN_ERROR(err, NC_ENOMEM);
+                        goto fn_exit;
+                    }
+                    boxes = box;
+                }
+                box = boxes + nboxes * 2 * ndims;
+                for (i = 0; i < ndims; i++){
+                    box[i] = idx[i];
+                    box[ndims + i] = (i < d) ? 1 : shape[i];
+                }
+                box[ndims + d] = cnt;
+                nboxes++;
+
+                a += cnt * pitch[d];
+                n -= cnt * pitch[d];
+            }
+        }
+    }
+    if (nelems != fnelems || nboxes > INT_MAX){
+        goto fn_exit;
+    }
+
+    /* Pack the buffer if it is not contiguous */
+    if (!iscontig){
+        int position = 0, psize;
+        MPI_Offset bsize;
+
+        MPI_Type_size(ptype, &psize);
+        bsize = fnelems * psize;
+        if (bsize != (int)bsize){
+            goto fn_exit;
+        }
+        cbuf = NCI_Malloc(bsize);
+        if (cbuf == NULL){
+            DEBUG_ASSIGN_ERROR(err, NC_ENOMEM);
+            goto fn_exit;
+        }
+        MPI_Pack(buf, (int)bufcount, buftype, cbuf, (int)bsize, &position,
+                 MPI_COMM_SELF);
+    }
+
+    starts = (MPI_Offset**)NCI_Malloc(nboxes * 2 * sizeof(MPI_Offset*));
+    if (starts == NULL){
+        DEBUG_ASSIGN_ERROR(err, NC_ENOMEM);
+        goto fn_exit;
+    }
+    counts = starts + nboxes;
+    for (j = 0; j < nboxes; j++){
+        starts[j] = boxes + j * 2 * ndims;
+        counts[j] = starts[j] + ndims;
+    }
+
+    err = ncdwio_log_put_varn(ncdwp, varid, (int)nboxes, starts, counts, cbuf,
+                              ptype, NULL);
+
+fn_exit:
+    if (starts != NULL) NCI_Free(starts);
+    if (cbuf != buf) NCI_Free(cbuf);
+    if (boxes != NULL) NCI_Free(boxes);
+    if (seg.segs != NULL) NCI_Free(seg.segs);
+    if (shape != NULL) NCI_Free(shape);
+    if (dimids != NULL) NCI_Free(dimids);
+
+    return err;
+}
@@ -0,0 +1,466 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ */
+/* $Id$ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <sys/types.h>
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <pnc_debug.h>
+#include <common.h>
+#include <pnetcdf.h>
+#include <ncdwio_driver.h>
+
+/* Log files left by an aborted run, recovered by this process */
+typedef struct NC_dw_leftover {
+    char *metalogpath;
+    char datalogpath[PATH_MAX];
+    int metafd;
+    int datafd;
+    int nchanel;    // Number of processes that shared the log files
+} NC_dw_leftover;
+
+/* Entries of the recovered logs */
+typedef struct NC_dw_recovery {
+    NC_dw_buffer metadata;      // Entries to replay
+    NC_dw_sharedfile *srcs;     // Data log of each recovered channel
+    int nsrcs;
+    size_t datasize;            // Size of data of the entries before compression
+    size_t maxentrysize;        // Size of data of the largest entry
+    int nvars;
+    int *ndims;                 // Number of dimensions of each variable
+} NC_dw_recovery;
+
+/*
+ * Size of the part of a log file written by process <chanel> among
+ * <nchanel> processes sharing the file
+ */
+static size_t chanel_size(size_t fsize, int chanel, int nchanel, size_t bsize) {
+    size_t size, round, rest;
+
+    if (nchanel == 1){
+        return fsize;
+    }
+
+    round = (size_t)nchanel * bsize;
+    size = (fsize / round) * bsize;
+    rest = fsize % round;
+    if (rest > (size_t)chanel * bsize){
+        rest -= (size_t)chanel * bsize;
+        size += (rest < bsize) ? rest : bsize;
+    }
+
+    return size;
+}
+
+/*
+ * Read the metadata log header at <offset> and check if it is a log of the
+ * CDF file <basename> made on a machine of the same byte order
+ */
+static int header_match(int fd, off_t offset, char *basename) {
+    ssize_t ioret;
+    char path[PATH_MAX];
+    NC_dw_metadataheader header;
+
+    ioret = pread(fd, &header, sizeof(NC_dw_metadataheader), offset);
+    if (ioret != sizeof(NC_dw_metadataheader)){
+        return 0;
+    }
+    if (memcmp(header.magic, NC_LOG_MAGIC, NC_LOG_MAGIC_SIZE) != 0 ||
+        memcmp(header.format, NC_LOG_FORMAT_CDF_MAGIC, NC_LOG_FORMAT_SIZE) != 0){
+        return 0;
+    }
+#ifdef WORDS_BIGENDIAN
+    if (header.big_endian != NC_LOG_TRUE){
+        return 0;
+    }
+#else
+    if (header.big_endian != NC_LOG_FALSE){
+        return 0;
+    }
+#endif
+    if (header.basenamelen <= 0 || header.basenamelen >= PATH_MAX ||
+        header.basenamelen != (int)strlen(basename)){
+        return 0;
+    }
+    ioret = pread(fd, path, header.basenamelen,
+                  offset + offsetof(NC_dw_metadataheader, basename));
+    if (ioret != header.basenamelen){
+        return 0;
+    }
+
+    return memcmp(path, basename, header.basenamelen) == 0;
+}
+
+/*
+ * Find metadata logs of CDF file <basename> in directory <logbase>
+ * Log files are named <file name>_<ncid>_<rank>.meta and .data
+ * OUT   paths:    paths of the metadata logs, PATH_MAX bytes each
+ * Return the number of metadata logs found
+ */
+static int log_scan(char *logbase, char *basename, char **paths) {
+    int n = 0, nalloc = 0, fd, ncid, rank, len, end, ret;
+    char *fname, path[PATH_MAX], *buf;
+    DIR *logdir;
+    struct dirent *dp;
+    struct stat st;
+
+    *paths = NULL;
+
+    fname = strrchr(basename, '/') + 1;
+    len = strlen(fname);
+
+    logdir = opendir(logbase);
+    if (logdir == NULL){
+        return 0;
+    }
+    while ((dp = readdir(logdir)) != NULL){
+        if (strncmp(dp->d_name, fname, len) != 0){
+            continue;
+        }
+        end = 0;
+        if (sscanf(dp->d_name + len, "_%d_%d.meta%n", &ncid, &rank, &end) != 2 ||
+            end == 0 || dp->d_name[len + end] != '\0'){
+            continue;
+        }
+        ret = snprintf(path, PATH_MAX, "%s/%s", logbase, dp->d_name);
+        if (ret < 0 || ret >= PATH_MAX){ // Path too long, skip
+            continue;
+        }
+
+        // Data log must exist and the metadata log must be of this file
+        sprintf(path + strlen(path) - 5, ".data");
+        if (stat(path, &st) != 0){
+            continue;
+        }
+        sprintf(path + strlen(path) - 5, ".meta");
+        fd = open(path, O_RDONLY);
+        if (fd < 0){
+            continue;
+        }
+        if (!header_match(fd, 0, basename)){
+            close(fd);
+            continue;
+        }
+        close(fd);
+
+        if (n == nalloc){
+            nalloc = (nalloc == 0) ? 8 : nalloc * 2;
+            buf = (char*)NCI_Realloc(*paths, (size_t)nalloc * PATH_MAX);
+            if (buf == NULL){
+                break;
+            }
+            *paths = buf;
+        }
+        strcpy(*paths + (size_t)n * PATH_MAX, path);
+        n++;
+    }
+    closedir(logdir);
+
+    return n;
+}
+
+/*
+ * Check the metadata of an entry in <room> bytes of the metadata log
+ */
+static int entry_valid(NC_dw_recovery *rp, NC_dw_metadataentry *entryp,
+                       size_t room) {
+    int kind = entryp->api_kind & ~NC_LOG_API_KIND_CANCELED;
+
+    if (room < sizeof(NC_dw_metadataentry) ||
+        entryp->esize < (MPI_Offset)sizeof(NC_dw_metadataentry) ||
+        entryp->esize > (MPI_Offset)room){
+        return 0;
+    }
+    if (kind < NC_LOG_API_KIND_VAR || kind > NC_LOG_API_KIND_VARN ||
+        entryp->itype < NC_LOG_TYPE_TEXT || entryp->itype > NC_LOG_TYPE_NATIVE){
+        return 0;
+    }
+    if (entryp->varid < 0 || entryp->varid >= rp->nvars ||
+        entryp->ndims != rp->ndims[entryp->varid]){
+        return 0;
+    }
+    if (entryp->codec < NC_LOG_CODEC_NONE ||
+        entryp->codec > NC_LOG_CODEC_SHUFFLE_LZ ||
+        entryp->data_len < 0 || entryp->zdata_len < 0 || entryp->data_off < 8){
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Add the entries of one process in a log file to the entries to replay
+ * Entries whose data did not reach the data log before the run was aborted
+ * are dropped, so are entries of canceled requests
+ * IN    rp:    entries to replay
+ * IN    lp:    log files
+ * IN    chanel:    process in the log files
+ */
+static int log_load(NC_dw_recovery *rp, NC_dw_leftover *lp, int chanel) {
+    int err;
+    char *buf, *entries;
+    size_t off, len, metasize, datasize;
+    MPI_Offset i;
+    struct stat st;
+    NC_dw_sharedfile mf, *df;
+    NC_dw_metadataheader header;
+    NC_dw_metadataentry *entryp;
+
+    mf.fd = lp->metafd;
+    mf.chanel = chanel;
+    mf.nchanel = lp->nchanel;
+    mf.pos = 0;
+    mf.bsize = NC_LOG_SHARED_BSIZE;
+    mf.fsize = 0;
+
+    if (fstat(lp->metafd, &st) != 0){
+        err = ncmpii_error_posix2nc("fstat");
+        DEBUG_RETURN_ERROR(err);
+    }
+    metasize = chanel_size(st.st_size, chanel, lp->nchanel, mf.bsize);
+    if (fstat(lp->datafd, &st) != 0){
+        err = ncmpii_error_posix2nc("fstat");
+        DEBUG_RETURN_ERROR(err);
+    }
+    datasize = chanel_size(st.st_size, chanel, lp->nchanel, mf.bsize);
+
+    if (metasize < sizeof(NC_dw_metadataheader)){
+        DEBUG_RETURN_ERROR(NC_EBADLOG);
+    }
+    err = ncdwio_sharedfile_pread(&mf, &header, sizeof(NC_dw_metadataheader), 0);
+    if (err != NC_NOERR){
+        return err;
+    }
+    if (header.num_entries <= 0){
+        return NC_NOERR;    // Flushed or empty
+    }
+    if (header.entry_begin < (MPI_Offset)sizeof(NC_dw_metadataheader) ||
+        header.entry_begin >= (MPI_Offset)metasize){
+        DEBUG_RETURN_ERROR(NC_EBADLOG);
+    }
+
+    /* Read the entries */
+    buf = (char*)NCI_Malloc(metasize - header.entry_begin);
+    if (buf == NULL){
+        DEBUG_RETURN_ERROR(NC_ENOMEM);
+    }
+    err = ncdwio_sharedfile_pread(&mf, buf, metasize - header.entry_begin,
+                                  header.entry_begin);
+    if (err != NC_NOERR){
+        NCI_Free(buf);
+        return err;
+    }
+
+    /* Keep the entries whose data is in the data log, entries of canceled
+     * requests are packed out of the buffer
+     */
+    off = len = 0;
+    for (i = 0; i < header.num_entries; i++){
+        entryp = (NC_dw_metadataentry*)(buf + off);
+        if (!entry_valid(rp, entryp, metasize - header.entry_begin - off)){
+            DEBUG_ASSIGN_ERROR(err, NC_EBADLOG);
+            break;
+        }
+        if ((size_t)(entryp->data_off + entryp->zdata_len) > datasize){
+            break;  // Data is lost with the aborted run
+        }
+        off += entryp->esize;
+        if (entryp->api_kind & NC_LOG_API_KIND_CANCELED){
+            continue;
+        }
+        if (len < off - entryp->esize){
+            memmove(buf + len, entryp, entryp->esize);
+        }
+        len += ((NC_dw_metadataentry*)(buf + len))->esize;
+    }
+    if (len > 0){
+        entries = ncdwio_log_buffer_alloc(&(rp->metadata), len);
+        if (entries == NULL){
+            NCI_Free(buf);
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        memcpy(entries, buf, len);
+
+        /* Tag the data offset with the data log holding the data */
+        for (i = 0; i < (MPI_Offset)len; i += entryp->esize){
+            entryp = (NC_dw_metadataentry*)(entries + i);
+            entryp->data_off |= ((MPI_Offset)rp->nsrcs) << NC_DW_REPLAY_SRC_SHIFT;
+            rp->datasize += entryp->data_len;
+            if (rp->maxentrysize < (size_t)entryp->data_len){
+                rp->maxentrysize = entryp->data_len;
+            }
+        }
+
+        df = (NC_dw_sharedfile*)NCI_Realloc(rp->srcs, (rp->nsrcs + 1) * sizeof(NC_dw_sharedfile));
+        if (df == NULL){
+            NCI_Free(buf);
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        rp->srcs = df;
+        df = rp->srcs + rp->nsrcs++;
+        *df = mf;
+        df->fd = lp->datafd;
+    }
+    NCI_Free(buf);
+
+    return err;
+}
+
+/*
+ * Replay logs of the CDF file left by a run that did not close the file
+ * Process 0 looks for the logs in the log directory, the log files are
+ * distributed among the processes, and the entries are replayed
+ * collectively the same way the log is flushed
+ * The log files are deleted or marked as flushed afterward, according to
+ * hint nc_dw_del_on_close, logs are kept if the replay fails
+ * Must be called by all processes before the log files are created
+ * IN    ncdwp:    log structure
+ * IN    logbase:    absolute path of the log directory
+ * IN    basename:    absolute path of the CDF file
+ */
+int ncdwio_log_recover(NC_dw *ncdwp, char *logbase, char *basename) {
+    int i, k, err, status = NC_NOERR, rank, np, nfiles = 0, nmine = 0;
+    char *paths = NULL;
+    MPI_Offset zero = 0;
+    NC_dw_leftover *leftovers = NULL, *lp;
+    NC_dw_recovery recovery;
+    NC_dw_sharedfile mf;
+
+    MPI_Comm_rank(ncdwp->comm, &rank);
+    MPI_Comm_size(ncdwp->comm, &np);
+
+    if (rank == 0){
+        nfiles = log_scan(logbase, basename, &paths);
+    }
+    MPI_Bcast(&nfiles, 1, MPI_INT, 0, ncdwp->comm);
+    if (nfiles == 0){
+        return NC_NOERR;
+    }
+    if (rank > 0){
+        paths = (char*)NCI_Malloc((size_t)nfiles * PATH_MAX);
+    }
+    MPI_Bcast(paths, nfiles * PATH_MAX, MPI_CHAR, 0, ncdwp->comm);
+
+    /* Variables the entries can write */
+    recovery.srcs = NULL;
+    recovery.nsrcs = 0;
+    recovery.datasize = 0;
+    recovery.maxentrysize = 0;
+    err = ncdwio_log_buffer_init(&(recovery.metadata));
+    if (err != NC_NOERR){
+        return err;
+    }
+    err = ncdwp->ncmpio_driver->inq(ncdwp->ncp, NULL, &(recovery.nvars), NULL, NULL);
+    if (err != NC_NOERR){
+        return err;
+    }
+    recovery.ndims = (int*)NCI_Malloc((recovery.nvars + 1) * SIZEOF_INT);
+    for (i = 0; i < recovery.nvars; i++){
+        ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, i, NULL, NULL,
+                                      recovery.ndims + i, NULL, NULL, NULL,
+                                      NULL, NULL);
+    }
+
+    /* Process i recovers log files i, i + np, ... */
+    leftovers = (NC_dw_leftover*)NCI_Malloc((nfiles / np + 1) * sizeof(NC_dw_leftover));
+    for (i = rank; i < nfiles; i += np){
+        lp = leftovers + nmine++;
+        lp->metalogpath = paths + (size_t)i * PATH_MAX;
+        strcpy(lp->datalogpath, lp->metalogpath);
+        sprintf(lp->datalogpath + strlen(lp->datalogpath) - 5, ".data");
+        lp->datafd = -1;
+        lp->metafd = open(lp->metalogpath, O_RDWR);
+        if (lp->metafd >= 0){
+            lp->datafd = open(lp->datalogpath, O_RDONLY);
+        }
+        if (lp->metafd < 0 || lp->datafd < 0){
+            err = ncmpii_error_posix2nc("open");
+            if (status == NC_NOERR){
+                DEBUG_ASSIGN_ERROR(status, err);
+            }
+            continue;
+        }
+
+        /* Processes sharing the log files have their headers at the start
+         * of the first blocks
+         */
+        lp->nchanel = 1;
+        while (header_match(lp->metafd, (off_t)lp->nchanel * NC_LOG_SHARED_BSIZE,
+                            basename)){
+            lp->nchanel++;
+        }
+
+        for (k = 0; k < lp->nchanel; k++){
+            err = log_load(&recovery, lp, k);
+            if (status == NC_NOERR){
+                status = err;
+            }
+        }
+    }
+
+    /* Replay collectively, processes with nothing to recover join */
+    err = log_replay_merged(ncdwp, (char*)recovery.metadata.buffer,
+                            recovery.metadata.nused, recovery.srcs,
+                            recovery.datasize, recovery.maxentrysize);
+    if (status == NC_NOERR){
+        status = err;
+    }
+    err = MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, ncdwp->comm);
+    if (err != MPI_SUCCESS){
+        DEBUG_ASSIGN_ERROR(status, ncmpii_error_mpi2nc(err, "MPI_Allreduce"));
+    }
+
+    /* The recovered logs are no longer needed */
+    for (i = 0; i < nmine; i++){
+        lp = leftovers + i;
+        if (status == NC_NOERR){
+            if (ncdwp->hints & NC_LOG_HINT_DEL_ON_CLOSE){
+                unlink(lp->metalogpath);
+                unlink(lp->datalogpath);
+            }
+            else{
+                mf.fd = lp->metafd;
+                mf.nchanel = lp->nchanel;
+                mf.pos = 0;
+                mf.bsize = NC_LOG_SHARED_BSIZE;
+                mf.fsize = 0;
+                for (k = 0; k < lp->nchanel; k++){
+                    mf.chanel = k;
+                    ncdwio_sharedfile_pwrite(&mf, &zero, SIZEOF_MPI_OFFSET,
+                                             offsetof(NC_dw_metadataheader, num_entries));
+                }
+            }
+        }
+        if (lp->metafd >= 0){
+            close(lp->metafd);
+        }
+        if (lp->datafd >= 0){
+            close(lp->datafd);
+        }
+    }
+
+    /* New log files may take the names of the recovered ones */
+    MPI_Barrier(ncdwp->comm);
+
+    NCI_Free(leftovers);
+    NCI_Free(recovery.ndims);
+    ncdwio_log_buffer_free(&(recovery.metadata));
+    if (recovery.srcs != NULL){
+        NCI_Free(recovery.srcs);
+    }
+    NCI_Free(paths);
+
+    return status;
+}
@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <assert.h>
@@ -210,12 +211,59 @@ int ncdwio_metaidx_init(NC_dw *ncdwp) {
     ip->nused = 0;
     ip->entries = (NC_dw_metadataptr*)NCI_Malloc(sizeof(NC_dw_metadataptr) * ip->nalloc);
 
+    /* Per variable index is allocated when the variable is first written */
+    ncdwp->varentries = NULL;
+    ncdwp->nvarentries = 0;
+
     return NC_NOERR;
 }
 
+/*
+ * Range of the subarrays written by a log entry along the first dimension
+ * IN    entryp:    log entry
+ * OUT   lo, hi:    first and last index written, hi < lo if nothing is written
+ */
+static void entry_interval(NC_dw_metadataentry *entryp, MPI_Offset *lo,
+                           MPI_Offset *hi) {
+    int i;
+    MPI_Offset r, nranges, last, *start, *count, *stride;
+
+    *lo = 0;
+    *hi = (entryp->ndims > 0) ? -1 : 0;    // A scalar has one element
+
+    nranges = ncdwio_log_entry_nranges(entryp);
+    for (r = 0; r < nranges && entryp->ndims > 0; r++) {
+        ncdwio_log_entry_range(entryp, r, &start, &count, &stride);
+        for (i = 0; i < entryp->ndims; i++) {
+            if (count[i] == 0) {
+                break;
+            }
+        }
+        if (i < entryp->ndims) {
+            continue; // No element written
+        }
+
+        last = start[0] + (count[0] - 1) *
+               ((stride == NULL || stride[0] == 0) ? 1 : stride[0]);
+        if (*hi < *lo) {
+            *lo = start[0];
+            *hi = last;
+        }
+        else {
+            if (start[0] < *lo) *lo = start[0];
+            if (last > *hi) *hi = last;
+        }
+    }
+}
+
 int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *ptr) {
+    int i, j, varid;
     NC_dw_metadataidx *ip = &(ncdwp->metaidx);
     NC_dw_metadataptr *tmp;
+    NC_dw_metadataentry *entryp;
+    NC_dw_varindex *vp;
+    NC_dw_interval *iv;
+    MPI_Offset lo, hi;
 
     if (ip->nused == ip->nalloc) {
         ip->nalloc *= SIZE_MULTIPLIER;
@@ -225,16 +273,198 @@ int ncdwio_metaidx_add(NC_dw *ncdwp, NC_dw_metadataentry *ptr) {
 
     ip->entries[ip->nused].ptr = ptr;
     ip->entries[ip->nused].valid = 1;
-    ip->entries[ip->nused++].reqid = -1;
+    ip->entries[ip->nused].reqid = -1;
+
+    /* Record the entry in the index of its variable
+     * Entry address is relative to the metadata buffer
+     */
+    entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + (size_t)ptr);
+    varid = entryp->varid;
+    if (varid >= ncdwp->nvarentries) {
+        vp = (NC_dw_varindex*)NCI_Realloc(ncdwp->varentries,
+                                          sizeof(NC_dw_varindex) * (varid + 1));
+        if (vp == NULL) {
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        ncdwp->varentries = vp;
+        for (i = ncdwp->nvarentries; i <= varid; i++) {
+            vp = ncdwp->varentries + i;
+            vp->intervals = (NC_dw_interval*)NCI_Malloc(LOG_ARRAY_SIZE * sizeof(NC_dw_interval));
+            if (vp->intervals == NULL) {
+                DEBUG_RETURN_ERROR(NC_ENOMEM);
+            }
+            vp->nalloc = LOG_ARRAY_SIZE;
+            vp->nused = 0;
+            vp->maxlen = 0;
+            ncdwp->nvarentries++;
+        }
+    }
+
+    vp = ncdwp->varentries + varid;
+    if (vp->nused == vp->nalloc) {
+        iv = (NC_dw_interval*)NCI_Realloc(vp->intervals, vp->nalloc * SIZE_MULTIPLIER * sizeof(NC_dw_interval));
+        if (iv == NULL) {
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        vp->intervals = iv;
+        vp->nalloc *= SIZE_MULTIPLIER;
+    }
+
+    /* Keep the index sorted by start, entries of the same start stay in the
+     * order they are logged
+     * Entries are usually logged in increasing order, so they are appended
+     */
+    entry_interval(entryp, &lo, &hi);
+    for (j = vp->nused; j > 0 && vp->intervals[j - 1].lo > lo; j--);
+    memmove(vp->intervals + j + 1, vp->intervals + j,
+            (vp->nused - j) * sizeof(NC_dw_interval));
+    vp->intervals[j].lo = lo;
+    vp->intervals[j].hi = hi;
+    vp->intervals[j].entry = ip->nused++;
+    vp->nused++;
+    if (hi - lo > vp->maxlen) {
+        vp->maxlen = hi - lo;
+    }
 
     return NC_NOERR;
 }
 
+/*
+ * Find the log entries of a variable whose range along the first dimension
+ * intersects [lo, hi]
+ * Entries starting after hi are past the end of the search, entries starting
+ * before lo - maxlen end before lo
+ * IN    vp:    index of the variable
+ * IN    lo, hi:    first and last index of the search along the first dimension
+ * OUT   entries:    index of the entries in the metadata index, in the order
+ *                   they are logged, of size vp->nused
+ * Return the number of entries found
+ */
+int ncdwio_varindex_find(NC_dw_varindex *vp, MPI_Offset lo, MPI_Offset hi,
+                         int *entries) {
+    int i, j, l, r, n = 0, tmp;
+
+    /* First interval starting at lo - maxlen or later */
+    l = 0;
+    r = vp->nused;
+    while (l < r) {
+        i = (l + r) / 2;
+        if (vp->intervals[i].lo < lo - vp->maxlen) {
+            l = i + 1;
+        }
+        else {
+            r = i;
+        }
+    }
+
+    for (i = l; i < vp->nused && vp->intervals[i].lo <= hi; i++) {
+        if (vp->intervals[i].hi >= lo && vp->intervals[i].hi >= vp->intervals[i].lo) {
+            entries[n++] = vp->intervals[i].entry;
+        }
+    }
+
+    /* Restore the order of logging, later entries overwrite earlier ones,
+     * the candidates are few and mostly in order already
+     */
+    for (i = 1; i < n; i++) {
+        tmp = entries[i];
+        for (j = i; j > 0 && entries[j - 1] > tmp; j--) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = tmp;
+    }
+
+    return n;
+}
+
 int ncdwio_metaidx_free(NC_dw *ncdwp) {
+    int i;
     NC_dw_metadataidx *ip = &(ncdwp->metaidx);
 
     NCI_Free(ip->entries);
 
+    for (i = 0; i < ncdwp->nvarentries; i++) {
+        NCI_Free(ncdwp->varentries[i].intervals);
+    }
+    if (ncdwp->varentries != NULL) {
+        NCI_Free(ncdwp->varentries);
+    }
+
+    return NC_NOERR;
+}
+
+/*
+ * Build the information of each variable used by the put path
+ * Called when the file enters data mode, variables can only be added in
+ * define mode
+ * IN    ncdwp:    log structure
+ */
+int ncdwio_varinfo_init(NC_dw *ncdwp) {
+    int i, err, nvars, unlimdimid, maxndims = 0;
+    int *dimids;
+    NC_dw_varinfo *vp;
+
+    err = ncdwp->ncmpio_driver->inq(ncdwp->ncp, NULL, &nvars, NULL, &unlimdimid);
+    if (err != NC_NOERR) {
+        return err;
+    }
+    /* The record dimension of an opened file is not seen by def_dim */
+    ncdwp->recdimid = unlimdimid;
+
+    if (nvars > ncdwp->nvarinfo) {
+        vp = (NC_dw_varinfo*)NCI_Realloc(ncdwp->varinfo,
+                                         sizeof(NC_dw_varinfo) * nvars);
+        if (vp == NULL) {
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        ncdwp->varinfo = vp;
+    }
+    ncdwp->nvarinfo = nvars;
+
+    for (i = 0; i < nvars; i++) {
+        vp = ncdwp->varinfo + i;
+        err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, i, NULL, &(vp->xtype),
+                                            &(vp->ndims), NULL, NULL, NULL,
+                                            NULL, NULL);
+        if (err != NC_NOERR) {
+            return err;
+        }
+        vp->isrec = 0;
+        vp->buftype = MPI_DATATYPE_NULL;
+        if (vp->ndims > maxndims) {
+            maxndims = vp->ndims;
+        }
+    }
+
+    /* Mark record variables */
+    if (maxndims > 0 && unlimdimid >= 0) {
+        dimids = (int*)NCI_Malloc(SIZEOF_INT * maxndims);
+        if (dimids == NULL) {
+            DEBUG_RETURN_ERROR(NC_ENOMEM);
+        }
+        for (i = 0; i < nvars; i++) {
+            vp = ncdwp->varinfo + i;
+            if (vp->ndims == 0) {
+                continue;
+            }
+            err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, i, NULL, NULL, NULL,
+                                                dimids, NULL, NULL, NULL, NULL);
+            if (err != NC_NOERR) {
+                NCI_Free(dimids);
+                return err;
+            }
+            vp->isrec = (dimids[0] == unlimdimid);
+        }
+        NCI_Free(dimids);
+    }
+
     return NC_NOERR;
 }
 
+void ncdwio_varinfo_free(NC_dw *ncdwp) {
+    if (ncdwp->varinfo != NULL) {
+        NCI_Free(ncdwp->varinfo);
+    }
+    ncdwp->varinfo = NULL;
+    ncdwp->nvarinfo = 0;
+}
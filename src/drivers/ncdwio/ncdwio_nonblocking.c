@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <assert.h>
@@ -277,6 +278,33 @@ int ncdwio_handle_all_put_req(NC_dw *ncdwp){
     return NC_NOERR;
 }
 
+/*
+ * Flag log entries of a canceled request in the metadata log
+ * Only the copy in the file is flagged, entries in memory are skipped by
+ * the valid flag of the metadata index
+ * IN    ncdwp:    log structure
+ * IN    start:    index of the first entry in the metadata index
+ * IN    end:    index after the last entry
+ */
+static int log_cancel_entries(NC_dw *ncdwp, int start, int end){
+    int i, err, kind;
+    size_t off;
+    NC_dw_metadataentry *entryp;
+
+    for(i = start; i < end; i++) {
+        off = (size_t)ncdwp->metaidx.entries[i].ptr;
+        entryp = (NC_dw_metadataentry*)((char*)ncdwp->metadata.buffer + off);
+        kind = entryp->api_kind | NC_LOG_API_KIND_CANCELED;
+        err = ncdwio_sharedfile_pwrite(ncdwp->metalog_fd, &kind, sizeof(int),
+                                       off + offsetof(NC_dw_metadataentry, api_kind));
+        if (err != NC_NOERR){
+            return err;
+        }
+    }
+
+    return NC_NOERR;
+}
+
 /*
  * Process put request
  * If corresponding log entries are already flushed, we retrun error
@@ -328,6 +356,14 @@ int ncdwio_cancel_put_req(NC_dw *ncdwp, int reqid, int *stat){
         for(i = req->entrystart; i < req->entryend; i++) {
             ncdwp->metaidx.entries[i].valid = 0;
         }
+
+        /* Mark the entries in the metadata log as well, so the recovery
+         * of an aborted run does not replay them
+         */
+        err = log_cancel_entries(ncdwp, req->entrystart, req->entryend);
+        if (status == NC_NOERR){
+            status = err;
+        }
     }
 
     // Recycle req object to the pool
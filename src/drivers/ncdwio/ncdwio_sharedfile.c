@@ -18,8 +18,6 @@
 #include <pnetcdf.h>
 #include <ncdwio_driver.h>
 
-#define BLOCK_SIZE 8388608
-
 /*
  * Open shared file
  * IN      comm:    MPI communicator of processes sharing the file
@@ -40,7 +38,7 @@ int ncdwio_sharedfile_open(MPI_Comm comm, char *path, int flag, MPI_Info info, N
      * Due to file sharing, actual file position differs than the logical file position within the file view
      * TODO: Adjustable bsize
      */
-    f->bsize = BLOCK_SIZE;
+    f->bsize = NC_LOG_SHARED_BSIZE;
     f->pos = 0;
     f->fsize = 0;
     MPI_Comm_rank(comm, &(f->chanel));
@@ -160,7 +158,7 @@ int ncdwio_sharedfile_pwrite(NC_dw_sharedfile *f, void *buf, size_t count, off_t
      * For the first block, start offset is increased by the offset within the block to handle partial block
      * For last block, end offset must be adjusted
      * After adjusting start and end offset, we write the block to the correct location
-     * Local blocknumber * nchanel = global blocknumber
+     * Local blocknumber * nchanel + chanel = global blocknumber
      * global blocknumber * blocksize = global offset
      * Offset % Block size = Offset within the block
      */
@@ -169,7 +167,7 @@ int ncdwio_sharedfile_pwrite(NC_dw_sharedfile *f, void *buf, size_t count, off_t
          * In this case, we can assume offend will always be larger than offstart
          */
         // Compute physical offset of th eblock
-        offstart = i * f->nchanel * f->bsize;
+        offstart = (i * f->nchanel + f->chanel) * f->bsize;
         // A block can be first and last block at the same time due to short write region
         // Last block must be partial
         // NOTE: offend must be computed before offstart, we reply on unadjusted offstart to mark the start position of the block
@@ -306,7 +304,7 @@ int ncdwio_sharedfile_pread(NC_dw_sharedfile *f, void *buf, size_t count, off_t
      * For the first block, start offset is increased by the offset within the block to handle partial block
      * For last block, end offset must be adjusted
      * After adjusting start and end offset, we write the block to the correct location
-     * Local blocknumber * nchanel = global blocknumber
+     * Local blocknumber * nchanel + chanel = global blocknumber
      * global blocknumber * blocksize = global offset
      * Offset % Block size = Offset within the block
      */
@@ -315,7 +313,7 @@ int ncdwio_sharedfile_pread(NC_dw_sharedfile *f, void *buf, size_t count, off_t
          * In this case, we can assume offend will always be larger than offstart
          */
         // Compute physical offset of th eblock
-        offstart = i * f->nchanel * f->bsize;
+        offstart = (i * f->nchanel + f->chanel) * f->bsize;
         // A block can be first and last block at the same time due to short write region
         // Last block must be partial
         // NOTE: offend must be computed before offstart, we reply on unadjusted offstart to mark the start position of the block
@@ -24,8 +24,8 @@ void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info){
     int flag;
     char value[MPI_MAX_INFO_VAL];
 
-    ncdwp->hints = NC_LOG_HINT_DEL_ON_CLOSE | NC_LOG_HINT_FLUSH_ON_READ |
-                    NC_LOG_HINT_FLUSH_ON_SYNC;
+    ncdwp->hints = NC_LOG_HINT_DEL_ON_CLOSE | NC_LOG_HINT_FLUSH_ON_SYNC |
+                   NC_LOG_HINT_RECOVER;
     // Directory to place log files
     MPI_Info_get(info, "nc_dw_dirname", MPI_MAX_INFO_VAL - 1,
                  value, &flag);
@@ -53,6 +53,30 @@ void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info){
     if (flag && strcasecmp(value, "disable") == 0){
         ncdwp->hints ^= NC_LOG_HINT_DEL_ON_CLOSE;
     }
+    // Flush the log before every read instead of reading from the log (disable)
+    MPI_Info_get(info, "nc_dw_flush_on_read", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0){
+        ncdwp->hints |= NC_LOG_HINT_FLUSH_ON_READ;
+    }
+    // Replay the log in the background on collective wait (disable)
+    MPI_Info_get(info, "nc_dw_async_flush", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0){
+        ncdwp->hints |= NC_LOG_HINT_ASYNC_FLUSH;
+    }
+    // Replay the logs of the processes on a node by the node leader (disable)
+    MPI_Info_get(info, "nc_dw_node_replay", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag && strcasecmp(value, "enable") == 0){
+        ncdwp->hints |= NC_LOG_HINT_NODE_REPLAY;
+    }
+    // Replay logs left by an aborted run when the file is opened (enable)
+    MPI_Info_get(info, "nc_dw_recover", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag && strcasecmp(value, "disable") == 0){
+        ncdwp->hints &= ~NC_LOG_HINT_RECOVER;
+    }
     // Buffer size used to flush the log (0 (unlimited))
     MPI_Info_get(info, "nc_dw_flush_buffer_size", MPI_MAX_INFO_VAL - 1,
                  value, &flag);
@@ -66,6 +90,44 @@ void ncdwio_extract_hint(NC_dw *ncdwp, MPI_Info info){
     else{
         ncdwp->flushbuffersize = 0; // 0 means unlimited}
     }
+    // Size of the data log that triggers a flush (0 (unlimited))
+    MPI_Info_get(info, "nc_dw_max_log_size", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag){
+        long long lsize = strtoll(value, NULL, 0);
+        if (lsize < 0) {
+            lsize = 0;
+        }
+        ncdwp->maxlogsize = (MPI_Offset)lsize; // Unit: byte
+    }
+    else{
+        ncdwp->maxlogsize = 0;
+    }
+    // Number of data log buffers written in the background (0 (synchronous))
+    MPI_Info_get(info, "nc_dw_write_behind", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag){
+        long int nbuf = strtol(value, NULL, 0);
+        if (nbuf < 2) {
+            nbuf = 0;   // A single buffer is written synchronously
+        }
+        ncdwp->writebehind = (int)nbuf;
+    }
+    else{
+        ncdwp->writebehind = 0;
+    }
+    // Codec to compress the data log entries (none)
+    ncdwp->codec = NC_LOG_CODEC_NONE;
+    MPI_Info_get(info, "nc_dw_compression", MPI_MAX_INFO_VAL - 1,
+                 value, &flag);
+    if (flag){
+        if (strcasecmp(value, "lz") == 0){
+            ncdwp->codec = NC_LOG_CODEC_LZ;
+        }
+        else if (strcasecmp(value, "shuffle_lz") == 0){
+            ncdwp->codec = NC_LOG_CODEC_SHUFFLE_LZ;
+        }
+    }
 }
 
 /*
@@ -86,6 +148,18 @@ void ncdwio_export_hint(NC_dw *ncdwp, MPI_Info info){
     if (!(ncdwp->hints & NC_LOG_HINT_DEL_ON_CLOSE)) {
         MPI_Info_set(info, "nc_dw_del_on_close", "disable");
     }
+    if (ncdwp->hints & NC_LOG_HINT_FLUSH_ON_READ) {
+        MPI_Info_set(info, "nc_dw_flush_on_read", "enable");
+    }
+    if (ncdwp->hints & NC_LOG_HINT_ASYNC_FLUSH) {
+        MPI_Info_set(info, "nc_dw_async_flush", "enable");
+    }
+    if (ncdwp->hints & NC_LOG_HINT_NODE_REPLAY) {
+        MPI_Info_set(info, "nc_dw_node_replay", "enable");
+    }
+    if (!(ncdwp->hints & NC_LOG_HINT_RECOVER)) {
+        MPI_Info_set(info, "nc_dw_recover", "disable");
+    }
     if (ncdwp->logbase[0] != '\0') {
         MPI_Info_set(info, "nc_dw_dirname", ncdwp->logbase);
     }
@@ -93,4 +167,58 @@ void ncdwio_export_hint(NC_dw *ncdwp, MPI_Info info){
         sprintf(value, "%llu", ncdwp->flushbuffersize);
         MPI_Info_set(info, "nc_dw_flush_buffer_size", value);
     }
+    if (ncdwp->maxlogsize > 0) {
+        sprintf(value, "%lld", ncdwp->maxlogsize);
+        MPI_Info_set(info, "nc_dw_max_log_size", value);
+    }
+    if (ncdwp->writebehind > 0) {
+        sprintf(value, "%d", ncdwp->writebehind);
+        MPI_Info_set(info, "nc_dw_write_behind", value);
+    }
+    if (ncdwp->codec == NC_LOG_CODEC_LZ) {
+        MPI_Info_set(info, "nc_dw_compression", "lz");
+    }
+    else if (ncdwp->codec == NC_LOG_CODEC_SHUFFLE_LZ) {
+        MPI_Info_set(info, "nc_dw_compression", "shuffle_lz");
+    }
+}
+
+/*
+ * Number of subarrays written by a log entry
+ * A varn entry writes num subarrays, other entries write one
+ * IN    entryp:    log entry
+ */
+MPI_Offset ncdwio_log_entry_nranges(NC_dw_metadataentry *entryp){
+    if (entryp->api_kind == NC_LOG_API_KIND_VARN) {
+        return *((MPI_Offset*)(entryp + 1));
+    }
+
+    return 1;
+}
+
+/*
+ * Locate a subarray written by a log entry
+ * Data of subarray r follows the data of subarray r - 1 in the data log
+ * IN    entryp:    log entry
+ * IN    r:    index of the subarray
+ * OUT   start, count:    start and count of the subarray
+ * OUT   stride:    stride of the subarray, NULL if there is no stride
+ */
+void ncdwio_log_entry_range(NC_dw_metadataentry *entryp, MPI_Offset r,
+                            MPI_Offset **start, MPI_Offset **count,
+                            MPI_Offset **stride){
+    MPI_Offset *base = (MPI_Offset*)(entryp + 1);
+
+    if (entryp->api_kind == NC_LOG_API_KIND_VARN) {
+        *start = base + 1 + r * 2 * entryp->ndims;
+        *count = *start + entryp->ndims;
+        *stride = NULL;
+    }
+    else {
+        *start = base;
+        *count = base + entryp->ndims;
+        // Stride is 0 for vara entries
+        *stride = (entryp->api_kind == NC_LOG_API_KIND_VARS) ?
+                  base + 2 * entryp->ndims : NULL;
+    }
 }
@@ -8,6 +8,7 @@
  * This file implements the following PnetCDF APIs.
  *
  * ncmpi_def_var()                  : dispatcher->def_var()
+ * ncmpi_def_vars()                 : dispatcher->def_vars()
  * ncmpi_inq_varid()                : dispatcher->inq_varid()
  * ncmpi_inq_var()                  : dispatcher->inq_var()
  * ncmpi_rename_var()               : dispatcher->rename_var()
@@ -54,6 +55,50 @@
 #include <common.h>
 #include <ncdwio_driver.h>
 
+/*
+ * Size of the data of a put request in bytes
+ * IN    num:    number of subarrays
+ * IN    counts:    counts of the subarrays, NULL means 1 element each
+ * IN    bufcount:    -1 for high-level APIs, otherwise number of buftype
+ * IN    buftype:    type of the buffer, MPI_DATATYPE_NULL means the type of
+ *                   the variable
+ */
+static MPI_Offset put_data_size(NC_dw *ncdwp, int varid, int num,
+                                MPI_Offset* const *counts, MPI_Offset bufcount,
+                                MPI_Datatype buftype)
+{
+    int i, j, elsize;
+    MPI_Offset n, nelems = 0;
+    NC_dw_varinfo *varp;
+
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        return 0;
+    }
+    varp = ncdwp->varinfo + varid;
+
+    if (buftype == MPI_DATATYPE_NULL){
+        ncmpii_xlen_nc_type(varp->xtype, &elsize);
+    }
+    else{
+        MPI_Type_size(buftype, &elsize);
+        if (bufcount != -1){
+            return bufcount * elsize;
+        }
+    }
+
+    for(i = 0; i < num; i++){
+        n = 1;
+        if (counts != NULL && counts[i] != NULL){
+            for(j = 0; j < varp->ndims; j++){
+                n *= counts[i][j];
+            }
+        }
+        nelems += n;
+    }
+
+    return nelems * elsize;
+}
+
 int
 ncdwio_def_var(void       *ncdp,
               const char *name,
@@ -65,6 +110,9 @@ ncdwio_def_var(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->def_var(ncdwp->ncp, name, xtype, ndims, dimids, varidp);
     if (err != NC_NOERR) return err;
 
@@ -76,6 +124,35 @@ ncdwio_def_var(void       *ncdp,
     return NC_NOERR;
 }
 
+int
+ncdwio_def_vars(void          *ncdp,
+                int            nvars,
+                char*   const *names,
+                const nc_type *xtypes,
+                const int     *ndims,
+                int*    const *dimids,
+                int           *varids)
+{
+    int i, err;
+    NC_dw *ncdwp = (NC_dw*)ncdp;
+
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
+    err = ncdwp->ncmpio_driver->def_vars(ncdwp->ncp, nvars, names, xtypes,
+                                         ndims, dimids, varids);
+    if (err != NC_NOERR) return err;
+
+    /* Update max_ndims */
+    for (i = 0; i < nvars; i++){
+        if (ndims[i] > ncdwp->max_ndims){
+            ncdwp->max_ndims = ndims[i];
+        }
+    }
+
+    return NC_NOERR;
+}
+
 int
 ncdwio_inq_varid(void       *ncdp,
                 const char *name,
@@ -84,6 +161,9 @@ ncdwio_inq_varid(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_varid(ncdwp->ncp, name, varid);
     if (err != NC_NOERR) return err;
 
@@ -105,6 +185,9 @@ ncdwio_inq_var(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, name, xtypep, ndimsp, dimids,
                                nattsp, offsetp, no_fillp, fill_valuep);
     if (err != NC_NOERR) return err;
@@ -120,6 +203,9 @@ ncdwio_rename_var(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->rename_var(ncdwp->ncp, varid, newname);
     if (err != NC_NOERR) return err;
 
@@ -141,9 +227,15 @@ ncdwio_get_var(void             *ncdp,
     int err, status = NC_NOERR;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    /* Serve the read from the log if data is written by this process */
+    if(ncdwp->inited && !(ncdwp->hints & NC_LOG_HINT_FLUSH_ON_READ)){
+        return ncdwio_log_get_var(ncdwp, varid, start, count, stride, imap,
+                                  buf, bufcount, buftype, reqMode);
+    }
+
     /* Flush on read */
     if(ncdwp->inited){
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_flush_all(ncdwp);
         if (status == NC_NOERR){
             status = err;
         }
@@ -174,6 +266,16 @@ ncdwio_put_var(void             *ncdp,
     void *cbuf=(void*)buf;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    /* Flush the log if the data does not fit in its size limit */
+    err = ncdwio_log_reserve(ncdwp, fIsSet(reqMode, NC_REQ_ZERO) ? 0 :
+                             put_data_size(ncdwp, varid, 1,
+                                           (MPI_Offset* const*)&count,
+                                           bufcount, buftype), reqMode);
+    if (err != NC_NOERR) return err;
+
+    /* Nothing to write if the request has error in collective mode */
+    if (fIsSet(reqMode, NC_REQ_ZERO)) return NC_NOERR;
+
     /* Resolve imap */
     if (imap != NULL || bufcount != -1) {
         /* pack buf to cbuf -------------------------------------------------*/
@@ -187,9 +289,8 @@ ncdwio_put_var(void             *ncdp,
         MPI_Offset nelems;
         MPI_Datatype etype;
 
-        err = ncdwp->ncmpio_driver->inq_var(ncdwp->ncp, varid, NULL, NULL, &ndims, NULL,
-                                   NULL, NULL, NULL, NULL);
-        if (err != NC_NOERR) return err;;
+        if (varid < 0 || varid >= ncdwp->nvarinfo) DEBUG_RETURN_ERROR(NC_ENOTVAR)
+        ndims = ncdwp->varinfo[varid].ndims;
 
         err = ncmpii_pack(ndims, count, imap, (void*)buf, bufcount, buftype,
                           &nelems, &etype, &cbuf);
@@ -224,6 +325,9 @@ ncdwio_iget_var(void             *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->iget_var(ncdwp->ncp, varid, start, count, stride, imap,
                                 buf, bufcount, buftype, reqid, reqMode);
     if (err != NC_NOERR) return err;
@@ -256,6 +360,16 @@ ncdwio_iput_var(void             *ncdp,
     int i, err, id;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    /* Flush the log before the entries of this request are counted below,
+     * put_var then finds the room already made
+     */
+    err = ncdwio_log_reserve(ncdwp, put_data_size(ncdwp, varid, 1,
+                             (MPI_Offset* const*)&count, bufcount, buftype),
+                             reqMode);
+    if (err != NC_NOERR){
+        return err;
+    }
+
     // Create a new put request with id
     err = ncdwio_put_list_add(ncdwp, &id);
     if (err != NC_NOERR){
@@ -314,6 +428,9 @@ ncdwio_buffer_attach(void       *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->buffer_attach(ncdwp->ncp, bufsize);
     if (err != NC_NOERR) return err;
 
@@ -326,6 +443,9 @@ ncdwio_buffer_detach(void *ncdp)
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->buffer_detach(ncdwp->ncp);
     if (err != NC_NOERR) return err;
 
@@ -370,7 +490,7 @@ ncdwio_get_varn(void              *ncdp,
 
     /* Flush on read */
     if(ncdwp->inited){
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_flush_all(ncdwp);
         if (status == NC_NOERR){
             status = err;
         }
@@ -386,7 +506,7 @@ ncdwio_get_varn(void              *ncdp,
 }
 
 /*
- * We treate varn operation as n of var operation
+ * A varn operation is recorded as a single log entry
  */
 int
 ncdwio_put_varn(void              *ncdp,
@@ -411,9 +531,24 @@ ncdwio_put_varn(void              *ncdp,
         DEBUG_RETURN_ERROR(NC_ENULLSTART)
     }
 
+    /* Flush the log if the data does not fit in its size limit */
+    err = ncdwio_log_reserve(ncdwp, fIsSet(reqMode, NC_REQ_ZERO) ? 0 :
+                             put_data_size(ncdwp, varid, num, counts,
+                                           bufcount, buftype), reqMode);
+    if (err != NC_NOERR) return err;
+
+    /* Nothing to write if the request has error in collective mode */
+    if (fIsSet(reqMode, NC_REQ_ZERO)){
+        return NC_NOERR;
+    }
+
+    if (varid < 0 || varid >= ncdwp->nvarinfo){
+        DEBUG_RETURN_ERROR(NC_ENOTVAR)
+    }
+
     /* Resolve flexible api so we can calculate size of each put_var */
     if (bufcount != -1){
-        int isderived, iscontig_of_ptypes, elsize, position;
+        int isderived, iscontig_of_ptypes, elsize, position = 0;
         MPI_Offset bnelems;
 
         err = ncmpii_dtype_decode(buftype, &ptype, &elsize, &bnelems,
@@ -421,23 +556,30 @@ ncdwio_put_varn(void              *ncdp,
         if (err != NC_NOERR) return err;
 
         if (!iscontig_of_ptypes) { /* pack only if non-contiguous */
-            bnelems *= elsize;
+            bnelems *= elsize * bufcount;
             if (bnelems != (int)bnelems) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
 
             cbuf = NCI_Malloc(bnelems);
+            if (cbuf == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
             MPI_Pack(buf, (int)bufcount, buftype, cbuf, (int)bnelems,
                      &position, MPI_COMM_SELF);
         }
     }
 
-    /* Decompose it into num put_vara calls */
-    bufp = cbuf;
-    for(i = 0; i < num; i++){
-        err = ncdwio_log_put_var(ncdwp, varid, starts[i], counts[i], NULL, bufp, ptype, &size);
-        if (status == NC_NOERR){
-            status = err;
+    if (ncdwp->varinfo[varid].ndims > 0){
+        status = ncdwio_log_put_varn(ncdwp, varid, num, starts, counts, cbuf,
+                                     ptype, NULL);
+    }
+    else{
+        /* Every request of a scalar variable writes the same element */
+        bufp = cbuf;
+        for(i = 0; i < num; i++){
+            err = ncdwio_log_put_var(ncdwp, varid, starts[i], NULL, NULL, bufp, ptype, &size);
+            if (status == NC_NOERR){
+                status = err;
+            }
+            bufp = (void*)(((char*)bufp) + size);
         }
-        bufp = (void*)(((char*)bufp) + size);
     }
 
     if (cbuf != buf){
@@ -462,6 +604,9 @@ ncdwio_iget_varn(void               *ncdp,
     int err;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
+    // Wait for the background replay of the log
+    ncdwio_log_join(ncdwp);
+
     err = ncdwp->ncmpio_driver->iget_varn(ncdwp->ncp, varid, num, starts, counts, buf,
                                  bufcount, buftype, reqid, reqMode);
     if (err != NC_NOERR) return err;
@@ -498,6 +643,15 @@ ncdwio_iput_varn(void               *ncdp,
         DEBUG_RETURN_ERROR(NC_ENULLSTART)
     }
 
+    /* Flush the log before the entries of this request are counted below,
+     * put_varn then finds the room already made
+     */
+    err = ncdwio_log_reserve(ncdwp, put_data_size(ncdwp, varid, num, counts,
+                             bufcount, buftype), reqMode);
+    if (err != NC_NOERR){
+        return err;
+    }
+
     // Create a new put request with id
     err = ncdwio_put_list_add(ncdwp, &id);
     if (err != NC_NOERR){
@@ -510,7 +664,7 @@ ncdwio_iput_varn(void               *ncdp,
     }
 
     /* We must link the request object to corresponding log entries
-     * For varn operation, we will create multiple log entries, so it's a 1 to many mapping
+     * A varn operation is a single log entry, except for scalar variables where each request is an entry, so it can be a 1 to many mapping
      * Assuming the program runs under single thread, those entries are a continuous region within the metadata log
      * We record the first and last metadata entries associated with this request
      * This is done by checking number of lof entries before and after handling this operation
@@ -584,7 +738,7 @@ ncdwio_get_vard(void         *ncdp,
 
     /* Flush on read */
     if(ncdwp->inited){
-        err = ncdwio_log_flush(ncdwp);
+        err = ncdwio_log_flush_all(ncdwp);
         if (status == NC_NOERR){
             status = err;
         }
@@ -608,14 +762,70 @@ ncdwio_put_vard(void         *ncdp,
                MPI_Datatype  buftype,
                int           reqMode)
 {
-    int err;
+    int err, status = NC_NOERR, fallback;
+    MPI_Offset size = 0;
     NC_dw *ncdwp = (NC_dw*)ncdp;
 
-    /* BB driver does not support vard */
-    err = ncdwp->ncmpio_driver->put_vard(ncdwp->ncp, varid, filetype, buf, bufcount,
-                                buftype, reqMode);
+    /* Flush the log if the data does not fit in its size limit */
+    if (!fIsSet(reqMode, NC_REQ_ZERO) && filetype != MPI_DATATYPE_NULL) {
+        int fsize;
+
+        MPI_Type_size(filetype, &fsize);
+        size = fsize;
+    }
+    err = ncdwio_log_reserve(ncdwp, size, reqMode);
     if (err != NC_NOERR) return err;
 
-    return NC_NOERR;
+    /* Record the request as a varn entry flattened from filetype */
+    if (fIsSet(reqMode, NC_REQ_ZERO)) {
+        err = NC_NOERR; /* Nothing to write, still join the collective call */
+    }
+    else {
+        err = ncdwio_log_put_vard(ncdwp, varid, filetype, (void*)buf, bufcount,
+                                  buftype);
+    }
+
+    /* A filetype that can not be flattened is written by the ncmpio driver
+     * after the log is flushed to keep the order of writes
+     * In collective mode, all processes fall back if any of them does
+     */
+    fallback = (err == NC_ENOTSUPPORT);
+    if (fIsSet(reqMode, NC_REQ_COLL)) {
+        int mpireturn;
+
+        mpireturn = MPI_Allreduce(MPI_IN_PLACE, &fallback, 1, MPI_INT,
+                                  MPI_LOR, ncdwp->comm);
+        if (mpireturn != MPI_SUCCESS) {
+            DEBUG_RETURN_ERROR(ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce"))
+        }
+    }
+    if (!fallback) {
+        return err;
+    }
+
+    status = ncdwio_log_flush_all(ncdwp);
+
+    if (err == NC_ENOTSUPPORT) {
+        err = ncdwp->ncmpio_driver->put_vard(ncdwp->ncp, varid, filetype, buf,
+                                             bufcount, buftype, reqMode);
+    }
+    else {
+        /* The request in the log is already flushed, join the collective
+         * call as a zero-length request. A NULL filetype, unlike
+         * NC_REQ_ZERO, still takes part in the sync of the number of
+         * records of a record variable
+         */
+        int err2 = ncdwp->ncmpio_driver->put_vard(ncdwp->ncp, varid,
+                                                  MPI_DATATYPE_NULL, buf, 0,
+                                                  buftype, reqMode);
+        if (err == NC_NOERR) {
+            err = err2;
+        }
+    }
+    if (status == NC_NOERR) {
+        status = err;
+    }
+
+    return status;
 }
 
@@ -15,6 +15,7 @@
  * ncmpi_del_att()     : dispatcher->inq_del_att()
  * ncmpi_get_att()     : dispatcher->inq_get_att()
  * ncmpi_put_att()     : dispatcher->inq_put_arr()
+ * ncmpi_put_atts()    : dispatcher->put_atts()
  *
  */
 
@@ -158,3 +159,22 @@ ncfoo_put_att(void         *ncdp,
 
     return NC_NOERR;
 }
+
+int
+ncfoo_put_atts(void              *ncdp,
+               int                varid,
+               int                natts,
+               char*       const *names,
+               const nc_type     *xtypes,
+               const MPI_Offset  *nelems,
+               void*       const *bufs)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->put_atts(foo->ncp, varid, natts, names, xtypes, nelems,
+                                bufs);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
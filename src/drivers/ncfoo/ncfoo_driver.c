@@ -18,6 +18,7 @@ static PNC_driver ncfoo_driver = {
     ncfoo_close,
     ncfoo_enddef,
     ncfoo__enddef,
+    ncfoo_enddef_from,
     ncfoo_redef,
     ncfoo_sync,
     ncfoo_abort,
@@ -43,9 +44,11 @@ static PNC_driver ncfoo_driver = {
     ncfoo_del_att,
     ncfoo_get_att,
     ncfoo_put_att,
+    ncfoo_put_atts,
 
     /* VARIABLE APIs */
     ncfoo_def_var,
+    ncfoo_def_vars,
     ncfoo_def_var_fill,
     ncfoo_fill_var_rec,
     ncfoo_inq_var,
@@ -36,6 +36,9 @@ ncfoo_enddef(void *ncdp);
 extern int
 ncfoo__enddef(void *ncdp, MPI_Offset h_minfree, MPI_Offset v_align, MPI_Offset v_minfree, MPI_Offset r_align);
 
+extern int
+ncfoo_enddef_from(void *ncdp, void *tmpl_ncdp);
+
 extern int
 ncfoo_redef(void *ncdp);
 
@@ -107,9 +110,15 @@ ncfoo_get_att(void *ncdp, int varid, const char *name, void *value, MPI_Datatype
 extern int
 ncfoo_put_att(void *ncdp, int varid, const char *name, nc_type xtype, MPI_Offset nelems, const void *value, MPI_Datatype itype);
 
+extern int
+ncfoo_put_atts(void *ncdp, int varid, int natts, char* const *names, const nc_type *xtypes, const MPI_Offset *nelems, void* const *values);
+
 extern int
 ncfoo_def_var(void *ncdp, const char *name, nc_type type, int ndims, const int *dimids, int *varidp);
 
+extern int
+ncfoo_def_vars(void *ncdp, int nvars, char* const *names, const nc_type *xtypes, const int *ndims, int* const *dimids, int *varids);
+
 extern int
 ncfoo_def_var_fill(void *ncdp, int varid, int nofill, const void *fill_value);
 
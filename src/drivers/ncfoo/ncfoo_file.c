@@ -12,6 +12,7 @@
  * ncmpi_close()            : dispatcher->close()
  * ncmpi_enddef()           : dispatcher->enddef()
  * ncmpi__enddef()          : dispatcher->_enddef()
+ * ncmpi_create_from_template() : dispatcher->enddef_from()
  * ncmpi_redef()            : dispatcher->redef()
  * ncmpi_begin_indep_data() : dispatcher->begin_indep_data()
  * ncmpi_end_indep_data()   : dispatcher->end_indep_data()
@@ -178,6 +179,20 @@ ncfoo__enddef(void       *ncdp,
     return NC_NOERR;
 }
 
+int
+ncfoo_enddef_from(void *ncdp,
+                  void *tmpl_ncdp)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+    NC_foo *tmpl = (NC_foo*)tmpl_ncdp;
+
+    err = foo->driver->enddef_from(foo->ncp, tmpl->ncp);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
 int
 ncfoo_redef(void *ncdp)
 {
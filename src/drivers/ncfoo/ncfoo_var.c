@@ -8,6 +8,7 @@
  * This file implements the following PnetCDF APIs.
  *
  * ncmpi_def_var()                  : dispatcher->def_var()
+ * ncmpi_def_vars()                 : dispatcher->def_vars()
  * ncmpi_inq_varid()                : dispatcher->inq_varid()
  * ncmpi_inq_var()                  : dispatcher->inq_var()
  * ncmpi_rename_var()               : dispatcher->rename_var()
@@ -71,6 +72,25 @@ ncfoo_def_var(void       *ncdp,
     return NC_NOERR;
 }
 
+int
+ncfoo_def_vars(void          *ncdp,
+               int            nvars,
+               char*   const *names,
+               const nc_type *xtypes,
+               const int     *ndims,
+               int*    const *dimids,
+               int           *varids)
+{
+    int err;
+    NC_foo *foo = (NC_foo*)ncdp;
+
+    err = foo->driver->def_vars(foo->ncp, nvars, names, xtypes, ndims, dimids,
+                                varids);
+    if (err != NC_NOERR) return err;
+
+    return NC_NOERR;
+}
+
 int
 ncfoo_inq_varid(void       *ncdp,
                 const char *name,
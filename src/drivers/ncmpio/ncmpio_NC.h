@@ -82,28 +82,19 @@ typedef enum {
 typedef struct NC NC; /* forward reference */
 
 #define NC_NAME_TABLE_CHUNK 16
-#define HASH_TABLE_SIZE 256
-/*
-#define HASH_FUNC(x) ncmpio_jenkins_one_at_a_time_hash(x)
-#define HASH_FUNC(x) ncmpio_additive_hash(x)
-#define HASH_FUNC(x) ncmpio_rotating_hash(x)
-#define HASH_FUNC(x) ncmpio_Pearson_hash(x)
-*/
-#define HASH_FUNC(x) ncmpio_Bernstein_hash(x)
-/* Look like Bernstein's hashing function performs the best */
+#define HASH_FUNC(x) ncmpio_name_hash(x)
 
-/* For the initial naive implementation of hashing:
- * #define HASH_FUNC(x) (unsigned char)x[0]
- * if used this simple hash function, HASH_TABLE_SIZE must be 256 which is the
- * number of possible keys can be stored in an unsigned char
+/* name lookup table, an open-addressing hash table of names of dimensions,
+ * variables, or attributes. See ncmpio_hash_func.c
  */
-
 typedef struct NC_nametable {
-    int  num;  /* number of elements added in the list array. Its value starts
-                  with zero and incremented with new name is created. When its
-                  value becomes a multiple of NC_NAME_TABLE_CHUNK, list will be
-                  reallocated to a space of size (num + NC_NAME_TABLE_CHUNK) */
-    int *list; /* dimension or variable IDs */
+    int           nalloc; /* number of slots, 0 or a power of 2 no less than
+                             NC_NAME_TABLE_CHUNK. The table grows to keep it
+                             at least twice of nused */
+    int           nused;  /* number of names in the table */
+    int          *ids;    /* [nalloc] dimension, variable, or attribute IDs,
+                             -1 for an empty slot */
+    unsigned int *keys;   /* [nalloc] hash of the names of ids[] */
 } NC_nametable;
 
 /*
@@ -129,12 +120,7 @@ typedef struct NC_dimarray {
     int            ndefined;      /* number of defined dimensions */
     int            unlimited_id;  /* -1 for not defined, otherwise >= 0 */
     NC_dim       **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * dimensions with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;         /* table for quick name lookup */
 } NC_dimarray;
 
 /* Begin defined in dim.c ---------------------------------------------------*/
@@ -169,12 +155,7 @@ typedef struct {
 typedef struct NC_attrarray {
     int            ndefined;  /* number of defined attributes */
     NC_attr      **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * variables with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;         /* table for quick name lookup */
 } NC_attrarray;
 
 /* Begin defined in attr.c --------------------------------------------------*/
@@ -236,12 +217,7 @@ typedef struct NC_vararray {
     int            ndefined;    /* number of defined variables */
     int            num_rec_vars;/* number of defined record variables */
     NC_var       **value;
-    NC_nametable   nameT[HASH_TABLE_SIZE]; /* table for quick name lookup.
-                    * indices 0, 1, ... HASH_TABLE_SIZE-1 are the hash keys.
-                    * nameT[i].num is the number of hash collisions. The IDs of
-                    * variables with names producing the same hash key i are
-                    * stored in nameT[i].list[*]
-                    */
+    NC_nametable   nameT;         /* table for quick name lookup */
 } NC_vararray;
 
 /* Begin defined in var.c ---------------------------------------------------*/
@@ -321,7 +297,7 @@ typedef struct NC_buf {
 #define NC_NSYNC  0x100000  /* synchronise numrecs on change */
 #define NC_HSYNC  0x200000  /* synchronise whole header on change */
 #define NC_NDIRTY 0x400000  /* numrecs has changed */
-#define NC_HDIRTY 0x800000  /* header info has changed */
+#define NC_HDIRTY 0x800000  /* header layout has changed, rewrite all */
 struct NC {
     int           ncid;         /* file ID */
     int           flags;        /* various modes, i.e. define/data, fill,
@@ -341,12 +317,26 @@ struct NC {
 #endif
     int           striping_unit; /* file stripe size of the file */
     int           chunk;       /* chunk size for reading header */
+    MPI_Offset    pipe_size;   /* staging buffer size for pipelined put, 0
+                                  disables pipelining */
+    int           num_aggrs;   /* number of aggregators of PnetCDF's own
+                                  two-phase I/O for collective nonblocking
+                                  writes, 0 disables it */
+    int           node_aggr;   /* 1 to aggregate collective nonblocking
+                                  writes at one process per compute node */
+    int           root_define; /* 1 if only root runs define-mode APIs and
+                                  broadcasts the header at enddef */
+    int           root_def_nvars; /* number of variables defined in current
+                                  define mode but skipped on non-root */
+    int           rank;        /* rank of this process in comm */
     MPI_Offset    h_align;     /* file alignment for header */
     MPI_Offset    v_align;     /* file alignment for each fixed variable */
     MPI_Offset    r_align;     /* file alignment for record variable section */
     MPI_Offset    h_minfree;   /* pad at the end of the header section */
     MPI_Offset    v_minfree;   /* pad at the end of the data section for fixed-size variables */
     MPI_Offset    xsz;       /* external size of this header, <= var[0].begin */
+    MPI_Offset    hdr_dirty_start; /* byte range [start, end) of the header */
+    MPI_Offset    hdr_dirty_end;   /* modified in place in data mode */
     MPI_Offset    begin_var; /* file offset of the first (non-record) var */
     MPI_Offset    begin_rec; /* file offset of the first 'record' */
 
@@ -360,6 +350,9 @@ struct NC {
     MPI_Info      mpiinfo;        /* used MPI info object */
     MPI_File      collective_fh;  /* file handle for collective mode */
     MPI_File      independent_fh; /* file handle for independent mode */
+    MPI_Comm      node_comm;      /* processes on the same compute node */
+    MPI_Comm      leader_comm;    /* first process of each compute node */
+    MPI_File      leader_fh;      /* file handle of leader_comm */
 
     NC_dimarray   dims;     /* dimensions defined */
     NC_attrarray  attrs;    /* global attributes defined */
@@ -382,6 +375,11 @@ struct NC {
 #define NC_indep(ncp)      fIsSet((ncp)->flags, NC_MODE_INDEP)
 #define NC_dofill(ncp)     fIsSet((ncp)->flags, NC_MODE_FILL)
 
+/* in root-define mode, non-root processes skip the define-mode APIs of
+ * variables and attributes */
+#define NC_skip_define(ncp) \
+        ((ncp)->root_define && (ncp)->rank > 0 && NC_indef(ncp))
+
 #define set_NC_ndirty(ncp)   fSet((ncp)->flags, NC_NDIRTY)
 #define NC_ndirty(ncp)     fIsSet((ncp)->flags, NC_NDIRTY)
 #define set_NC_hdirty(ncp)   fSet((ncp)->flags, NC_HDIRTY)
@@ -415,8 +413,14 @@ typedef struct bufferinfo {
     int         size;     /* allocated size of the buffer */
     int         version;  /* 1, 2, and 5 for CDF-1, 2, and 5 respectively */
     int         safe_mode;/* 0: disabled, 1: enabled */
+    int         chunked;  /* 1: get buffer keeps only the unparsed header */
     void       *base;     /* beginning of read/write buffer */
     void       *pos;      /* current position in buffer */
+    MPI_Offset  bcast_end;/* >0: root broadcasts the header up to this offset
+                             block by block, instead of reading the file */
+    MPI_Offset  blk_off;  /* file offset of the block last broadcast */
+    int         blk_len;  /* size of the block last broadcast */
+    char       *blk;      /* the block last broadcast */
 } bufferinfo;
 
 extern MPI_Offset
@@ -425,10 +429,28 @@ ncmpio_hdr_len_NC(const NC *ncp);
 extern int
 ncmpio_hdr_get_NC(NC *ncp);
 
+extern int
+ncmpio_hdr_get_NC_buf(NC *ncp, void *buf, int size);
+
+extern MPI_Offset
+ncmpio_hdr_len_NC_name(const NC *ncp, size_t name_len);
+
+extern MPI_Offset
+ncmpio_hdr_off_NC_dim(const NC *ncp, int dimid);
+
+extern MPI_Offset
+ncmpio_hdr_off_NC_var(const NC *ncp, int varid);
+
+extern MPI_Offset
+ncmpio_hdr_off_NC_attr(const NC *ncp, int varid, int attid, MPI_Offset *lenp);
+
 /* Begin defined in ncmpio_header_put.c -------------------------------------*/
 extern int
 ncmpio_hdr_put_NC(NC *ncp, void *buf);
 
+extern void
+ncmpio_hdr_set_dirty(NC *ncp, MPI_Offset off, MPI_Offset len);
+
 extern int
 ncmpio_write_header(NC *ncp);
 
@@ -468,20 +490,14 @@ ncmpio_igetput_varm(NC *ncp, NC_var *varp, const MPI_Offset *start,
                 MPI_Datatype datatype, int *reqid, int reqMode);
 
 /* Begin defined in ncmpio_hash_func.c --------------------------------------*/
-extern int
-ncmpio_jenkins_one_at_a_time_hash(const char *str_name);
-
-extern int
-ncmpio_additive_hash(const char *str_name);
-
-extern int
-ncmpio_rotating_hash(const char *str_name);
+extern unsigned int
+ncmpio_name_hash(const char *str_name);
 
-extern int
-ncmpio_Bernstein_hash(const char *str_name);
+extern void
+ncmpio_digest128(const void *buf, size_t len, unsigned long long *digest);
 
 extern int
-ncmpio_Pearson_hash(const char *str_name);
+ncmpio_hash_probe(const NC_nametable *nameT, unsigned int key, int *slot);
 
 extern int
 ncmpio_update_name_lookup_table(NC_nametable *nameT, const int id,
@@ -503,6 +519,9 @@ ncmpio_hash_table_copy(NC_nametable *dest, const NC_nametable *src);
 extern void
 ncmpio_hash_table_free(NC_nametable *nameT);
 
+extern void
+ncmpio_hash_table_grow(NC_nametable *nameT, int n);
+
 extern void
 ncmpio_hash_table_populate_NC_var(NC_vararray *varsp);
 
@@ -551,6 +570,11 @@ ncmpio_access_range(const NC *ncp, const NC_var *varp, const MPI_Offset start[],
                     const MPI_Offset count[], const MPI_Offset stride[],
                     MPI_Offset *start_off, MPI_Offset *end_off);
 
+extern int
+ncmpio_put_convert(int format, NC_var *varp, const void *cbuf,
+                   MPI_Offset nelems, MPI_Datatype itype, void *fillp,
+                   void *xbuf);
+
 extern int
 ncmpio_pack_xbuf(int format, NC_var *varp, MPI_Offset bufcount,
                  MPI_Datatype buftype, int buftype_is_contig, MPI_Offset nelems,
@@ -20,6 +20,7 @@ dnl
  * ncmpi_rename_att()  : dispatcher->rename_att()
  * ncmpi_del_att()     : dispatcher->del_att()
  * ncmpi_put_att()     : dispatcher->put_att()
+ * ncmpi_put_atts()    : dispatcher->put_atts()
  * ncmpi_get_att()     : dispatcher->get_att()
  */
 
@@ -121,6 +122,7 @@ ncmpio_free_NC_attr(NC_attr *attrp)
 static int
 dup_NC_attr(const NC_attr *rattrp, NC_attr **attrp)
 {
+    int err;
     char *name;
 
     /* rattrp->name has already been normalized */
@@ -128,7 +130,17 @@ dup_NC_attr(const NC_attr *rattrp, NC_attr **attrp)
     if (name == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
     strcpy(name, rattrp->name);
 
-    return ncmpio_new_NC_attr(name, rattrp->xtype, rattrp->nelems, attrp);
+    err = ncmpio_new_NC_attr(name, rattrp->xtype, rattrp->nelems, attrp);
+    if (err != NC_NOERR) {
+        NCI_Free(name);
+        return err;
+    }
+
+    /* copy the attribute values in external representation */
+    if (rattrp->xsz > 0)
+        memcpy((*attrp)->xvalue, rattrp->xvalue, (size_t)rattrp->xsz);
+
+    return NC_NOERR;
 }
 
 /* attrarray */
@@ -161,7 +173,7 @@ ncmpio_free_NC_attrarray(NC_attrarray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for attribute name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -200,7 +212,7 @@ ncmpio_dup_NC_attrarray(NC_attrarray *ncap, const NC_attrarray *ref)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* duplicate attribute name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
 #endif
 
     return NC_NOERR;
@@ -254,7 +266,12 @@ int
 ncmpio_NC_findattr(const NC_attrarray *ncap,
                    const char         *name) /* normalized string */
 {
-    int i, key;
+#ifdef SEARCH_NAME_LINEARLY
+    int i;
+#else
+    int slot, attr_id;
+    unsigned int key;
+#endif
     size_t nchars;
 
     assert(ncap != NULL);
@@ -276,10 +293,10 @@ ncmpio_NC_findattr(const NC_attrarray *ncap,
     /* hash name into a key for name lookup */
     key = HASH_FUNC(name);
 
-    /* check the list (all names sharing the same key) using linear search */
+    /* check the IDs of all names sharing the same key */
     nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        int attr_id = ncap->nameT[key].list[i];
+    slot = -1;
+    while ((attr_id = ncmpio_hash_probe(&ncap->nameT, key, &slot)) >= 0) {
         if (ncap->value[attr_id]->name_len == nchars &&
             strcmp(name, ncap->value[attr_id]->name) == 0) {
             return attr_id; /* the name already exists */
@@ -423,6 +440,9 @@ ncmpio_rename_att(void       *ncdp,
     NC_attrarray *ncap=NULL;
     NC_attr *attrp=NULL;
 
+    /* in root-define mode, non-root gets the new name at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
     ncap = NC_attrarray0(ncp, varid);
     if (ncap == NULL) {
         DEBUG_ASSIGN_ERROR(err, NC_ENOTVAR)
@@ -484,20 +504,26 @@ err_check:
     assert(attrp != NULL);
 
 #ifndef SEARCH_NAME_LINEARLY
-    ncmpio_hash_replace(ncap->nameT, attrp->name, nnewname, attr_id);
+    ncmpio_hash_replace(&ncap->nameT, attrp->name, nnewname, attr_id);
 #endif
 
+    if (! NC_indef(ncp)) { /* when file is in data mode */
+        /* rewrite only the name if its space in the header is unchanged */
+        if (_RNDUP(nnewname_len, X_ALIGN) == _RNDUP(attrp->name_len, X_ALIGN))
+            ncmpio_hdr_set_dirty(ncp,
+                                 ncmpio_hdr_off_NC_attr(ncp, varid, attr_id, NULL),
+                                 ncmpio_hdr_len_NC_name(ncp, nnewname_len));
+        else
+            set_NC_hdirty(ncp);
+    }
+
     /* replace the old name with new name */
     NCI_Free(attrp->name);
     attrp->name     = nnewname;
     attrp->name_len = nnewname_len;
 
     if (! NC_indef(ncp)) { /* when file is in data mode */
-        /* Let root write the entire header to the file. Note that we cannot
-         * just update the variable name in its space occupied in the file
-         * header, because if the file space occupied by the name shrinks, all
-         * the metadata following it must be moved ahead.
-         */
+        /* Let root write the modified part of the header to the file */
         err = ncmpio_write_header(ncp);
         if (err != NC_NOERR) DEBUG_RETURN_ERROR(err)
     }
@@ -527,6 +553,9 @@ ncmpio_copy_att(void       *ncdp_in,
     NC_attrarray *ncap_out=NULL, *ncap_in;
     NC_attr *iattrp=NULL, *attrp=NULL;
 
+    /* in root-define mode, non-root gets the attribute at enddef */
+    if (NC_skip_define(ncp_out)) return NC_NOERR;
+
     ncap_in = NC_attrarray0(ncp_in, varid_in);
     if (ncap_in == NULL) {
         DEBUG_ASSIGN_ERROR(err, NC_ENOTVAR)
@@ -619,6 +648,18 @@ err_check:
         /* reuse existing attribute array slot without redef */
         attrp = ncap_out->value[indx];
 
+        if (!NC_indef(ncp_out)) {
+            /* in data mode, the attribute can be updated in place in the file
+             * header only if the space it occupies is unchanged */
+            if (iattrp->xsz == attrp->xsz) {
+                MPI_Offset off, len;
+                off = ncmpio_hdr_off_NC_attr(ncp_out, varid_out, indx, &len);
+                ncmpio_hdr_set_dirty(ncp_out, off, len);
+            }
+            else
+                set_NC_hdirty(ncp_out);
+        }
+
         if (iattrp->xsz > attrp->xsz) {
             if (attrp->xvalue != NULL) NCI_Free(attrp->xvalue);
             attrp->xvalue = NCI_Malloc((size_t)iattrp->xsz);
@@ -633,7 +674,7 @@ err_check:
         if (err != NC_NOERR) return err;
 
 #ifndef SEARCH_NAME_LINEARLY
-        ncmpio_hash_insert(ncap_out->nameT, nname, ncap_out->ndefined);
+        ncmpio_hash_insert(&ncap_out->nameT, nname, ncap_out->ndefined);
 #endif
 
         err = incr_NC_attrarray(ncap_out, attrp);
@@ -644,11 +685,7 @@ err_check:
         memcpy(attrp->xvalue, iattrp->xvalue, (size_t)iattrp->xsz);
 
     if (!NC_indef(ncp_out)) { /* called in data mode */
-        /* Let root write the entire header to the file. Note that we
-         * cannot just update the variable name in its space occupied in
-         * the file header, because if the file space occupied by the name
-         * shrinks, all the metadata following it must be moved ahead.
-         */
+        /* Let root write the modified part of the header to the file */
         err = ncmpio_write_header(ncp_out); /* update file header */
         if (err != NC_NOERR) DEBUG_RETURN_ERROR(err)
     }
@@ -668,6 +705,9 @@ ncmpio_del_att(void       *ncdp,
     NC *ncp=(NC*)ncdp;
     NC_attrarray *ncap=NULL;
 
+    /* in root-define mode, non-root gets the attributes at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
     /* check NC_ENOTVAR */
     ncap = NC_attrarray0(ncp, varid);
     if (ncap == NULL) {
@@ -687,7 +727,7 @@ ncmpio_del_att(void       *ncdp,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* delete name entry from hash table */
-    err = ncmpio_hash_delete(ncap->nameT, nname, attrid);
+    err = ncmpio_hash_delete(&ncap->nameT, nname, attrid);
     if (err != NC_NOERR) goto err_check;
 #endif
 
@@ -796,9 +836,11 @@ ncmpio_get_att(void         *ncdp,
 
     /* sanity checks for varid and name has been done in dispatcher */
 
-    /* obtain NC_attrarray object pointer */
-    if (varid == NC_GLOBAL) ncap = &ncp->attrs;
-    else                    ncap = &ncp->vars.value[varid]->attrs;
+    /* obtain NC_attrarray object pointer. In root-define mode, variables
+     * defined in the current define mode are not available on non-root
+     * processes until enddef */
+    ncap = NC_attrarray0(ncp, varid);
+    if (ncap == NULL) DEBUG_RETURN_ERROR(NC_ENOTVAR)
 
     /* create a normalized character string */
     err = ncmpii_utf8_normalize(name, &nname);
@@ -924,7 +966,7 @@ foreach(`iType', (schar,uchar,short,ushort,int,uint,float,double,longlong,ulongl
  *
  */
 
-/*----< ncmpio_put_att() >---------------------------------------------------*/
+/*----< NC_put_att() >-------------------------------------------------------*/
 /* This is a collective subroutine, all arguments should be consistent among
  * all processes.
  *
@@ -944,20 +986,21 @@ foreach(`iType', (schar,uchar,short,ushort,int,uint,float,double,longlong,ulongl
  *        type of buf matches the external type of attribute defined in file.
  *        For other MPI promitive data type, it corresponds to the type names
  *        shown in the API name.
+ *
+ * In data mode, the caller writes the updated file header.
  */
-int
-ncmpio_put_att(void         *ncdp,
-               int           varid,
-               const char   *name,
-               nc_type       xtype,  /* external (file/NC) data type */
-               MPI_Offset    nelems,
-               const void   *buf,
-               MPI_Datatype  itype)  /* internal (memory) data type */
+static int
+NC_put_att(NC           *ncp,
+           int           varid,
+           const char   *name,
+           nc_type       xtype,  /* external (file/NC) data type */
+           MPI_Offset    nelems,
+           const void   *buf,
+           MPI_Datatype  itype)  /* internal (memory) data type */
 {
     int indx=0, err;
     char *nname=NULL; /* normalized name */
     MPI_Offset xsz=0;
-    NC *ncp=(NC*)ncdp;
     NC_attrarray *ncap=NULL;
     NC_attr *attrp=NULL;
 
@@ -1060,6 +1103,18 @@ err_check:
         NCI_Free(nname);
         attrp = ncap->value[indx]; /* convenience */
 
+        if (!NC_indef(ncp)) {
+            /* in data mode, the attribute can be updated in place in the file
+             * header only if the space it occupies is unchanged */
+            if (xsz == attrp->xsz) {
+                MPI_Offset off, len;
+                off = ncmpio_hdr_off_NC_attr(ncp, varid, indx, &len);
+                ncmpio_hdr_set_dirty(ncp, off, len);
+            }
+            else
+                set_NC_hdirty(ncp);
+        }
+
         if (xsz > attrp->xsz) { /* new attribute requires a larger space */
             if (attrp->xvalue != NULL) NCI_Free(attrp->xvalue);
             attrp->xvalue = NCI_Malloc((size_t)xsz);
@@ -1074,7 +1129,7 @@ err_check:
         if (err != NC_NOERR) return err;
 
 #ifndef SEARCH_NAME_LINEARLY
-        ncmpio_hash_insert(ncap->nameT, nname, ncap->ndefined);
+        ncmpio_hash_insert(&ncap->nameT, nname, ncap->ndefined);
 #endif
 
         err = incr_NC_attrarray(ncap, attrp);
@@ -1156,11 +1211,32 @@ err_check:
 */
     }
 
-    if (!NC_indef(ncp)) { /* called in data mode */
-        /* Let root write the entire header to the file. Note that we
-         * cannot just update the attribute in its space occupied in the
-         * file header, because if the file space occupied by the attribute
-         * shrinks, all the metadata following it must be moved ahead.
+    return err;
+}
+
+/*----< ncmpio_put_att() >---------------------------------------------------*/
+/* This is a collective subroutine. See NC_put_att() for its semantics. */
+int
+ncmpio_put_att(void         *ncdp,
+               int           varid,
+               const char   *name,
+               nc_type       xtype,  /* external (file/NC) data type */
+               MPI_Offset    nelems,
+               const void   *buf,
+               MPI_Datatype  itype)  /* internal (memory) data type */
+{
+    int err;
+    NC *ncp=(NC*)ncdp;
+
+    /* in root-define mode, non-root gets the attribute at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
+    err = NC_put_att(ncp, varid, name, xtype, nelems, buf, itype);
+
+    if (!NC_indef(ncp) && (err == NC_NOERR || err == NC_ERANGE)) {
+        /* called in data mode. Let root write the modified part of the
+         * header to the file. If the attribute shrinks, all the metadata
+         * following it must be moved ahead and the entire header is written.
          */
         int status;
         status = ncmpio_write_header(ncp); /* update file header */
@@ -1169,3 +1245,52 @@ err_check:
 
     return err;
 }
+
+/*----< ncmpio_put_atts() >--------------------------------------------------*/
+/* This is a collective subroutine that puts natts attributes of the same
+ * variable, each buffer is of the C type of its external type. The name
+ * lookup table is grown once for all new attributes and, in data mode, the
+ * file header is written once at the end.
+ */
+int
+ncmpio_put_atts(void              *ncdp,
+                int                varid,
+                int                natts,
+                char*       const *names,
+                const nc_type     *xtypes,
+                const MPI_Offset  *nelems,
+                void*       const *bufs)
+{
+    int i, err, status=NC_NOERR;
+    NC *ncp=(NC*)ncdp;
+
+    /* in root-define mode, non-root gets the attributes at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
+#ifndef SEARCH_NAME_LINEARLY
+    if (NC_indef(ncp)) {
+        NC_attrarray *ncap;
+
+        ncap = (varid == NC_GLOBAL) ? &ncp->attrs
+                                    : &ncp->vars.value[varid]->attrs;
+        ncmpio_hash_table_grow(&ncap->nameT, natts);
+    }
+#endif
+
+    for (i=0; i<natts; i++) {
+        MPI_Datatype itype = ncmpii_nc2mpitype(xtypes[i]);
+
+        err = NC_put_att(ncp, varid, names[i], xtypes[i], nelems[i], bufs[i],
+                         itype);
+        /* NC_ERANGE is not fatal, the attribute has been added */
+        if (err != NC_NOERR && err != NC_ERANGE) return err;
+        if (status == NC_NOERR) status = err;
+    }
+
+    if (!NC_indef(ncp) && natts > 0) { /* called in data mode */
+        err = ncmpio_write_header(ncp); /* update file header */
+        if (status == NC_NOERR) status = err;
+    }
+
+    return status;
+}
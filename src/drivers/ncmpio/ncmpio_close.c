@@ -67,6 +67,15 @@ ncmpio_close_files(NC *ncp, int doUnlink) {
             return ncmpii_error_mpi2nc(mpireturn, "MPI_File_close");
     }
 
+    /* file handle and communicators used by intra-node aggregation */
+    if (ncp->leader_fh != MPI_FILE_NULL) {
+        TRACE_IO(MPI_File_close)(&ncp->leader_fh);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_File_close");
+    }
+    if (ncp->leader_comm != MPI_COMM_NULL) MPI_Comm_free(&ncp->leader_comm);
+    if (ncp->node_comm   != MPI_COMM_NULL) MPI_Comm_free(&ncp->node_comm);
+
     if (doUnlink) {
         /* called from ncmpi_abort, if the file is being created and is still
          * in define mode, the file is deleted */
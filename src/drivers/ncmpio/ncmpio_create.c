@@ -239,14 +239,9 @@ ncmpio_create(MPI_Comm     comm,
     ncp->get_size     = 0;    /* bytes read    so far */
 
 #ifndef SEARCH_NAME_LINEARLY
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        /* initialize dim name lookup table */
-        ncp->dims.nameT[i].num = 0;
-        ncp->dims.nameT[i].list = NULL;
-        /* initialize var name lookup table */
-        ncp->vars.nameT[i].num = 0;
-        ncp->vars.nameT[i].list = NULL;
-    }
+    /* initialize dim and var name lookup tables */
+    memset(&ncp->dims.nameT, 0, sizeof(NC_nametable));
+    memset(&ncp->vars.nameT, 0, sizeof(NC_nametable));
 #endif
 
 #ifdef ENABLE_SUBFILING
@@ -263,6 +258,9 @@ ncmpio_create(MPI_Comm     comm,
     ncp->mpiomode       = mpiomode;
     ncp->collective_fh  = fh;
     ncp->independent_fh = MPI_FILE_NULL;
+    ncp->node_comm      = MPI_COMM_NULL; /* created when first used */
+    ncp->leader_comm    = MPI_COMM_NULL;
+    ncp->leader_fh      = MPI_FILE_NULL;
     ncp->path = (char*) NCI_Malloc(strlen(path) + 1);
     strcpy(ncp->path, path);
 
@@ -281,6 +279,14 @@ ncmpio_create(MPI_Comm     comm,
          * be '\0' (null character). In this case, safe_mode is enabled */
     }
 
+    /* root-define mode skips the consistency check of safe mode, and
+     * subfiling partitions variables on all processes */
+    MPI_Comm_rank(comm, &ncp->rank);
+    if (ncp->safe_mode) ncp->root_define = 0;
+#ifdef ENABLE_SUBFILING
+    if (ncp->subfile_mode) ncp->root_define = 0;
+#endif
+
     *ncpp = (void*)ncp;
 
     return NC_NOERR;
@@ -87,7 +87,8 @@ NC_finddim(const NC_dimarray *ncap,
            const char        *name,  /* normalized dim name */
            int               *dimidp)
 {
-    int i, key, dimid;
+    int slot, dimid;
+    unsigned int key;
     size_t nchars;
 
     if (ncap->ndefined == 0) return NC_EBADDIM;
@@ -95,10 +96,10 @@ NC_finddim(const NC_dimarray *ncap,
     /* hash the dim name into a key for name lookup */
     key = HASH_FUNC(name);
 
-    /* check the list using linear search */
+    /* check the IDs of names sharing the same key */
     nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        dimid = ncap->nameT[key].list[i];
+    slot = -1;
+    while ((dimid = ncmpio_hash_probe(&ncap->nameT, key, &slot)) >= 0) {
         if (ncap->value[dimid]->name_len == nchars &&
             strcmp(name, ncap->value[dimid]->name) == 0) {
             if (dimidp != NULL) *dimidp = dimid;
@@ -139,7 +140,7 @@ ncmpio_free_NC_dimarray(NC_dimarray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for dim name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -179,7 +180,7 @@ ncmpio_dup_NC_dimarray(NC_dimarray *ncap, const NC_dimarray *ref)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* duplicate dim name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
 #endif
 
     return NC_NOERR;
@@ -234,7 +235,7 @@ ncmpio_def_dim(void       *ncdp,    /* IN:  NC object */
     ncp->dims.ndefined++;
 
 #ifndef SEARCH_NAME_LINEARLY
-    ncmpio_hash_insert(ncp->dims.nameT, nname, dimid);
+    ncmpio_hash_insert(&ncp->dims.nameT, nname, dimid);
 #endif
 
     if (dimidp != NULL) *dimidp = dimid;
@@ -322,7 +323,7 @@ ncmpio_rename_dim(void       *ncdp,
 #ifndef SEARCH_NAME_LINEARLY
     /* update dim name lookup table, by removing the old name and add
      * the new name */
-    err = ncmpio_update_name_lookup_table(ncp->dims.nameT, dimid,
+    err = ncmpio_update_name_lookup_table(&ncp->dims.nameT, dimid,
                              ncp->dims.value[dimid]->name, nnewname);
     if (err != NC_NOERR) {
         DEBUG_TRACE_ERROR(err)
@@ -351,18 +352,28 @@ err_check:
         return err;
     }
 
-    /* replace the old name with new name */
     assert(dimp != NULL);
+
+    if (! NC_indef(ncp)) { /* when file is in data mode */
+        /* If the space occupied by the name in the file header is unchanged,
+         * only the name is rewritten in place. Otherwise, all the metadata
+         * following it must be moved ahead and root rewrites the entire
+         * header.
+         */
+        if (_RNDUP(nnewname_len, X_ALIGN) == _RNDUP(dimp->name_len, X_ALIGN))
+            ncmpio_hdr_set_dirty(ncp, ncmpio_hdr_off_NC_dim(ncp, dimid),
+                                 ncmpio_hdr_len_NC_name(ncp, nnewname_len));
+        else
+            set_NC_hdirty(ncp);
+    }
+
+    /* replace the old name with new name */
     NCI_Free(dimp->name);
     dimp->name     = nnewname;
     dimp->name_len = nnewname_len;
 
     if (! NC_indef(ncp)) { /* when file is in data mode */
-        /* Let root write the entire header to the file. Note that we cannot
-         * just update the variable name in its space occupied in the file
-         * header, because if the file space occupied by the name shrinks, all
-         * the metadata following it must be moved ahead.
-         */
+        /* Let root write the modified part of the header to the file */
         err = ncmpio_write_header(ncp);
         if (err != NC_NOERR) DEBUG_RETURN_ERROR(err)
     }
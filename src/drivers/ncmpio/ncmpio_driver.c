@@ -19,6 +19,7 @@ static PNC_driver ncmpio_driver = {
     ncmpio_close,
     ncmpio_enddef,
     ncmpio__enddef,
+    ncmpio_enddef_from,
     ncmpio_redef,
     ncmpio_sync,
     ncmpio_abort,
@@ -44,9 +45,11 @@ static PNC_driver ncmpio_driver = {
     ncmpio_del_att,
     ncmpio_get_att,
     ncmpio_put_att,
+    ncmpio_put_atts,
 
     /* VARIABLE APIs */
     ncmpio_def_var,
+    ncmpio_def_vars,
     ncmpio_def_var_fill,
     ncmpio_fill_var_rec,
     ncmpio_inq_var,
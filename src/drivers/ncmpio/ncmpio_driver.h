@@ -26,6 +26,9 @@ ncmpio_enddef(void *ncdp);
 extern int
 ncmpio__enddef(void *ncdp, MPI_Offset h_minfree, MPI_Offset v_align, MPI_Offset v_minfree, MPI_Offset r_align);
 
+extern int
+ncmpio_enddef_from(void *ncdp, void *tmpl_ncdp);
+
 extern int
 ncmpio_redef(void *ncdp);
 
@@ -97,9 +100,15 @@ ncmpio_get_att(void *ncdp, int varid, const char *name, void *value, MPI_Datatyp
 extern int
 ncmpio_put_att(void *ncdp, int varid, const char *name, nc_type xtype, MPI_Offset nelems, const void *value, MPI_Datatype itype);
 
+extern int
+ncmpio_put_atts(void *ncdp, int varid, int natts, char* const *names, const nc_type *xtypes, const MPI_Offset *nelems, void* const *values);
+
 extern int
 ncmpio_def_var(void *ncdp, const char *name, nc_type type, int ndims, const int *dimids, int *varidp);
 
+extern int
+ncmpio_def_vars(void *ncdp, int nvars, char* const *names, const nc_type *xtypes, const int *ndims, int* const *dimids, int *varids);
+
 extern int
 ncmpio_def_var_fill(void *ncdp, int varid, int nofill, const void *fill_value);
 
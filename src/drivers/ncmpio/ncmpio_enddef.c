@@ -9,6 +9,7 @@
  *
  * ncmpi_enddef()  : dispatcher->enddef()
  * ncmpi__enddef() : dispatcher->_enddef()
+ * ncmpi_create_from_template() : dispatcher->enddef_from()
  */
 
 #ifdef HAVE_CONFIG_H
@@ -244,7 +245,8 @@ NC_begins(NC *ncp)
     MPI_Comm_rank(ncp->comm, &rank);
     ncp->xsz = ncmpio_hdr_len_NC(ncp);
 
-    if (ncp->safe_mode) { /* this consistency check is redundant as metadata is
+    if (ncp->safe_mode && !ncp->root_define) {
+                          /* this consistency check is redundant as metadata is
                              kept consistent at all time when safe mode is on */
         int err, status;
         MPI_Offset root_xsz = ncp->xsz;
@@ -440,13 +442,201 @@ NC_begins(NC *ncp)
     return NC_NOERR;
 }
 
+/*----< root_define_sync() >-------------------------------------------------*/
+/* In root-define mode, only root has run the define-mode APIs of variables
+ * and attributes. Root computes the variable offsets and serializes the
+ * header once, then broadcasts it together with the variables' fill modes,
+ * which are not part of the header. Other processes discard their header
+ * objects and rebuild them from root's header using the header parser.
+ * A process whose number of variables defined differs from root's, e.g.
+ * when a def_var call failed only at root, returns NC_EMULTIDEFINE once its
+ * header objects are rebuilt, so the caller can still exit define mode.
+ */
+static int
+root_define_sync(NC *ncp)
+{
+    int i, err=NC_NOERR, mpireturn, nvars=0, mismatch;
+    char *buf=NULL, *no_fill;
+    MPI_Offset msg[9];
+
+    if (ncp->rank == 0) {
+        /* check whether sizes of all variables are legal */
+        err = ncmpio_NC_check_vlens(ncp);
+
+        /* compute each variable's 'begin' and the header size */
+        if (err == NC_NOERR) err = NC_begins(ncp);
+
+        if (err == NC_NOERR && ncp->xsz != (int)ncp->xsz)
+            DEBUG_ASSIGN_ERROR(err, NC_EINTOVERFLOW)
+
+        if (err == NC_NOERR) {
+            nvars = ncp->vars.ndefined;
+            buf = (char*) NCI_Malloc((size_t)(ncp->xsz + nvars));
+            err = ncmpio_hdr_put_NC(ncp, buf);
+            for (i=0; i<nvars; i++)
+                buf[ncp->xsz + i] = (char)ncp->vars.value[i]->no_fill;
+        }
+        msg[0] = err;
+        msg[1] = ncp->xsz;
+        msg[2] = nvars;
+        msg[3] = ncp->begin_var;
+        msg[4] = ncp->begin_rec;
+        msg[5] = ncp->recsize;
+        msg[6] = ncp->h_align;
+        msg[7] = ncp->v_align;
+        msg[8] = ncp->r_align;
+    }
+
+    TRACE_COMM(MPI_Bcast)(msg, 9, MPI_OFFSET, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        if (buf != NULL) NCI_Free(buf);
+        DEBUG_RETURN_ERROR(err)
+    }
+
+    /* root's error is returned by all processes */
+    err = (int)msg[0];
+    if (err != NC_NOERR) {
+        if (buf != NULL) NCI_Free(buf);
+        return err;
+    }
+
+    nvars = (int)msg[2];
+    if (ncp->rank > 0)
+        buf = (char*) NCI_Malloc((size_t)(msg[1] + nvars));
+
+    TRACE_COMM(MPI_Bcast)(buf, (int)msg[1] + nvars, MPI_BYTE, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        NCI_Free(buf);
+        DEBUG_RETURN_ERROR(err)
+    }
+
+    if (ncp->rank == 0) {
+        NCI_Free(buf);
+        return NC_NOERR;
+    }
+
+    /* varids returned by the skipped def_var calls must match root's */
+    mismatch = (nvars != ncp->vars.ndefined + ncp->root_def_nvars);
+
+    /* keep the fill modes, as buf is freed when the header is parsed */
+    no_fill = (char*) NCI_Malloc((size_t)nvars + 1);
+    memcpy(no_fill, buf + msg[1], (size_t)nvars);
+
+    /* rebuild the header objects from root's header */
+    ncmpio_free_NC_dimarray(&ncp->dims);
+    ncmpio_free_NC_attrarray(&ncp->attrs);
+    ncmpio_free_NC_vararray(&ncp->vars);
+    ncp->root_def_nvars = 0;
+
+    err = ncmpio_hdr_get_NC_buf(ncp, buf, (int)msg[1]);
+    if (err != NC_NOERR) {
+        NCI_Free(no_fill);
+        return err;
+    }
+
+    for (i=0; i<nvars; i++)
+        ncp->vars.value[i]->no_fill = no_fill[i];
+    NCI_Free(no_fill);
+
+#ifndef SEARCH_NAME_LINEARLY
+    ncmpio_hash_table_populate_NC_dim(&ncp->dims);
+    ncmpio_hash_table_populate_NC_var(&ncp->vars);
+    ncmpio_hash_table_populate_NC_attr(ncp);
+#endif
+
+    /* the header parser derives these from the variables, use root's */
+    ncp->xsz       = msg[1];
+    ncp->begin_var = msg[3];
+    ncp->begin_rec = msg[4];
+    ncp->recsize   = msg[5];
+    ncp->h_align   = msg[6];
+    ncp->v_align   = msg[7];
+    ncp->r_align   = msg[8];
+
+    if (mismatch) DEBUG_RETURN_ERROR(NC_EMULTIDEFINE)
+
+    return NC_NOERR;
+}
+
+/*----< check_header() >-----------------------------------------------------*/
+/* Check whether the serialized headers of all processes are the same. Each
+ * process computes a 128-bit digest of its header and a single allreduce of
+ * the header sizes and digests finds whether they all agree, moving only a few
+ * bytes per process. Only when they disagree and PNETCDF_DEBUG is defined,
+ * root's header is broadcast and compared byte by byte to report where a
+ * process's header differs.
+ * Return NC_EMULTIDEFINE if the headers are inconsistent.
+ */
+static int
+check_header(NC         *ncp,
+             const void *buf,
+             MPI_Offset  local_xsz,
+             int         rank)
+{
+    int i, mpireturn, status=NC_NOERR;
+    unsigned long long digest[2];
+    MPI_Offset msg[6];
+#ifdef PNETCDF_DEBUG
+    int err;
+    char *root_header;
+#endif
+
+    ncmpio_digest128(buf, (size_t)local_xsz, digest);
+
+    /* max of x and of ~x, as ~max(~x) is min(x) */
+    msg[0] = local_xsz;
+    msg[1] = (MPI_Offset)digest[0];
+    msg[2] = (MPI_Offset)digest[1];
+    for (i=0; i<3; i++) msg[i+3] = ~msg[i];
+
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, msg, 6, MPI_OFFSET, MPI_MAX,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+
+    for (i=0; i<3; i++)
+        if (msg[i] != ~msg[i+3]) break;
+    if (i == 3) return NC_NOERR; /* all digests agree */
+
+#ifdef PNETCDF_DEBUG
+    /* compare against root's header byte by byte to report where it differs */
+    if (ncp->xsz != (int)ncp->xsz) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+
+    if (rank == 0) root_header = (char*)buf;
+    else           root_header = (char*) NCI_Malloc((size_t)ncp->xsz);
+
+    TRACE_COMM(MPI_Bcast)(root_header, (int)ncp->xsz, MPI_BYTE, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        if (rank > 0) NCI_Free(root_header);
+        DEBUG_RETURN_ERROR(err)
+    }
+
+    if (rank > 0) {
+        MPI_Offset len = MIN(local_xsz, ncp->xsz);
+        for (i=0; i<len; i++)
+            if (((const char*)buf)[i] != root_header[i]) break;
+        if (i < len || local_xsz != ncp->xsz)
+            fprintf(stderr, "Rank %d: header differs from root's at byte %d (size %lld, root's %lld)\n",
+                    rank, i, (long long)local_xsz, (long long)ncp->xsz);
+        NCI_Free(root_header);
+    }
+#endif
+
+    /* all processes return the same error */
+    DEBUG_ASSIGN_ERROR(status, NC_EMULTIDEFINE)
+    return status;
+}
+
 /*----< write_NC() >---------------------------------------------------------*/
 /*
  * This function is collective and only called by enddef().
  * Write out the header
  * 1. Call ncmpio_hdr_put_NC() to copy the header object, ncp, to a buffer.
- * 2. Call NC_check_header() to check if header is consistent across all
- *    processes.
+ * 2. In safe mode, call check_header() to check if header is consistent
+ *    across all processes.
  * 3. Process rank 0 writes the header to file.
  * This is a collective call.
  */
@@ -459,6 +649,13 @@ write_NC(NC *ncp)
 
     assert(!NC_readonly(ncp));
 
+    /* In root-define mode, all processes have root's header and only root
+     * writes it */
+    if (ncp->root_define && ncp->rank > 0) {
+        fClr(ncp->flags, NC_NDIRTY);
+        return NC_NOERR;
+    }
+
     /* In NC_begins(), root's ncp->xsz, root's header size, has been
      * broadcast, so ncp->xsz is now root's header size. To check any
      * inconsistency in file header, we need to calculate local header
@@ -481,42 +678,16 @@ write_NC(NC *ncp)
 
     MPI_Comm_rank(ncp->comm, &rank);
 
-#ifdef _DIFF_HEADER
-    if (ncp->safe_mode == 0) {
-        int h_size=(int)ncp->xsz;
-        void *root_header;
-
+    if (ncp->safe_mode == 1) {
         /* check header against root's */
-        if (rank == 0) root_header = buf;
-        else           root_header = (void*) NCI_Malloc((size_t)h_size);
-
-        TRACE_COMM(MPI_Bcast)(root_header, h_size, MPI_BYTE, 0, ncp->comm);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
-            DEBUG_RETURN_ERROR(err)
-        }
-
-        if (rank > 0) {
-            if (h_size != local_xsz || memcmp(buf, root_buf, h_size))
-                status = NC_EMULTIDEFINE;
-            NCI_Free(root_buf);
-        }
-
-        /* report error if header is inconsistency */
-        TRACE_COMM(MPI_Allreduce)(&status, &err, 1, MPI_INT, MPI_MIN,ncp->comm);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
-            DEBUG_RETURN_ERROR(err)
-        }
-        if (err != NC_NOERR) {
-            /* TODO: this error return is harsh. Maybe relax for inconsistent
-             * attribute contents? */
-            if (status == NC_NOERR) status = err;
+        err = check_header(ncp, buf, local_xsz, rank);
+        if (err != NC_NOERR && !ErrIsHeaderDiff(err)) {
             NCI_Free(buf);
-            return status;
+            return err;
         }
+        /* inconsistent header is not fatal, root's header is written */
+        status = err;
     }
-#endif
 
 #ifdef _CHECK_HEADER_CONSISTENCY
     /* check the header consistency across all processes and sync header.
@@ -818,6 +989,7 @@ ncmpio__enddef(void       *ncdp,
                MPI_Offset  r_align)
 {
     int i, flag, striping_unit, mpireturn, err=NC_NOERR, status=NC_NOERR;
+    int sync_err=NC_NOERR;
     char value[MPI_MAX_INFO_VAL];
     MPI_Offset all_fix_var_size;
     NC *ncp = (NC*)ncdp;
@@ -910,21 +1082,34 @@ ncmpio__enddef(void       *ncdp,
     }
 #endif
 
-    /* check whether sizes of all variables are legal */
-    err = ncmpio_NC_check_vlens(ncp);
-    CHECK_ERROR(err)
+    if (ncp->root_define) {
+        /* root computes the variable offsets and broadcasts the header */
+        err = root_define_sync(ncp);
+        if (err == NC_EMULTIDEFINE) {
+            /* header objects are rebuilt from root's, continue to exit
+             * define mode and report the error at the end */
+            sync_err = err;
+            err = NC_NOERR;
+        }
+        CHECK_ERROR(err)
+    }
+    else {
+        /* check whether sizes of all variables are legal */
+        err = ncmpio_NC_check_vlens(ncp);
+        CHECK_ERROR(err)
 
-    /* When ncp->old == NULL, this enddef is called the first time after file
-     * create call. In this case, we compute each variable's 'begin', starting
-     * file offset as well as the offsets of record variables.
-     * When ncp->old != NULL, this enddef is called after a redef. In this
-     * case, we re-used all variable offsets as many as possible.
-     *
-     * Note in NC_begins, root broadcasts ncp->xsz, the file header size, to
-     * all processes.
-     */
-    err = NC_begins(ncp);
-    CHECK_ERROR(err)
+        /* When ncp->old == NULL, this enddef is called the first time after
+         * file create call. In this case, we compute each variable's 'begin',
+         * starting file offset as well as the offsets of record variables.
+         * When ncp->old != NULL, this enddef is called after a redef. In this
+         * case, we re-used all variable offsets as many as possible.
+         *
+         * Note in NC_begins, root broadcasts ncp->xsz, the file header size,
+         * to all processes.
+         */
+        err = NC_begins(ncp);
+        CHECK_ERROR(err)
+    }
 
     if (ncp->safe_mode) {
         /* check whether variable begins are in an increasing order.
@@ -987,6 +1172,7 @@ ncmpio__enddef(void       *ncdp,
      * writes the header to file. Note safe_mode error check will be done in
      * write_NC() */
     status = write_NC(ncp);
+    if (status == NC_NOERR) status = sync_err;
 
     /* we should continue to exit define mode, even if header is inconsistent
      * among processes, so the program can proceed, say to close file properly.
@@ -1039,3 +1225,85 @@ ncmpio_enddef(void *ncdp)
     return ncmpio__enddef(ncdp, 0, 0, 0, 0);
 }
 
+
+/*----< ncmpio_enddef_from() >-----------------------------------------------*/
+/* This is a collective subroutine, called right after ncmpio_create() to copy
+ * the header of an opened file, tmpl_ncdp, to the new file and enter data
+ * mode. The template's header has been checked for consistency and its
+ * variable offsets have been computed when it was created or opened. Thus,
+ * the new file reuses the offsets and only root writes the header, skipping
+ * NC_begins(), the checks of variable sizes, and the consistency check of the
+ * header.
+ */
+int
+ncmpio_enddef_from(void *ncdp,
+                   void *tmpl_ncdp)
+{
+    int i, mpireturn, err=NC_NOERR, status;
+    char value[MPI_MAX_INFO_VAL];
+    NC *ncp = (NC*)ncdp;
+    NC *tmpl = (NC*)tmpl_ncdp;
+
+    /* the new file has nothing defined and the template is in data mode, both
+     * have been checked at dispatchers */
+    assert(NC_IsNew(ncp) && ncp->vars.ndefined == 0);
+    assert(!NC_indef(tmpl));
+
+#ifdef ENABLE_SUBFILING
+    /* subfiles split the variables, which requires NC_begins() */
+    if (ncp->num_subfiles > 1 || tmpl->num_subfiles > 1)
+        DEBUG_ASSIGN_ERROR(err, NC_ENOTSUPPORT)
+#endif
+
+    /* copy dimensions, global attributes, and variables, including their
+     * attributes, offsets, and name lookup tables */
+    if (err == NC_NOERR &&
+        (ncmpio_dup_NC_dimarray(&ncp->dims,   &tmpl->dims)  != NC_NOERR ||
+         ncmpio_dup_NC_attrarray(&ncp->attrs, &tmpl->attrs) != NC_NOERR ||
+         ncmpio_dup_NC_vararray(&ncp->vars,   &tmpl->vars)  != NC_NOERR))
+        DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+    CHECK_ERROR(err)
+    ncp->dims.unlimited_id = tmpl->dims.unlimited_id;
+
+    /* reuse the template's file layout */
+    ncp->format    = tmpl->format;
+    ncp->xsz       = tmpl->xsz;
+    ncp->begin_var = tmpl->begin_var;
+    ncp->begin_rec = tmpl->begin_rec;
+    ncp->recsize   = tmpl->recsize;
+    ncp->numrecs   = 0;
+    ncp->h_align   = tmpl->h_align;
+    ncp->v_align   = tmpl->v_align;
+    ncp->r_align   = tmpl->r_align;
+    ncp->h_minfree = tmpl->h_minfree;
+    ncp->v_minfree = tmpl->v_minfree;
+
+    /* reflect the alignments used to the MPI info object */
+    sprintf(value, "%lld", ncp->h_align);
+    MPI_Info_set(ncp->mpiinfo, "nc_header_align_size", value);
+    sprintf(value, "%lld", ncp->v_align);
+    MPI_Info_set(ncp->mpiinfo, "nc_var_align_size", value);
+    sprintf(value, "%lld", ncp->r_align);
+    MPI_Info_set(ncp->mpiinfo, "nc_record_align_size", value);
+
+    /* as in a newly defined variable, the fill mode is the file's */
+    ncp->vars.num_rec_vars = 0;
+    for (i=0; i<ncp->vars.ndefined; i++) {
+        ncp->vars.value[i]->no_fill = NC_dofill(ncp) ? 0 : 1;
+        ncp->vars.num_rec_vars += IS_RECVAR(ncp->vars.value[i]);
+    }
+
+    /* only root writes the header, which also syncs the file if NC_SHARE is
+     * set */
+    status = ncmpio_write_header(ncp);
+
+    /* fill variables according to their fill mode settings */
+    if (ncp->vars.ndefined > 0 && NC_dofill(ncp)) {
+        err = ncmpio_fill_vars(ncp);
+        if (status == NC_NOERR) status = err;
+    }
+
+    fClr(ncp->flags, NC_MODE_CREATE | NC_MODE_DEF);
+
+    return status;
+}
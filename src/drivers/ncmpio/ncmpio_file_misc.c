@@ -396,6 +396,22 @@ ncmpio_inq_misc(void       *ncdp,
         sprintf(value, "%d", ncp->chunk);
         MPI_Info_set(*info_used, "nc_header_read_chunk_size", value);
 
+        sprintf(value, "%lld", ncp->pipe_size);
+        MPI_Info_set(*info_used, "nc_put_pipeline_size", value);
+
+        sprintf(value, "%d", ncp->num_aggrs);
+        MPI_Info_set(*info_used, "nc_num_aggrs", value);
+
+        if (ncp->node_aggr)
+            MPI_Info_set(*info_used, "nc_node_aggr", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_node_aggr", "disable");
+
+        if (ncp->root_define)
+            MPI_Info_set(*info_used, "nc_root_define", "enable");
+        else
+            MPI_Info_set(*info_used, "nc_root_define", "disable");
+
 #ifdef ENABLE_SUBFILING
         if (ncp->subfile_mode)
             MPI_Info_set(*info_used, "pnetcdf_subfiling", "enable");
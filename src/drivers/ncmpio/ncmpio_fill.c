@@ -776,6 +776,9 @@ ncmpio_def_var_fill(void       *ncdp,
     NC *ncp=(NC*)ncdp;
     NC_var *varp=NULL;
 
+    /* in root-define mode, non-root gets the fill mode at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
     /* sanity check for ncdp and varid has been done in dispatchers */
     varp = ncp->vars.value[varid];
 
@@ -103,6 +103,188 @@ dnl
      7. free up temp buffers (lbuf, cbuf, xbuf if != buf)
 */
 
+/*----< convert_chunk() >----------------------------------------------------*/
+/* type-convert and/or byte-swap a chunk of user buffer into staging buffer */
+static int
+convert_chunk(NC           *ncp,
+              NC_var       *varp,
+              const void   *buf,     /* user buffer, of internal type itype */
+              MPI_Offset    nelems,
+              MPI_Datatype  itype,
+              int           need_convert,
+              void         *fillp,
+              void         *xbuf)    /* staging buffer, of external type */
+{
+    if (need_convert)
+        return ncmpio_put_convert(ncp->format, varp, buf, nelems, itype, fillp,
+                                  xbuf);
+
+    ncmpii_swapn(xbuf, buf, nelems, varp->xsz);
+    return NC_NOERR;
+}
+
+/*----< put_pipelined() >----------------------------------------------------*/
+/* Write buf to the file view already set on fh. When pipeline is 1, buf is
+ * the contiguous user buffer in internal type, datatype, and is converted
+ * (type-casted and/or byte-swapped) one chunk at a time into two staging
+ * buffers of size ncp->pipe_size used alternately. Converting a chunk is
+ * overlapped with writing the previous chunk, using split collective writes
+ * in collective mode and nonblocking writes in independent mode. The user
+ * buffer is never modified and no buffer of the whole request size is
+ * allocated. When pipeline is 0, buf is already in the external
+ * representation and is written by the first call. In collective mode, all
+ * processes must make the same number of write calls, thus the max number of
+ * chunks among all processes is used.
+ */
+static int
+put_pipelined(NC           *ncp,
+              NC_var       *varp,
+              MPI_File      fh,
+              int           reqMode,
+              MPI_Offset    offset,   /* explicit offset in file view */
+              int           pipeline,
+              int           need_convert,
+              void         *buf,
+              int           nelems,   /* number of elements in buf */
+              MPI_Datatype  datatype) /* itype if pipeline, otherwise xtype */
+{
+    int el_size, wlen, mpireturn, started, err, status=NC_NOERR, coll;
+    char *bufp=(char*)buf;
+    void *wbuf, *fillp=NULL, *stage[2]={NULL, NULL};
+    MPI_Offset k, nchunks, max_nchunks, chunk=0, len=0, next_len;
+    MPI_Datatype xtype=MPI_BYTE, wtype;
+    MPI_Request req;
+    MPI_Status mpistatus;
+
+    coll = fIsSet(reqMode, NC_REQ_COLL);
+    MPI_Type_size(datatype, &el_size);
+
+    if (pipeline) {
+        /* number of elements in a chunk */
+        chunk = ncp->pipe_size / varp->xsz;
+        if (chunk == 0) chunk = 1;
+
+        xtype = ncmpii_nc2mpitype(varp->xtype);
+        stage[0] = NCI_Malloc((size_t)(chunk * varp->xsz));
+        stage[1] = NCI_Malloc((size_t)(chunk * varp->xsz));
+        if (stage[0] == NULL || stage[1] == NULL) {
+            DEBUG_ASSIGN_ERROR(status, NC_ENOMEM)
+            pipeline = 0; /* participate collective calls with zero length */
+            nelems   = 0;
+        }
+        else if (need_convert) {
+            /* find the fill value */
+            fillp = NCI_Malloc((size_t)varp->xsz);
+            ncmpio_inq_var_fill(varp, fillp);
+        }
+    }
+    nchunks = (pipeline) ? (nelems + chunk - 1) / chunk : 1;
+
+    max_nchunks = nchunks;
+    if (coll) {
+        TRACE_COMM(MPI_Allreduce)(&nchunks, &max_nchunks, 1, MPI_OFFSET,
+                                  MPI_MAX, ncp->comm);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+            if (status == NC_NOERR) status = err;
+            max_nchunks = nchunks;
+        }
+    }
+
+    if (pipeline) { /* convert the first chunk */
+        len = MIN(chunk, nelems);
+        err = convert_chunk(ncp, varp, bufp, len, datatype, need_convert,
+                            fillp, stage[0]);
+        if (status == NC_NOERR) status = err; /* can only be NC_ERANGE */
+    }
+
+    for (k=0; k<max_nchunks; k++) {
+        if (pipeline) {
+            wbuf  = stage[k%2];
+            wlen  = (int)len;
+            wtype = xtype;
+        }
+        else if (k == 0) {
+            wbuf  = buf;
+            wlen  = nelems;
+            wtype = datatype;
+        }
+        else { /* zero-length to participate the collective write */
+            wbuf  = NULL;
+            wlen  = 0;
+            wtype = MPI_BYTE;
+        }
+
+        /* start writing chunk k */
+        if (coll)
+            TRACE_IO(MPI_File_write_at_all_begin)(fh, offset, wbuf, wlen,
+                                                  wtype);
+        else
+            TRACE_IO(MPI_File_iwrite_at)(fh, offset, wbuf, wlen, wtype, &req);
+        started = (mpireturn == MPI_SUCCESS);
+        if (!started) {
+            err = ncmpii_error_mpi2nc(mpireturn, (coll) ?
+                  "MPI_File_write_at_all_begin" : "MPI_File_iwrite_at");
+            /* return the first encountered error if there is any */
+            if (status == NC_NOERR) {
+                err = (err == NC_EFILE) ? NC_EWRITE : err;
+                DEBUG_ASSIGN_ERROR(status, err)
+            }
+        }
+
+        /* convert chunk k+1, while chunk k is being written */
+        next_len = 0;
+        if (pipeline && k + 1 < nchunks) {
+            bufp += len * el_size;
+            next_len = MIN(chunk, nelems - (k + 1) * chunk);
+            err = convert_chunk(ncp, varp, bufp, next_len, datatype,
+                                need_convert, fillp, stage[(k+1)%2]);
+            if (status == NC_NOERR) status = err;
+        }
+
+        /* complete writing chunk k */
+        if (started) {
+#ifdef _USE_MPI_GET_COUNT
+            /* explicitly initialize mpistatus object to 0 */
+            memset(&mpistatus, 0, sizeof(MPI_Status));
+#endif
+            if (coll)
+                TRACE_IO(MPI_File_write_at_all_end)(fh, wbuf, &mpistatus);
+            else
+                TRACE_IO(MPI_Wait)(&req, &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, (coll) ?
+                      "MPI_File_write_at_all_end" : "MPI_Wait");
+                if (status == NC_NOERR) {
+                    err = (err == NC_EFILE) ? NC_EWRITE : err;
+                    DEBUG_ASSIGN_ERROR(status, err)
+                }
+            }
+            else {
+#ifdef _USE_MPI_GET_COUNT
+                int put_size;
+                MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
+                ncp->put_size += put_size;
+#else
+                int type_size;
+                MPI_Type_size(wtype, &type_size);
+                ncp->put_size += (MPI_Offset)type_size * wlen;
+#endif
+            }
+        }
+
+        /* file view etype is MPI_BYTE */
+        if (pipeline) offset += len * varp->xsz;
+        len = next_len;
+    }
+
+    if (fillp    != NULL) NCI_Free(fillp);
+    if (stage[1] != NULL) NCI_Free(stage[1]);
+    if (stage[0] != NULL) NCI_Free(stage[0]);
+
+    return status;
+}
+
 /*----< put_varm() >------------------------------------------------------*/
 static int
 put_varm(NC               *ncp,
@@ -118,7 +300,8 @@ put_varm(NC               *ncp,
 {
     void *xbuf=NULL;
     int mpireturn, err=NC_NOERR, status=NC_NOERR, nelems, buftype_is_contig;
-    int el_size, need_convert, need_swap, in_place_swap, need_swap_back_buf=0;
+    int el_size, need_convert=0, need_swap, in_place_swap, need_swap_back_buf=0;
+    int pipeline=0;
     MPI_Offset bnelems=0, nbytes=0, offset=0;
     MPI_Status mpistatus;
     MPI_Datatype itype, xtype, imaptype, filetype=MPI_BYTE;
@@ -178,7 +361,18 @@ put_varm(NC               *ncp,
     err = ncmpii_create_imaptype(varp->ndims, count, imap, itype, &imaptype);
     if (err != NC_NOERR) goto err_check;
 
-    if (!need_convert && imaptype == MPI_DATATYPE_NULL &&
+    /* When hint nc_put_pipeline_size is set, a large contiguous user buffer
+     * that requires type conversion or byte swap is converted and written
+     * in chunks by put_pipelined(), without allocating xbuf or modifying
+     * buf. Noncontiguous buftype and true varm are handled as before.
+     */
+    if (ncp->pipe_size > 0 && (need_convert || need_swap) &&
+        buftype_is_contig && imaptype == MPI_DATATYPE_NULL &&
+        nbytes > ncp->pipe_size) {
+        pipeline = 1;
+        xbuf = NULL; /* buf will be converted to staging buffers */
+    }
+    else if (!need_convert && imaptype == MPI_DATATYPE_NULL &&
         (!need_swap || (in_place_swap && buftype_is_contig))) {
         /* reuse buftype, bufcount, buf in later MPI file write */
         xbuf = buf;
@@ -235,7 +429,12 @@ put_varm(NC               *ncp,
 #endif
 
     /* Set nelems and xtype which will be used in MPI read/write */
-    if (buf != xbuf) {
+    if (pipeline) {
+        /* buf is contiguous and will be converted in chunks */
+        xtype  = itype;
+        nelems = (int)bnelems;
+    }
+    else if (buf != xbuf) {
         /* xbuf is a contiguous buffer */
         xtype = ncmpii_nc2mpitype(varp->xtype);
         nelems = (int)bnelems;
@@ -261,6 +460,7 @@ err_check:
         nelems   = 0;
         filetype = MPI_BYTE;
         xtype    = MPI_BYTE;
+        pipeline = 0;
     }
     else {
         /* Create the filetype for this request and calculate the beginning
@@ -275,6 +475,7 @@ err_check:
             nelems   = 0;
             filetype = MPI_BYTE;
             xtype    = MPI_BYTE;
+            pipeline = 0;
             if (status == NC_NOERR) status = err;
         }
     }
@@ -303,38 +504,49 @@ err_check:
      * written to the variable defined in file. Note data stored in xbuf is in
      * the external data type, ready to be written to file.
      */
-    if (fIsSet(reqMode, NC_REQ_COLL)) {
-        TRACE_IO(MPI_File_write_at_all)(fh, offset, xbuf, nelems, xtype,
-                                        &mpistatus);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
-            /* return the first encountered error if there is any */
-            if (status == NC_NOERR) {
-                err = (err == NC_EFILE) ? NC_EWRITE : err;
-                DEBUG_ASSIGN_ERROR(status, err)
+    if (pipeline || (ncp->pipe_size > 0 && fIsSet(reqMode, NC_REQ_COLL))) {
+        /* In collective mode, processes not pipelining must still make the
+         * same number of write calls as the ones that are.
+         */
+        err = put_pipelined(ncp, varp, fh, reqMode, offset, pipeline,
+                            need_convert, (pipeline) ? buf : xbuf, nelems,
+                            xtype);
+        if (status == NC_NOERR) status = err;
+    }
+    else {
+        if (fIsSet(reqMode, NC_REQ_COLL)) {
+            TRACE_IO(MPI_File_write_at_all)(fh, offset, xbuf, nelems, xtype,
+                                            &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
+                /* return the first encountered error if there is any */
+                if (status == NC_NOERR) {
+                    err = (err == NC_EFILE) ? NC_EWRITE : err;
+                    DEBUG_ASSIGN_ERROR(status, err)
+                }
             }
         }
-    }
-    else {  /* reqMode == NC_REQ_INDEP */
-        TRACE_IO(MPI_File_write_at)(fh, offset, xbuf, nelems, xtype,
-                                    &mpistatus);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
-            /* return the first encountered error if there is any */
-            if (status == NC_NOERR) {
-                err = (err == NC_EFILE) ? NC_EWRITE : err;
-                DEBUG_ASSIGN_ERROR(status, err)
+        else {  /* reqMode == NC_REQ_INDEP */
+            TRACE_IO(MPI_File_write_at)(fh, offset, xbuf, nelems, xtype,
+                                        &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
+                /* return the first encountered error if there is any */
+                if (status == NC_NOERR) {
+                    err = (err == NC_EFILE) ? NC_EWRITE : err;
+                    DEBUG_ASSIGN_ERROR(status, err)
+                }
             }
         }
-    }
-    if (mpireturn == MPI_SUCCESS) {
+        if (mpireturn == MPI_SUCCESS) {
 #ifdef _USE_MPI_GET_COUNT
-        int put_size;
-        MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
-        ncp->put_size += put_size;
+            int put_size;
+            MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
+            ncp->put_size += put_size;
 #else
-        ncp->put_size += nbytes;
+            ncp->put_size += nbytes;
 #endif
+        }
     }
 
     /* done with xbuf */
@@ -12,112 +12,231 @@
 #include <stdlib.h>
 #endif
 #include <stdio.h>
-#include <string.h> /* strlen() */
+#include <string.h> /* strlen(), memcpy() */
 #include <assert.h>
 
 #include <pnc_debug.h>
 #include <common.h>
 #include "ncmpio_NC.h"
 
-/*----< ncmpio_jenkins_one_at_a_time_hash() >--------------------------------*/
-/* borrow Jenkins hash function:
- * https://en.wikipedia.org/wiki/Jenkins_hash_function
+/* The name lookup tables are open-addressing hash tables with linear probing.
+ * Each slot holds the ID of a name and the hash of the name, so a lookup
+ * compares strings only for names of the same 32-bit hash, and a table grows
+ * by rehashing the cached hashes without touching the names. The number of
+ * slots is a power of 2, kept at least twice the number of names. An empty
+ * slot has ID -1, and a table that has never been allocated (nalloc == 0) is
+ * an empty table, so a zero-initialized NC_nametable is ready to use.
  */
-int ncmpio_jenkins_one_at_a_time_hash(const char *str_name)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/*----< ncmpio_name_hash() >-------------------------------------------------*/
+/* A string hash following the round and avalanche steps of xxHash64, see
+ * https://github.com/Cyan4973/xxHash
+ * The input is consumed 8 bytes at a time, so the cost of hashing long names
+ * is low, and all bits of the result depend on all bytes of the name.
+ */
+unsigned int
+ncmpio_name_hash(const char *str_name)
 {
-    unsigned int i, hash=0;
-    for (i=0; i<strlen(str_name); ++i) {
-        hash += (unsigned int)str_name[i];
-        hash += (hash << 10);
-        hash ^= (hash >> 6);
+    size_t len = strlen(str_name);
+    const unsigned char *p = (const unsigned char*) str_name;
+    unsigned long long hash, k;
+
+    hash = PRIME64_5 + (unsigned long long)len;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&k, p, 8);
+        k *= PRIME64_2;
+        k  = ROTL64(k, 31);
+        k *= PRIME64_1;
+        hash ^= k;
+        hash  = ROTL64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    for (; len > 0; len--, p++) {
+        hash ^= (unsigned long long)(*p) * PRIME64_5;
+        hash  = ROTL64(hash, 11) * PRIME64_1;
     }
-    hash += (hash << 3);
-    hash ^= (hash >> 11);
-    hash += (hash << 15);
 
-#if 0
-    ret = (int)hash; /* the return value will be used as an array index */
-    return ((ret < 0) ? -ret : ret); /* make the value positive */
-#endif
-    /* this is to avoid expensive % operation, i.e. % HASH_TABLE_SIZE
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
-    */
-    return (int)(hash & (HASH_TABLE_SIZE-1));
-    /* return value will be used as an array index */
+    /* avalanche */
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return (unsigned int)hash;
 }
 
-/*----< ncmpio_additive_hash() >---------------------------------------------*/
-/* try different hash functions described in
- * http://www.burtleburtle.net/bob/hash/doobs.html
+/*----< ncmpio_digest128() >-------------------------------------------------*/
+/* A 128-bit digest of a byte buffer, following the body and finalization
+ * steps of MurmurHash3_x64_128, see https://github.com/aappleby/smhasher
+ * It is used to compare large buffers, such as the file header, across
+ * processes by exchanging 16 bytes instead of the buffers.
  */
-int ncmpio_additive_hash(const char *str_name)
+#define FMIX64(k) {                  \
+    (k) ^= (k) >> 33;                \
+    (k) *= 0xFF51AFD7ED558CCDULL;    \
+    (k) ^= (k) >> 33;                \
+    (k) *= 0xC4CEB9FE1A85EC53ULL;    \
+    (k) ^= (k) >> 33;                \
+}
+
+void
+ncmpio_digest128(const void         *buf,
+                 size_t              len,
+                 unsigned long long *digest) /* OUT: [2] */
 {
-    size_t i, len = strlen(str_name);
-    int hash = (int)len;
-    for (i=0; i<len; ++i)
-        hash += str_name[i]; /* additive hash */
+    const unsigned long long c1 = 0x87C37B91114253D5ULL;
+    const unsigned long long c2 = 0x4CF5AD432745937FULL;
+    const unsigned char *p = (const unsigned char*) buf;
+    unsigned long long h1 = PRIME64_5, h2 = PRIME64_5, k1, k2;
+    size_t i, nblocks = len / 16, total = len;
+
+    for (i=0; i<nblocks; i++, p+=16) {
+        memcpy(&k1, p,     8);
+        memcpy(&k2, p + 8, 8);
 
-    return (hash % 251); /* 251 is the largest prime <= 255 */
+        k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = ROTL64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = ROTL64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    /* the remaining bytes, less than 16 */
+    k1 = k2 = 0;
+    len -= nblocks * 16;
+    for (i=len; i>8; i--) k2 ^= (unsigned long long)p[i-1] << ((i-9) * 8);
+    for (i=MIN(len,8); i>0; i--) k1 ^= (unsigned long long)p[i-1] << ((i-1) * 8);
+    if (len > 8) { k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2; }
+    if (len > 0) { k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1; }
+
+    /* finalization */
+    h1 ^= (unsigned long long)total;
+    h2 ^= (unsigned long long)total;
+    h1 += h2;
+    h2 += h1;
+    FMIX64(h1)
+    FMIX64(h2)
+    h1 += h2;
+    h2 += h1;
+
+    digest[0] = h1;
+    digest[1] = h2;
 }
 
-/*----< ncmpio_rotating_hash() >---------------------------------------------*/
-int ncmpio_rotating_hash(const char *str_name)
+/*----< hash_table_resize() >------------------------------------------------*/
+/* allocate nalloc slots and move all names to the new slots */
+static void
+hash_table_resize(NC_nametable *nameT, int nalloc)
 {
-    size_t i, len = strlen(str_name);
-    unsigned int hash = (unsigned int)len;
-    for (i=0; i<len; ++i)
-        hash = (hash<<4)^(hash>>28)^(unsigned int)str_name[i];
+    int i, slot, old_nalloc = nameT->nalloc;
+    int *old_ids = nameT->ids;
+    unsigned int *old_keys = nameT->keys;
+
+    nameT->nalloc = nalloc;
+    nameT->ids    = (int*) NCI_Malloc((size_t)nalloc * SIZEOF_INT);
+    nameT->keys   = (unsigned int*) NCI_Malloc((size_t)nalloc * sizeof(unsigned int));
+    for (i=0; i<nalloc; i++) nameT->ids[i] = -1;
+
+    for (i=0; i<old_nalloc; i++) {
+        if (old_ids[i] < 0) continue;
+        slot = (int)(old_keys[i] & (unsigned int)(nalloc-1));
+        while (nameT->ids[slot] >= 0) slot = (slot+1) & (nalloc-1);
+        nameT->ids[slot]  = old_ids[i];
+        nameT->keys[slot] = old_keys[i];
+    }
+
+    if (old_nalloc > 0) {
+        NCI_Free(old_ids);
+        NCI_Free(old_keys);
+    }
+}
 
-    /* below is a clever way to replace (hash % prime) */
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
+/*----< hash_table_add() >---------------------------------------------------*/
+static void
+hash_table_add(NC_nametable *nameT, unsigned int key, int id)
+{
+    int slot;
+
+    /* keep the load factor at most 1/2 */
+    if (2 * (nameT->nused + 1) > nameT->nalloc)
+        hash_table_resize(nameT, (nameT->nalloc == 0) ? NC_NAME_TABLE_CHUNK
+                                                      : nameT->nalloc * 2);
+
+    slot = (int)(key & (unsigned int)(nameT->nalloc-1));
+    while (nameT->ids[slot] >= 0) slot = (slot+1) & (nameT->nalloc-1);
+    nameT->ids[slot]  = id;
+    nameT->keys[slot] = key;
+    nameT->nused++;
 }
 
-/*----< ncmpio_Bernstein_hash() >--------------------------------------------*/
-int ncmpio_Bernstein_hash(const char *str_name)
+/*----< hash_table_remove() >------------------------------------------------*/
+/* remove the entry of id from the table, key is the hash of its name */
+static int
+hash_table_remove(NC_nametable *nameT, unsigned int key, int id)
 {
-    size_t i, len = strlen(str_name);
-    unsigned int hash = (unsigned int)len;
-    for (i=0; i<len; ++i)
-        /* hash = 65*hash+str_name[i]; */
-        hash = hash+(hash<<6)+(unsigned int)str_name[i];
+    int slot, next, home, mask = nameT->nalloc - 1;
+
+    if (nameT->nalloc == 0) DEBUG_RETURN_ERROR(NC_ENOTATT)
+
+    /* find the slot that holds id */
+    slot = (int)(key & (unsigned int)mask);
+    while (nameT->ids[slot] != id) {
+        if (nameT->ids[slot] < 0) DEBUG_RETURN_ERROR(NC_ENOTATT)
+        slot = (slot+1) & mask;
+    }
+
+    /* move back the entries after the removed one that can no longer be
+     * reached from their home slots, so no tombstone is needed
+     */
+    next = slot;
+    while (1) {
+        next = (next+1) & mask;
+        if (nameT->ids[next] < 0) break;
+        home = (int)(nameT->keys[next] & (unsigned int)mask);
+        /* skip the entry if its home slot is cyclically in (slot, next] */
+        if (slot <= next) {
+            if (slot < home && home <= next) continue;
+        }
+        else if (slot < home || home <= next) continue;
+        nameT->ids[slot]  = nameT->ids[next];
+        nameT->keys[slot] = nameT->keys[next];
+        slot = next;
+    }
+    nameT->ids[slot] = -1;
+    nameT->nused--;
 
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
+    return NC_NOERR;
 }
 
-/*----< ncmpio_Pearson_hash() >----------------------------------------------*/
-int ncmpio_Pearson_hash(const char *str_name)
+/*----< ncmpio_hash_probe() >------------------------------------------------*/
+/* Return the next ID in the table whose name has the hash key, or -1 when
+ * there is no more. *slot must be set to -1 before the first call. Callers
+ * compare the name of each returned ID with the name being looked up.
+ */
+int
+ncmpio_hash_probe(const NC_nametable *nameT,
+                  unsigned int        key,
+                  int                *slot)
 {
-#if HASH_TABLE_SIZE == 256
-    unsigned char T[256] = {
-        251, 175, 119, 215, 81, 14, 79, 191, 103, 49, 181, 143, 186, 157,  0,
-        232, 31, 32, 55, 60, 152, 58, 17, 237, 174, 70, 160, 144, 220, 90, 57,
-        223, 59,  3, 18, 140, 111, 166, 203, 196, 134, 243, 124, 95, 222, 179,
-        197, 65, 180, 48, 36, 15, 107, 46, 233, 130, 165, 30, 123, 161, 209, 23,
-        97, 16, 40, 91, 219, 61, 100, 10, 210, 109, 250, 127, 22, 138, 29, 108,
-        244, 67, 207,  9, 178, 204, 74, 98, 126, 249, 167, 116, 34, 77, 193,
-        200, 121,  5, 20, 113, 71, 35, 128, 13, 182, 94, 25, 226, 227, 199, 75,
-        27, 41, 245, 230, 224, 43, 225, 177, 26, 155, 150, 212, 142, 218, 115,
-        241, 73, 88, 105, 39, 114, 62, 255, 192, 201, 145, 214, 168, 158, 221,
-        148, 154, 122, 12, 84, 82, 163, 44, 139, 228, 236, 205, 242, 217, 11,
-        187, 146, 159, 64, 86, 239, 195, 42, 106, 198, 118, 112, 184, 172, 87,
-        2, 173, 117, 176, 229, 247, 253, 137, 185, 99, 164, 102, 147, 45, 66,
-        231, 52, 141, 211, 194, 206, 246, 238, 56, 110, 78, 248, 63, 240, 189,
-        93, 92, 51, 53, 183, 19, 171, 72, 50, 33, 104, 101, 69, 8, 252, 83, 120,
-        76, 135, 85, 54, 202, 125, 188, 213, 96, 235, 136, 208, 162, 129, 190,
-        132, 156, 38, 47, 1, 7, 254, 24, 4, 216, 131, 89, 21, 28, 133, 37, 153,
-        149, 80, 170, 68, 6, 169, 234, 151
-    };
-    size_t i, len=strlen(str_name);
-    unsigned char hash = (unsigned char)len;
-    for (i=len; i>0; ) hash = T[hash ^ str_name[--i]];
-    return (int)hash;
-#else
-    unsigned int i, hash=strlen(str_name);
-    for (i=0; i<strlen(str_name); ++i)
-        hash ^= str_name[i];
-
-    return (int)((hash ^ (hash>>10) ^ (hash>>20)) & (HASH_TABLE_SIZE-1));
-#endif
+    int mask = nameT->nalloc - 1;
+
+    if (nameT->nalloc == 0) return -1;
+
+    *slot = (*slot < 0) ? (int)(key & (unsigned int)mask) : ((*slot+1) & mask);
+    while (nameT->ids[*slot] >= 0) {
+        if (nameT->keys[*slot] == key) return nameT->ids[*slot];
+        *slot = (*slot+1) & mask;
+    }
+    return -1;
 }
 
 /*----< ncmpio_update_name_lookup_table() >----------------------------------*/
@@ -130,45 +249,22 @@ ncmpio_update_name_lookup_table(NC_nametable *nameT,
                                 const char   *oldname,  /*    normalized */
                                 const char   *unewname) /* un-normalized */
 {
-    int i, key, err;
+    int err;
     char *name; /* normalized name string */
 
-    /* remove the old name from the lookup table
-     * hash the var name into a key for name lookup
-     */
-    key = HASH_FUNC(oldname);
-    for (i=0; i<nameT[key].num; i++) {
-        if (nameT[key].list[i] == id) break;
-    }
-    assert(i!=nameT[key].num);
-
-    /* coalesce the id array */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
-
-    /* decrease the number of IDs and free space if necessary */
-    nameT[key].num--;
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
+    /* remove the old name from the lookup table */
+    err = hash_table_remove(nameT, HASH_FUNC(oldname), id);
+    assert(err == NC_NOERR);
 
     /* normalized version of uname */
     err = ncmpii_utf8_normalize(unewname, &name);
     if (err != NC_NOERR) return err;
 
-    /* hash the var name into a key for name lookup */
-    key = HASH_FUNC(name);
-    NCI_Free(name);
-
     /* add the new name to the lookup table
      * Note unewname must have already been checked for existence
      */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) * SIZEOF_INT);
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
+    hash_table_add(nameT, HASH_FUNC(name), id);
+    NCI_Free(name);
 
     return NC_NOERR;
 }
@@ -179,20 +275,7 @@ ncmpio_hash_insert(NC_nametable *nameT, /* var name lookup table */
                    const char   *name,
                    int           id)
 {
-    int key;
-
-    /* hash the name into a key for name lookup */
-    key = HASH_FUNC(name);
-
-    /* allocate or expand the space for nameT[key].list */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) *
-                          SIZEOF_INT);
-
-    /* add the ID to the name lookup table */
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
+    hash_table_add(nameT, HASH_FUNC(name), id);
 }
 
 /*----< ncmpio_hash_delete() >-----------------------------------------------*/
@@ -202,37 +285,15 @@ ncmpio_hash_delete(NC_nametable *nameT, /* var name lookup table */
                    const char   *name,
                    int           id)
 {
-    int i, j, key;
-
-    /* hash the name into a key for name lookup */
-    key = HASH_FUNC(name);
-
-    /* find the entry from list[] that matches id */
-    for (i=0; i<nameT[key].num; i++)
-        if (nameT[key].list[i] == id)
-            break;
-
-    /* name is not found in nameT hash table */
-    if (i == nameT[key].num) DEBUG_RETURN_ERROR(NC_ENOTATT)
-
-    /* coalesce list[] */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
+    int i, err;
 
-    nameT[key].num--;
-
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
+    err = hash_table_remove(nameT, HASH_FUNC(name), id);
+    if (err != NC_NOERR) return err;
 
     /* update all IDs that are > id */
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        if (nameT[i].num == 0) continue;
-        for (j=0; j<nameT[i].num; j++)
-            if (nameT[i].list[j] > id)
-                nameT[i].list[j]--;
-    }
+    for (i=0; i<nameT->nalloc; i++)
+        if (nameT->ids[i] > id)
+            nameT->ids[i]--;
 
     return NC_NOERR;
 }
@@ -245,42 +306,12 @@ ncmpio_hash_replace(NC_nametable *nameT, /* var name lookup table */
                     const char   *new_name,
                     int           id)
 {
-    int i, key;
-
-    /* hash the old name into a key for name lookup */
-    key = HASH_FUNC(old_name);
+    int err;
 
-    /* find the entry from list[] that matches id */
-    for (i=0; i<nameT[key].num; i++)
-        if (nameT[key].list[i] == id)
-            break;
-
-    /* name is not found in nameT hash table */
-    if (i == nameT[key].num) DEBUG_RETURN_ERROR(NC_ENOTATT)
-
-    /* coalesce list[] */
-    for (; i<nameT[key].num-1; i++)
-        nameT[key].list[i] = nameT[key].list[i+1];
-
-    nameT[key].num--;
-
-    if (nameT[key].num == 0) {
-        NCI_Free(nameT[key].list);
-        nameT[key].list = NULL;
-    }
-
-    /* hash the new name into a key for name lookup */
-    key = HASH_FUNC(new_name);
-
-    /* allocate or expand the space for nameT[key].list */
-    if (nameT[key].num % NC_NAME_TABLE_CHUNK == 0)
-        nameT[key].list = (int*) NCI_Realloc(nameT[key].list,
-                          (size_t)(nameT[key].num+NC_NAME_TABLE_CHUNK) *
-                          SIZEOF_INT);
+    err = hash_table_remove(nameT, HASH_FUNC(old_name), id);
+    if (err != NC_NOERR) return err;
 
-    /* add the ID to the name lookup table */
-    nameT[key].list[nameT[key].num] = id;
-    nameT[key].num++;
+    hash_table_add(nameT, HASH_FUNC(new_name), id);
 
     return NC_NOERR;
 }
@@ -290,15 +321,16 @@ void
 ncmpio_hash_table_copy(NC_nametable       *dest,
                        const NC_nametable *src)
 {
-    int i;
-
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        dest[i].num = src[i].num;
-        dest[i].list = NULL;
-        if (dest[i].num > 0) {
-            dest[i].list = NCI_Malloc((size_t)dest[i].num * SIZEOF_INT);
-            memcpy(dest[i].list, src[i].list, (size_t)dest[i].num * SIZEOF_INT);
-        }
+    dest->nalloc = src->nalloc;
+    dest->nused  = src->nused;
+    dest->ids    = NULL;
+    dest->keys   = NULL;
+    if (src->nalloc > 0) {
+        dest->ids  = (int*) NCI_Malloc((size_t)src->nalloc * SIZEOF_INT);
+        dest->keys = (unsigned int*) NCI_Malloc((size_t)src->nalloc *
+                                                sizeof(unsigned int));
+        memcpy(dest->ids,  src->ids,  (size_t)src->nalloc * SIZEOF_INT);
+        memcpy(dest->keys, src->keys, (size_t)src->nalloc * sizeof(unsigned int));
     }
 }
 
@@ -307,12 +339,40 @@ ncmpio_hash_table_copy(NC_nametable       *dest,
 void
 ncmpio_hash_table_free(NC_nametable *nameT)
 {
-    int i;
-    for (i=0; i<HASH_TABLE_SIZE; i++) {
-        if (nameT[i].num > 0)
-            NCI_Free(nameT[i].list);
-        nameT[i].num = 0;
+    if (nameT->nalloc > 0) {
+        NCI_Free(nameT->ids);
+        NCI_Free(nameT->keys);
     }
+    nameT->nalloc = 0;
+    nameT->nused  = 0;
+    nameT->ids    = NULL;
+    nameT->keys   = NULL;
+}
+
+/*----< ncmpio_hash_table_grow() >-------------------------------------------*/
+/* make room for n more names, so adding them causes no resize */
+void
+ncmpio_hash_table_grow(NC_nametable *nameT, int n)
+{
+    int nalloc = (nameT->nalloc == 0) ? NC_NAME_TABLE_CHUNK : nameT->nalloc;
+
+    while (nalloc < 2 * (nameT->nused + n)) nalloc *= 2;
+
+    if (nalloc > nameT->nalloc) hash_table_resize(nameT, nalloc);
+}
+
+/*----< hash_table_reserve() >-----------------------------------------------*/
+/* initialize an empty table with room for n names */
+static void
+hash_table_reserve(NC_nametable *nameT, int n)
+{
+    int nalloc = NC_NAME_TABLE_CHUNK;
+
+    memset(nameT, 0, sizeof(NC_nametable));
+    if (n == 0) return;
+
+    while (nalloc < 2 * n) nalloc *= 2;
+    hash_table_resize(nameT, nalloc);
 }
 
 /*----< ncmpio_hash_table_populate_NC_dim() >--------------------------------*/
@@ -320,22 +380,13 @@ void
 ncmpio_hash_table_populate_NC_dim(NC_dimarray *dimsp)
 {
     int i;
-    NC_nametable *nameT = dimsp->nameT;
 
     /* initialize dim name lookup table -------------------------------------*/
-    memset(nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
+    hash_table_reserve(&dimsp->nameT, dimsp->ndefined);
 
     /* populate name lookup table */
-    for (i=0; i<dimsp->ndefined; i++) {
-        /* hash the dim name into a key for name lookup */
-        int key = HASH_FUNC(dimsp->value[i]->name);
-        nameT = &dimsp->nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    for (i=0; i<dimsp->ndefined; i++)
+        hash_table_add(&dimsp->nameT, HASH_FUNC(dimsp->value[i]->name), i);
 }
 
 /*----< ncmpio_hash_table_populate_NC_var() >--------------------------------*/
@@ -343,22 +394,13 @@ void
 ncmpio_hash_table_populate_NC_var(NC_vararray *varsp)
 {
     int i;
-    NC_nametable *nameT = varsp->nameT;
 
     /* initialize var name lookup table -------------------------------------*/
-    memset(nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
+    hash_table_reserve(&varsp->nameT, varsp->ndefined);
 
     /* populate name lookup table */
-    for (i=0; i<varsp->ndefined; i++) {
-        /* hash the var name into a key for name lookup */
-        int key = HASH_FUNC(varsp->value[i]->name);
-        nameT = &varsp->nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    for (i=0; i<varsp->ndefined; i++)
+        hash_table_add(&varsp->nameT, HASH_FUNC(varsp->value[i]->name), i);
 }
 
 /*----< ncmpio_hash_table_populate_NC_attr() >-------------------------------*/
@@ -366,36 +408,20 @@ void
 ncmpio_hash_table_populate_NC_attr(NC *ncp)
 {
     int i, j;
-    NC_nametable *nameT;
 
     /* populate name lookup table of global attributes */
-    memset(ncp->attrs.nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
-
-    for (i=0; i<ncp->attrs.ndefined; i++) {
-        /* hash the var name into a key for name lookup */
-        int key = HASH_FUNC(ncp->attrs.value[i]->name);
-        nameT = &ncp->attrs.nameT[key];
-        if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-            nameT->list = (int*) NCI_Realloc(nameT->list,
-                          (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-        nameT->list[nameT->num] = i;
-        nameT->num++;
-    }
+    hash_table_reserve(&ncp->attrs.nameT, ncp->attrs.ndefined);
+
+    for (i=0; i<ncp->attrs.ndefined; i++)
+        hash_table_add(&ncp->attrs.nameT, HASH_FUNC(ncp->attrs.value[i]->name), i);
 
     /* populate name lookup table of each variable's attributes */
     for (j=0; j<ncp->vars.ndefined; j++) {
-        NC_var *varp = ncp->vars.value[j];
-        memset(varp->attrs.nameT, 0, sizeof(NC_nametable) * HASH_TABLE_SIZE);
-
-        for (i=0; i<varp->attrs.ndefined; i++) {
-            /* hash the var name into a key for name lookup */
-            int key = HASH_FUNC(varp->attrs.value[i]->name);
-            nameT = &varp->attrs.nameT[key];
-            if (nameT->num % NC_NAME_TABLE_CHUNK == 0)
-                nameT->list = (int*) NCI_Realloc(nameT->list,
-                              (size_t)(nameT->num+NC_NAME_TABLE_CHUNK) *SIZEOF_INT);
-            nameT->list[nameT->num] = i;
-            nameT->num++;
-        }
+        NC_attrarray *ncap = &ncp->vars.value[j]->attrs;
+
+        hash_table_reserve(&ncap->nameT, ncap->ndefined);
+
+        for (i=0; i<ncap->ndefined; i++)
+            hash_table_add(&ncap->nameT, HASH_FUNC(ncap->value[i]->name), i);
     }
 }
@@ -314,83 +314,115 @@ hdr_len_NC_vararray(const NC_vararray *ncap,
     return xlen;
 }
 
+/*----< hdr_recv_block() >---------------------------------------------------*/
+/* Receive the next block of the header broadcast by root into gbp->blk. The
+ * blocks are of size gbp->size, the read chunk size, except the last one.
+ */
+static int
+hdr_recv_block(bufferinfo *gbp) {
+    int mpireturn;
+
+    gbp->blk_off += gbp->blk_len;
+    gbp->blk_len  = (int)MIN(gbp->size, gbp->bcast_end - gbp->blk_off);
+
+    TRACE_COMM(MPI_Bcast)(gbp->blk, gbp->blk_len, MPI_BYTE, 0, gbp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+
+    return NC_NOERR;
+}
+
 /*----< hdr_fetch() >--------------------------------------------------------*/
-/* Fetch the next header chunk.  the chunk is 'gbp->size' bytes big
- * Takes care to not overwrite leftover (unused) data in the buffer before
- * fetching a new chunk: the current approach is to re-read the extra data.
+/* Read more of the header into the get buffer. Only the root process reads
+ * the file, other processes parse the header after it is broadcast in full.
+ * The buffer keeps all the header read so far, so no part of the file is read
+ * twice and gbp->pos stays valid. The first call reads 'gbp->size' bytes, the
+ * read chunk size, from the start of the file. Later calls double the buffer
+ * and read the next part of the file into its second half, so a header of n
+ * chunks takes about log2(n) reads. Bytes past the end of file read as zeros.
+ *
+ * A buffer of size 4-byte int cannot be doubled past NC_MAX_INT. Then, or
+ * when gbp->chunked is already set, the parsed part of the buffer is dropped,
+ * the unparsed bytes are moved to its front, and the rest of the buffer is
+ * filled with the next part of the file. gbp->chunked is set to tell the
+ * header no longer fits in memory and cannot be broadcast in full.
  *
- * NOTE: An alternate approach (which we do not do) would be to save the old
- *       data, read the next chunk and then copy the old data into the new
- *       chunk.  This alternate approach might help if it is important for
- *       reads to be aligned.
+ * When gbp->bcast_end is set, the header is not read from the file but copied
+ * from the blocks broadcast by root, see ncmpio_hdr_get_NC().
  */
 static int
 hdr_fetch(bufferinfo *gbp) {
-    int rank, err=NC_NOERR, mpireturn;
-    int slack; /* any leftover data in the buffer */
+    int err=NC_NOERR, mpireturn, readsize, slack=0;
+    size_t pos_off;
+    MPI_Status mpistatus;
 
     assert(gbp->base != NULL);
 
-#if 0
-    MPI_Aint pos_addr, base_addr;
-#ifdef HAVE_MPI_GET_ADDRESS
-    MPI_Get_address(gbp->pos,  &pos_addr);
-    MPI_Get_address(gbp->base, &base_addr);
-#else
-    MPI_Address(gbp->pos,  &pos_addr);
-    MPI_Address(gbp->base, &base_addr);
-#endif
-    slack = gbp->size - (pos_addr - base_addr);
-#endif
-    slack = gbp->size - ((char*)gbp->pos - (char*)gbp->base);
-
-    /* If gbp->pos and gbp->base are the same, there is no leftover buffer
-     * data to worry about.
-     * In the other extreme, where gbp->size == (gbp->pos - gbp->base), then
-     * all data in the buffer has been consumed
-     * If slack is neither, then we re-read slack + additional header into a
-     * contiguous buffer, gbp->base.
-     */
-    if (slack == gbp->size) slack = 0;
-
-    /* No need to zero out the buffer, as it will be filled with read */
-    /*
-    memset(gbp->base, 0, (size_t)gbp->size);
-    */
-    gbp->pos = gbp->base;
-
-    MPI_Comm_rank(gbp->comm, &rank);
-    if (rank == 0) {
-        MPI_Status mpistatus;
-        /* fileview is already entire file visible and MPI_File_read_at does
-           not change the file pointer */
-        TRACE_IO(MPI_File_read_at)(gbp->collective_fh,
-                                   (gbp->offset)-slack, gbp->base,
-                                   gbp->size, MPI_BYTE, &mpistatus);
-        if (mpireturn != MPI_SUCCESS) {
-            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at");
-            if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(err, NC_EREAD)
+    if (gbp->offset > 0) {
+        /* the whole buffer has been read */
+        pos_off = (char*)gbp->pos - (char*)gbp->base;
+        if (!gbp->chunked && gbp->size <= NC_MAX_INT / 2) {
+            /* double the buffer */
+            gbp->base = NCI_Realloc(gbp->base, (size_t)gbp->size * 2);
+            if (gbp->base == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+            gbp->pos = (char*)gbp->base + pos_off;
+            slack = gbp->size;
+            gbp->size *= 2;
         }
         else {
-#ifdef _USE_MPI_GET_COUNT
-            int get_size; /* actual read amount can be smaller */
-            MPI_Get_count(&mpistatus, MPI_BYTE, &get_size);
-            gbp->get_size += get_size;
-#else
-            gbp->get_size += gbp->size;
-#endif
+            /* keep the unparsed bytes only */
+            slack = gbp->size - (int)pos_off;
+            if (slack > 0) memmove(gbp->base, gbp->pos, (size_t)slack);
+            gbp->pos = gbp->base;
+            gbp->chunked = 1;
         }
     }
-    /* we might have to backtrack */
-    gbp->offset += (gbp->size - slack);
-
-    if (gbp->safe_mode == 1) {
-        TRACE_COMM(MPI_Bcast)(&err, 1, MPI_INT, 0, gbp->comm);
-        if (err != NC_NOERR) return err;
+    readsize = gbp->size - slack;
+
+    /* the read can be shorter at the end of file */
+    memset((char*)gbp->base + slack, 0, (size_t)readsize);
+
+    if (gbp->bcast_end > 0) {
+        /* copy the header from the blocks broadcast by root, receiving the
+         * next block when the last one is used up */
+        char *ptr = (char*)gbp->base + slack;
+        MPI_Offset off = gbp->offset;
+        MPI_Offset end = MIN(gbp->offset + readsize, gbp->bcast_end);
+
+        while (off < end) {
+            MPI_Offset len;
+            if (off >= gbp->blk_off + gbp->blk_len) {
+                err = hdr_recv_block(gbp);
+                if (err != NC_NOERR) break;
+            }
+            len = MIN(end, gbp->blk_off + gbp->blk_len) - off;
+            memcpy(ptr, gbp->blk + (off - gbp->blk_off), (size_t)len);
+            ptr += len;
+            off += len;
+        }
+        gbp->offset += readsize;
+        return err;
     }
 
-    /* broadcast root's read (full or partial header) to other processes */
-    TRACE_COMM(MPI_Bcast)(gbp->base, gbp->size, MPI_BYTE, 0, gbp->comm);
+    /* fileview is already entire file visible and MPI_File_read_at does
+       not change the file pointer */
+    TRACE_IO(MPI_File_read_at)(gbp->collective_fh, gbp->offset,
+                               (char*)gbp->base + slack,
+                               readsize, MPI_BYTE, &mpistatus);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at");
+        if (err == NC_EFILE) DEBUG_ASSIGN_ERROR(err, NC_EREAD)
+    }
+    else {
+#ifdef _USE_MPI_GET_COUNT
+        int get_size; /* actual read amount can be smaller */
+        MPI_Get_count(&mpistatus, MPI_BYTE, &get_size);
+        gbp->get_size += get_size;
+#else
+        gbp->get_size += readsize;
+#endif
+    }
+    gbp->offset += readsize;
 
     return err;
 }
@@ -592,7 +624,7 @@ hdr_get_NC_name(bufferinfo  *gbp, char **namep)
                 *namep = NULL;
                 return err;
             }
-            bufremain = gbp->size;
+            bufremain = gbp->size - ((char*)gbp->pos - (char*)gbp->base);
         }
     }
 
@@ -822,7 +854,7 @@ hdr_get_NC_attrV(bufferinfo *gbp, NC_attr *attrp)
     bufremain = gbp->size - (pos_addr - base_addr);
 #endif
     bufremain = gbp->size - ((char*)gbp->pos - (char*)gbp->base);
-    /* gbp->size is the read chunk size, which is of type 4-byte int.
+    /* gbp->size is the size of the get buffer, which is of type 4-byte int.
      * thus bufremain should be less than INT_MAX */
 
     /* get values */
@@ -838,7 +870,7 @@ hdr_get_NC_attrV(bufferinfo *gbp, NC_attr *attrp)
             int err;
             err = hdr_fetch(gbp);
             if (err != NC_NOERR) return err;
-            bufremain = gbp->size;
+            bufremain = gbp->size - ((char*)gbp->pos - (char*)gbp->base);
         }
     }
 
@@ -1302,57 +1334,130 @@ ncmpio_hdr_len_NC(const NC *ncp)
     return xlen; /* return the header size (not yet aligned) */
 }
 
-/*----< ncmpio_hdr_get_NC() >------------------------------------------------*/
-/*  CDF format specification
- *      netcdf_file  = header  data
- *      header       = magic  numrecs  dim_list  gatt_list  var_list
- *      magic        = 'C'  'D'  'F'  VERSION
- *      VERSION      = \x01 |                      // classic format
- *                     \x02 |                      // 64-bit offset format
- *                     \x05                        // 64-bit data format
- *      numrecs      = NON_NEG | STREAMING         // length of record dimension
- *      dim_list     = ABSENT | NC_DIMENSION  nelems  [dim ...]
- *      gatt_list    = att_list                    // global attributes
- *      att_list     = ABSENT | NC_ATTRIBUTE  nelems  [attr ...]
- *      var_list     = ABSENT | NC_VARIABLE   nelems  [var ...]
+/*----< hdr_sizeof_NON_NEG() >-----------------------------------------------*/
+/* size of NON_NEG and OFFSET in the file header, 4 or 8 bytes */
+inline static int
+hdr_sizeof_NON_NEG(const NC *ncp, int *sizeof_off_t)
+{
+    if (sizeof_off_t != NULL)
+        *sizeof_off_t = (ncp->format == 1) ? X_SIZEOF_INT : X_SIZEOF_INT64;
+
+    return (ncp->format == 5) ? X_SIZEOF_INT64 : X_SIZEOF_INT;
+}
+
+/*----< ncmpio_hdr_len_NC_name() >-------------------------------------------*/
+/* size of an object name of name_len characters in the file header, i.e.
+ * nelems followed by the namestring padded to a 4-byte boundary */
+MPI_Offset
+ncmpio_hdr_len_NC_name(const NC *ncp, size_t name_len)
+{
+    return hdr_sizeof_NON_NEG(ncp, NULL) + _RNDUP(name_len, X_ALIGN);
+}
+
+/*----< ncmpio_hdr_off_NC_dim() >--------------------------------------------*/
+/* offset of dimension dimid from the beginning of the file header */
+MPI_Offset
+ncmpio_hdr_off_NC_dim(const NC *ncp, int dimid)
+{
+    int i, sizeof_NON_NEG;
+    MPI_Offset off;
+
+    sizeof_NON_NEG = hdr_sizeof_NON_NEG(ncp, NULL);
+
+    off  = NC_MAGIC_LEN + sizeof_NON_NEG;  /* magic numrecs */
+    off += X_SIZEOF_NC_TAG;                /* NC_DIMENSION */
+    off += sizeof_NON_NEG;                 /* nelems */
+
+    for (i=0; i<dimid; i++)
+        off += hdr_len_NC_dim(ncp->dims.value[i], sizeof_NON_NEG);
+
+    return off;
+}
+
+/*----< ncmpio_hdr_off_NC_var() >--------------------------------------------*/
+/* offset of variable varid from the beginning of the file header */
+MPI_Offset
+ncmpio_hdr_off_NC_var(const NC *ncp, int varid)
+{
+    int i, sizeof_NON_NEG, sizeof_off_t;
+    MPI_Offset off;
+
+    sizeof_NON_NEG = hdr_sizeof_NON_NEG(ncp, &sizeof_off_t);
+
+    off  = NC_MAGIC_LEN + sizeof_NON_NEG;                      /* magic numrecs */
+    off += hdr_len_NC_dimarray(&ncp->dims,   sizeof_NON_NEG);  /* dim_list */
+    off += hdr_len_NC_attrarray(&ncp->attrs, sizeof_NON_NEG);  /* gatt_list */
+    off += X_SIZEOF_NC_TAG;                                    /* NC_VARIABLE */
+    off += sizeof_NON_NEG;                                     /* nelems */
+
+    for (i=0; i<varid; i++)
+        off += hdr_len_NC_var(ncp->vars.value[i], sizeof_off_t, sizeof_NON_NEG);
+
+    return off;
+}
+
+/*----< ncmpio_hdr_off_NC_attr() >-------------------------------------------*/
+/* offset of attribute attid of variable varid (or NC_GLOBAL) from the
+ * beginning of the file header. If lenp is not NULL, it returns the size of
+ * the attribute in the header.
  */
-int
-ncmpio_hdr_get_NC(NC *ncp)
+MPI_Offset
+ncmpio_hdr_off_NC_attr(const NC   *ncp,
+                       int         varid,
+                       int         attid,
+                       MPI_Offset *lenp)
 {
-    int err, status=NC_NOERR;
-    bufferinfo getbuf;
-    char magic[NC_MAGIC_LEN];
+    int i, sizeof_NON_NEG;
+    MPI_Offset off;
+    const NC_attrarray *ncap;
 
-    assert(ncp != NULL);
+    sizeof_NON_NEG = hdr_sizeof_NON_NEG(ncp, NULL);
 
-    /* Initialize the get buffer that stores the header read from the file */
-    getbuf.comm          = ncp->comm;
-    getbuf.collective_fh = ncp->collective_fh;
-    getbuf.get_size      = 0;
-    getbuf.offset        = 0;   /* read from start of the file */
-    getbuf.safe_mode     = ncp->safe_mode;
+    if (varid == NC_GLOBAL) {
+        ncap = &ncp->attrs;
+        off  = NC_MAGIC_LEN + sizeof_NON_NEG;                    /* magic numrecs */
+        off += hdr_len_NC_dimarray(&ncp->dims, sizeof_NON_NEG);  /* dim_list */
+    }
+    else {
+        const NC_var *varp = ncp->vars.value[varid];
+        ncap = &varp->attrs;
+        off  = ncmpio_hdr_off_NC_var(ncp, varid);
+        off += ncmpio_hdr_len_NC_name(ncp, varp->name_len);      /* name */
+        off += sizeof_NON_NEG;                                   /* nelems */
+        off += sizeof_NON_NEG * varp->ndims;                     /* [dimid ...] */
+    }
+    off += X_SIZEOF_NC_TAG;  /* NC_ATTRIBUTE */
+    off += sizeof_NON_NEG;   /* nelems */
 
-    /* CDF-5's minimum header size is 4 bytes more than CDF-1 and CDF-2's */
-    getbuf.size = _RNDUP( MAX(MIN_NC_XSZ+4, ncp->chunk), X_ALIGN );
+    for (i=0; i<attid; i++)
+        off += hdr_len_NC_attr(ncap->value[i], sizeof_NON_NEG);
 
-    getbuf.base = (void *)NCI_Malloc((size_t)getbuf.size);
-    getbuf.pos  = getbuf.base;
+    if (lenp != NULL)
+        *lenp = hdr_len_NC_attr(ncap->value[attid], sizeof_NON_NEG);
 
-    /* Fetch the next header chunk. The chunk is 'gbp->size' bytes big */
-    err = hdr_fetch(&getbuf);
-    if (err != NC_NOERR) return err;
+    return off;
+}
 
-    /* processing the header from getbuf, the get buffer */
+/*----< hdr_parse_NC() >-----------------------------------------------------*/
+/* Decode the file header in the get buffer into ncp. On the root process,
+ * more of the header is read from the file whenever the buffer runs out.
+ * Return NC_ENULLPAD if the header is only non-fatally corrupted.
+ */
+static int
+hdr_parse_NC(NC *ncp, bufferinfo *gbp)
+{
+    int err, status=NC_NOERR;
+    char magic[NC_MAGIC_LEN];
 
     /* First get the file format information, magic */
-    err = ncmpix_getn_text((const void**)(&getbuf.pos), NC_MAGIC_LEN, magic);
+    err = ncmpix_getn_text((const void**)(&gbp->pos), NC_MAGIC_LEN, magic);
     if (err != NC_NOERR) return err;
 
     /* check if the first three bytes are 'C','D','F' */
     if (memcmp(magic, "CDF", 3) != 0) {
         /* check if is HDF5 file */
         char signature[8], *hdf5_signature="\211HDF\r\n\032\n";
-        ncmpix_getn_text((const void**)(&getbuf.pos), 8, signature);
+        ncmpix_getn_text((const void**)(&gbp->pos), 8, signature);
         if (memcmp(signature, hdf5_signature, 8) == 0) {
             DEBUG_ASSIGN_ERROR(err, NC_ENOTNC3)
             if (ncp->safe_mode)
@@ -1360,72 +1465,58 @@ ncmpio_hdr_get_NC(NC *ncp)
         }
         else
             DEBUG_ASSIGN_ERROR(err, NC_ENOTNC)
-        goto fn_exit;
+        return err;
     }
 
     /* check version number in last byte of magic */
     if (magic[3] == 0x1) {
-        getbuf.version = ncp->format = 1;
+        gbp->version = ncp->format = 1;
     } else if (magic[3] == 0x2) {
-        getbuf.version = ncp->format = 2;
+        gbp->version = ncp->format = 2;
 #if SIZEOF_MPI_OFFSET < 8
         /* take the easy way out: if we can't support all CDF-2
          * files, return immediately */
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ESMALL)
 #endif
     } else if (magic[3] == 0x5) {
-        getbuf.version = ncp->format = 5;
+        gbp->version = ncp->format = 5;
 #if SIZEOF_MPI_OFFSET < 8
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ESMALL)
 #endif
     } else {
-        NCI_Free(getbuf.base);
         DEBUG_RETURN_ERROR(NC_ENOTNC) /* not a netCDF file */
     }
 
     /* get numrecs from getbuf into ncp */
-    if (getbuf.version < 5) {
+    if (gbp->version < 5) {
         uint tmp=0;
-        err = hdr_get_uint32(&getbuf, &tmp);
-        if (err != NC_NOERR) goto fn_exit;
+        err = hdr_get_uint32(gbp, &tmp);
+        if (err != NC_NOERR) return err;
         ncp->numrecs = (MPI_Offset)tmp;
     }
     else {
         uint64 tmp=0;
-        err = hdr_get_uint64(&getbuf, &tmp);
-        if (err != NC_NOERR) goto fn_exit;
+        err = hdr_get_uint64(gbp, &tmp);
+        if (err != NC_NOERR) return err;
         ncp->numrecs = (MPI_Offset)tmp;
     }
 
-#if 0
-    MPI_Aint pos_addr, base_addr;
-#ifdef HAVE_MPI_GET_ADDRESS
-    MPI_Get_address(getbuf.pos,  &pos_addr);
-    MPI_Get_address(getbuf.base, &base_addr);
-#else
-    MPI_Address(getbuf.pos,  &pos_addr);
-    MPI_Address(getbuf.base, &base_addr);
-#endif
-    assert(pos_addr < base_addr + getbuf.size);
-#endif
-    assert((char*)getbuf.pos < (char*)getbuf.base + getbuf.size);
+    assert((char*)gbp->pos < (char*)gbp->base + gbp->size);
 
     /* get dim_list from getbuf into ncp */
-    err = hdr_get_NC_dimarray(&getbuf, &ncp->dims);
+    err = hdr_get_NC_dimarray(gbp, &ncp->dims);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
 
     /* get gatt_list from getbuf into ncp */
-    err = hdr_get_NC_attrarray(&getbuf, &ncp->attrs);
+    err = hdr_get_NC_attrarray(gbp, &ncp->attrs);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
 
     /* get var_list from getbuf into ncp */
-    err = hdr_get_NC_vararray(&getbuf, &ncp->vars, ncp->dims.ndefined);
+    err = hdr_get_NC_vararray(gbp, &ncp->vars, ncp->dims.ndefined);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
-    else if (err != NC_NOERR) goto fn_exit;
+    else if (err != NC_NOERR) return err;
 
     /* get the un-aligned size occupied by the file header */
     ncp->xsz = ncmpio_hdr_len_NC(ncp);
@@ -1435,21 +1526,221 @@ ncmpio_hdr_get_NC(NC *ncp)
      * Sets ncp->begin_rec to start of first record variable.
      */
     err = compute_var_shape(ncp);
-    if (err != NC_NOERR) goto fn_exit;
+    if (err != NC_NOERR) return err;
 
     /* Check whether variable sizes are legal for the given file format */
     err = ncmpio_NC_check_vlens(ncp);
-    if (err != NC_NOERR) goto fn_exit;
+    if (err != NC_NOERR) return err;
 
     /* Check whether variable begins are in an increasing order.
      * Adding this check here is necessary for detecting corrupted metadata. */
     err = ncmpio_NC_check_voffs(ncp);
-    if (err != NC_NOERR) goto fn_exit;
+    if (err != NC_NOERR) return err;
+
+    return status;
+}
+
+/*----< ncmpio_hdr_get_NC() >------------------------------------------------*/
+/*  CDF format specification
+ *      netcdf_file  = header  data
+ *      header       = magic  numrecs  dim_list  gatt_list  var_list
+ *      magic        = 'C'  'D'  'F'  VERSION
+ *      VERSION      = \x01 |                      // classic format
+ *                     \x02 |                      // 64-bit offset format
+ *                     \x05                        // 64-bit data format
+ *      numrecs      = NON_NEG | STREAMING         // length of record dimension
+ *      dim_list     = ABSENT | NC_DIMENSION  nelems  [dim ...]
+ *      gatt_list    = att_list                    // global attributes
+ *      att_list     = ABSENT | NC_ATTRIBUTE  nelems  [attr ...]
+ *      var_list     = ABSENT | NC_VARIABLE   nelems  [var ...]
+ */
+/* Only the root process reads the header from the file. It parses the header
+ * as it reads, so the header extent is known when parsing is done. The root
+ * then broadcasts the parse status and the extent in one call and, unless the
+ * header is corrupted, the whole header in another. The other processes parse
+ * the header from memory. A header too large for the get buffer, over 1 GiB,
+ * cannot be broadcast at once. Root then reads it again block by block and
+ * broadcasts each block, which the other processes parse as they arrive.
+ */
+int
+ncmpio_hdr_get_NC(NC *ncp)
+{
+    int rank, err, mpireturn;
+    bufferinfo getbuf;
+    MPI_Offset msg[3]; /* parse status, header extent, and 1 if the header
+                          is too large to broadcast at once */
+
+    assert(ncp != NULL);
+
+    MPI_Comm_rank(ncp->comm, &rank);
+
+    /* Initialize the get buffer that stores the header read from the file */
+    getbuf.comm          = ncp->comm;
+    getbuf.collective_fh = ncp->collective_fh;
+    getbuf.get_size      = 0;
+    getbuf.offset        = 0;   /* read from start of the file */
+    getbuf.safe_mode     = ncp->safe_mode;
+    getbuf.chunked       = 0;
+    getbuf.base          = NULL;
+    getbuf.bcast_end     = 0;
+
+    if (rank == 0) {
+        /* CDF-5's minimum header size is 4 bytes more than CDF-1 and CDF-2's */
+        getbuf.size = _RNDUP( MAX(MIN_NC_XSZ+4, ncp->chunk), X_ALIGN );
+
+        getbuf.base = (void *)NCI_Malloc((size_t)getbuf.size);
+        if (getbuf.base == NULL) DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+        else {
+            getbuf.pos = getbuf.base;
+
+            /* Fetch the first header chunk and parse the header, fetching
+             * more when needed */
+            err = hdr_fetch(&getbuf);
+            if (err == NC_NOERR) err = hdr_parse_NC(ncp, &getbuf);
+        }
+        msg[0] = err;
+        msg[2] = 0;
+        if (getbuf.base == NULL)
+            msg[1] = 0;
+        else if (getbuf.chunked) { /* header is too large to broadcast */
+            /* the buffer holds the part of the file before getbuf.offset */
+            msg[1] = getbuf.offset - getbuf.size
+                   + ((char*)getbuf.pos - (char*)getbuf.base);
+            msg[2] = 1;
+        }
+        else
+            msg[1] = MIN((char*)getbuf.pos - (char*)getbuf.base, getbuf.size);
+    }
+
+    TRACE_COMM(MPI_Bcast)(msg, 3, MPI_OFFSET, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        goto fn_exit;
+    }
+    err = (int)msg[0];
+
+    /* the header is corrupted, all processes return the root's error */
+    if (err != NC_NOERR && err != NC_ENULLPAD) goto fn_exit;
+
+    if (msg[2]) {
+        /* the header is larger than a get buffer can hold. Root reads it
+         * again in blocks of the read chunk size and broadcasts each block.
+         * Other processes parse the blocks through a buffer of the same
+         * size, so root stays the only process reading the file */
+        int blk_size = _RNDUP( MAX(MIN_NC_XSZ+4, ncp->chunk), X_ALIGN );
+        int read_err = NC_NOERR;
+
+        if (rank == 0) {
+            MPI_Offset off;
+            MPI_Status mpistatus;
+
+            /* root's get buffer is no smaller than a block */
+            for (off=0; off<msg[1]; off+=blk_size) {
+                int len = (int)MIN(blk_size, msg[1] - off);
+
+                if (read_err == NC_NOERR) {
+                    TRACE_IO(MPI_File_read_at)(ncp->collective_fh, off,
+                                               getbuf.base, len, MPI_BYTE,
+                                               &mpistatus);
+                    if (mpireturn != MPI_SUCCESS) {
+                        read_err = ncmpii_error_mpi2nc(mpireturn,
+                                                       "MPI_File_read_at");
+                        if (read_err == NC_EFILE)
+                            DEBUG_ASSIGN_ERROR(read_err, NC_EREAD)
+                    }
+                    else
+                        getbuf.get_size += len;
+                }
+                TRACE_COMM(MPI_Bcast)(getbuf.base, len, MPI_BYTE, 0,
+                                      ncp->comm);
+                if (mpireturn != MPI_SUCCESS) {
+                    err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+                    goto fn_exit;
+                }
+            }
+        }
+        else {
+            /* one allocation for the get buffer and the received block */
+            getbuf.size      = blk_size;
+            getbuf.chunked   = 1;
+            getbuf.bcast_end = msg[1];
+            getbuf.blk_off   = 0;
+            getbuf.blk_len   = 0;
+            getbuf.base      = (void *)NCI_Malloc((size_t)blk_size * 2);
+            getbuf.blk       = (char*)getbuf.base + blk_size;
+            getbuf.pos       = getbuf.base;
+
+            err = hdr_fetch(&getbuf);
+            if (err == NC_NOERR) err = hdr_parse_NC(ncp, &getbuf);
+
+            /* receive the blocks left when the parsing stops early */
+            while (getbuf.blk_off + getbuf.blk_len < getbuf.bcast_end) {
+                int berr = hdr_recv_block(&getbuf);
+                if (berr != NC_NOERR) {
+                    if (err == NC_NOERR) err = berr;
+                    break;
+                }
+            }
+        }
+
+        /* all processes return root's read error */
+        TRACE_COMM(MPI_Bcast)(&read_err, 1, MPI_INT, 0, ncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        else if (read_err != NC_NOERR)
+            err = read_err;
+        goto fn_exit;
+    }
+
+    if (rank > 0) {
+        /* the buffer holds the exact header extent. Should the parsing go
+         * past it, hdr_fetch() reads the rest from the file */
+        getbuf.size   = (int)msg[1];
+        getbuf.offset = msg[1];
+        getbuf.base   = (void *)NCI_Malloc((size_t)getbuf.size);
+        getbuf.pos    = getbuf.base;
+    }
+
+    TRACE_COMM(MPI_Bcast)(getbuf.base, (int)msg[1], MPI_BYTE, 0, ncp->comm);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Bcast");
+        goto fn_exit;
+    }
+
+    if (rank > 0) err = hdr_parse_NC(ncp, &getbuf);
 
 fn_exit:
     ncp->get_size += getbuf.get_size;
-    NCI_Free(getbuf.base);
+    if (getbuf.base != NULL) NCI_Free(getbuf.base);
 
-    return (err == NC_NOERR) ? status : err;
+    return err;
 }
 
+/*----< ncmpio_hdr_get_NC_buf() >--------------------------------------------*/
+/* Decode a file header that is already in memory, such as one broadcast by
+ * root, into ncp. 'buf' must be allocated by NCI_Malloc and is freed here.
+ */
+int
+ncmpio_hdr_get_NC_buf(NC   *ncp,
+                      void *buf,
+                      int   size)
+{
+    int err;
+    bufferinfo getbuf;
+
+    getbuf.comm          = ncp->comm;
+    getbuf.collective_fh = ncp->collective_fh;
+    getbuf.get_size      = 0;
+    getbuf.offset        = size; /* the buffer holds the whole header */
+    getbuf.safe_mode     = ncp->safe_mode;
+    getbuf.chunked       = 0;
+    getbuf.bcast_end     = 0;
+    getbuf.size          = size;
+    getbuf.base          = buf;
+    getbuf.pos           = buf;
+
+    err = hdr_parse_NC(ncp, &getbuf);
+
+    NCI_Free(getbuf.base);
+    return err;
+}
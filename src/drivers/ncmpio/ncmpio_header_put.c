@@ -493,6 +493,23 @@ ncmpio_hdr_put_NC(NC *ncp, void *buf)
     return NC_NOERR;
 }
 
+/*----< ncmpio_hdr_set_dirty() >---------------------------------------------*/
+/* Mark the byte range [off, off+len) of the file header as modified in place,
+ * i.e. the header layout is unchanged. Ranges marked before the next call to
+ * ncmpio_write_header() are merged into one.
+ */
+void
+ncmpio_hdr_set_dirty(NC *ncp, MPI_Offset off, MPI_Offset len)
+{
+    if (ncp->hdr_dirty_end <= ncp->hdr_dirty_start) { /* no range marked yet */
+        ncp->hdr_dirty_start = off;
+        ncp->hdr_dirty_end   = off + len;
+        return;
+    }
+    ncp->hdr_dirty_start = MIN(ncp->hdr_dirty_start, off);
+    ncp->hdr_dirty_end   = MAX(ncp->hdr_dirty_end, off + len);
+}
+
 /*----< ncmpio_write_header() >---------------------------------------------*/
 /* This function is collective (even in independent data mode).
  * It is called only in data mode (collective or independent) and by
@@ -501,18 +518,17 @@ ncmpio_hdr_put_NC(NC *ncp, void *buf)
  * 3. ncmpi_put_att()
  * 4. ncmpi_rename_dim()
  * 5. ncmpi_rename_var()
+ * If the callers have only marked byte ranges modified in place through
+ * ncmpio_hdr_set_dirty(), only the merged range is written. Otherwise, e.g.
+ * NC_HDIRTY is set because a new name or attribute shrinks and all metadata
+ * following it must be moved ahead, the entire header is written.
  */
 int ncmpio_write_header(NC *ncp)
 {
     int rank, status=NC_NOERR, mpireturn, err;
+    MPI_Offset xsz, off=0, len;
     MPI_File fh;
 
-    /* Write the entire header to the file. This function may be called from
-     * a rename API. In that case, we cannot just change the variable name in
-     * the file header, because if the file space occupied by the name shrinks,
-     * all metadata following the new name must be moved ahead.
-     */
-
     fh = ncp->collective_fh;
     if (NC_indep(ncp))
         fh = ncp->independent_fh;
@@ -521,17 +537,35 @@ int ncmpio_write_header(NC *ncp)
      * API (var or attribute) and the new name is smaller/bigger which changes
      * the header size. We recalculate ncp->xsz by getting the un-aligned size
      * occupied by the file header */
-    ncp->xsz = ncmpio_hdr_len_NC(ncp);
+    xsz = ncmpio_hdr_len_NC(ncp);
+
+    len = xsz;
+    if (!NC_hdirty(ncp) && xsz == ncp->xsz &&
+        ncp->hdr_dirty_end > ncp->hdr_dirty_start) {
+        /* header layout is unchanged, write only the dirty range */
+        off = ncp->hdr_dirty_start;
+        len = MIN(ncp->hdr_dirty_end, xsz) - off;
+    }
+    ncp->xsz = xsz;
+
+    /* reset the dirty state */
+    fClr(ncp->flags, NC_HDIRTY);
+    ncp->hdr_dirty_start = ncp->hdr_dirty_end = 0;
 
     MPI_Comm_rank(ncp->comm, &rank);
     if (rank == 0) { /* only root writes to file header */
         MPI_Status mpistatus;
         void *buf = NCI_Malloc((size_t)ncp->xsz); /* header's write buffer */
 
-        /* copy header object to write buffer */
+        /* copy header object to write buffer. The entire header is
+         * serialized even when only a range of it is written, as the header
+         * objects are variable-sized and a range can only be located by
+         * walking through the objects preceding it. Serializing in memory
+         * costs much less than writing it to the file.
+         */
         status = ncmpio_hdr_put_NC(ncp, buf);
 
-        if (ncp->xsz != (int)ncp->xsz) {
+        if (len != (int)len) {
             NCI_Free(buf);
             DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
         }
@@ -540,7 +574,8 @@ int ncmpio_write_header(NC *ncp)
         /* explicitly initialize mpistatus object to 0, see comments below */
         memset(&mpistatus, 0, sizeof(MPI_Status));
 #endif
-        TRACE_IO(MPI_File_write_at)(fh, 0, buf, (int)ncp->xsz, MPI_BYTE, &mpistatus);
+        TRACE_IO(MPI_File_write_at)(fh, off, (char*)buf + off, (int)len,
+                                    MPI_BYTE, &mpistatus);
         if (mpireturn != MPI_SUCCESS) {
             err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
             if (status == NC_NOERR) {
@@ -554,7 +589,7 @@ int ncmpio_write_header(NC *ncp)
             MPI_Get_count(&mpistatus, MPI_BYTE, &put_size);
             ncp->put_size += put_size;
 #else
-            ncp->put_size += ncp->xsz;
+            ncp->put_size += len;
 #endif
         }
         NCI_Free(buf);
@@ -141,6 +141,9 @@ ncmpio_open(MPI_Comm     comm,
     ncp->mpiomode       = mpiomode;
     ncp->collective_fh  = fh;
     ncp->independent_fh = MPI_FILE_NULL;
+    ncp->node_comm      = MPI_COMM_NULL; /* created when first used */
+    ncp->leader_comm    = MPI_COMM_NULL;
+    ncp->leader_fh      = MPI_FILE_NULL;
     ncp->path = (char*) NCI_Malloc(strlen(path) + 1);
     strcpy(ncp->path, path);
 
@@ -159,6 +162,14 @@ ncmpio_open(MPI_Comm     comm,
          * be '\0' (null character). In this case, safe_mode is enabled */
     }
 
+    /* root-define mode skips the consistency check of safe mode, and
+     * subfiling partitions variables on all processes */
+    MPI_Comm_rank(comm, &ncp->rank);
+    if (ncp->safe_mode) ncp->root_define = 0;
+#ifdef ENABLE_SUBFILING
+    if (ncp->subfile_mode) ncp->root_define = 0;
+#endif
+
     /* read header from file into NC object pointed by ncp -------------------*/
     err = ncmpio_hdr_get_NC(ncp);
     if (err == NC_ENULLPAD) status = NC_ENULLPAD; /* non-fatal error */
@@ -48,6 +48,14 @@ ncmpio_file_sync(NC *ncp) {
     if (mpireturn != MPI_SUCCESS)
         return ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
 
+    /* node leaders of intra-node aggregation write through leader_fh.
+     * MPI_File_sync() is collective over leader_comm */
+    if (ncp->leader_fh != MPI_FILE_NULL) {
+        TRACE_IO(MPI_File_sync)(ncp->leader_fh);
+        if (mpireturn != MPI_SUCCESS)
+            return ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+    }
+
     TRACE_COMM(MPI_Barrier)(ncp->comm);
 #endif
     return NC_NOERR;
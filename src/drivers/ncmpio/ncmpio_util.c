@@ -71,6 +71,49 @@ void ncmpio_set_pnetcdf_hints(NC *ncp, MPI_Info info)
         else if (ncp->chunk < 0) ncp->chunk = 0;
     }
 
+    /* size of staging buffers used to pipeline type conversion and byte swap
+     * with writes in blocking put APIs, 0 (default) disables pipelining */
+    MPI_Info_get(info, "nc_put_pipeline_size", MPI_MAX_INFO_VAL-1, value,
+                 &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtoll */
+        ncp->pipe_size = strtoll(value,NULL,10);
+        if (errno != 0) ncp->pipe_size = 0;
+        else if (ncp->pipe_size < 0) ncp->pipe_size = 0;
+    }
+
+    /* number of aggregators used by PnetCDF's own two-phase I/O for
+     * collective nonblocking writes, 0 (default) leaves it to MPI-IO */
+    MPI_Info_get(info, "nc_num_aggrs", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        errno = 0;  /* errno must set to zero before calling strtol */
+        ncp->num_aggrs = (int) strtol(value,NULL,10);
+        if (errno != 0) ncp->num_aggrs = 0;
+        else if (ncp->num_aggrs < 0) ncp->num_aggrs = 0;
+    }
+
+    /* hint to aggregate collective nonblocking writes of processes on the
+     * same compute node, requires MPI shared memory windows of MPI 3.0 */
+    MPI_Info_get(info, "nc_node_aggr", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+#if MPI_VERSION >= 3
+        if (strcasecmp(value, "enable") == 0)
+            ncp->node_aggr = 1;
+        else if (strcasecmp(value, "disable") == 0)
+#endif
+            ncp->node_aggr = 0;
+    }
+
+    /* hint to run define-mode APIs of variables and attributes only on
+     * root, which broadcasts the file header at enddef */
+    MPI_Info_get(info, "nc_root_define", MPI_MAX_INFO_VAL-1, value, &flag);
+    if (flag) {
+        if (strcasecmp(value, "enable") == 0)
+            ncp->root_define = 1;
+        else if (strcasecmp(value, "disable") == 0)
+            ncp->root_define = 0;
+    }
+
     /* hint on setting in-place byte swap (matters only for Little Endian) */
     MPI_Info_get(info, "nc_in_place_swap", MPI_MAX_INFO_VAL-1, value, &flag);
     if (flag) {
@@ -313,11 +356,68 @@ ncmpio_access_range(const NC         *ncp,
     return NC_NOERR;
 }
 
+/*----< ncmpio_put_convert() >-----------------------------------------------*/
+/* Type-convert and byte-swap nelems elements in cbuf, of internal data type
+ * itype, into xbuf in the external data type of variable varp. fillp points
+ * to the fill value of varp in the internal representation. Return NC_ERANGE
+ * if any element is out of range representable by the external data type.
+ */
+int
+ncmpio_put_convert(int           fmt,    /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
+                   NC_var       *varp,
+                   const void   *cbuf,
+                   MPI_Offset    nelems,
+                   MPI_Datatype  itype,
+                   void         *fillp,
+                   void         *xbuf)
+{
+    int err;
+
+    switch(varp->xtype) {
+        case NC_BYTE:
+            err = ncmpii_putn_NC_BYTE(fmt,xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_UBYTE:
+            err = ncmpii_putn_NC_UBYTE(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_SHORT:
+            err = ncmpii_putn_NC_SHORT(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_USHORT:
+            err = ncmpii_putn_NC_USHORT(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_INT:
+            err = ncmpii_putn_NC_INT(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_UINT:
+            err = ncmpii_putn_NC_UINT(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_FLOAT:
+            err = ncmpii_putn_NC_FLOAT(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_DOUBLE:
+            err = ncmpii_putn_NC_DOUBLE(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_INT64:
+            err = ncmpii_putn_NC_INT64(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        case NC_UINT64:
+            err = ncmpii_putn_NC_UINT64(xbuf,cbuf,nelems,itype,fillp);
+            break;
+        default:
+            err = NC_EBADTYPE; /* this never happens */
+            break;
+    }
+    return err;
+}
+
 /*----< ncmpio_pack_xbuf() >-------------------------------------------------*/
 /* Pack user buffer, buf, into xbuf, when buftype is non-contiguous or imap
  * is non-contiguous, or type-casting is needed. The immediate buffers, lbuf
  * and cbuf, may be allocated and freed within this subroutine. We try to reuse
  * the intermediate buffers as much as possible. Below describe such design.
+ * When no type conversion is needed and buf is copied to xbuf, the byte swap,
+ * if required, is done while copying, so the data is only traversed once.
  *
  * When called from bput APIs: (abuf means attached buffer pool)
  *     if contig && no imap && no convert
@@ -458,42 +558,9 @@ ncmpio_pack_xbuf(int           fmt,    /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
         ncmpio_inq_var_fill(varp, fillp);
 
         /* datatype conversion + byte-swap from cbuf to xbuf */
-        switch(varp->xtype) {
-            case NC_BYTE:
-                err = ncmpii_putn_NC_BYTE(fmt,xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_UBYTE:
-                err = ncmpii_putn_NC_UBYTE(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_SHORT:
-                err = ncmpii_putn_NC_SHORT(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_USHORT:
-                err = ncmpii_putn_NC_USHORT(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_INT:
-                err = ncmpii_putn_NC_INT(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_UINT:
-                err = ncmpii_putn_NC_UINT(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_FLOAT:
-                err = ncmpii_putn_NC_FLOAT(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_DOUBLE:
-                err = ncmpii_putn_NC_DOUBLE(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_INT64:
-                err = ncmpii_putn_NC_INT64(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            case NC_UINT64:
-                err = ncmpii_putn_NC_UINT64(xbuf,cbuf,nelems,itype,fillp);
-                break;
-            default:
-                err = NC_EBADTYPE; /* this never happens */
-                break;
-        }
-        /* The only error codes returned from the above switch block are
+        err = ncmpio_put_convert(fmt, varp, cbuf, nelems, itype, fillp, xbuf);
+
+        /* The only error codes returned from ncmpio_put_convert() are
 	 * NC_EBADTYPE or NC_ERANGE. Bad varp->xtype and itype have been sanity
 	 * checked at the dispatchers, so NC_EBADTYPE is not possible. Thus,
 	 * the only possible error is NC_ERANGE.  NC_ERANGE can be caused by
@@ -505,13 +572,16 @@ ncmpio_pack_xbuf(int           fmt,    /* NC_FORMAT_CDF2 NC_FORMAT_CDF5 etc. */
         NCI_Free(fillp);
         if (cbuf != buf) NCI_Free(cbuf);
     }
-    else {
-        if (cbuf == buf && xbuf != buf)
+    else if (cbuf == buf && xbuf != buf) {
+        /* copy buf to xbuf and byte-swap in the same pass */
+        if (need_swap)
+            ncmpii_swapn(xbuf, cbuf, nelems, varp->xsz);
+        else
             memcpy(xbuf, cbuf, (size_t)xbuf_size);
-
-        if (need_swap) /* perform array in-place byte swap on xbuf */
-            ncmpii_in_swapn(xbuf, nelems, varp->xsz);
     }
+    else if (need_swap) /* perform array in-place byte swap on xbuf */
+        ncmpii_in_swapn(xbuf, nelems, varp->xsz);
+
     return err;
 }
 
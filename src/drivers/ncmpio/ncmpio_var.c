@@ -9,6 +9,7 @@
  * src/dispatchers/variable.c
  *
  * ncmpi_def_var()    : dispatcher->def_var()
+ * ncmpi_def_vars()   : dispatcher->def_vars()
  * ncmpi_inq_varid()  : dispatcher->inq_varid()
  * ncmpi_inq_var()    : dispatcher->inq_var()
  * ncmpi_rename_var() : dispatcher->rename_var()
@@ -145,7 +146,7 @@ ncmpio_free_NC_vararray(NC_vararray *ncap)
 
 #ifndef SEARCH_NAME_LINEARLY
     /* free space allocated for var name lookup table */
-    ncmpio_hash_table_free(ncap->nameT);
+    ncmpio_hash_table_free(&ncap->nameT);
 #endif
 }
 
@@ -189,7 +190,7 @@ ncmpio_dup_NC_vararray(NC_vararray       *ncap,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* duplicate var name lookup table */
-    ncmpio_hash_table_copy(ncap->nameT, ref->nameT);
+    ncmpio_hash_table_copy(&ncap->nameT, &ref->nameT);
 #endif
 
     return NC_NOERR;
@@ -254,7 +255,8 @@ NC_findvar(const NC_vararray  *ncap,
            const char         *name,  /* normalized name */
            int                *varidp)
 {
-    int i, key, varid;
+    int slot, varid;
+    unsigned int key;
     size_t nchars;
 
     assert (ncap != NULL);
@@ -264,10 +266,10 @@ NC_findvar(const NC_vararray  *ncap,
     /* hash the var name into a key for name lookup */
     key = HASH_FUNC(name);
 
-    /* check the list using linear search */
+    /* check the IDs of names sharing the same key */
     nchars = strlen(name);
-    for (i=0; i<ncap->nameT[key].num; i++) {
-        varid = ncap->nameT[key].list[i];
+    slot = -1;
+    while ((varid = ncmpio_hash_probe(&ncap->nameT, key, &slot)) >= 0) {
         if (ncap->value[varid]->name_len == nchars &&
             strcmp(ncap->value[varid]->name, name) == 0) {
             if (varidp != NULL) *varidp = varid;
@@ -389,6 +391,14 @@ ncmpio_def_var(void       *ncdp,
     NC *ncp=(NC*)ncdp;
     NC_var *varp=NULL;
 
+    if (NC_skip_define(ncp)) {
+        /* only root defines the variable, non-root gets it at enddef */
+        if (varidp != NULL)
+            *varidp = ncp->vars.ndefined + ncp->root_def_nvars;
+        ncp->root_def_nvars++;
+        return NC_NOERR;
+    }
+
     /* create a normalized character string */
     err = ncmpii_utf8_normalize(name, &nname);
     if (err != NC_NOERR) goto err_check;
@@ -460,7 +470,7 @@ err_check:
 
 #ifndef SEARCH_NAME_LINEARLY
     /* insert nname to the lookup table */
-    ncmpio_hash_insert(ncp->vars.nameT, nname, varp->varid);
+    ncmpio_hash_insert(&ncp->vars.nameT, nname, varp->varid);
 #endif
 
     if (varidp != NULL) *varidp = varp->varid;
@@ -474,6 +484,135 @@ err_check:
     return NC_NOERR;
 }
 
+/*----< ncmpio_def_vars() >--------------------------------------------------*/
+/* Define nvars variables in one call. The array of variable objects and the
+ * name lookup table are grown once for all of them. Sanity checks of the
+ * arguments, except for names in use, have been done in the dispatcher. On
+ * error, none of the variables is defined.
+ */
+int
+ncmpio_def_vars(void          *ncdp,
+                int            nvars,
+                char*   const *names,
+                const nc_type *xtypes,
+                const int     *ndims,
+                int*    const *dimids,
+                int           *varids)
+{
+    int i, err=NC_NOERR, ndefined, no_fill;
+    char *nname;
+    NC *ncp=(NC*)ncdp;
+    NC_var *varp;
+
+    if (NC_skip_define(ncp)) {
+        /* only root defines the variables, non-root gets them at enddef */
+        if (varids != NULL)
+            for (i=0; i<nvars; i++)
+                varids[i] = ncp->vars.ndefined + ncp->root_def_nvars + i;
+        ncp->root_def_nvars += nvars;
+        return NC_NOERR;
+    }
+
+    ndefined = ncp->vars.ndefined;
+
+    /* grow ncp->vars.value once, keep its size a multiple of NC_ARRAY_GROWBY
+     * as expected by ncmpio_def_var() */
+    if (nvars > 0) {
+        NC_var **value;
+        size_t alloc_size = (size_t)ndefined + nvars + NC_ARRAY_GROWBY - 1;
+        alloc_size -= alloc_size % NC_ARRAY_GROWBY;
+
+        value = (NC_var **) NCI_Realloc(ncp->vars.value,
+                                        alloc_size * sizeof(NC_var*));
+        if (value == NULL) {
+            DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+            goto err_check;
+        }
+        ncp->vars.value = value;
+    }
+
+#ifndef SEARCH_NAME_LINEARLY
+    ncmpio_hash_table_grow(&ncp->vars.nameT, nvars);
+#endif
+
+    /* default is NOFILL, FILL only if the entire dataset fill mode is FILL */
+    no_fill = NC_dofill(ncp) ? 0 : 1;
+
+    for (i=0; i<nvars; i++) {
+        /* create a normalized character string */
+        err = ncmpii_utf8_normalize(names[i], &nname);
+        if (err != NC_NOERR) break;
+
+        /* the name may also be used by a variable defined earlier in names */
+        if (NC_findvar(&ncp->vars, nname, NULL) == NC_NOERR) {
+            NCI_Free(nname);
+            DEBUG_ASSIGN_ERROR(err, NC_ENAMEINUSE)
+            break;
+        }
+
+        /* allocate a new NC_var object, it takes nname */
+        varp = ncmpio_new_NC_var(nname, ndims[i]);
+        if (varp == NULL) {
+            NCI_Free(nname);
+            DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+            break;
+        }
+        varp->xtype = xtypes[i];
+        ncmpii_xlen_nc_type(xtypes[i], &varp->xsz);
+
+        if (ndims[i] > 0)
+            memcpy(varp->dimids, dimids[i], (size_t)ndims[i] * SIZEOF_INT);
+
+        /* set up array dimensional structures */
+        err = ncmpio_NC_var_shape64(varp, &ncp->dims);
+        if (err != NC_NOERR) {
+            ncmpio_free_NC_var(varp);
+            break;
+        }
+
+        varp->varid   = ncp->vars.ndefined;
+        varp->no_fill = no_fill;
+        ncp->vars.value[ncp->vars.ndefined++] = varp;
+
+#ifndef SEARCH_NAME_LINEARLY
+        /* insert the name now, so it is found when checking later names */
+        ncmpio_hash_insert(&ncp->vars.nameT, varp->name, varp->varid);
+#endif
+    }
+
+err_check:
+    if (ncp->safe_mode) {
+        int minE, mpireturn;
+
+        /* check the error code across processes */
+        TRACE_COMM(MPI_Allreduce)(&err, &minE, 1, MPI_INT, MPI_MIN, ncp->comm);
+        if (mpireturn != MPI_SUCCESS)
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+        else if (minE != NC_NOERR)
+            err = minE;
+    }
+
+    if (err != NC_NOERR) {
+        /* remove the variables added by this call */
+        if (ncp->vars.ndefined > ndefined) {
+            for (i=ndefined; i<ncp->vars.ndefined; i++)
+                ncmpio_free_NC_var(ncp->vars.value[i]);
+            ncp->vars.ndefined = ndefined;
+#ifndef SEARCH_NAME_LINEARLY
+            ncmpio_hash_table_free(&ncp->vars.nameT);
+            ncmpio_hash_table_populate_NC_var(&ncp->vars);
+#endif
+        }
+        return err;
+    }
+
+    if (varids != NULL)
+        for (i=0; i<nvars; i++)
+            varids[i] = ndefined + i;
+
+    return NC_NOERR;
+}
+
 
 /*----< ncmpio_inq_varid() >-------------------------------------------------*/
 /* This is an independent subroutine */
@@ -529,6 +668,10 @@ ncmpio_inq_var(void       *ncdp,
         return NC_NOERR;
     }
 
+    /* in root-define mode, variables defined in the current define mode are
+     * not available on non-root processes until enddef */
+    if (varid >= ncp->vars.ndefined) DEBUG_RETURN_ERROR(NC_ENOTVAR)
+
 #if 0
     varp = elem_NC_vararray(&ncp->vars, varid);
     if (varp == NULL) DEBUG_RETURN_ERROR(NC_ENOTVAR)
@@ -592,6 +735,9 @@ ncmpio_rename_var(void       *ncdp,
     NC *ncp=(NC*)ncdp;
     NC_var *varp=NULL;
 
+    /* in root-define mode, non-root gets the new name at enddef */
+    if (NC_skip_define(ncp)) return NC_NOERR;
+
     /* check whether variable ID is valid */
     /* sanity check for ncdp and varid has been done in dispatchers */
     varp = ncp->vars.value[varid];
@@ -610,7 +756,7 @@ ncmpio_rename_var(void       *ncdp,
 
 #ifndef SEARCH_NAME_LINEARLY
     /* update var name lookup table */
-    err = ncmpio_update_name_lookup_table(ncp->vars.nameT, varid,
+    err = ncmpio_update_name_lookup_table(&ncp->vars.nameT, varid,
                         ncp->vars.value[varid]->name, nnewname);
     if (err != NC_NOERR) {
         DEBUG_TRACE_ERROR(err)
@@ -641,17 +787,22 @@ err_check:
 
     assert(varp != NULL);
 
+    if (! NC_indef(ncp)) { /* when file is in data mode */
+        /* rewrite only the name if its space in the header is unchanged */
+        if (_RNDUP(nnewname_len, X_ALIGN) == _RNDUP(varp->name_len, X_ALIGN))
+            ncmpio_hdr_set_dirty(ncp, ncmpio_hdr_off_NC_var(ncp, varid),
+                                 ncmpio_hdr_len_NC_name(ncp, nnewname_len));
+        else
+            set_NC_hdirty(ncp);
+    }
+
     /* replace the old name with new name */
     NCI_Free(varp->name);
     varp->name     = nnewname;
     varp->name_len = nnewname_len;
 
     if (! NC_indef(ncp)) { /* when file is in data mode */
-        /* Let root write the entire header to the file. Note that we cannot
-         * just update the variable name in its space occupied in the file
-         * header, because if the file space occupied by the name shrinks, all
-         * the metadata following it must be moved ahead.
-         */
+        /* Let root write the modified part of the header to the file */
         err = ncmpio_write_header(ncp);
         if (err != NC_NOERR) DEBUG_RETURN_ERROR(err)
     }
@@ -969,7 +969,8 @@ ncmpio_wait(void *ncdp,
             int   num_reqs,
             int  *req_ids,   /* [num_reqs]: IN/OUT */
             int  *statuses,  /* [num_reqs] */
-            int   reqMode)   /* only check if NC_REQ_COLL or NC_REQ_INDEP */
+            int   reqMode)   /* only check if NC_REQ_COLL or NC_REQ_INDEP, and
+                                NC_REQ_NODE */
 {
     NC *ncp = (NC*)ncdp;
     int coll_indep;
@@ -988,6 +989,17 @@ ncmpio_wait(void *ncdp,
 
     if (coll_indep == NC_REQ_INDEP && num_reqs == 0) return NC_NOERR;
 
+    if (coll_indep == NC_REQ_COLL && fIsSet(reqMode, NC_REQ_NODE) &&
+        !ncp->node_aggr) {
+        /* the caller asks for intra-node aggregation of this wait only, as
+         * if hint nc_node_aggr were enabled */
+        int err;
+        ncp->node_aggr = 1;
+        err = req_commit(ncp, num_reqs, req_ids, statuses, coll_indep);
+        ncp->node_aggr = 0;
+        return err;
+    }
+
     return req_commit(ncp, num_reqs, req_ids, statuses, coll_indep);
 #else
     /* If request aggregation is disabled, we call an independent wait() for
@@ -1078,6 +1090,22 @@ typedef struct {
                             request to be merged */
 } off_len;
 
+/* C struct for breaking down a request to a list of strided runs, each made
+ * of nreps segments of the same length */
+typedef struct {
+    MPI_Offset off;      /* file offset of the first segment */
+    MPI_Offset len;      /* length in bytes of each segment */
+    MPI_Offset stride;   /* distance in bytes between file offsets of two
+                            consecutive segments */
+    MPI_Offset nreps;    /* number of segments */
+    MPI_Aint   buf_addr; /* distance of the first segment's I/O buffer to the
+                            first request to be merged. The segments are
+                            contiguous in the buffer. */
+    int        prec;     /* ID of the request, which increases in the order
+                            requests are posted. The run of a higher ID wins
+                            the writes to overlapped regions. */
+} off_run;
+
 /*----< off_compare() >-------------------------------------------------------*/
 /* used for sorting the offsets of the off_len array */
 static int
@@ -1088,143 +1116,911 @@ off_compare(const void *a, const void *b)
     return 0;
 }
 
-/*----< vars_flatten() >------------------------------------------------------*/
-/* flatten a subarray request into a list of offset-length pairs */
+/* Sorting an array of off_len whose offsets are not in an increasing order.
+ * The array is often made of a few runs already sorted, for example when
+ * concatenating the flattened lists of interleaved subarray requests. When
+ * the number of runs is no more than SEG_MERGE_MAX_RUNS, the runs are merged
+ * by a k-way merge using a binary heap. Otherwise, an LSD radix sort on the
+ * offsets is used. Both methods are stable, i.e. among elements of the same
+ * offset, their original order is kept.
+ */
+#define SEG_MERGE_MAX_RUNS 64
+#define SEG_RADIX_BITS     11
+#define SEG_RADIX_SIZE     (1 << SEG_RADIX_BITS)
+
+/* compare the heads of runs a and b, ties are broken by run index */
+#define HEAP_LESS(src, pos, a, b)                    \
+    ((src)[(pos)[a]].off <  (src)[(pos)[b]].off ||   \
+    ((src)[(pos)[a]].off == (src)[(pos)[b]].off && (a) < (b)))
+
+/*----< heap_sift_down() >---------------------------------------------------*/
+static void
+heap_sift_down(int               *heap,
+               int                nheap,
+               int                i,
+               const off_len     *src,
+               const MPI_Offset  *pos)
+{
+    int r = heap[i];
+    while (1) {
+        int c = 2 * i + 1;
+        if (c >= nheap) break;
+        if (c + 1 < nheap && HEAP_LESS(src, pos, heap[c+1], heap[c])) c++;
+        if (!HEAP_LESS(src, pos, heap[c], r)) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = r;
+}
+
+/*----< merge_runs() >-------------------------------------------------------*/
+/* merge nruns sorted runs of src[nelems] into dst[nelems] */
+static int
+merge_runs(MPI_Offset     nelems,
+           int            nruns,
+           const off_len *src,
+           off_len       *dst)
+{
+    int i, r, nheap, *heap;
+    MPI_Offset k, *pos, *end;
+
+    heap = (int*)        NCI_Malloc((size_t)nruns * sizeof(int));
+    pos  = (MPI_Offset*) NCI_Malloc((size_t)nruns * 2 * sizeof(MPI_Offset));
+    if (heap == NULL || pos == NULL) {
+        if (heap != NULL) NCI_Free(heap);
+        if (pos  != NULL) NCI_Free(pos);
+        DEBUG_RETURN_ERROR(NC_ENOMEM)
+    }
+    end = pos + nruns;
+
+    /* find the boundaries of runs */
+    r = 0;
+    pos[0] = 0;
+    for (k=1; k<nelems; k++) {
+        if (src[k-1].off > src[k].off) {
+            end[r++] = k;
+            pos[r] = k;
+        }
+    }
+    end[r] = nelems;
+    assert(r + 1 == nruns);
+
+    /* build the heap from the first element of all runs */
+    nheap = nruns;
+    for (i=0; i<nruns; i++) heap[i] = i;
+    for (i=nheap/2-1; i>=0; i--)
+        heap_sift_down(heap, nheap, i, src, pos);
+
+    for (k=0; k<nelems; k++) {
+        r = heap[0];
+        dst[k] = src[pos[r]++];
+        if (pos[r] == end[r]) /* run r is exhausted */
+            heap[0] = heap[--nheap];
+        if (nheap > 0) heap_sift_down(heap, nheap, 0, src, pos);
+    }
+
+    NCI_Free(pos);
+    NCI_Free(heap);
+    return NC_NOERR;
+}
+
+/*----< radix_sort() >-------------------------------------------------------*/
+/* LSD radix sort of buf[nelems] based on member off, using tmp[nelems] as
+ * the scratch space. Only the digits of (off - min offset) are sorted.
+ * Return the array that contains the sorted result, either buf or tmp.
+ */
+static off_len*
+radix_sort(MPI_Offset  nelems,
+           off_len    *buf,
+           off_len    *tmp)
+{
+    int d, shift;
+    off_len *src=buf, *dst=tmp, *swap;
+    MPI_Offset k, min_off, max_off, range, *cnt;
+
+    cnt = (MPI_Offset*) NCI_Malloc(SEG_RADIX_SIZE * sizeof(MPI_Offset));
+    if (cnt == NULL) return NULL;
+
+    min_off = max_off = buf[0].off;
+    for (k=1; k<nelems; k++) {
+        if (buf[k].off < min_off) min_off = buf[k].off;
+        if (buf[k].off > max_off) max_off = buf[k].off;
+    }
+    range = max_off - min_off;
+
+    for (shift=0; shift < 64 && (range >> shift) > 0; shift += SEG_RADIX_BITS) {
+        MPI_Offset sum=0;
+
+        /* histogram of this digit */
+        memset(cnt, 0, SEG_RADIX_SIZE * sizeof(MPI_Offset));
+        for (k=0; k<nelems; k++)
+            cnt[((src[k].off - min_off) >> shift) & (SEG_RADIX_SIZE-1)]++;
+
+        /* prefix sums become the starting index of each bucket */
+        for (d=0; d<SEG_RADIX_SIZE; d++) {
+            MPI_Offset c = cnt[d];
+            cnt[d] = sum;
+            sum += c;
+        }
+
+        /* scatter, stable */
+        for (k=0; k<nelems; k++)
+            dst[cnt[((src[k].off - min_off) >> shift) & (SEG_RADIX_SIZE-1)]++]
+                = src[k];
+
+        swap = src; src = dst; dst = swap;
+    }
+    NCI_Free(cnt);
+
+    return src;
+}
+
+/*----< sort_off_len() >-----------------------------------------------------*/
+/* Sort buf[nelems] in an increasing order of member off. Return the sorted
+ * array, which is either buf or a newly allocated array. In the latter case,
+ * buf has been freed. Return NULL if memory allocation fails, in which case
+ * buf is left intact.
+ */
+static off_len*
+sort_off_len(MPI_Offset  nelems,
+             off_len    *buf)
+{
+    int err;
+    off_len *tmp, *sorted;
+    MPI_Offset k, nruns=1;
+
+    /* count the number of sorted runs */
+    for (k=1; k<nelems; k++)
+        if (buf[k-1].off > buf[k].off) nruns++;
+    if (nruns == 1) return buf;
+
+    tmp = (off_len*) NCI_Malloc((size_t)nelems * sizeof(off_len));
+    if (tmp == NULL) return NULL;
+
+    if (nruns <= SEG_MERGE_MAX_RUNS) {
+        err = merge_runs(nelems, (int)nruns, buf, tmp);
+        sorted = (err == NC_NOERR) ? tmp : NULL;
+    }
+    else
+        sorted = radix_sort(nelems, buf, tmp);
+
+    if (sorted == NULL) {
+        NCI_Free(tmp);
+        return NULL;
+    }
+    if (sorted == tmp) NCI_Free(buf);
+    else               NCI_Free(tmp);
+
+    return sorted;
+}
+
+/*----< vars_to_runs() >------------------------------------------------------*/
+/* Break a subarray request into a list of strided runs. A run describes
+ * nreps segments of the same length, whose file offsets are stride bytes
+ * apart and which are contiguous in the I/O buffer. The repeat is along the
+ * lowest dimension that is not contiguous in the file, i.e. the last
+ * dimension if its stride is > 1, or the second last one otherwise. One run
+ * is created for each index of the remaining higher dimensions. When runs is
+ * NULL, only the number of runs is returned.
+ */
 static MPI_Offset
-vars_flatten(int          ndim,    /* number of dimensions */
+vars_to_runs(int          ndim,    /* number of dimensions */
              int          el_size, /* array element size */
              MPI_Offset  *dimlen,  /* [ndim] dimension lengths */
              MPI_Offset   offset,  /* starting file offset of variable */
              MPI_Aint     buf_addr,/* starting buffer address */
              MPI_Offset  *start,   /* [ndim] starts of subarray */
              MPI_Offset  *count,   /* [ndim] counts of subarray */
-             MPI_Offset  *stride,  /* [ndim] strides of subarray */
-             MPI_Offset  *nseg,    /* OUT: number of segments */
-             off_len     *seg)     /* OUT: array of segments */
+             MPI_Offset  *stride,  /* [ndim] strides of subarray, can be NULL */
+             off_run     *runs)    /* OUT: array of runs */
 {
-    int i, j, to_free_stride=0;
-    MPI_Offset seg_len, nstride, array_len, off, subarray_len;
-    off_len *ptr=seg, *seg0;
+    int i, rdim;
+    MPI_Offset j, nruns, len, nreps, rstride, off, *dimsz, *idx;
 
-    *nseg = 0;
-    if (ndim < 0) return *nseg;
+    if (ndim < 0) return 0;
 
     if (ndim == 0) {  /* scalar record variable */
-        *nseg = 1;
-        seg->off      = offset;
-        seg->len      = el_size;
-        seg->buf_addr = buf_addr;
-        return *nseg;
-    }
-
-    if (stride == NULL) { /* equivalent to {1, 1, ..., 1} */
-        stride = (MPI_Offset*) NCI_Malloc((size_t)ndim * SIZEOF_MPI_OFFSET);
-        for (i=0; i<ndim; i++) stride[i] = 1;
-        to_free_stride = 1;
-    }
-
-    /* TODO: check if all stride[] >= 1
-       Q: Is it legal if any stride[] <= 0 ? */
-
-    /* calculate the number of offset-length pairs */
-    *nseg = (stride[ndim-1] == 1) ? 1 : count[ndim-1];
-    for (i=0; i<ndim-1; i++)
-        *nseg *= count[i];
-    if (*nseg == 0) {  /* not reachable, an error if count[] == 0 */
-        if (to_free_stride) NCI_Free(stride);
-        return *nseg;
-    }
-
-    /* the length of all segments are of the same size */
-    seg_len  = (stride[ndim-1] == 1) ? count[ndim-1] : 1;
-    seg_len *= el_size;
-    nstride  = (stride[ndim-1] == 1) ? 1 : count[ndim-1];
-
-    /* set the offset-length pairs for the lowest dimension */
-    off = offset + start[ndim-1] * el_size;
-    for (i=0; i<nstride; i++) {
-        ptr->off       = off;
-        ptr->len       = seg_len;
-        ptr->buf_addr  = buf_addr;
-        buf_addr      += seg_len;
-        off           += stride[ndim-1] * el_size;
-        ptr++;
-    }
-    ndim--;
-
-    subarray_len = nstride;
-    array_len = 1;
-    /* for higher dimensions */
-    while (ndim > 0) {
-        /* array_len is global array size from lowest up to ndim */
-        array_len *= dimlen[ndim];
-
-        /* off is the global array offset for this dimension, ndim-1 */
-        off = start[ndim-1] * array_len * el_size;
-
-        /* update all offsets from lowest up to dimension ndim-1 */
-        seg0 = seg;
-        for (j=0; j<subarray_len; j++) {
-            seg0->off += off;
-            seg0++;
-        }
-
-        /* update each plan subarray of dimension ndim-1 */
-        off = array_len * stride[ndim-1] * el_size;
-        for (i=1; i<count[ndim-1]; i++) {
-            seg0 = seg;
-            for (j=0; j<subarray_len; j++) {
-                ptr->off       = seg0->off + off;
-                ptr->len       = seg_len;
-                ptr->buf_addr  = buf_addr;
-                buf_addr      += seg_len;
-                ptr++;
-                seg0++;
-            }
-            off += array_len * stride[ndim-1] * el_size;
-        }
-        ndim--;  /* move to next higher dimension */
-        subarray_len *= count[ndim];
-    }
-    if (to_free_stride) NCI_Free(stride);
-
-    return *nseg;
+        if (runs != NULL) {
+            runs->off      = offset;
+            runs->len      = el_size;
+            runs->stride   = el_size;
+            runs->nreps    = 1;
+            runs->buf_addr = buf_addr;
+        }
+        return 1;
+    }
+
+#define RUN_STRIDE(d) ((stride == NULL) ? 1 : stride[d])
+
+    /* the segment length and the dimension along which segments repeat */
+    if (RUN_STRIDE(ndim-1) == 1) {
+        len  = count[ndim-1] * el_size;
+        rdim = ndim - 2;
+    }
+    else {
+        len  = el_size;
+        rdim = ndim - 1;
+    }
+    nreps = (rdim >= 0) ? count[rdim] : 1;
+
+    /* one run for each index of dimensions higher than rdim */
+    nruns = (len == 0 || nreps == 0) ? 0 : 1;
+    for (i=0; i<rdim; i++)
+        nruns *= count[i];
+    if (runs == NULL || nruns == 0) return nruns;
+
+    /* dimsz[i] is the size in bytes of a subarray of dimensions i+1 ... */
+    dimsz = (MPI_Offset*) NCI_Malloc((size_t)ndim * 2 * SIZEOF_MPI_OFFSET);
+    idx   = dimsz + ndim;
+    dimsz[ndim-1] = el_size;
+    for (i=ndim-2; i>=0; i--)
+        dimsz[i] = dimsz[i+1] * dimlen[i+1];
+
+    /* file offset of the first element of the subarray */
+    for (i=0; i<ndim; i++) {
+        offset += start[i] * dimsz[i];
+        idx[i]  = 0;
+    }
+    rstride = (rdim >= 0) ? RUN_STRIDE(rdim) * dimsz[rdim] : len;
+
+    for (j=0; j<nruns; j++) {
+        off = offset;
+        for (i=0; i<rdim; i++)
+            off += idx[i] * RUN_STRIDE(i) * dimsz[i];
+
+        runs[j].off      = off;
+        runs[j].len      = len;
+        runs[j].stride   = rstride;
+        runs[j].nreps    = nreps;
+        runs[j].buf_addr = buf_addr;
+        buf_addr += len * nreps;
+
+        /* move on to the next index of dimensions higher than rdim */
+        for (i=rdim-1; i>=0; i--) {
+            if (++idx[i] < count[i]) break;
+            idx[i] = 0;
+        }
+    }
+    NCI_Free(dimsz);
+
+    return nruns;
 }
 
-/*----< merge_requests() >---------------------------------------------------*/
+/*----< merge_off_len() >----------------------------------------------------*/
+/* merge the overlapped segments of a sorted off-len array, skip the overlapped
+ * regions for those segments with higher indices (i.e. segments with lower
+ * indices win the writes to the overlapped regions). Return the number of
+ * segments after merge.
+ */
+static MPI_Offset
+merge_off_len(MPI_Offset  nsegs,
+              off_len    *segs)  /* [nsegs] IN/OUT */
+{
+    MPI_Offset i, j;
+
+    for (i=0, j=1; j<nsegs; j++) {
+        if (segs[i].off + segs[i].len >= segs[j].off + segs[j].len)
+            /* segment i completely covers segment j, skip j */
+            continue;
+
+        MPI_Offset gap = segs[i].off + segs[i].len - segs[j].off;
+        if (gap >= 0) { /* segments i and j overlaps */
+            if (segs[i].buf_addr + segs[i].len == segs[j].buf_addr + gap) {
+                /* buffers i and j are contiguous, merge j to i */
+                segs[i].len += segs[j].len - gap;
+            }
+            else { /* buffers are not contiguous, reduce j's len */
+                segs[i+1].off      = segs[j].off + gap;
+                segs[i+1].len      = segs[j].len - gap;
+                segs[i+1].buf_addr = segs[j].buf_addr + gap;
+                i++;
+            }
+        }
+        else { /* i and j do not overlap */
+            i++;
+            if (i < j) segs[i] = segs[j];
+        }
+    }
+
+    /* now all off-len pairs are not overlapped */
+    return i+1;
+}
+
+/*----< merge_off_len_prec() >-----------------------------------------------*/
+/* Sort and merge an off-len array whose segments may overlap, where prec[k] is
+ * the precedence of segs[k]. An overlapped region is written by the segment of
+ * the highest precedence, or of the highest index among the segments of the
+ * same precedence. The segments are swept in an increasing order of offsets,
+ * keeping the ones covering the current offset in a max-heap of precedence.
+ * Return a newly allocated array of sorted and non-overlapped segments, in
+ * which case segs has been freed. Return NULL if memory allocation fails, in
+ * which case segs is left intact.
+ */
+#define PREC_ABOVE(a, b) (prec[a] > prec[b] || (prec[a] == prec[b] && (a) > (b)))
+
+static off_len*
+merge_off_len_prec(MPI_Offset  nsegs,
+                   off_len    *segs,    /* [nsegs] */
+                   const int  *prec,    /* [nsegs] */
+                   MPI_Offset *nmerged) /* OUT: number of segments after merge */
+{
+    MPI_Offset i, c, k, s, n, pos, end, nheap, *heap;
+    MPI_Aint addr;
+    off_len *keys, *sorted, *merged;
+
+    assert(nsegs > 0);
+
+    /* sort the segments by their offsets, keys[].len stores the index of
+     * segs[] */
+    keys = (off_len*) NCI_Malloc((size_t)nsegs * sizeof(off_len));
+    if (keys == NULL) return NULL;
+    for (k=0; k<nsegs; k++) {
+        keys[k].off      = segs[k].off;
+        keys[k].len      = k;
+        keys[k].buf_addr = 0;
+    }
+    sorted = sort_off_len(nsegs, keys);
+    if (sorted == NULL) {
+        NCI_Free(keys);
+        return NULL;
+    }
+    keys = sorted;
+
+    /* each segment starts and ends at most one merged segment */
+    heap   = (MPI_Offset*) NCI_Malloc((size_t)nsegs * SIZEOF_MPI_OFFSET);
+    merged = (off_len*)    NCI_Malloc((size_t)nsegs * 2 * sizeof(off_len));
+    if (heap == NULL || merged == NULL) {
+        if (heap   != NULL) NCI_Free(heap);
+        if (merged != NULL) NCI_Free(merged);
+        NCI_Free(keys);
+        return NULL;
+    }
+
+    n = nheap = s = 0;
+    pos = keys[0].off;
+    while (s < nsegs || nheap > 0) {
+        /* push the segments starting at pos into the heap */
+        while (s < nsegs && keys[s].off <= pos) {
+            k = keys[s++].len;
+            for (i=nheap++; i>0 && PREC_ABOVE(k, heap[(i-1)/2]); i=(i-1)/2)
+                heap[i] = heap[(i-1)/2];
+            heap[i] = k;
+        }
+
+        /* pop the segments ending at or before pos */
+        while (nheap > 0 && segs[heap[0]].off + segs[heap[0]].len <= pos) {
+            k = heap[--nheap];
+            for (i=0; (c=2*i+1) < nheap; i=c) {
+                if (c+1 < nheap && PREC_ABOVE(heap[c+1], heap[c])) c++;
+                if (!PREC_ABOVE(heap[c], k)) break;
+                heap[i] = heap[c];
+            }
+            heap[i] = k;
+        }
+
+        if (nheap == 0) { /* a hole, move on to the next segment */
+            if (s < nsegs) pos = keys[s].off;
+            continue;
+        }
+
+        /* [pos, end) is written by the segment at the top of the heap */
+        k   = heap[0];
+        end = segs[k].off + segs[k].len;
+        if (s < nsegs && keys[s].off < end) end = keys[s].off;
+        addr = segs[k].buf_addr + (pos - segs[k].off);
+
+        if (n > 0 && merged[n-1].off + merged[n-1].len == pos &&
+            merged[n-1].buf_addr + merged[n-1].len == addr)
+            /* contiguous in both file and buffer, merge to the last one */
+            merged[n-1].len += end - pos;
+        else {
+            merged[n].off      = pos;
+            merged[n].len      = end - pos;
+            merged[n].buf_addr = addr;
+            n++;
+        }
+        pos = end;
+    }
+    NCI_Free(heap);
+    NCI_Free(keys);
+    NCI_Free(segs);
+
+    *nmerged = n;
+    return merged;
+}
+
+/*----< type_create_off_len() >----------------------------------------------*/
 static int
-merge_requests(NC          *ncp,
-               int          num_reqs,
-               NC_req      *reqs,    /* [num_reqs] */
-               void       **buf,     /* OUT: 1st I/O buf addr */
-               MPI_Offset  *nsegs,   /* OUT: no. off-len pairs */
-               off_len    **segs)    /* OUT: [*nsegs] */
+type_create_off_len(MPI_Offset    nsegs,    /* no. off-len pairs */
+                    off_len      *segs,     /* [nsegs] off-en pairs */
+                    MPI_Datatype *filetype,
+                    MPI_Datatype *buf_type)
 {
-    int i, j, status=NC_NOERR, ndims;
-    MPI_Offset  nseg, *start, *count, *shape, *stride;
-    MPI_Aint addr, buf_addr;
+    int i, j, mpireturn, *blocklengths;
+    MPI_Aint   *displacements;
+    MPI_Offset  next_off, next_len;
 
-    *nsegs = 0;    /* total number of offset-length pairs */
-    *segs  = NULL; /* array of offset-length pairs */
+    assert(nsegs > 0);
 
-    /* note invalid requests have been removed in wait_getput() */
-    *buf = reqs[0].xbuf; /* I/O buffer of first request */
+    /* create the file view MPI derived data type by concatenating the sorted
+       offset-length pairs */
 
-    /* buf_addr is the buffer address of the first request */
-#ifdef HAVE_MPI_GET_ADDRESS
-    MPI_Get_address(reqs[0].xbuf, &buf_addr);
+    /* For filetype, the segs[].off can be further coalesced. For example,
+     * when writing a consecutive columns of a 2D array, even though the I/O
+     * buffer addresses may not be able to coalesced, the file offsets on
+     * the same row can be coalesced. Thus, first calculate the length of
+     * coalesced off-len pairs (the memory space needed for malloc)
+     */
+    next_off = segs[0].off;
+    next_len = segs[0].len;
+    for (j=0,i=1; i<nsegs; i++) {
+        if (next_off + next_len == segs[i].off) /* j and i are contiguous */
+            next_len += segs[i].len;
+        else {
+            j++;
+            next_off = segs[i].off;
+            next_len = segs[i].len;
+        }
+    }
+    /* j+1 is the coalesced length */
+    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
+    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
+
+    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
+    if (segs[0].len != (int)segs[0].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+    displacements[0] =      segs[0].off;
+    blocklengths[0]  = (int)segs[0].len;
+    for (j=0,i=1; i<nsegs; i++) {
+        if (segs[i].len != (int)segs[i].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+        if (displacements[j] + blocklengths[j] == segs[i].off)
+            /* j and i are contiguous */
+            blocklengths[j] += (int)segs[i].len;
+            /* TODO: take care of 4-byte int overflow problem */
+        else {
+            j++;
+            displacements[j] =      segs[i].off;
+            blocklengths[j]  = (int)segs[i].len;
+        }
+    }
+    /* j+1 is the coalesced length */
+
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
+                                         MPI_BYTE, filetype);
 #else
-    MPI_Address(reqs[0].xbuf, &buf_addr);
+    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
+                                  filetype);
+#endif
+    if (mpireturn != MPI_SUCCESS) {
+        *filetype = MPI_BYTE;
+        *buf_type = MPI_BYTE;
+        NCI_Free(displacements);
+        NCI_Free(blocklengths);
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+    }
+    MPI_Type_commit(filetype);
+    NCI_Free(displacements);
+    NCI_Free(blocklengths);
+
+    /* create the I/O buffer derived data type from the I/O buffer's
+       offset-length pairs */
+
+    /* Although it is unlikely buffers can be coalesced, it will not harm to
+       check it out */
+    next_off = segs[0].buf_addr;
+    next_len = segs[0].len;
+    for (j=0,i=1; i<nsegs; i++) {
+        if (next_off + next_len == segs[i].buf_addr)
+            /* j and i are contiguous */
+            next_len += segs[i].len;
+        else {
+            j++;
+            next_off = segs[i].buf_addr;
+            next_len = segs[i].len;
+        }
+    }
+    /* j+1 is the coalesced length */
+    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
+    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
+
+    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
+    if (segs[0].len != (int)segs[0].len) {
+        NCI_Free(displacements);
+        NCI_Free(blocklengths);
+        DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+    }
+    displacements[0] =      segs[0].buf_addr;
+    blocklengths[0]  = (int)segs[0].len;
+    for (j=0,i=1; i<nsegs; i++) {
+        if (segs[i].len != (int)segs[i].len) {
+            NCI_Free(displacements);
+            DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+        }
+        if (displacements[j] + blocklengths[j] == segs[i].buf_addr)
+            /* j and i are contiguous */
+            blocklengths[j] += (int)segs[i].len;
+        else {
+            j++;
+            displacements[j] =      segs[i].buf_addr;
+            blocklengths[j]  = (int)segs[i].len;
+        }
+    }
+    /* j+1 is the coalesced length */
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
+                                         MPI_BYTE, buf_type);
+#else
+    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
+                                  buf_type);
+#endif
+    if (mpireturn != MPI_SUCCESS) {
+        if (*filetype != MPI_BYTE) MPI_Type_free(filetype);
+        *filetype = MPI_BYTE;
+        *buf_type = MPI_BYTE;
+        NCI_Free(displacements);
+        NCI_Free(blocklengths);
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+    }
+    MPI_Type_commit(buf_type);
+    NCI_Free(displacements);
+    NCI_Free(blocklengths);
+
+    return NC_NOERR;
+}
+
+/*----< type_create_lockstep() >---------------------------------------------*/
+/* Create the filetype and buffer type for a cluster of nruns runs of the same
+ * segment length, stride, and number of repeats, whose segments interleave
+ * in lockstep, i.e. one segment of each run in every stride, for example
+ * requests each accessing a column of a 2D array. keys[] gives the indices of
+ * runs[] in an increasing order of file offsets. Both types are an hvector of
+ * nreps copies of an hindexed type describing the nruns segments of one
+ * stride, so their sizes are independent from nreps.
+ */
+static int
+type_create_lockstep(int            nruns,
+                     const off_run *runs,
+                     const off_len *keys,     /* [nruns] */
+                     MPI_Datatype  *filetype,
+                     MPI_Datatype  *buf_type)
+{
+    int i, mpireturn, len, nreps, *blocklengths;
+    MPI_Aint *f_disps, *b_disps;
+    MPI_Datatype type1;
+
+    len   = (int)runs[keys[0].len].len;
+    nreps = (int)runs[keys[0].len].nreps;
+
+    blocklengths = (int*)      NCI_Malloc((size_t)nruns * SIZEOF_INT);
+    f_disps      = (MPI_Aint*) NCI_Malloc((size_t)nruns * 2 * SIZEOF_MPI_AINT);
+    b_disps      = f_disps + nruns;
+    for (i=0; i<nruns; i++) {
+        blocklengths[i] = len;
+        f_disps[i]      = runs[keys[i].len].off;
+        b_disps[i]      = runs[keys[i].len].buf_addr;
+    }
+
+    *filetype = *buf_type = MPI_BYTE;
+
+    /* segments in the first stride of the file */
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(nruns, blocklengths, f_disps,
+                                         MPI_BYTE, &type1);
+#else
+    mpireturn = MPI_Type_hindexed(nruns, blocklengths, f_disps, MPI_BYTE,
+                                  &type1);
+#endif
+    if (mpireturn != MPI_SUCCESS) goto err_out;
+    MPI_Type_commit(&type1);
+
+#ifdef HAVE_MPI_TYPE_CREATE_HVECTOR
+    mpireturn = MPI_Type_create_hvector(nreps, 1, runs[keys[0].len].stride,
+                                        type1, filetype);
+#else
+    mpireturn = MPI_Type_hvector(nreps, 1, runs[keys[0].len].stride, type1,
+                                 filetype);
+#endif
+    MPI_Type_free(&type1);
+    if (mpireturn != MPI_SUCCESS) goto err_out;
+    MPI_Type_commit(filetype);
+
+    /* the same segments in the buffer, each run's buffer is contiguous */
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+    mpireturn = MPI_Type_create_hindexed(nruns, blocklengths, b_disps,
+                                         MPI_BYTE, &type1);
+#else
+    mpireturn = MPI_Type_hindexed(nruns, blocklengths, b_disps, MPI_BYTE,
+                                  &type1);
+#endif
+    if (mpireturn != MPI_SUCCESS) goto err_out;
+    MPI_Type_commit(&type1);
+
+#ifdef HAVE_MPI_TYPE_CREATE_HVECTOR
+    mpireturn = MPI_Type_create_hvector(nreps, 1, len, type1, buf_type);
+#else
+    mpireturn = MPI_Type_hvector(nreps, 1, len, type1, buf_type);
+#endif
+    MPI_Type_free(&type1);
+    if (mpireturn != MPI_SUCCESS) goto err_out;
+    MPI_Type_commit(buf_type);
+
+    NCI_Free(f_disps);
+    NCI_Free(blocklengths);
+    return NC_NOERR;
+
+err_out:
+    if (*filetype != MPI_BYTE) MPI_Type_free(filetype);
+    *filetype = *buf_type = MPI_BYTE;
+    NCI_Free(f_disps);
+    NCI_Free(blocklengths);
+    return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hvector");
+}
+
+/*----< key_compare() >-------------------------------------------------------*/
+/* used for sorting keys of runs back into the original order of runs */
+static int
+key_compare(const void *a, const void *b)
+{
+    if (((off_len*)a)->len > ((off_len*)b)->len) return  1;
+    if (((off_len*)a)->len < ((off_len*)b)->len) return -1;
+    return 0;
+}
+
+/* A run is kept in its compact form only when it has at least this number of
+ * segments. Shorter runs are expanded into off-len pairs, to avoid creating
+ * too many small MPI derived data types.
+ */
+#define RUN_MIN_NREPS 16
+
+#define RUN_END(r) ((r)->off + ((r)->nreps - 1) * (r)->stride + (r)->len)
+
+/*----< type_create_runs() >-------------------------------------------------*/
+/* Create the filetype and buffer type from a list of runs whose file offsets
+ * may interleave. The runs are sorted by their starting offsets and divided
+ * into clusters of runs whose file extents overlap. A cluster of runs
+ * interleaving in lockstep (including a cluster of a single run) is
+ * described by an hvector datatype without expanding the runs. Runs of other
+ * clusters are expanded into off-len pairs, which are then sorted and merged.
+ * The datatypes of all clusters are concatenated into one, following an
+ * increasing order of file offsets.
+ */
+static int
+type_create_runs(MPI_Offset    nruns,
+                 off_run      *runs,     /* [nruns] */
+                 MPI_Datatype *filetype,
+                 MPI_Datatype *buf_type)
+{
+    int k, err=NC_NOERR, status=NC_NOERR, mpireturn, npieces=0, compact;
+    int *blocklengths, *exp_prec;
+    MPI_Offset i, j, m, max_end, nsegs=0, max_nsegs=0, nexp;
+    MPI_Aint *disps;
+    MPI_Datatype *ftypes, *btypes;
+    off_len *keys, *sorted, *segs=NULL, *exp_segs;
+    off_run *r0, *rj;
+
+    *filetype = *buf_type = MPI_BYTE;
+
+    /* check if any run is long enough to be kept compact */
+    for (i=0; i<nruns; i++)
+        if (runs[i].nreps >= RUN_MIN_NREPS) break;
+    compact = (i < nruns);
+
+    /* sort runs by their starting file offsets, keys[].len stores the index
+     * of runs[] */
+    keys = NULL;
+    if (compact) {
+        keys = (off_len*) NCI_Malloc((size_t)nruns * sizeof(off_len));
+        for (i=0; i<nruns; i++) {
+            keys[i].off      = runs[i].off;
+            keys[i].len      = i;
+            keys[i].buf_addr = 0;
+        }
+        sorted = sort_off_len(nruns, keys);
+        if (sorted != NULL)
+            keys = sorted;
+        else /* out of memory, sort in place */
+            qsort(keys, (size_t)nruns, sizeof(off_len), off_compare);
+    }
+
+    /* each cluster produces at most 2 pieces of datatypes */
+    ftypes = (MPI_Datatype*) NCI_Malloc((size_t)(nruns*2+1) * 2 *
+                                        sizeof(MPI_Datatype));
+    btypes = ftypes + nruns*2+1;
+
+    for (i=0; i<nruns; i=j) {
+        int lockstep=0;
+
+        if (!compact) /* expand all runs as a single cluster */
+            j = nruns;
+        else {
+            /* find cluster [i, j) of runs whose file extents overlap */
+            r0 = runs + keys[i].len;
+            max_end = RUN_END(r0);
+            for (j=i+1; j<nruns && runs[keys[j].len].off < max_end; j++)
+                max_end = MAX(max_end, RUN_END(runs + keys[j].len));
+
+            /* check if all runs in this cluster interleave in lockstep */
+            lockstep = (r0->nreps >= RUN_MIN_NREPS && r0->nreps <= INT_MAX &&
+                        r0->len <= INT_MAX && j - i <= INT_MAX &&
+                        runs[keys[j-1].len].off + r0->len <=
+                        r0->off + r0->stride);
+            for (m=i+1; lockstep && m<j; m++) {
+                rj = runs + keys[m].len;
+                if (rj->len != r0->len || rj->stride != r0->stride ||
+                    rj->nreps != r0->nreps ||
+                    runs[keys[m-1].len].off + r0->len > rj->off)
+                    lockstep = 0;
+            }
+        }
+
+        if (!lockstep) {
+            /* expand the runs into off-len pairs in the original order of
+             * runs, each pair carrying the precedence of its run, so the
+             * request posted last wins the writes to overlapped regions.
+             * When all runs are in this cluster, use runs[] directly. */
+            if (j - i < nruns)
+                qsort(keys+i, (size_t)(j-i), sizeof(off_len), key_compare);
+            for (nexp=0, m=i; m<j; m++) {
+                rj = (j - i < nruns) ? runs + keys[m].len : runs + m;
+                nexp += rj->nreps;
+            }
+            exp_segs = (off_len*) NCI_Malloc((size_t)nexp * sizeof(off_len));
+            exp_prec = (int*)     NCI_Malloc((size_t)nexp * SIZEOF_INT);
+            for (nexp=0, m=i; m<j; m++) {
+                MPI_Offset n;
+                rj = (j - i < nruns) ? runs + keys[m].len : runs + m;
+                for (n=0; n<rj->nreps; n++, nexp++) {
+                    exp_segs[nexp].off      = rj->off + n * rj->stride;
+                    exp_segs[nexp].len      = rj->len;
+                    exp_segs[nexp].buf_addr = rj->buf_addr + n * rj->len;
+                    exp_prec[nexp]          = rj->prec;
+                }
+            }
+            if (j - i > 1) {
+                sorted = merge_off_len_prec(nexp, exp_segs, exp_prec, &nexp);
+                if (sorted != NULL)
+                    exp_segs = sorted;
+                else { /* out of memory, sort and merge in place */
+                    qsort(exp_segs, (size_t)nexp, sizeof(off_len), off_compare);
+                    nexp = merge_off_len(nexp, exp_segs);
+                }
+            }
+            NCI_Free(exp_prec);
+
+            /* append to the pending off-len pairs */
+            if (nsegs == 0) { /* take over exp_segs */
+                if (segs != NULL) NCI_Free(segs);
+                segs      = exp_segs;
+                nsegs     = nexp;
+                max_nsegs = nexp;
+                continue;
+            }
+            if (nsegs + nexp > max_nsegs) {
+                max_nsegs = MAX(max_nsegs * 2, nsegs + nexp);
+                segs = (off_len*) NCI_Realloc(segs, (size_t)max_nsegs *
+                                              sizeof(off_len));
+            }
+            memcpy(segs + nsegs, exp_segs, (size_t)nexp * sizeof(off_len));
+            nsegs += nexp;
+            NCI_Free(exp_segs);
+            continue;
+        }
+
+        /* construct datatypes for the pending off-len pairs */
+        if (nsegs > 0) {
+            err = type_create_off_len(nsegs, segs, &ftypes[npieces],
+                                      &btypes[npieces]);
+            if (err != NC_NOERR) break;
+            npieces++;
+            nsegs = 0;
+        }
+
+        /* construct datatypes for this cluster without expanding it */
+        err = type_create_lockstep((int)(j-i), runs, keys+i, &ftypes[npieces],
+                                   &btypes[npieces]);
+        if (err != NC_NOERR) break;
+        npieces++;
+    }
+    if (err == NC_NOERR && nsegs > 0) {
+        err = type_create_off_len(nsegs, segs, &ftypes[npieces],
+                                  &btypes[npieces]);
+        if (err == NC_NOERR) npieces++;
+    }
+    if (segs != NULL) NCI_Free(segs);
+    if (keys != NULL) NCI_Free(keys);
+
+    if (err != NC_NOERR) {
+        for (k=0; k<npieces; k++) {
+            MPI_Type_free(&ftypes[k]);
+            MPI_Type_free(&btypes[k]);
+        }
+        NCI_Free(ftypes);
+        return err;
+    }
+
+    if (npieces == 1) {
+        *filetype = ftypes[0];
+        *buf_type = btypes[0];
+        NCI_Free(ftypes);
+        return NC_NOERR;
+    }
+
+    /* concatenate all pieces, displacements are already absolute */
+    blocklengths = (int*)      NCI_Malloc((size_t)npieces * SIZEOF_INT);
+    disps        = (MPI_Aint*) NCI_Malloc((size_t)npieces * SIZEOF_MPI_AINT);
+    for (k=0; k<npieces; k++) {
+        blocklengths[k] = 1;
+        disps[k]        = 0;
+    }
+
+#ifdef HAVE_MPI_TYPE_CREATE_STRUCT
+    mpireturn = MPI_Type_create_struct(npieces, blocklengths, disps, ftypes,
+                                       filetype);
+#else
+    mpireturn = MPI_Type_struct(npieces, blocklengths, disps, ftypes, filetype);
 #endif
+    if (mpireturn != MPI_SUCCESS) {
+        status = ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_struct");
+        *filetype = MPI_BYTE;
+    }
+    else {
+        MPI_Type_commit(filetype);
+#ifdef HAVE_MPI_TYPE_CREATE_STRUCT
+        mpireturn = MPI_Type_create_struct(npieces, blocklengths, disps,
+                                           btypes, buf_type);
+#else
+        mpireturn = MPI_Type_struct(npieces, blocklengths, disps, btypes,
+                                    buf_type);
+#endif
+        if (mpireturn != MPI_SUCCESS) {
+            status = ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_struct");
+            MPI_Type_free(filetype);
+            *filetype = *buf_type = MPI_BYTE;
+        }
+        else
+            MPI_Type_commit(buf_type);
+    }
 
-    /* Count the number off-len pairs from reqs[], so we can malloc a
-     * contiguous memory space for storing off-len pairs
+    for (k=0; k<npieces; k++) {
+        MPI_Type_free(&ftypes[k]);
+        MPI_Type_free(&btypes[k]);
+    }
+    NCI_Free(disps);
+    NCI_Free(blocklengths);
+    NCI_Free(ftypes);
+
+    return status;
+}
+
+/*----< reqs_to_runs() >-----------------------------------------------------*/
+/* Break down requests into a list of strided runs. The buffer addresses of
+ * runs are relative to buf_addr. Return the array of runs, to be freed by
+ * the caller.
+ */
+static off_run*
+reqs_to_runs(NC         *ncp,
+             int         num_reqs,
+             NC_req     *reqs,     /* [num_reqs] */
+             MPI_Aint    buf_addr, /* base address of runs[].buf_addr */
+             MPI_Offset *nruns)    /* OUT: number of runs */
+{
+    int i, ndims;
+    MPI_Offset  j, n, *start, *count, *shape, *stride;
+    MPI_Aint addr;
+    off_run *runs, *run_ptr;
+
+    /* note invalid requests have been removed in wait_getput() */
+
+    /* Count the number of runs from reqs[], so we can malloc a contiguous
+     * memory space for storing them
      */
+    *nruns = 0;
     for (i=0; i<num_reqs; i++) {
         ndims  = reqs[i].varp->ndims;
         start  = reqs[i].start;
         count  = start + ndims;
         stride = count + ndims;
+        shape  = reqs[i].varp->shape;
 
         /* for record variable, each reqs[] is within a record */
         if (IS_RECVAR(reqs[i].varp)) {
@@ -1232,38 +2028,29 @@ merge_requests(NC          *ncp,
             start++;
             count++;
             stride++;
+            shape++;
         }
         if (fIsSet(reqs[i].flag, NC_REQ_STRIDE_NULL)) stride = NULL;
 
-        if (ndims < 0) continue;
-        if (ndims == 0) {  /* 1D record variable */
-            (*nsegs)++;
-            continue;
-        }
-        nseg = 1;
-        if (stride != NULL && stride[ndims-1] > 1)
-            nseg = count[ndims-1];  /* count of last dimension */
-        for (j=0; j<ndims-1; j++)
-            nseg *= count[j];  /* all count[] except the last dimension */
-
-        *nsegs += nseg;
+        *nruns += vars_to_runs(ndims, reqs[i].varp->xsz, shape, 0, 0, start,
+                               count, stride, NULL);
     }
+    if (*nruns == 0) return NULL;
 
-    /* now we can allocate a contiguous memory space for the off-len pairs */
-    off_len *seg_ptr = (off_len*) NCI_Malloc((size_t)(*nsegs) * sizeof(off_len));
-    *segs = seg_ptr;
+    /* now we can allocate a contiguous memory space for the runs */
+    runs = (off_run*) NCI_Malloc((size_t)(*nruns) * sizeof(off_run));
 
-    /* now re-run the loop to fill in the off-len pairs */
+    /* now re-run the loop to fill in the runs */
+    run_ptr = runs;
     for (i=0; i<num_reqs; i++) {
         MPI_Offset var_begin;
 
-        /* buf_addr is the buffer address of the first valid request */
 #ifdef HAVE_MPI_GET_ADDRESS
         MPI_Get_address(reqs[i].xbuf, &addr);
 #else
         MPI_Address(reqs[i].xbuf, &addr);
 #endif
-        addr -= buf_addr,  /* distance to the buf of first req */
+        addr -= buf_addr,  /* distance to the base address */
 
         ndims  = reqs[i].varp->ndims;
         start  = reqs[i].start;
@@ -1285,198 +2072,713 @@ merge_requests(NC          *ncp,
             var_begin += reqs[i].start[0] * ncp->recsize;
         }
 
-        if (fIsSet(reqs[i].flag, NC_REQ_STRIDE_NULL)) stride = NULL;
+        if (fIsSet(reqs[i].flag, NC_REQ_STRIDE_NULL)) stride = NULL;
+
+        /* break down each request to a list of runs and append to runs[] */
+        n = vars_to_runs(ndims, reqs[i].varp->xsz, shape, var_begin, addr,
+                         start, count, stride, run_ptr);
+        for (j=0; j<n; j++) run_ptr[j].prec = reqs[i].id;
+        run_ptr += n;
+    }
+
+    return runs;
+}
+
+/*----< merge_requests() >---------------------------------------------------*/
+/* Break down the interleaved requests into strided runs and construct a
+ * filetype and a buffer type from them. The buffer type is relative to the
+ * I/O buffer of the first request.
+ */
+static int
+merge_requests(NC           *ncp,
+               int           num_reqs,
+               NC_req       *reqs,     /* [num_reqs] */
+               MPI_Datatype *filetype, /* OUT */
+               MPI_Datatype *buf_type) /* OUT */
+{
+    int err;
+    MPI_Offset nruns;
+    MPI_Aint buf_addr;
+    off_run *runs;
+
+    *filetype = *buf_type = MPI_BYTE;
+
+    /* buf_addr is the buffer address of the first request */
+#ifdef HAVE_MPI_GET_ADDRESS
+    MPI_Get_address(reqs[0].xbuf, &buf_addr);
+#else
+    MPI_Address(reqs[0].xbuf, &buf_addr);
+#endif
+
+    runs = reqs_to_runs(ncp, num_reqs, reqs, buf_addr, &nruns);
+    assert(nruns > 0);
+
+    err = type_create_runs(nruns, runs, filetype, buf_type);
+    NCI_Free(runs);
+
+    return err;
+}
+
+/*----< coalesce_lead_reqs() >-----------------------------------------------*/
+/* Once the I/O is done, non-lead requests are no longer used. Free the start
+ * arrays allocated by lead requests and keep only the lead requests in
+ * reqs[], which are needed for post-I/O processing.
+ */
+static void
+coalesce_lead_reqs(NC      *ncp,
+                   int     *num_reqs, /* IN/OUT: # requests */
+                   NC_req **reqs,     /* IN/OUT: [*num_reqs] */
+                   int      rw_flag)  /* NC_REQ_WR or NC_REQ_RD */
+{
+    int i, j, maxLead;
+
+    maxLead = (rw_flag == NC_REQ_RD) ? ncp->numLeadGetReqs
+                                     : ncp->numLeadPutReqs;
+    j = 0;
+    for (i=0; i<*num_reqs; i++) {
+        if (fIsSet((*reqs)[i].flag, NC_REQ_LEAD)) {
+            /* lead request allocated start array for all sub-requests */
+            NCI_Free((*reqs)[i].start);
+            if (j < i) (*reqs)[j] = (*reqs)[i]; /* coalesce lead requests */
+            j++;
+            if (j == maxLead) break;
+        }
+    }
+    if (j < *num_reqs) {
+        *num_reqs = j;  /* number of lead requests */
+        *reqs = (NC_req*) NCI_Realloc(*reqs, j * sizeof(NC_req));
+    }
+}
+
+/* size of file domains assigned to an aggregator in each round of PnetCDF's
+ * two-phase I/O, used when the file striping unit is unknown */
+#define AGGR_DEFAULT_STRIPE 1048576
+
+/*----< aggr_flatten() >-----------------------------------------------------*/
+/* Flatten requests into a sorted list of non-overlapped off-len pairs, whose
+ * buf_addr are absolute memory addresses to be used with MPI_BOTTOM.
+ */
+static int
+aggr_flatten(NC          *ncp,
+             int          num_reqs,
+             NC_req      *reqs,   /* [num_reqs] */
+             MPI_Offset  *nsegs,  /* OUT: number of off-len pairs */
+             off_len    **segs)   /* OUT: [*nsegs] */
+{
+    int *prec;
+    MPI_Offset i, j, n, nruns;
+    off_run *runs;
+    off_len *sorted;
+
+    *nsegs = 0;
+    *segs  = NULL;
+    if (num_reqs == 0) return NC_NOERR;
+
+    runs = reqs_to_runs(ncp, num_reqs, reqs, 0, &nruns);
+    if (runs == NULL) return NC_NOERR;
+
+    for (n=0, i=0; i<nruns; i++) n += runs[i].nreps;
+    *segs = (off_len*) NCI_Malloc((size_t)n * sizeof(off_len));
+    prec  = (int*)     NCI_Malloc((size_t)n * SIZEOF_INT);
+    if (*segs == NULL || prec == NULL) {
+        if (*segs != NULL) NCI_Free(*segs);
+        if (prec  != NULL) NCI_Free(prec);
+        *segs = NULL;
+        NCI_Free(runs);
+        DEBUG_RETURN_ERROR(NC_ENOMEM)
+    }
+    for (n=0, i=0; i<nruns; i++) {
+        for (j=0; j<runs[i].nreps; j++, n++) {
+            (*segs)[n].off      = runs[i].off + j * runs[i].stride;
+            (*segs)[n].len      = runs[i].len;
+            (*segs)[n].buf_addr = runs[i].buf_addr + j * runs[i].len;
+            prec[n]             = runs[i].prec;
+        }
+    }
+    NCI_Free(runs);
+
+    /* the request posted last wins the writes to overlapped regions */
+    sorted = merge_off_len_prec(n, *segs, prec, nsegs);
+    if (sorted != NULL)
+        *segs = sorted;
+    else { /* out of memory, sort and merge in place */
+        qsort(*segs, (size_t)n, sizeof(off_len), off_compare);
+        *nsegs = merge_off_len(n, *segs);
+    }
+    NCI_Free(prec);
+
+    return NC_NOERR;
+}
+
+/*----< aggr_write() >-------------------------------------------------------*/
+/* Called by an aggregator to write the data received in one round. The data
+ * from all sources is sorted and copied into wbuf, which is then written to
+ * the file by a single contiguous write. If there are holes in between, the
+ * file contents of the holes are read first. This is safe, because in this
+ * round no other process writes to the stripe owned by this aggregator.
+ */
+static int
+aggr_write(MPI_File    fh,
+           int         npieces,  /* number of pieces received */
+           MPI_Offset *meta,     /* [npieces*2] offsets and lengths */
+           char       *rbuf,     /* data received */
+           char       *wbuf)     /* buffer of size of a stripe */
+{
+    int i, mpireturn, err, status=NC_NOERR;
+    MPI_Offset nsegs, w_lo, w_len, covered=0, disp=0;
+    MPI_Status mpistatus;
+    off_len *segs, *sorted;
+    void *buf;
+
+    segs = (off_len*) NCI_Malloc((size_t)npieces * sizeof(off_len));
+    if (segs == NULL) DEBUG_RETURN_ERROR(NC_ENOMEM)
+
+    /* pieces from each source are sorted and stored back to back in rbuf */
+    for (i=0; i<npieces; i++) {
+        segs[i].off      = meta[2*i];
+        segs[i].len      = meta[2*i+1];
+        segs[i].buf_addr = disp;
+        disp += segs[i].len;
+    }
+    sorted = sort_off_len(npieces, segs);
+    if (sorted != NULL)
+        segs = sorted;
+    else /* out of memory, sort in place */
+        qsort(segs, (size_t)npieces, sizeof(off_len), off_compare);
+    nsegs = merge_off_len(npieces, segs);
+
+    w_lo  = segs[0].off;
+    w_len = segs[nsegs-1].off + segs[nsegs-1].len - w_lo;
+    for (i=0; i<nsegs; i++) covered += segs[i].len;
+
+    if (nsegs == 1)  /* write directly from rbuf */
+        buf = rbuf + segs[0].buf_addr;
+    else {
+        if (covered < w_len) {
+            /* read the holes, part of the file may not exist yet */
+            memset(wbuf, 0, (size_t)w_len);
+            TRACE_IO(MPI_File_read_at)(fh, w_lo, wbuf, (int)w_len, MPI_BYTE,
+                                       &mpistatus);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_read_at");
+                err = (err == NC_EFILE) ? NC_EREAD : err;
+                DEBUG_ASSIGN_ERROR(status, err)
+            }
+        }
+        for (i=0; i<nsegs; i++)
+            memcpy(wbuf + segs[i].off - w_lo, rbuf + segs[i].buf_addr,
+                   (size_t)segs[i].len);
+        buf = wbuf;
+    }
+    NCI_Free(segs);
+    if (status != NC_NOERR) return status;
+
+    TRACE_IO(MPI_File_write_at)(fh, w_lo, buf, (int)w_len, MPI_BYTE,
+                                &mpistatus);
+    if (mpireturn != MPI_SUCCESS) {
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at");
+        err = (err == NC_EFILE) ? NC_EWRITE : err;
+        DEBUG_ASSIGN_ERROR(status, err)
+    }
+    return status;
+}
+
+/*----< aggr_put() >---------------------------------------------------------*/
+/* PnetCDF's own two-phase I/O for collective nonblocking writes, enabled by
+ * hint nc_num_aggrs, as an alternative to the collective buffering of
+ * MPI-IO. The file is divided into stripes of size of the file striping
+ * unit, which are assigned to the aggregators in a round-robin fashion. The
+ * aggregators are spread evenly among the ranks of ncp->comm. The writes
+ * are carried out in rounds, each covering one stripe per aggregator. In
+ * each round, the file offsets and lengths of all pieces are first sent to
+ * the aggregators, followed by the data by a single MPI_Alltoallw, using
+ * derived datatypes describing the requests' I/O buffers. Each aggregator
+ * then writes its stripe with one MPI_File_write_at call.
+ *
+ * Note all processes must call this subroutine, including those that have
+ * no request.
+ */
+static int
+aggr_put(NC      *ncp,
+         int     *num_reqs,  /* IN/OUT: # requests */
+         NC_req **reqs)      /* [*num_reqs] */
+{
+    int i, j, rank, nprocs, naggrs, my_aggr, mpireturn, err, status=NC_NOERR;
+    int npieces, max_npieces, rpieces, *aggr_ranks, *blocklengths;
+    int *cnt_send, *cnt_recv, *m_scounts, *m_sdispls, *m_rcounts, *m_rdispls;
+    int *d_scounts, *d_sdispls, *d_rcounts, *d_rdispls;
+    char *rbuf=NULL, *wbuf=NULL;
+    MPI_Offset k, koff, nsegs, stripe, first, last, r, nrounds, range[2];
+    MPI_Offset *meta, *rmeta=NULL, rbytes, put_size=0;
+    MPI_Aint *addrs;
+    MPI_Datatype *d_stypes, *d_rtypes;
+    MPI_Comm comm=ncp->comm;
+    MPI_File fh=ncp->collective_fh;
+    off_len *segs;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    /* flatten this process's requests, if there is any */
+    err = aggr_flatten(ncp, *num_reqs, *reqs, &nsegs, &segs);
+    if (err != NC_NOERR) {
+        status = err;
+        nsegs  = 0;  /* continue to participate the collective calls */
+    }
+
+    /* find the file range accessed by all processes. The values reduced are
+     * kept non-negative, as some MPI implementations compare MPI_OFFSET as
+     * unsigned integers */
+    range[0] = (nsegs == 0) ? 0 : NC_MAX_INT64 - segs[0].off;
+    range[1] = (nsegs == 0) ? 0 : segs[nsegs-1].off + segs[nsegs-1].len;
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, range, 2, MPI_OFFSET, MPI_MAX,
+                              comm);
+    if (mpireturn != MPI_SUCCESS) {
+        if (segs != NULL) NCI_Free(segs);
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+    }
+
+    if (range[1] > 0) { /* at least one process has data to write */
+        /* make the whole file visible, this is collective */
+        MPI_Offset offset=0;
+        err = ncmpio_file_set_view(ncp, fh, &offset, MPI_BYTE);
+        if (status == NC_NOERR) status = err;
+
+        stripe  = (ncp->striping_unit > 0) ? ncp->striping_unit
+                                           : AGGR_DEFAULT_STRIPE;
+        naggrs  = MIN(ncp->num_aggrs, nprocs);
+        first   = (NC_MAX_INT64 - range[0]) / stripe;
+        last    = (range[1] - 1) / stripe;
+        nrounds = (last - first) / naggrs + 1;
+
+        /* aggregator i is rank i * nprocs / naggrs */
+        aggr_ranks = (int*) NCI_Malloc((size_t)naggrs * SIZEOF_INT);
+        my_aggr = -1;
+        for (i=0; i<naggrs; i++) {
+            aggr_ranks[i] = (int)((MPI_Offset)i * nprocs / naggrs);
+            if (aggr_ranks[i] == rank) my_aggr = i;
+        }
+
+        cnt_send  = (int*) NCI_Malloc((size_t)nprocs * 12 * SIZEOF_INT);
+        cnt_recv  = cnt_send  + nprocs * 2;
+        m_scounts = cnt_recv  + nprocs * 2;
+        m_sdispls = m_scounts + nprocs;
+        m_rcounts = m_sdispls + nprocs;
+        m_rdispls = m_rcounts + nprocs;
+        d_scounts = m_rdispls + nprocs;
+        d_sdispls = d_scounts + nprocs;
+        d_rcounts = d_sdispls + nprocs;
+        d_rdispls = d_rcounts + nprocs;
+        d_stypes  = (MPI_Datatype*) NCI_Malloc((size_t)nprocs * 2 *
+                                               sizeof(MPI_Datatype));
+        d_rtypes  = d_stypes + nprocs;
+        for (i=0; i<nprocs; i++) {
+            d_sdispls[i] = 0; /* send buffers use absolute addresses */
+            d_stypes[i]  = MPI_BYTE;
+            d_rtypes[i]  = MPI_BYTE;
+        }
+        if (my_aggr >= 0) wbuf = (char*) NCI_Malloc((size_t)stripe);
+
+        /* pieces of this process in a round */
+        max_npieces  = 0;
+        meta         = NULL;
+        addrs        = NULL;
+        blocklengths = NULL;
+
+        k    = 0; /* index of next segment to be sent */
+        koff = 0; /* bytes of segs[k] already sent */
+        for (r=0; r<nrounds; r++) {
+            MPI_Offset round_lo, round_hi;
+
+            round_lo = (first + r * naggrs) * stripe;
+            round_hi = round_lo + naggrs * stripe;
+
+            /* split the segments in this round at stripe boundaries. As
+             * segments are sorted, the pieces are grouped by aggregators */
+            for (i=0; i<nprocs*2; i++) cnt_send[i] = 0;
+            npieces = 0;
+            while (k < nsegs && segs[k].off + koff < round_hi) {
+                MPI_Offset off, len, s;
+
+                off = segs[k].off + koff;
+                s   = off / stripe;
+                len = MIN(segs[k].len - koff, (s + 1) * stripe - off);
+                if (npieces == max_npieces) {
+                    max_npieces += (max_npieces == 0) ? 64 : max_npieces;
+                    meta  = (MPI_Offset*) NCI_Realloc(meta, (size_t)max_npieces
+                                                      * 2 * SIZEOF_MPI_OFFSET);
+                    addrs = (MPI_Aint*) NCI_Realloc(addrs, (size_t)max_npieces
+                                                    * SIZEOF_MPI_AINT);
+                    blocklengths = (int*) NCI_Realloc(blocklengths,
+                                   (size_t)max_npieces * SIZEOF_INT);
+                }
+                meta[2*npieces]      = off;
+                meta[2*npieces+1]    = len;
+                addrs[npieces]       = segs[k].buf_addr + koff;
+                blocklengths[npieces] = (int)len;
+                npieces++;
+
+                j = aggr_ranks[s - first - r * naggrs];
+                cnt_send[2*j]++;
+                cnt_send[2*j+1] += (int)len;
+                put_size += len;
+
+                koff += len;
+                if (koff == segs[k].len) {
+                    k++;
+                    koff = 0;
+                }
+            }
+
+            /* construct a derived datatype for the data sent to each
+             * aggregator. If it fails, send nothing to that aggregator. */
+            for (j=0, i=0; i<nprocs; i++) {
+                m_scounts[i] = cnt_send[2*i] * 2;
+                m_sdispls[i] = j * 2;
+                j += cnt_send[2*i];
+                d_scounts[i] = 0;
+                if (cnt_send[2*i] == 0) continue;
+#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
+                mpireturn = MPI_Type_create_hindexed(cnt_send[2*i],
+                            blocklengths + m_sdispls[i] / 2,
+                            addrs + m_sdispls[i] / 2, MPI_BYTE, &d_stypes[i]);
+#else
+                mpireturn = MPI_Type_hindexed(cnt_send[2*i],
+                            blocklengths + m_sdispls[i] / 2,
+                            addrs + m_sdispls[i] / 2, MPI_BYTE, &d_stypes[i]);
+#endif
+                if (mpireturn != MPI_SUCCESS) {
+                    err = ncmpii_error_mpi2nc(mpireturn,
+                                              "MPI_Type_create_hindexed");
+                    if (status == NC_NOERR) status = err;
+                    d_stypes[i]     = MPI_BYTE;
+                    m_scounts[i]    = 0;
+                    cnt_send[2*i]   = 0;
+                    cnt_send[2*i+1] = 0;
+                    continue;
+                }
+                MPI_Type_commit(&d_stypes[i]);
+                d_scounts[i] = 1;
+            }
 
-        /* flatten each request to a list of offset-length pairs */
-        vars_flatten(ndims, reqs[i].varp->xsz, shape, var_begin,
-                     addr, start, count, stride,
-                     &nseg,    /* OUT: number of offset-length pairs */
-                     seg_ptr); /* OUT: array of offset-length pairs */
-        seg_ptr += nseg; /* append the list to the end of segs array */
-    }
+            /* tell aggregators the number of pieces and bytes to receive */
+            TRACE_COMM(MPI_Alltoall)(cnt_send, 2, MPI_INT, cnt_recv, 2,
+                                     MPI_INT, comm);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoall");
+                if (status == NC_NOERR) status = err;
+                break;
+            }
 
-    /* check if (*segs)[].off are in an increasing order */
-    for (i=1; i<*nsegs; i++) {
-        if ((*segs)[i-1].off > (*segs)[i].off)
-            break;
-    }
-    if (i < *nsegs) /* not in an increasing order */
-        /* sort the off-len array, segs[], in an increasing order */
-        qsort(*segs, (size_t)(*nsegs), sizeof(off_len), off_compare);
+            /* The data received by an aggregator in a round is no more than
+             * the stripe size, unless requests of different processes
+             * overlap. */
+            rpieces = 0;
+            rbytes  = 0;
+            for (i=0; i<nprocs; i++) {
+                m_rcounts[i] = cnt_recv[2*i] * 2;
+                m_rdispls[i] = rpieces * 2;
+                rpieces += cnt_recv[2*i];
+                d_rcounts[i] = cnt_recv[2*i+1];
+                d_rdispls[i] = (int)rbytes;
+                rbytes += cnt_recv[2*i+1];
+            }
+            if (rpieces > 0) {
+                rmeta = (MPI_Offset*) NCI_Realloc(rmeta, (size_t)rpieces * 2 *
+                                                  SIZEOF_MPI_OFFSET);
+                rbuf  = (char*) NCI_Realloc(rbuf, (size_t)rbytes);
+            }
 
-    /* merge the overlapped requests, skip the overlapped regions for those
-     * requests with higher j indices (i.e. requests with lower j indices
-     * win the writes to the overlapped regions)
-     */
-    for (i=0, j=1; j<*nsegs; j++) {
-        if ((*segs)[i].off + (*segs)[i].len >= (*segs)[j].off + (*segs)[j].len)
-            /* segment i completely covers segment j, skip j */
-            continue;
+            /* send file offsets and lengths of pieces */
+            TRACE_COMM(MPI_Alltoallv)(meta, m_scounts, m_sdispls, MPI_OFFSET,
+                                      rmeta, m_rcounts, m_rdispls, MPI_OFFSET,
+                                      comm);
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoallv");
+                if (status == NC_NOERR) status = err;
+                break;
+            }
 
-        MPI_Offset gap = (*segs)[i].off + (*segs)[i].len - (*segs)[j].off;
-        if (gap >= 0) { /* segments i and j overlaps */
-            if ((*segs)[i].buf_addr + (*segs)[i].len ==
-                (*segs)[j].buf_addr + gap) {
-                /* buffers i and j are contiguous, merge j to i */
-                (*segs)[i].len += (*segs)[j].len - gap;
+            /* send data, buffers are described by the derived datatypes */
+            TRACE_COMM(MPI_Alltoallw)(MPI_BOTTOM, d_scounts, d_sdispls,
+                                      d_stypes, rbuf, d_rcounts, d_rdispls,
+                                      d_rtypes, comm);
+            for (i=0; i<nprocs; i++) {
+                if (d_stypes[i] != MPI_BYTE) MPI_Type_free(&d_stypes[i]);
+                d_stypes[i] = MPI_BYTE;
             }
-            else { /* buffers are not contiguous, reduce j's len */
-                (*segs)[i+1].off      = (*segs)[j].off + gap;
-                (*segs)[i+1].len      = (*segs)[j].len - gap;
-                (*segs)[i+1].buf_addr = (*segs)[j].buf_addr + gap;
-                i++;
+            if (mpireturn != MPI_SUCCESS) {
+                err = ncmpii_error_mpi2nc(mpireturn, "MPI_Alltoallw");
+                if (status == NC_NOERR) status = err;
+                break;
+            }
+
+            /* aggregators write the received data to their stripes */
+            if (rpieces > 0) {
+                err = aggr_write(fh, rpieces, rmeta, rbuf, wbuf);
+                if (status == NC_NOERR) status = err;
             }
         }
-        else { /* i and j do not overlap */
-            i++;
-            if (i < j) (*segs)[i] = (*segs)[j];
-        }
+
+        for (i=0; i<nprocs; i++) /* in case of breaking out of the loop */
+            if (d_stypes[i] != MPI_BYTE) MPI_Type_free(&d_stypes[i]);
+        if (meta         != NULL) NCI_Free(meta);
+        if (addrs        != NULL) NCI_Free(addrs);
+        if (blocklengths != NULL) NCI_Free(blocklengths);
+        if (rmeta        != NULL) NCI_Free(rmeta);
+        if (rbuf         != NULL) NCI_Free(rbuf);
+        if (wbuf         != NULL) NCI_Free(wbuf);
+        NCI_Free(d_stypes);
+        NCI_Free(cnt_send);
+        NCI_Free(aggr_ranks);
     }
+    if (segs != NULL) NCI_Free(segs);
+
+    /* update the number of bytes written by this process's requests */
+    if (status == NC_NOERR) ncp->put_size += put_size;
 
-    /* update number of segments, now all off-len pairs are not overlapped */
-    *nsegs = i+1;
+    /* non-lead requests are no longer used */
+    coalesce_lead_reqs(ncp, num_reqs, reqs, NC_REQ_WR);
 
     return status;
 }
 
-/*----< type_create_off_len() >----------------------------------------------*/
+#if MPI_VERSION >= 3
+/*----< node_aggr_init() >---------------------------------------------------*/
+/* Create the communicators used by intra-node aggregation, when it is used
+ * for the first time: node_comm of processes sharing memory on the same
+ * compute node, and leader_comm of the first process of each node, which
+ * opens the file again for the aggregated collective I/O. This subroutine is
+ * collective. If it fails, intra-node aggregation is disabled.
+ */
 static int
-type_create_off_len(MPI_Offset    nsegs,    /* no. off-len pairs */
-                    off_len      *segs,     /* [nsegs] off-en pairs */
-                    MPI_Datatype *filetype,
-                    MPI_Datatype *buf_type)
+node_aggr_init(NC *ncp)
 {
-    int i, j, mpireturn, *blocklengths;
-    MPI_Aint   *displacements;
-    MPI_Offset  next_off, next_len;
+    int node_rank, omode, mpireturn, err=NC_NOERR;
 
-    assert(nsegs > 0);
+    if (ncp->node_comm != MPI_COMM_NULL) return NC_NOERR;
 
-    /* create the file view MPI derived data type by concatenating the sorted
-       offset-length pairs */
+    TRACE_COMM(MPI_Comm_split_type)(ncp->comm, MPI_COMM_TYPE_SHARED, 0,
+                                    MPI_INFO_NULL, &ncp->node_comm);
+    if (mpireturn != MPI_SUCCESS) {
+        ncp->node_comm = MPI_COMM_NULL;
+        ncp->node_aggr = 0;
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Comm_split_type");
+    }
+    MPI_Comm_rank(ncp->node_comm, &node_rank);
 
-    /* For filetype, the segs[].off can be further coalesced. For example,
-     * when writing a consecutive columns of a 2D array, even though the I/O
-     * buffer addresses may not be able to coalesced, the file offsets on
-     * the same row can be coalesced. Thus, first calculate the length of
-     * coalesced off-len pairs (the memory space needed for malloc)
-     */
-    next_off = segs[0].off;
-    next_len = segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (next_off + next_len == segs[i].off) /* j and i are contiguous */
-            next_len += segs[i].len;
-        else {
-            j++;
-            next_off = segs[i].off;
-            next_len = segs[i].len;
+    TRACE_COMM(MPI_Comm_split)(ncp->comm, (node_rank == 0) ? 0 : MPI_UNDEFINED,
+                               0, &ncp->leader_comm);
+    if (mpireturn != MPI_SUCCESS)
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Comm_split");
+    else if (ncp->leader_comm != MPI_COMM_NULL) {
+        /* the file has been created or opened by ncp->comm */
+        omode = ncp->mpiomode & ~(MPI_MODE_CREATE | MPI_MODE_EXCL);
+        TRACE_IO(MPI_File_open)(ncp->leader_comm, ncp->path, omode,
+                                ncp->mpiinfo, &ncp->leader_fh);
+        if (mpireturn != MPI_SUCCESS) {
+            ncp->leader_fh = MPI_FILE_NULL;
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_open");
         }
     }
-    /* j+1 is the coalesced length */
-    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
-    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
 
-    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
-    if (segs[0].len != (int)segs[0].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-    displacements[0] =      segs[0].off;
-    blocklengths[0]  = (int)segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (segs[i].len != (int)segs[i].len) DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-        if (displacements[j] + blocklengths[j] == segs[i].off)
-            /* j and i are contiguous */
-            blocklengths[j] += (int)segs[i].len;
-            /* TODO: take care of 4-byte int overflow problem */
-        else {
-            j++;
-            displacements[j] =      segs[i].off;
-            blocklengths[j]  = (int)segs[i].len;
-        }
+    /* all processes must agree on whether to use intra-node aggregation */
+    TRACE_COMM(MPI_Allreduce)(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN,
+                              ncp->comm);
+    if (mpireturn != MPI_SUCCESS)
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_Allreduce");
+
+    if (err != NC_NOERR) {
+        if (ncp->leader_fh != MPI_FILE_NULL) MPI_File_close(&ncp->leader_fh);
+        if (ncp->leader_comm != MPI_COMM_NULL) MPI_Comm_free(&ncp->leader_comm);
+        MPI_Comm_free(&ncp->node_comm);
+        ncp->node_aggr = 0;
     }
-    /* j+1 is the coalesced length */
+    return err;
+}
 
-#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
-    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
-                                         MPI_BYTE, filetype);
+/*----< node_aggr_put() >----------------------------------------------------*/
+/* Intra-node aggregation of collective nonblocking writes, enabled by hint
+ * nc_node_aggr. Each process packs the file offsets, lengths, and data of its
+ * flattened requests into an MPI shared memory window allocated on the
+ * node's communicator. The node leader reads them from the window directly,
+ * sorts and merges the off-len pairs, and writes the data of the whole node
+ * by a collective write among the node leaders only. Thus, the number of
+ * processes participating MPI-IO's two-phase I/O is reduced to the number of
+ * compute nodes and small noncontiguous pieces of processes on the same node
+ * are coalesced.
+ *
+ * Note all processes must call this subroutine, including those that have
+ * no request.
+ */
+static int
+node_aggr_put(NC      *ncp,
+              int     *num_reqs,  /* IN/OUT: # requests */
+              NC_req **reqs)      /* [*num_reqs] */
+{
+    int i, node_rank, node_nprocs, disp_unit, mpireturn, err, status=NC_NOERR;
+    char *base, *data;
+    MPI_Aint win_size, addr;
+    MPI_Offset j, n, nsegs, nbytes=0, *meta;
+    MPI_Win win;
+    off_len *segs;
+
+    MPI_Comm_rank(ncp->node_comm, &node_rank);
+    MPI_Comm_size(ncp->node_comm, &node_nprocs);
+
+    /* flatten this process's requests, if there is any */
+    err = aggr_flatten(ncp, *num_reqs, *reqs, &nsegs, &segs);
+    if (err != NC_NOERR) {
+        status = err;
+        nsegs  = 0;  /* continue to participate the collective calls */
+    }
+    for (j=0; j<nsegs; j++) nbytes += segs[j].len;
+
+    /* window layout: number of pairs, the off-len pairs, and then data */
+    win_size = (MPI_Aint)(SIZEOF_MPI_OFFSET * (1 + 2 * nsegs) + nbytes);
+    TRACE_COMM(MPI_Win_allocate_shared)(win_size, 1, MPI_INFO_NULL,
+                                        ncp->node_comm, &base, &win);
+    if (mpireturn != MPI_SUCCESS) {
+        if (segs != NULL) NCI_Free(segs);
+        coalesce_lead_reqs(ncp, num_reqs, reqs, NC_REQ_WR);
+        return ncmpii_error_mpi2nc(mpireturn, "MPI_Win_allocate_shared");
+    }
+
+    meta = (MPI_Offset*) base;
+    data = base + SIZEOF_MPI_OFFSET * (1 + 2 * nsegs);
+    meta[0] = nsegs;
+    for (j=0; j<nsegs; j++) {
+        meta[1+2*j] = segs[j].off;
+        meta[2+2*j] = segs[j].len;
+        memcpy(data, (void*)segs[j].buf_addr, (size_t)segs[j].len);
+        data += segs[j].len;
+    }
+    if (segs != NULL) NCI_Free(segs);
+
+    /* make the packed requests visible to the node leader */
+    MPI_Win_fence(0, win);
+
+    if (node_rank == 0) {
+        int buf_len=0;
+        MPI_Offset offset=0, total_bytes=0;
+        MPI_Datatype filetype=MPI_BYTE, buf_type=MPI_BYTE;
+        MPI_Status mpistatus;
+
+        /* collect the off-len pairs of all processes on this node, with
+         * buffer addresses pointing to the data in the window */
+        for (n=0, i=0; i<node_nprocs; i++) {
+            MPI_Win_shared_query(win, i, &win_size, &disp_unit, &base);
+            n += ((MPI_Offset*)base)[0];
+        }
+        segs = NULL;
+        if (n > 0) {
+            segs = (off_len*) NCI_Malloc((size_t)n * sizeof(off_len));
+            if (segs == NULL) {
+                DEBUG_ASSIGN_ERROR(err, NC_ENOMEM)
+                if (status == NC_NOERR) status = err;
+                n = 0;
+            }
+        }
+        for (nsegs=0, i=0; segs != NULL && i<node_nprocs; i++) {
+            MPI_Win_shared_query(win, i, &win_size, &disp_unit, &base);
+            meta = (MPI_Offset*) base;
+            data = base + SIZEOF_MPI_OFFSET * (1 + 2 * meta[0]);
+#ifdef HAVE_MPI_GET_ADDRESS
+            MPI_Get_address(data, &addr);
 #else
-    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
-                                  filetype);
+            MPI_Address(data, &addr);
 #endif
-    if (mpireturn != MPI_SUCCESS) {
-        *filetype = MPI_BYTE;
-        *buf_type = MPI_BYTE;
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
-        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
-    }
-    MPI_Type_commit(filetype);
-    NCI_Free(displacements);
-    NCI_Free(blocklengths);
+            for (j=0; j<meta[0]; j++, nsegs++) {
+                segs[nsegs].off      = meta[1+2*j];
+                segs[nsegs].len      = meta[2+2*j];
+                segs[nsegs].buf_addr = addr;
+                addr        += segs[nsegs].len;
+                total_bytes += segs[nsegs].len;
+            }
+        }
 
-    /* create the I/O buffer derived data type from the I/O buffer's
-       offset-length pairs */
+        if (n > 0) {
+            /* each process's pairs are sorted, merge them */
+            off_len *sorted = sort_off_len(n, segs);
+            if (sorted != NULL)
+                segs = sorted;
+            else /* out of memory, sort in place */
+                qsort(segs, (size_t)n, sizeof(off_len), off_compare);
+            n = merge_off_len(n, segs);
 
-    /* Although it is unlikely buffers can be coalesced, it will not harm to
-       check it out */
-    next_off = segs[0].buf_addr;
-    next_len = segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (next_off + next_len == segs[i].buf_addr)
-            /* j and i are contiguous */
-            next_len += segs[i].len;
-        else {
-            j++;
-            next_off = segs[i].buf_addr;
-            next_len = segs[i].len;
+#ifndef ENABLE_LARGE_REQ
+            if (total_bytes > INT_MAX) {
+                /* ROMIO currently does not support a single request with
+                 * amount > 2 GiB */
+                DEBUG_ASSIGN_ERROR(err, NC_EMAX_REQ)
+            }
+            else
+#endif
+                err = type_create_off_len(n, segs, &filetype, &buf_type);
+            if (err == NC_NOERR) buf_len = 1;
+            else if (status == NC_NOERR) status = err;
+            NCI_Free(segs);
         }
-    }
-    /* j+1 is the coalesced length */
-    blocklengths  = (int*)      NCI_Malloc((size_t)(j+1) * SIZEOF_INT);
-    displacements = (MPI_Aint*) NCI_Malloc((size_t)(j+1) * SIZEOF_MPI_AINT);
 
-    /* coalesce segs[].off and len to dispalcements[] and blocklengths[] */
-    if (segs[0].len != (int)segs[0].len) {
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
-        DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
-    }
-    displacements[0] =      segs[0].buf_addr;
-    blocklengths[0]  = (int)segs[0].len;
-    for (j=0,i=1; i<nsegs; i++) {
-        if (segs[i].len != (int)segs[i].len) {
-            NCI_Free(displacements);
-            DEBUG_RETURN_ERROR(NC_EINTOVERFLOW)
+        /* collective write among node leaders */
+        err = ncmpio_file_set_view(ncp, ncp->leader_fh, &offset, filetype);
+        if (err != NC_NOERR) {
+            buf_len = 0; /* skip this request */
+            if (status == NC_NOERR) status = err;
         }
-        if (displacements[j] + blocklengths[j] == segs[i].buf_addr)
-            /* j and i are contiguous */
-            blocklengths[j] += (int)segs[i].len;
-        else {
-            j++;
-            displacements[j] =      segs[i].buf_addr;
-            blocklengths[j]  = (int)segs[i].len;
+        TRACE_IO(MPI_File_write_at_all)(ncp->leader_fh, offset, MPI_BOTTOM,
+                                        buf_len, buf_type, &mpistatus);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_write_at_all");
+            err = (err == NC_EFILE) ? NC_EWRITE : err;
+            if (status == NC_NOERR) DEBUG_ASSIGN_ERROR(status, err)
         }
+        if (filetype != MPI_BYTE) MPI_Type_free(&filetype);
+        if (buf_type != MPI_BYTE) MPI_Type_free(&buf_type);
     }
-    /* j+1 is the coalesced length */
-#ifdef HAVE_MPI_TYPE_CREATE_HINDEXED
-    mpireturn = MPI_Type_create_hindexed(j+1, blocklengths, displacements,
-                                         MPI_BYTE, buf_type);
-#else
-    mpireturn = MPI_Type_hindexed(j+1, blocklengths, displacements, MPI_BYTE,
-                                  buf_type);
-#endif
+
+    /* all processes on the node report the error of the leader's write */
+    err = status;
+    MPI_Bcast(&err, 1, MPI_INT, 0, ncp->node_comm);
+    if (status == NC_NOERR) status = err;
+
+    MPI_Win_free(&win);
+
+#ifndef DISABLE_FILE_SYNC
+    /* Node leaders wrote through leader_fh. To let all processes read back
+     * the data through the other file handles, as if written by themselves,
+     * follow the MPI-IO sync-barrier-sync rule. */
+    if (ncp->leader_fh != MPI_FILE_NULL) {
+        TRACE_IO(MPI_File_sync)(ncp->leader_fh);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+            if (status == NC_NOERR) status = err;
+        }
+    }
+    TRACE_COMM(MPI_Barrier)(ncp->comm);
+    TRACE_IO(MPI_File_sync)(ncp->collective_fh);
     if (mpireturn != MPI_SUCCESS) {
-        if (*filetype != MPI_BYTE) MPI_Type_free(filetype);
-        *filetype = MPI_BYTE;
-        *buf_type = MPI_BYTE;
-        NCI_Free(displacements);
-        NCI_Free(blocklengths);
-        return ncmpii_error_mpi2nc(mpireturn, "MPI_Type_create_hindexed");
+        err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+        if (status == NC_NOERR) status = err;
     }
-    MPI_Type_commit(buf_type);
-    NCI_Free(displacements);
-    NCI_Free(blocklengths);
+    if (ncp->independent_fh != MPI_FILE_NULL) {
+        TRACE_IO(MPI_File_sync)(ncp->independent_fh);
+        if (mpireturn != MPI_SUCCESS) {
+            err = ncmpii_error_mpi2nc(mpireturn, "MPI_File_sync");
+            if (status == NC_NOERR) status = err;
+        }
+    }
+#endif
 
-    return NC_NOERR;
+    /* update the number of bytes written by this process's requests */
+    if (status == NC_NOERR) ncp->put_size += nbytes;
+
+    /* non-lead requests are no longer used */
+    coalesce_lead_reqs(ncp, num_reqs, reqs, NC_REQ_WR);
+
+    return status;
 }
+#endif
 
 /*----< req_compare() >------------------------------------------------------*/
 /* used to sort the the string file offsets of reqs[] */
@@ -1673,46 +2975,26 @@ req_aggregation(NC      *ncp,
             }
         }
         else { /* this group is interleaved */
-            /* flatten the interleaved requests in this group, so interleaved
-             * requests can be sorted and merged into a monotonically
-             * non-decreasing filetype. For example, multiple nonblocking
-             * requests each accessing a single column of a 2D array, that each
-             * produces a filetype interleaving with others'.
-             *
-             * The pitfall of this flattening is the additional memory
-             * requirement, as it will have to break down each request into a
-             * list of offset-length pairs, and merge all lists into a sorted
-             * list based on their offsets into an increasing order.
+            /* break down the interleaved requests in this group, so they can
+             * be sorted and merged into a monotonically non-decreasing
+             * filetype. For example, multiple nonblocking requests each
+             * accessing a single column of a 2D array, that each produces a
+             * filetype interleaving with others'.
              *
-             * Be warned! The additional memory requirement for this merging can
-             * be more than the I/O data itself. For example, each nonblocking
-             * request access a single column of a 2D array of 4-byte integer
-             * type. Each off-len pair represents only a 4-byte integer, but the
-             * off-len pair itself takes 24 bytes. Additional memory is also
-             * required for MPI arguments of displacements and blocklengths.
+             * Each request is broken down into strided runs, one for each
+             * row of a subarray, rather than into offset-length pairs, one
+             * for each contiguous segment. Runs are only expanded into
+             * offset-length pairs when they overlap in an irregular way, as
+             * the additional memory for the pairs can be more than the I/O
+             * data itself. For example, when each request accesses a single
+             * column of a 2D array of 4-byte integer type, each off-len pair
+             * represents only a 4-byte integer, but the pair itself takes 24
+             * bytes. Such runs are described by vector datatypes instead.
              */
-            MPI_Offset  nsegs=0;   /* number of merged offset-length pairs */
-            off_len    *segs=NULL; /* array of the offset-length pairs */
-            void       *merged_buf;
-
-            /* merge all requests into sorted offset-length pairs */
-            err = merge_requests(ncp, g_num_reqs, g_reqs, &merged_buf, &nsegs,
-                                 &segs);
-            if (status == NC_NOERR) status = err;
-            if (err != NC_NOERR) { /* skip this group */
-                ftypes[i] = btypes[i] = MPI_BYTE;
-                b_blocklengths[i] = 0;
-                f_blocklengths[i] = 0;
-                if (segs != NULL) NCI_Free(segs);
-                continue;
-            }
-            assert(nsegs > 0);
-
-            /* sges[] will be used to construct fileview and buffer type */
-            err = type_create_off_len(nsegs, segs, &ftypes[i], &btypes[i]);
+            err = merge_requests(ncp, g_num_reqs, g_reqs, &ftypes[i],
+                                 &btypes[i]);
             /* preserve the previous error if there is any */
             if (status == NC_NOERR) status = err;
-            NCI_Free(segs);
             if (err != NC_NOERR) { /* skip this group */
                 ftypes[i] = btypes[i] = MPI_BYTE;
                 b_blocklengths[i] = 0;
@@ -1792,21 +3074,7 @@ req_aggregation(NC      *ncp,
     }
 
     /* non-lead requests are no longer used */
-    int maxLead = (rw_flag == NC_REQ_RD) ? ncp->numLeadGetReqs : ncp->numLeadPutReqs;
-    int j = 0;
-    for (i=0; i<*num_reqs; i++) {
-        if (fIsSet((*reqs)[i].flag, NC_REQ_LEAD)) {
-            /* lead request allocated start array for all sub-requests */
-            NCI_Free((*reqs)[i].start);
-            if (j < i) (*reqs)[j] = (*reqs)[i]; /* coalesce lead requests */
-            j++;
-            if (j == maxLead) break;
-        }
-    }
-    if (j < *num_reqs) {
-        *num_reqs = j;  /* number of lead requests */
-        *reqs = (NC_req*) NCI_Realloc(*reqs, j * sizeof(NC_req));
-    }
+    coalesce_lead_reqs(ncp, num_reqs, reqs, rw_flag);
 
 #if MPI_VERSION >= 3
     /* MPI_Type_size_x is introduced in MPI 3.0 */
@@ -2010,9 +3278,35 @@ wait_getput(NC          *ncp,
         }
     }
 
-    if (i < *num_reqs) /* a non-increasing order is found */
-        /* sort reqs[] based on reqs[].offset_start */
-        qsort(*reqs, (size_t)*num_reqs, sizeof(NC_req), req_compare);
+    if (i < *num_reqs) { /* a non-increasing order is found */
+        /* sort reqs[] based on reqs[].offset_start, by sorting the pairs of
+         * offset_start and index and then permuting reqs[]
+         */
+        off_len *keys, *sorted=NULL;
+        NC_req *tmp_reqs;
+
+        keys = (off_len*) NCI_Malloc((size_t)*num_reqs * sizeof(off_len));
+        tmp_reqs = (NC_req*) NCI_Malloc((size_t)*num_reqs * sizeof(NC_req));
+        if (keys != NULL && tmp_reqs != NULL) {
+            for (i=0; i<*num_reqs; i++) {
+                keys[i].off      = (*reqs)[i].offset_start;
+                keys[i].len      = i;
+                keys[i].buf_addr = 0;
+            }
+            sorted = sort_off_len(*num_reqs, keys);
+        }
+        if (sorted != NULL) {
+            for (i=0; i<*num_reqs; i++)
+                tmp_reqs[i] = (*reqs)[sorted[i].len];
+            memcpy(*reqs, tmp_reqs, (size_t)*num_reqs * sizeof(NC_req));
+            keys = sorted;
+        }
+        else /* out of memory, sort in place */
+            qsort(*reqs, (size_t)*num_reqs, sizeof(NC_req), req_compare);
+
+        if (tmp_reqs != NULL) NCI_Free(tmp_reqs);
+        if (keys     != NULL) NCI_Free(keys);
+    }
 
     /* check for any interleaved requests */
     for (i=1; i<*num_reqs; i++) {
@@ -2023,8 +3317,20 @@ wait_getput(NC          *ncp,
     }
 
     /* aggregate requests and carry out the I/O */
-    err = req_aggregation(ncp, num_reqs, reqs, rw_flag, coll_indep,
-                          access_interleaved);
+#if MPI_VERSION >= 3
+    if (ncp->node_aggr && rw_flag == NC_REQ_WR && coll_indep == NC_REQ_COLL &&
+        node_aggr_init(ncp) == NC_NOERR)
+        /* aggregate writes at one process per compute node */
+        err = node_aggr_put(ncp, num_reqs, reqs);
+    else
+#endif
+    if (ncp->num_aggrs > 0 && rw_flag == NC_REQ_WR &&
+        coll_indep == NC_REQ_COLL)
+        /* use PnetCDF's own two-phase I/O, instead of MPI-IO's */
+        err = aggr_put(ncp, num_reqs, reqs);
+    else
+        err = req_aggregation(ncp, num_reqs, reqs, rw_flag, coll_indep,
+                              access_interleaved);
     if (status == NC_NOERR) status = err;
 
     /* Update the number of records if new records have been created.
@@ -2255,21 +3561,7 @@ mgetput(NC      *ncp,
     /* if (buf_type == MPI_BYTE) then the whole buf is contiguous */
 
     /* non-lead requests are no longer used */
-    int maxLead = (rw_flag == NC_REQ_RD) ? ncp->numLeadGetReqs : ncp->numLeadPutReqs;
-    j = 0;
-    for (i=0; i<*num_reqs; i++) {
-        if (fIsSet((*reqs)[i].flag, NC_REQ_LEAD)) {
-            /* lead request allocated start array for all sub-requests */
-            NCI_Free((*reqs)[i].start);
-            if (j < i) (*reqs)[j] = (*reqs)[i]; /* coalesce lead requests */
-            j++;
-            if (j == maxLead) break;
-        }
-    }
-    if (j < *num_reqs) {
-        *num_reqs = j;  /* number of lead requests */
-        *reqs = (NC_req*) NCI_Realloc(*reqs, j * sizeof(NC_req));
-    }
+    coalesce_lead_reqs(ncp, num_reqs, reqs, rw_flag);
 
 #if MPI_VERSION >= 3
     /* MPI_Type_size_x is introduced in MPI 3.0 */
@@ -21,6 +21,7 @@
 #define NC_REQ_BLK     0x00000080  /* blocking get/put API */
 #define NC_REQ_NBI     0x00000100  /* nonblocking iget/iput API */
 #define NC_REQ_NBB     0x00000200  /* nonblocking bput API */
+#define NC_REQ_NODE    0x00000400  /* aggregate collective writes at node leaders */
 
 #define NC_MODE_RDONLY 0x00001000  /* file is opned in read-only mode */
 #define NC_MODE_DEF    0x00002000  /* in define mode */
@@ -50,6 +51,7 @@ struct PNC_driver {
     int (*close)(void*);
     int (*enddef)(void*);
     int (*_enddef)(void*,MPI_Offset,MPI_Offset,MPI_Offset,MPI_Offset);
+    int (*enddef_from)(void*,void*);
     int (*redef)(void*);
     int (*sync)(void*);
     int (*abort)(void*);
@@ -75,9 +77,11 @@ struct PNC_driver {
     int (*del_att)(void*,int,const char*);
     int (*get_att)(void*,int,const char*,void*,MPI_Datatype);
     int (*put_att)(void*,int,const char*,nc_type,MPI_Offset,const void*,MPI_Datatype);
+    int (*put_atts)(void*,int,int,char* const*,const nc_type*,const MPI_Offset*,void* const*);
 
     /* APIs read/write variables */
     int (*def_var)(void*,const char*,nc_type,int,const int*,int*);
+    int (*def_vars)(void*,int,char* const*,const nc_type*,const int*,int* const*,int*);
     int (*def_var_fill)(void*,int,int,const void*);
     int (*fill_var_rec)(void*,int,MPI_Offset);
     int (*inq_var)(void*,int,char*,nc_type*,int*,int*,int*,MPI_Offset*,int*,void*);
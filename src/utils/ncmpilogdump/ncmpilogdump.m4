@@ -31,25 +31,62 @@ define(`PRINTTYPE',dnl
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <../../drivers/ncdwio/ncdwio_driver.h>
 #include <pnetcdf.h>
 
+/* Replay the logs of a netCDF file left in a log directory by a run that did
+ * not close the file, the logs are recovered by all processes in parallel
+ * when the file is opened for write with DataWarp driver enabled
+ */
+static int recover(int argc, char *argv[]) {
+    int err, ncid, rank;
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_dirname", argv[3]);
+    MPI_Info_set(info, "nc_dw_recover", "enable");
+
+    err = ncmpi_open(MPI_COMM_WORLD, argv[2], NC_WRITE, info, &ncid);
+    if (err == NC_NOERR) {
+        err = ncmpi_close(ncid);
+    }
+    MPI_Info_free(&info);
+
+    if (err != NC_NOERR && rank == 0) {
+        printf("Error: %s\n", ncmpi_strerror(err));
+    }
+
+    MPI_Finalize();
+
+    return err != NC_NOERR;
+}
+
 int main(int argc, char *argv[]) {
     int i, j, k, fd, ret, err = NC_NOERR;
     size_t offset;
     FILE *fmeta=NULL, *fdata=NULL;
     struct stat metastat;
     struct stat datastat;
-    MPI_Offset *start, *count, *stride;
+    MPI_Offset r, nranges, *start, *count, *stride;
     char *tail;
     char *Data=NULL, *Meta=NULL;
     NC_dw_metadataheader *Header;
     NC_dw_metadataentry *E;
 
+    if (argc == 4 && strcmp(argv[1], "-r") == 0){
+        return recover(argc, argv);
+    }
+
     if (argc < 2){
         printf("Usage: ./ncmpilogdump <metadata log> [<data log>]\n");
+        printf("       mpiexec -n <np> ./ncmpilogdump -r <netCDF file> <log directory>\n");
         return 0;
     }
 
@@ -141,9 +178,9 @@ int main(int argc, char *argv[]) {
 
         /* Original function call */
         printf("ncmpi_put_var");
-        /* put_vara or put_vars */
+        /* put_vara, put_vars, or put_varn */
         switch (E->api_kind){
-foreach(`apikind', (`var1, var, vara, vars'), `PRINTAPIKIND(apikind, upcase(apikind))')dnl
+foreach(`apikind', (`var1, var, vara, vars, varn'), `PRINTAPIKIND(apikind, upcase(apikind))')dnl
             default:
                 err = NC_EBADLOG;
                 goto fn_exit;
@@ -155,24 +192,40 @@ foreach(`vartype', (`text, uchar, schar, short, ushort, int, uint, float, double
                 err = NC_EBADLOG;
                 goto fn_exit;
         }
-        /* Start */
-        printf("(ncid, %d, [ ", E->varid);
-        for(i = 0; i < E->ndims; i++){
-            printf("%lld", start[i]);
-            if (i < (E->ndims - 1)){
-                printf(", ");
-            }
+        printf("(ncid, %d, ", E->varid);
+        /* A varn entry has the number of subarrays followed by start and
+         * count of each subarray
+         */
+        nranges = 1;
+        if (E->api_kind == NC_LOG_API_KIND_VARN){
+            nranges = *((MPI_Offset*)tail);
+            start = (MPI_Offset*)tail + 1;
+            printf("%lld, ", nranges);
         }
-        /* Count */
-        printf(" ], [ ");
-        for(i = 0; i < E->ndims; i++){
-            printf("%lld", count[i]);
-            if (i < (E->ndims - 1)){
-                printf(", ");
+        for (r = 0; r < nranges; r++){
+            if (E->api_kind == NC_LOG_API_KIND_VARN){
+                count = start + E->ndims;
             }
+            /* Start */
+            printf("[ ");
+            for(i = 0; i < E->ndims; i++){
+                printf("%lld", start[i]);
+                if (i < (E->ndims - 1)){
+                    printf(", ");
+                }
+            }
+            /* Count */
+            printf(" ], [ ");
+            for(i = 0; i < E->ndims; i++){
+                printf("%lld", count[i]);
+                if (i < (E->ndims - 1)){
+                    printf(", ");
+                }
+            }
+            printf(" ], ");
+            start += 2 * E->ndims;
         }
         /* Stride */
-        printf(" ], ");
         if (E->api_kind == NC_LOG_API_KIND_VARS){
             printf(" [ ");
             for(i = 0; i < E->ndims; i++){
@@ -184,12 +237,18 @@ foreach(`vartype', (`text, uchar, schar, short, ushort, int, uint, float, double
             printf(" ], ");
         }
         printf("%08llx);\n", E->data_off);
+        /* Compressed data */
+        if (E->codec != NC_LOG_CODEC_NONE){
+            printf("Compressed by %s: %lld bytes to %lld bytes\n",
+                   (E->codec == NC_LOG_CODEC_SHUFFLE_LZ) ? "shuffle_lz" : "lz",
+                   E->data_len, E->zdata_len);
+        }
 
-        /* Corresponding content in data log */
+        /* Corresponding content in data log, as stored */
         if (Data != NULL){
-            for (i = 0; i < E->data_len; i+= 16) {
+            for (i = 0; i < E->zdata_len; i+= 16) {
                 printf("%08llx: ", E->data_off + i);
-                for(k = 0; k < 16 && (i + k) < E->data_len; k++){
+                for(k = 0; k < 16 && (i + k) < E->zdata_len; k++){
                     printf("%02x", (int)(Data[E->data_off + i + k]));
                     if(k & 1){
                         putchar(' ');
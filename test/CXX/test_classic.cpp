@@ -48,6 +48,16 @@ int main( int argc, char *argv[] )
 	 dimArray[1]=dim1;
 	 NcmpiVar varA1_3  = ncFile.addVar("varA1_3", ncmpiInt, dimArray);
 
+	 // add two more variables in one call
+	 vector<string> names(2);
+	 vector<NcmpiType> types;
+	 vector< vector<NcmpiDim> > dims(2);
+	 names[0]="scalar_var"; types.push_back(ncmpiDouble);
+	 names[1]="varA3";      types.push_back(ncmpiFloat); dims[1].push_back(dim3);
+	 vector<NcmpiVar> vars = ncFile.addVars(names, types, dims);
+	 if (vars.size() != 2 || vars[1].getName() != "varA3")
+	    throw NcmpiException( "addVars failed", __FILE__, __LINE__);
+
 	 // ncFile.enddef(); is no need in C++ program
 
          // and inserting some data that needs leaving the define mode
@@ -60,7 +70,7 @@ int main( int argc, char *argv[] )
       {
 	 NcmpiFile ncFile(MPI_COMM_WORLD, filename, NcmpiFile::read);
 
-	 if (ncFile.getVarCount() != 2)
+	 if (ncFile.getVarCount() != 4)
 	    throw NcmpiException( "Holy Mother of Pearl!", __FILE__, __LINE__);
       }
 
@@ -69,6 +79,19 @@ int main( int argc, char *argv[] )
         NcmpiFile ncFile(MPI_COMM_WORLD, filename, NcmpiFile::write);
         if (verbose) cout << "testing the switch to DEFINE mode..." << endl;
         ncFile.putAtt(string("name"),string("value"));
+
+        // add two more attributes in one call
+        int ival = 1;
+        double dval = 2.0;
+        vector<string> names(2);
+        vector<NcmpiType> types;
+        vector<MPI_Offset> lens(2, 1);
+        vector<const void*> values(2);
+        names[0]="int_att";    types.push_back(ncmpiInt);    values[0]=&ival;
+        names[1]="double_att"; types.push_back(ncmpiDouble); values[1]=&dval;
+        ncFile.putAtts(names, types, lens, values);
+        if (ncFile.getAttCount() != 3)
+           throw NcmpiException( "putAtts failed", __FILE__, __LINE__);
       }
 
       if (verbose) cout << "    -----------   passed\n";
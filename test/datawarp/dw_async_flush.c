@@ -0,0 +1,142 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests replaying the log of DataWarp driver in the background,
+ * enabled by hint nc_dw_async_flush. Each collective wait starts replaying
+ * the log while the program keeps writing. Every record is written twice,
+ * the second write is posted after the wait that drains the first one, so it
+ * must not be overwritten by the replay. Reads of data in the log and of
+ * data being replayed are checked in between. If MPI does not support
+ * MPI_THREAD_MULTIPLE, the log is flushed synchronously and the results
+ * must be the same.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 16
+#define NREC 4
+
+int main(int argc, char *argv[]) {
+    int i, r, err, nerrs = 0, rank, np, ncid, varid, dimid[2], req[2];
+    int provided, flag, buf[2][NX], rbuf[NX], *abuf;
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[2], count[2];
+    MPI_Info info;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for background log replay", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_async_flush", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_async_flush", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, "enable")) {
+        printf("Error at line %d in %s: hint nc_dw_async_flush expect enable but got %s\n",
+               __LINE__, __FILE__, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "T", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX * np, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    start[1] = rank * NX;
+    count[0] = 1; count[1] = NX;
+    for (r=0; r<NREC; r++) {
+        /* first write of record r, drained by the wait */
+        for (i=0; i<NX; i++) buf[0][i] = -(r * 1000 + rank * 100 + i);
+        start[0] = r;
+        err = ncmpi_iput_vara_int(ncid, varid, start, count, buf[0], &req[0]); CHECK_ERR
+        err = ncmpi_wait_all(ncid, 1, req, NULL); CHECK_ERR
+
+        /* second write of record r, posted while the first is replayed */
+        for (i=0; i<NX; i++) buf[1][i] = r * 1000 + rank * 100 + i;
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf[1]); CHECK_ERR
+
+        /* read it back, served from the log */
+        err = ncmpi_get_vara_int_all(ncid, varid, start, count, rbuf); CHECK_ERR
+        for (i=0; i<NX; i++) {
+            if (rbuf[i] != buf[1][i]) {
+                printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                       __LINE__, __FILE__, r, rank * NX + i, buf[1][i], rbuf[i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    /* an empty collective wait drains the remaining log */
+    err = ncmpi_wait_all(ncid, 0, NULL, NULL); CHECK_ERR
+
+    /* read everything, including data written by other processes */
+    abuf = (int*) malloc(NREC * NX * np * sizeof(int));
+    err = ncmpi_get_var_int_all(ncid, varid, abuf); CHECK_ERR
+    for (i=0; i<NREC*NX*np; i++) {
+        int x = i % (NX * np);
+        int expect = (i / (NX * np)) * 1000 + (x / NX) * 100 + x % NX;
+        if (abuf[i] != expect) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i / (NX * np), x, expect, abuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(abuf);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
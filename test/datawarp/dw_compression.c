@@ -0,0 +1,242 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests compressing the data log of DataWarp driver, enabled by
+ * hint nc_dw_compression. For each codec, every process writes smooth
+ * doubles, integers with long runs, random bytes that do not compress and
+ * puts too small to be compressed. The data is read back from the log, after
+ * a nonblocking put and a flush by ncmpi_sync, and from the file.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 100000
+
+/* fill the row of a process, pass makes the data of every pass different */
+static void
+fill_row(int rank, int pass, double *dbuf, int *ibuf, signed char *bbuf)
+{
+    int i;
+    unsigned int seed = (unsigned int)(rank * 7919 + pass * 104729 + 1);
+
+    for (i=0; i<NX; i++) {
+        dbuf[i] = pass + rank * 1000.0 + i * 0.001;
+        ibuf[i] = pass * 100 + rank * 10 + i / 1000;
+        seed = seed * 1103515245U + 12345U;
+        bbuf[i] = (signed char)(seed >> 16);
+    }
+}
+
+static int
+check_row(int ncid, int *varid, int rank, int pass, double *dbuf,
+          int *ibuf, signed char *bbuf)
+{
+    int i, err, nerrs = 0;
+    double *dget;
+    int *iget;
+    signed char *bget;
+    MPI_Offset start[2], count[2];
+
+    dget = (double*) malloc(NX * sizeof(double));
+    iget = (int*) malloc(NX * sizeof(int));
+    bget = (signed char*) malloc(NX);
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_get_vara_double_all(ncid, varid[0], start, count, dget); CHECK_ERR
+    err = ncmpi_get_vara_int_all(ncid, varid[1], start, count, iget); CHECK_ERR
+    err = ncmpi_get_vara_schar_all(ncid, varid[2], start, count, bget); CHECK_ERR
+
+    for (i=0; i<NX; i++) {
+        if (dget[i] != dbuf[i]) {
+            printf("Error at line %d in %s: pass %d D[%d][%d] expect %f but got %f\n",
+                   __LINE__, __FILE__, pass, rank, i, dbuf[i], dget[i]);
+            nerrs++;
+            break;
+        }
+    }
+    for (i=0; i<NX; i++) {
+        if (iget[i] != ibuf[i]) {
+            printf("Error at line %d in %s: pass %d I[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, pass, rank, i, ibuf[i], iget[i]);
+            nerrs++;
+            break;
+        }
+    }
+    if (memcmp(bget, bbuf, NX)) {
+        printf("Error at line %d in %s: pass %d B[%d] mismatch\n",
+               __LINE__, __FILE__, pass, rank);
+        nerrs++;
+    }
+
+    free(dget);
+    free(iget);
+    free(bget);
+
+    return nerrs;
+}
+
+static int
+test_codec(const char *filename, const char *codec, int rank, int np)
+{
+    int i, err, nerrs = 0, ncid, varid[4], dimid[2], flag, req, st;
+    int small[4], sget[4];
+    char hint[MPI_MAX_INFO_VAL];
+    double *dbuf;
+    int *ibuf;
+    signed char *bbuf;
+    MPI_Offset start[2], count[2];
+    MPI_Info info;
+
+    dbuf = (double*) malloc(NX * sizeof(double));
+    ibuf = (int*) malloc(NX * sizeof(int));
+    bbuf = (signed char*) malloc(NX);
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_compression", (char*)codec);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_compression", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, codec)) {
+        printf("Error at line %d in %s: hint nc_dw_compression expect %s but got %s\n",
+               __LINE__, __FILE__, codec, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "D", NC_DOUBLE, 2, dimid, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "I", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "B", NC_BYTE, 2, dimid, &varid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "S", NC_INT, 2, dimid, &varid[3]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+
+    /* pass 0: blocking puts, read back from the log */
+    fill_row(rank, 0, dbuf, ibuf, bbuf);
+    err = ncmpi_put_vara_double_all(ncid, varid[0], start, count, dbuf); CHECK_ERR
+    err = ncmpi_put_vara_int_all(ncid, varid[1], start, count, ibuf); CHECK_ERR
+    err = ncmpi_put_vara_schar_all(ncid, varid[2], start, count, bbuf); CHECK_ERR
+
+    /* puts below the size worth compressing */
+    for (i=0; i<4; i++) small[i] = rank * 4 + i;
+    count[1] = 4;
+    err = ncmpi_put_vara_int_all(ncid, varid[3], start, count, small); CHECK_ERR
+    err = ncmpi_get_vara_int_all(ncid, varid[3], start, count, sget); CHECK_ERR
+    for (i=0; i<4; i++) {
+        if (sget[i] != small[i]) {
+            printf("Error at line %d in %s: S[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, small[i], sget[i]);
+            nerrs++;
+            break;
+        }
+    }
+    count[1] = NX;
+
+    nerrs += check_row(ncid, varid, rank, 0, dbuf, ibuf, bbuf);
+
+    /* pass 1: nonblocking puts, read back after the log is flushed */
+    fill_row(rank, 1, dbuf, ibuf, bbuf);
+    err = ncmpi_iput_vara_double(ncid, varid[0], start, count, dbuf, &req); CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, &req, &st); CHECK_ERR
+    err = st; CHECK_ERR
+    err = ncmpi_put_vara_int_all(ncid, varid[1], start, count, ibuf); CHECK_ERR
+    err = ncmpi_put_vara_schar_all(ncid, varid[2], start, count, bbuf); CHECK_ERR
+    err = ncmpi_sync(ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid, rank, 1, dbuf, ibuf, bbuf);
+
+    /* pass 2: left in the log until close */
+    fill_row(rank, 2, dbuf, ibuf, bbuf);
+    err = ncmpi_put_vara_double_all(ncid, varid[0], start, count, dbuf); CHECK_ERR
+    err = ncmpi_put_vara_int_all(ncid, varid[1], start, count, ibuf); CHECK_ERR
+    err = ncmpi_put_vara_schar_all(ncid, varid[2], start, count, bbuf); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid, rank, 2, dbuf, ibuf, bbuf);
+    count[1] = 4;
+    err = ncmpi_get_vara_int_all(ncid, varid[3], start, count, sget); CHECK_ERR
+    for (i=0; i<4; i++) {
+        if (sget[i] != small[i]) {
+            printf("Error at line %d in %s: S[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, small[i], sget[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(dbuf);
+    free(ibuf);
+    free(bbuf);
+
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int err, nerrs = 0, rank, np;
+    char filename[PATH_MAX];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for compressed data log", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    nerrs += test_codec(filename, "lz", rank, np);
+    nerrs += test_codec(filename, "shuffle_lz", rank, np);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
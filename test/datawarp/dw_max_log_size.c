@@ -0,0 +1,267 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests the size limit of the data log of DataWarp driver set
+ * by hint nc_dw_max_log_size. The limit holds two chunks, once it is full
+ * each put flushes only the oldest chunk and reuses its space. Data flushed
+ * early is checked in the file while it is still open, as well as the data
+ * that must still be in the log. Puts are made by collective calls, by
+ * collective calls where only one process writes, in independent mode, by
+ * nonblocking calls, which can not flush the log in collective data mode,
+ * and by a put larger than the limit.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+/* chunk of 4000 bytes, the data log of 10000 bytes holds two chunks */
+#define CH 1000
+#define NCHUNK 12
+#define MAX_LOG_SIZE "10000"
+
+#define VALUE(v, r, i) ((v) * 10000000 + (r) * 100000 + (i))
+
+/* number of chunks flushed from the log after n puts of a chunk, the oldest
+ * chunk is flushed by each put after the second */
+#define NFLUSHED(n) (((n) > 2) ? (n) - 2 : 0)
+
+/* put chunk k of the row of a process */
+static int
+put_chunk(int ncid, int varid, int v, int rank, int k, int coll, int *buf)
+{
+    int i, err, nerrs = 0;
+    MPI_Offset start[2], count[2];
+
+    for (i=0; i<CH; i++) buf[i] = VALUE(v, rank, k * CH + i);
+    start[0] = rank; start[1] = k * CH;
+    count[0] = 1;    count[1] = CH;
+    if (coll)
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf);
+    else
+        err = ncmpi_put_vara_int(ncid, varid, start, count, buf);
+    CHECK_ERR
+
+    return nerrs;
+}
+
+/* check the first nchunk chunks of the row of a process */
+static int
+check_row(int ncid, int varid, int v, int rank, int nchunk, int coll, int *buf)
+{
+    int i, err, nerrs = 0;
+    MPI_Offset start[2], count[2];
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = nchunk * CH;
+    if (coll)
+        err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf);
+    else
+        err = ncmpi_get_vara_int(ncid, varid, start, count, buf);
+    CHECK_ERR
+    for (i=0; i<nchunk*CH; i++) {
+        if (buf[i] != VALUE(v, rank, i)) {
+            printf("Error at line %d in %s: var %d [%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, v, rank, i, VALUE(v, rank, i), buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    return nerrs;
+}
+
+/* check the data already flushed to the file, while it is still open */
+static int
+check_flushed(const char *filename, int varid, int v, int rank, int nchunk,
+              int *buf)
+{
+    int err, nerrs = 0, ncid;
+
+    err = ncmpi_open(MPI_COMM_SELF, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid, v, rank, nchunk, 1, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    return nerrs;
+}
+
+/* check chunk k of the row of a process is still in the log only */
+static int
+check_not_flushed(const char *filename, int varid, int v, int rank, int k,
+                  int *buf)
+{
+    int i, err, nerrs = 0, ncid;
+    MPI_Offset start[2], count[2];
+
+    err = ncmpi_open(MPI_COMM_SELF, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    start[0] = rank; start[1] = k * CH;
+    count[0] = 1;    count[1] = CH;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (i=0; i<CH; i++)
+        if (buf[i] != VALUE(v, rank, k * CH + i)) break;
+    if (i == CH) {
+        printf("Error at line %d in %s: var %d [%d] chunk %d expect not flushed yet\n",
+               __LINE__, __FILE__, v, rank, k);
+        nerrs++;
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int i, k, n, err, nerrs = 0, rank, np, ncid, varid[4], dimid[2], flag;
+    int *buf, req[5], st[5];
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[2], count[2];
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for size limit of data log", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_max_log_size", MAX_LOG_SIZE);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_max_log_size", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, MAX_LOG_SIZE)) {
+        printf("Error at line %d in %s: hint nc_dw_max_log_size expect %s but got %s\n",
+               __LINE__, __FILE__, MAX_LOG_SIZE, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NCHUNK * CH, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "COLL", NC_INT, 2, dimid, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "ONE", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "INDEP", NC_INT, 2, dimid, &varid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "NB", NC_INT, 2, dimid, &varid[3]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    buf = (int*) malloc(NCHUNK * CH * sizeof(int));
+
+    /* collective puts */
+    for (k=0; k<5; k++)
+        nerrs += put_chunk(ncid, varid[0], 0, rank, k, 1, buf);
+    nerrs += check_flushed(filename, varid[0], 0, rank, NFLUSHED(5), buf);
+    nerrs += check_not_flushed(filename, varid[0], 0, rank, NFLUSHED(5), buf);
+    err = ncmpi_sync(ncid); CHECK_ERR
+
+    /* collective puts where only rank 0 writes, others join the flush */
+    for (k=0; k<3; k++) {
+        if (rank == 0) {
+            nerrs += put_chunk(ncid, varid[1], 1, rank, k, 1, buf);
+        }
+        else {
+            start[0] = rank; start[1] = 0;
+            count[0] = 0;    count[1] = 0;
+            err = ncmpi_put_vara_int_all(ncid, varid[1], start, count, buf); CHECK_ERR
+        }
+    }
+    if (rank == 0)
+        nerrs += check_flushed(filename, varid[1], 1, rank, NFLUSHED(3), buf);
+    err = ncmpi_sync(ncid); CHECK_ERR
+
+    /* independent puts, processes flush different number of times */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    n = 3 + rank % 4;
+    for (k=0; k<n; k++)
+        nerrs += put_chunk(ncid, varid[2], 2, rank, k, 0, buf);
+    nerrs += check_flushed(filename, varid[2], 2, rank, NFLUSHED(n), buf);
+    nerrs += check_row(ncid, varid[2], 2, rank, n, 0, buf);
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    /* nonblocking puts in collective data mode can not flush the log, it
+     * grows beyond the limit until the next collective call. The collective
+     * puts before them make the data log wrap around */
+    for (k=0; k<3; k++)
+        nerrs += put_chunk(ncid, varid[3], 3, rank, k, 1, buf);
+    for (k=3; k<5; k++) {
+        for (i=0; i<CH; i++) buf[k * CH + i] = VALUE(3, rank, k * CH + i);
+        start[0] = rank; start[1] = k * CH;
+        count[0] = 1;    count[1] = CH;
+        err = ncmpi_iput_vara_int(ncid, varid[3], start, count, buf + k * CH, &req[k]); CHECK_ERR
+    }
+    nerrs += check_flushed(filename, varid[3], 3, rank, NFLUSHED(3), buf);
+    for (k=NFLUSHED(3); k<5; k++)
+        nerrs += check_not_flushed(filename, varid[3], 3, rank, k, buf + 5 * CH);
+    err = ncmpi_wait_all(ncid, 2, req + 3, st); CHECK_ERR
+    for (k=0; k<2; k++) {
+        err = st[k]; CHECK_ERR
+    }
+    nerrs += check_flushed(filename, varid[3], 3, rank, 5, buf);
+
+    /* a put larger than the limit */
+    for (i=0; i<3*CH; i++) buf[i] = VALUE(3, rank, 5 * CH + i);
+    start[0] = rank; start[1] = 5 * CH;
+    count[0] = 1;    count[1] = 3 * CH;
+    err = ncmpi_put_vara_int_all(ncid, varid[3], start, count, buf); CHECK_ERR
+    nerrs += put_chunk(ncid, varid[3], 3, rank, 8, 1, buf);
+    nerrs += check_flushed(filename, varid[3], 3, rank, 8, buf);
+
+    nerrs += check_row(ncid, varid[0], 0, rank, 5, 1, buf);
+    nerrs += check_row(ncid, varid[3], 3, rank, 9, 1, buf);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid[0], 0, rank, 5, 1, buf);
+    nerrs += check_row(ncid, varid[1], 1, rank, (rank == 0) ? 3 : 0, 1, buf);
+    nerrs += check_row(ncid, varid[2], 2, rank, n, 1, buf);
+    nerrs += check_row(ncid, varid[3], 3, rank, 9, 1, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(buf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
@@ -0,0 +1,232 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests replaying the logs of the processes on a node by the
+ * node leader, enabled by hint nc_dw_node_replay, with and without shared
+ * log files. The collective writes of the replay use the intra-node
+ * aggregation of the ncmpio driver, so only the node leaders write the file,
+ * while hint nc_node_aggr stays disabled for other writes.
+ * Every process writes its own row by several collective puts and
+ * its element of a record variable by nonblocking puts, a canceled request
+ * must not be written. The data is read back from the log, after a flush by
+ * ncmpi_sync, and from the file after the log is replayed again on close.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 1000
+#define NCHUNK 4
+#define NREC 3
+
+#define VALUE(p, r, i) ((p) * 10000000 + (r) * 10000 + (i))
+
+/* check rows [0, nrows) of A of pass p, and the elements of R of the rows */
+static int
+check_rows(int ncid, int *varid, int p, int row, int nrows, int coll,
+           int *buf)
+{
+    int i, j, err, nerrs = 0;
+    MPI_Offset start[2], count[2];
+
+    start[0] = row;   start[1] = 0;
+    count[0] = nrows; count[1] = NX;
+    if (coll)
+        err = ncmpi_get_vara_int_all(ncid, varid[0], start, count, buf);
+    else
+        err = ncmpi_get_vara_int(ncid, varid[0], start, count, buf);
+    CHECK_ERR
+    for (j=0; j<nrows; j++) {
+        for (i=0; i<NX; i++) {
+            if (buf[j * NX + i] != VALUE(p, row + j, i)) {
+                printf("Error at line %d in %s: pass %d A[%d][%d] expect %d but got %d\n",
+                       __LINE__, __FILE__, p, row + j, i, VALUE(p, row + j, i),
+                       buf[j * NX + i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    start[0] = 0; start[1] = row;
+    count[0] = NREC; count[1] = nrows;
+    if (coll)
+        err = ncmpi_get_vara_int_all(ncid, varid[1], start, count, buf);
+    else
+        err = ncmpi_get_vara_int(ncid, varid[1], start, count, buf);
+    CHECK_ERR
+    for (i=0; i<NREC; i++) {
+        for (j=0; j<nrows; j++) {
+            if (buf[i * nrows + j] != VALUE(p, row + j, i)) {
+                printf("Error at line %d in %s: pass %d R[%d][%d] expect %d but got %d\n",
+                       __LINE__, __FILE__, p, i, row + j, VALUE(p, row + j, i),
+                       buf[i * nrows + j]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    return nerrs;
+}
+
+/* write the row of a process, chunks are written in reverse order in odd
+ * passes
+ */
+static int
+put_row(int ncid, int *varid, int p, int rank, int *buf)
+{
+    int i, k, err, nerrs = 0, req[NREC + 1], st[NREC + 1], junk[NX];
+    MPI_Offset start[2], count[2];
+
+    for (i=0; i<NX; i++) buf[i] = VALUE(p, rank, i);
+    for (k=0; k<NCHUNK; k++) {
+        int c = (p % 2) ? NCHUNK - 1 - k : k;
+        start[0] = rank; start[1] = c * (NX / NCHUNK);
+        count[0] = 1;    count[1] = NX / NCHUNK;
+        err = ncmpi_put_vara_int_all(ncid, varid[0], start, count,
+                                     buf + start[1]); CHECK_ERR
+    }
+
+    for (i=0; i<NREC; i++) {
+        buf[NX + i] = VALUE(p, rank, i);
+        start[0] = i; start[1] = rank;
+        count[0] = 1; count[1] = 1;
+        err = ncmpi_iput_vara_int(ncid, varid[1], start, count, buf + NX + i,
+                                  &req[i]); CHECK_ERR
+    }
+
+    /* a canceled request overwriting the row */
+    for (i=0; i<NX; i++) junk[i] = -1;
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, varid[0], start, count, junk, &req[NREC]); CHECK_ERR
+    err = ncmpi_cancel(ncid, 1, &req[NREC], &st[NREC]); CHECK_ERR
+
+    err = ncmpi_wait_all(ncid, NREC, req, st); CHECK_ERR
+    for (i=0; i<NREC; i++) {
+        err = st[i]; CHECK_ERR
+    }
+
+    return nerrs;
+}
+
+static int
+test_node_replay(const char *filename, const char *shared, int rank, int np)
+{
+    int err, nerrs = 0, ncid, varid[2], dimid[3], flag;
+    int *buf;
+    char hint[MPI_MAX_INFO_VAL];
+    MPI_Info info;
+
+    buf = (int*) malloc((size_t)np * NX * sizeof(int) + NREC * sizeof(int));
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_node_replay", "enable");
+    MPI_Info_set(info, "nc_dw_shared_logs", (char*)shared);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_node_replay", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, "enable")) {
+        printf("Error at line %d in %s: hint nc_dw_node_replay expect enable but got %s\n",
+               __LINE__, __FILE__, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    /* only the writes of the replay are aggregated, the hint is kept */
+    MPI_Info_get(info, "nc_node_aggr", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, "disable")) {
+        printf("Error at line %d in %s: hint nc_node_aggr expect disable but got %s\n",
+               __LINE__, __FILE__, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "A", NC_INT, 2, dimid + 1, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "R", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* pass 0: read back from the log, then from the file after a flush */
+    nerrs += put_row(ncid, varid, 0, rank, buf);
+    nerrs += check_rows(ncid, varid, 0, rank, 1, 1, buf);
+    err = ncmpi_sync(ncid); CHECK_ERR
+    nerrs += check_rows(ncid, varid, 0, 0, np, 1, buf);
+
+    /* pass 1: left in the log until close */
+    nerrs += put_row(ncid, varid, 1, rank, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_rows(ncid, varid, 1, 0, np, 1, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(buf);
+
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int err, nerrs = 0, rank, np;
+    char filename[PATH_MAX];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for node leader replay", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    nerrs += test_node_replay(filename, "disable", rank, np);
+    nerrs += test_node_replay(filename, "enable", rank, np);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
@@ -58,6 +58,8 @@ int main(int argc, char *argv[]) {
 	MPI_Info_create(&info);
     MPI_Info_set(info, "nc_dw", "enable");
     MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    /* This test relies on reads flushing the log */
+    MPI_Info_set(info, "nc_dw_flush_on_read", "enable");
 
     /* Create new netcdf file */
     err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);    CHECK_ERR
@@ -0,0 +1,243 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests reading data that is still in the log of DataWarp driver
+ * Reads fully covered by the log of the reading process are served from the
+ * log without flushing it, which is checked by canceling a nonblocking put
+ * request posted before the read. Partially covered reads in independent
+ * mode merge the log data over the file data. Reads of data written by other
+ * processes and reads in a type different from the variable flush the log.
+ * Entries logged out of order along the first dimension, overlapping each
+ * other, are looked up by their range and later entries win.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 10
+
+/* Value of row i of the column of process r after the out of order puts,
+ * rows 0-9 are written, then rows 6-7, 2-3 and 8 */
+static int
+expect_col(int r, int i)
+{
+    if (i == 6 || i == 7) return r * 1000 + 100 + i;
+    if (i == 2 || i == 3) return r * 1000 + 200 + i;
+    if (i == 8) return r * 1000 + 300 + i;
+    return r * 1000 + i;
+}
+
+/* Value of column i of row r after all puts in the collective phase */
+static int
+expect_val(int r, int i, int canceled)
+{
+    if (i >= 2 && i < 6) return r * 100 + 50 + i;
+    if (i == 7 && !canceled) return -1;
+    return r * 100 + i;
+}
+
+int main(int argc, char *argv[]) {
+    int i, err, nerrs = 0, rank, np, ncid, varid, tvarid, dimid[2], req, stat;
+    int tdimid[2];
+    int buf[NX], rbuf[NX], *abuf;
+    double dbuf[NX];
+    char filename[PATH_MAX];
+    MPI_Offset start[2], count[2], stride[2];
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for reading data in the log", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+    tdimid[0] = dimid[1]; tdimid[1] = dimid[0];
+    err = ncmpi_def_var(ncid, "T", NC_INT, 2, tdimid, &tvarid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* each process writes its row, then overwrites columns 2-5 */
+    for (i=0; i<NX; i++) buf[i] = rank * 100 + i;
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (i=0; i<4; i++) buf[i] = rank * 100 + 52 + i;
+    start[1] = 2; count[1] = 4;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+
+    /* a pending nonblocking put to column 7 */
+    buf[0] = -1;
+    start[1] = 7;
+    err = ncmpi_iput_var1_int(ncid, varid, start, buf, &req); CHECK_ERR
+
+    /* read own row, served from the log */
+    start[1] = 0; count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, rbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (rbuf[i] != expect_val(rank, i, 0)) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, expect_val(rank, i, 0), rbuf[i]);
+            nerrs++;
+        }
+    }
+
+    /* the log is not flushed, so the request can still be canceled */
+    err = ncmpi_cancel(ncid, 1, &req, &stat); CHECK_ERR
+    err = stat; CHECK_ERR
+
+    /* strided read of own row skips the canceled entry */
+    start[1] = 1; count[1] = NX / 2; stride[0] = 1; stride[1] = 2;
+    err = ncmpi_get_vars_int_all(ncid, varid, start, count, stride, rbuf); CHECK_ERR
+    for (i=0; i<NX/2; i++) {
+        if (rbuf[i] != expect_val(rank, 1 + 2 * i, 1)) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, 1 + 2 * i,
+                   expect_val(rank, 1 + 2 * i, 1), rbuf[i]);
+            nerrs++;
+        }
+    }
+
+    /* read in a different type, the log is flushed */
+    start[1] = 0; count[1] = NX;
+    err = ncmpi_get_vara_double_all(ncid, varid, start, count, dbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (dbuf[i] != expect_val(rank, i, 1)) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %f\n",
+                   __LINE__, __FILE__, rank, i, expect_val(rank, i, 1), dbuf[i]);
+            nerrs++;
+        }
+    }
+
+    /* overwrite column 0 and read the whole variable, including rows
+     * written by other processes, the log is flushed */
+    buf[0] = rank * 100 + 99;
+    start[1] = 0;
+    err = ncmpi_put_var1_int_all(ncid, varid, start, buf); CHECK_ERR
+    abuf = (int*) malloc(np * NX * sizeof(int));
+    err = ncmpi_get_var_int_all(ncid, varid, abuf); CHECK_ERR
+    for (i=0; i<np*NX; i++) {
+        int expect = (i % NX == 0) ? (i / NX) * 100 + 99
+                                   : expect_val(i / NX, i % NX, 1);
+        if (abuf[i] != expect) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i / NX, i % NX, expect, abuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(abuf);
+
+    /* in independent mode, a partially covered read merges the log data
+     * over the file data */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    for (i=0; i<3; i++) buf[i] = rank * 100 + 70 + i;
+    start[1] = 4; count[1] = 3;
+    err = ncmpi_put_vara_int(ncid, varid, start, count, buf); CHECK_ERR
+    buf[0] = -2;
+    start[1] = 9;
+    err = ncmpi_iput_var1_int(ncid, varid, start, buf, &req); CHECK_ERR
+    start[1] = 0; count[1] = 8;
+    err = ncmpi_get_vara_int(ncid, varid, start, count, rbuf); CHECK_ERR
+    for (i=0; i<8; i++) {
+        int expect = (i == 0) ? rank * 100 + 99
+                   : (i >= 4 && i < 7) ? rank * 100 + 66 + i
+                   : expect_val(rank, i, 1);
+        if (rbuf[i] != expect) {
+            printf("Error at line %d in %s: M[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, expect, rbuf[i]);
+            nerrs++;
+        }
+    }
+    err = ncmpi_cancel(ncid, 1, &req, &stat); CHECK_ERR
+    err = stat; CHECK_ERR
+
+    /* each process writes its column of T, then overwrites parts of it out
+     * of order, the reads are served from the log */
+    for (i=0; i<NX; i++) buf[i] = rank * 1000 + i;
+    start[0] = 0;  start[1] = rank;
+    count[0] = NX; count[1] = 1;
+    err = ncmpi_put_vara_int(ncid, tvarid, start, count, buf); CHECK_ERR
+    for (i=0; i<2; i++) buf[i] = rank * 1000 + 106 + i;
+    start[0] = 6; count[0] = 2;
+    err = ncmpi_put_vara_int(ncid, tvarid, start, count, buf); CHECK_ERR
+    for (i=0; i<2; i++) buf[i] = rank * 1000 + 202 + i;
+    start[0] = 2;
+    err = ncmpi_put_vara_int(ncid, tvarid, start, count, buf); CHECK_ERR
+    buf[0] = rank * 1000 + 308;
+    start[0] = 8;
+    err = ncmpi_put_var1_int(ncid, tvarid, start, buf); CHECK_ERR
+
+    start[0] = 7; count[0] = 3;
+    err = ncmpi_get_vara_int(ncid, tvarid, start, count, rbuf); CHECK_ERR
+    for (i=0; i<3; i++) {
+        if (rbuf[i] != expect_col(rank, 7 + i)) {
+            printf("Error at line %d in %s: T[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, 7 + i, rank, expect_col(rank, 7 + i), rbuf[i]);
+            nerrs++;
+        }
+    }
+    start[0] = 0; count[0] = 4; stride[0] = 3; stride[1] = 1;
+    err = ncmpi_get_vars_int(ncid, tvarid, start, count, stride, rbuf); CHECK_ERR
+    for (i=0; i<4; i++) {
+        if (rbuf[i] != expect_col(rank, 3 * i)) {
+            printf("Error at line %d in %s: T[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, 3 * i, rank, expect_col(rank, 3 * i), rbuf[i]);
+            nerrs++;
+        }
+    }
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
@@ -0,0 +1,219 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests recovering the logs left by a run that aborted before
+ * the log was replayed. Variable A is written and flushed by ncmpi_sync, then
+ * variable B is written and the file is aborted. B must not be in the file
+ * until it is opened for write, where the leftover logs are replayed. The
+ * flushed entries of A must not be replayed again over later writes, nor
+ * must a nonblocking put to A canceled before the abort be replayed. Logs
+ * are tested with and without shared log files and with logs kept on close,
+ * kept logs are overwritten when the file is opened again.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 1000
+#define NCHUNK 4
+
+#define VALUE(p, r, i) ((p) * 10000000 + (r) * 10000 + (i))
+
+/* check rows [0, nrows) of a variable, p < 0 for the fill value */
+static int
+check_rows(int ncid, int varid, int p, int nrows, int *buf)
+{
+    int i, j, err, nerrs = 0, expect;
+    MPI_Offset start[2], count[2];
+
+    start[0] = 0;     start[1] = 0;
+    count[0] = nrows; count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (j=0; j<nrows; j++) {
+        for (i=0; i<NX; i++) {
+            expect = (p < 0) ? NC_FILL_INT : VALUE(p, j, i);
+            if (buf[j * NX + i] != expect) {
+                printf("Error at line %d in %s: var %d [%d][%d] expect %d but got %d\n",
+                       __LINE__, __FILE__, varid, j, i, expect, buf[j * NX + i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+
+    return nerrs;
+}
+
+/* write the row of a process by several collective puts */
+static int
+put_row(int ncid, int varid, int p, int rank, int *buf)
+{
+    int i, k, err, nerrs = 0;
+    MPI_Offset start[2], count[2];
+
+    for (i=0; i<NX; i++) buf[i] = VALUE(p, rank, i);
+    for (k=0; k<NCHUNK; k++) {
+        start[0] = rank; start[1] = k * (NX / NCHUNK);
+        count[0] = 1;    count[1] = NX / NCHUNK;
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count,
+                                     buf + start[1]); CHECK_ERR
+    }
+
+    return nerrs;
+}
+
+/* check the variables in the file, opened without DataWarp driver */
+static int
+check_file(const char *filename, int pa, int pb, int np, int *buf)
+{
+    int err, nerrs = 0, ncid;
+    MPI_Info info;
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "disable");
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+    nerrs += check_rows(ncid, 0, pa, np, buf);
+    nerrs += check_rows(ncid, 1, pb, np, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    return nerrs;
+}
+
+static int
+test_recover(const char *filename, const char *shared, const char *del,
+             int rank, int np)
+{
+    int i, err, nerrs = 0, ncid, varid[2], dimid[2], flag, req, st;
+    int *buf;
+    MPI_Offset start[2], count[2];
+    char hint[MPI_MAX_INFO_VAL];
+    MPI_Info info;
+
+    buf = (int*) malloc((size_t)np * NX * sizeof(int));
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_shared_logs", (char*)shared);
+    MPI_Info_set(info, "nc_dw_del_on_close", (char*)del);
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       info, &ncid); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "A", NC_INT, 2, dimid, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "B", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* A is flushed, B is left in the log */
+    nerrs += put_row(ncid, varid[0], 0, rank, buf);
+    err = ncmpi_sync(ncid); CHECK_ERR
+    nerrs += put_row(ncid, varid[1], 1, rank, buf);
+
+    /* a canceled request is left in the log */
+    for (i=0; i<NX; i++) buf[i] = VALUE(3, rank, i);
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_iput_vara_int(ncid, varid[0], start, count, buf, &req); CHECK_ERR
+    err = ncmpi_cancel(ncid, 1, &req, &st); CHECK_ERR
+    err = st; CHECK_ERR
+    err = ncmpi_abort(ncid); CHECK_ERR
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    nerrs += check_file(filename, 0, -1, np, buf);
+
+    /* opening for write replays the leftover logs */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_WRITE, info, &ncid); CHECK_ERR
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_recover", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (flag && !strcmp(hint, "disable")) {
+        printf("Error at line %d in %s: hint nc_dw_recover expect enable but got %s\n",
+               __LINE__, __FILE__, hint);
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+    nerrs += check_rows(ncid, varid[1], 1, np, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    nerrs += check_file(filename, 0, 1, np, buf);
+
+    /* recovered logs must not be replayed again */
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_shared_logs", (char*)shared);
+    MPI_Info_set(info, "nc_dw_del_on_close", (char*)del);
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_WRITE, info, &ncid); CHECK_ERR
+    nerrs += put_row(ncid, varid[1], 2, rank, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_WRITE, info, &ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    nerrs += check_file(filename, 0, 2, np, buf);
+
+    free(buf);
+
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int err, nerrs = 0, rank, np;
+    char filename[PATH_MAX];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for recovery of leftover logs", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    nerrs += test_recover(filename, "disable", "enable", rank, np);
+    nerrs += test_recover(filename, "enable", "enable", rank, np);
+    nerrs += test_recover(filename, "disable", "disable", rank, np);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
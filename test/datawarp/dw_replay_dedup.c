@@ -0,0 +1,170 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests replaying the log of DataWarp driver when entries are
+ * overwritten or continue each other. A checkpoint variable is rewritten
+ * several times by nonblocking puts, only the last write reaches the file
+ * and every request must complete without error. A row written one element
+ * at a time and records written one at a time are merged into larger
+ * requests. A strided write followed by a partial overwrite must keep the
+ * elements not overwritten.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 8
+#define NREC 4
+#define NCKPT 3
+
+int main(int argc, char *argv[]) {
+    int i, r, err, nerrs = 0, rank, np, ncid, varid[3], dimid[3];
+    int req[NCKPT], st[NCKPT], buf[NCKPT][NX], rbuf[NREC * NX];
+    char filename[PATH_MAX];
+    MPI_Offset start[3], count[3], stride[2];
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for merging log entries", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "T", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "ckpt", NC_INT, 2, dimid + 1, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "str", NC_INT, 2, dimid + 1, &varid[2]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* rewrite the checkpoint, only the last write is in the file */
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    for (r=0; r<NCKPT; r++) {
+        for (i=0; i<NX; i++) buf[r][i] = r * 1000 + rank * 100 + i;
+        err = ncmpi_iput_vara_int(ncid, varid[0], start, count, buf[r], &req[r]); CHECK_ERR
+    }
+
+    /* records of own row written one element at a time */
+    count[0] = 1; count[1] = 1; count[2] = 1;
+    for (r=0; r<NREC; r++) {
+        for (i=0; i<NX; i++) {
+            int v = r * 1000 + rank * 100 + i;
+            start[0] = r; start[1] = rank; start[2] = i;
+            err = ncmpi_put_vara_int_all(ncid, varid[1], start, count, &v); CHECK_ERR
+        }
+    }
+
+    /* strided write of the even columns, then overwrite columns 0-3 */
+    for (i=0; i<NX; i++) rbuf[i] = rank * 100 + i;
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX / 2;
+    stride[0] = 1;   stride[1] = 2;
+    err = ncmpi_put_vars_int_all(ncid, varid[2], start, count, stride, rbuf); CHECK_ERR
+    for (i=0; i<4; i++) rbuf[i] = -(rank * 100 + i);
+    count[1] = 4;
+    err = ncmpi_put_vara_int_all(ncid, varid[2], start, count, rbuf); CHECK_ERR
+
+    err = ncmpi_wait_all(ncid, NCKPT, req, st); CHECK_ERR
+    for (r=0; r<NCKPT; r++) {
+        err = st[r]; CHECK_ERR
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file without the log */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[0], start, count, rbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (rbuf[i] != buf[NCKPT - 1][i]) {
+            printf("Error at line %d in %s: ckpt[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, buf[NCKPT - 1][i], rbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    start[0] = 0;    start[1] = rank; start[2] = 0;
+    count[0] = NREC; count[1] = 1;    count[2] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[1], start, count, rbuf); CHECK_ERR
+    for (i=0; i<NREC*NX; i++) {
+        int expect = (i / NX) * 1000 + rank * 100 + i % NX;
+        if (rbuf[i] != expect) {
+            printf("Error at line %d in %s: rec[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i / NX, i % NX, expect, rbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[2], start, count, rbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        /* odd columns after 3 are not written */
+        int expect = (i < 4) ? -(rank * 100 + i) : rank * 100 + i / 2;
+        if (i >= 4 && i % 2) continue;
+        if (rbuf[i] != expect) {
+            printf("Error at line %d in %s: str[%d][%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, rank, i, expect, rbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
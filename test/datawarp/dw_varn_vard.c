@@ -0,0 +1,272 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests varn and vard APIs with the DataWarp driver. A varn call
+ * is recorded as a single log entry and a vard call is flattened into a varn
+ * entry. The data is read back from the log before the file is closed and
+ * from the file after it is closed. A filetype the driver can not flatten,
+ * a darray, is written through the ncmpio driver after the log is flushed.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+#define NX 8
+#define NREC 3
+
+#define CHECK_VAL(name, expect, val) {                                    \
+    if ((val) != (expect)) {                                              \
+        printf("Error at line %d in %s: %s expect %d but got %d\n",       \
+               __LINE__, __FILE__, name, expect, val);                    \
+        nerrs++;                                                          \
+        goto fn_exit;                                                     \
+    }                                                                     \
+}
+
+/* vn:  varn of 2 element subarrays in reverse order, then partially
+ *      overwritten by iput_varn
+ * vd:  vard of the even columns of a row, struct of a vector
+ * vs:  vard of a subarray, noncontiguous buffer
+ * dd:  vard of a darray, written by the ncmpio driver
+ * rn:  varn of single elements of records
+ * rd:  vard of records of a record variable, hvector
+ */
+static int
+check_vars(int ncid, int *varid, int rank)
+{
+    int i, t, err, nerrs = 0, buf[2 * NX * NREC];
+    MPI_Offset start[3], count[3];
+
+    start[0] = 2 * rank; start[1] = 0;
+    count[0] = 2;        count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[0], start, count, buf); CHECK_ERR
+    for (i = 0; i < 2 * NX; i++) {
+        int expect = (2 * rank + i / NX) * 100 + i % NX;
+        if (i >= NX && i < NX + 4) expect = -expect;
+        CHECK_VAL("vn", expect, buf[i])
+    }
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[1], start, count, buf); CHECK_ERR
+    for (i = 0; i < NX; i += 2)
+        CHECK_VAL("vd", rank * 100 + i, buf[i])
+
+    start[0] = 2 * rank; start[1] = NX / 4;
+    count[0] = 2;        count[1] = NX / 2;
+    err = ncmpi_get_vara_int_all(ncid, varid[2], start, count, buf); CHECK_ERR
+    for (i = 0; i < NX; i++)
+        CHECK_VAL("vs", (2 * rank + i / (NX / 2)) * 100 + NX / 4 + i % (NX / 2), buf[i])
+
+    start[0] = 0; start[1] = 4 * rank;
+    count[0] = 2; count[1] = 4;
+    err = ncmpi_get_vara_int_all(ncid, varid[3], start, count, buf); CHECK_ERR
+    for (i = 0; i < 8; i++)
+        CHECK_VAL("dd", (i / 4) * 1000 + rank * 4 + i % 4, buf[i])
+
+    for (t = 0; t < NREC; t++) {
+        start[0] = t; start[1] = rank; start[2] = t;
+        err = ncmpi_get_var1_int_all(ncid, varid[4], start, buf); CHECK_ERR
+        CHECK_VAL("rn", t * 1000 + rank * 100 + t, buf[0])
+    }
+
+    start[0] = 0;    start[1] = rank; start[2] = 0;
+    count[0] = NREC; count[1] = 1;    count[2] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[5], start, count, buf); CHECK_ERR
+    for (i = 0; i < NREC * NX; i++)
+        CHECK_VAL("rd", (i / NX) * 1000 + rank * 100 + i % NX, buf[i])
+
+fn_exit:
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int i, k, n, t, err, nerrs = 0, rank, np, ncid, varid[6], dimid[6], vdims[2];
+    int req, st, buf[2 * NX * NREC];
+    int blocklen = 1, gsizes[2], distribs[2], dargs[2], psizes[2];
+    int sizes[2], subsizes[2], substarts[2];
+    char filename[PATH_MAX];
+    MPI_Offset recsize, *starts[2 * NX + 1], *counts[2 * NX + 1];
+    MPI_Offset range[2 * NX + 1][4];
+    MPI_Aint disp;
+    MPI_Datatype vtype, ftype, btype;
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for varn and vard", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "T", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "P", np, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[2]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", 2 * np, &dimid[3]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Z", 4 * np, &dimid[4]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "R", 2, &dimid[5]); CHECK_ERR
+
+    vdims[0] = dimid[3]; vdims[1] = dimid[2];
+    err = ncmpi_def_var(ncid, "vn", NC_INT, 2, vdims, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "vd", NC_INT, 2, dimid + 1, &varid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "vs", NC_INT, 2, vdims, &varid[2]); CHECK_ERR
+    vdims[0] = dimid[5]; vdims[1] = dimid[4];
+    err = ncmpi_def_var(ncid, "dd", NC_INT, 2, vdims, &varid[3]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rn", NC_INT, 3, dimid, &varid[4]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rd", NC_INT, 3, dimid, &varid[5]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* varn of own two rows, 2 elements at a time from the last column, with
+     * an empty subarray in the middle
+     */
+    k = n = 0;
+    for (i = NX - 2; i >= 0; i -= 2) {
+        for (t = 0; t < 2; t++) {
+            range[k][0] = 2 * rank + t; range[k][1] = i;
+            range[k][2] = 1;            range[k][3] = 2;
+            buf[n++] = (2 * rank + t) * 100 + i;
+            buf[n++] = (2 * rank + t) * 100 + i + 1;
+            k++;
+        }
+        if (i == NX / 2) {
+            range[k][0] = 0; range[k][1] = 0;
+            range[k][2] = 0; range[k][3] = 2;
+            k++;
+        }
+    }
+    for (i = 0; i < k; i++) {
+        starts[i] = range[i];
+        counts[i] = range[i] + 2;
+    }
+    err = ncmpi_put_varn_int_all(ncid, varid[0], k, starts, counts, buf); CHECK_ERR
+
+    /* overwrite columns 0 to 3 of the second row by a nonblocking varn */
+    range[0][0] = 2 * rank + 1; range[0][1] = 2;
+    range[1][0] = 2 * rank + 1; range[1][1] = 0;
+    range[0][2] = range[1][2] = 1;
+    range[0][3] = range[1][3] = 2;
+    for (i = 0; i < 2; i++) {
+        buf[2 * i]     = -((2 * rank + 1) * 100 + range[i][1]);
+        buf[2 * i + 1] = -((2 * rank + 1) * 100 + range[i][1] + 1);
+    }
+    err = ncmpi_iput_varn_int(ncid, varid[0], 2, starts, counts, buf, &req); CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, &req, &st); CHECK_ERR
+    err = st; CHECK_ERR
+
+    /* vard of the even columns of own row */
+    MPI_Type_vector(NX / 2, 1, 2, MPI_INT, &vtype);
+    disp = (MPI_Aint)rank * NX * sizeof(int);
+    MPI_Type_create_struct(1, &blocklen, &disp, &vtype, &ftype);
+    MPI_Type_commit(&ftype);
+    MPI_Type_free(&vtype);
+    for (i = 0; i < NX / 2; i++) buf[i] = rank * 100 + 2 * i;
+    err = ncmpi_put_vard_all(ncid, varid[1], ftype, buf, NX / 2, MPI_INT); CHECK_ERR
+    MPI_Type_free(&ftype);
+
+    /* vard of a subarray from a noncontiguous buffer */
+    sizes[0] = 2 * np;    sizes[1] = NX;
+    subsizes[0] = 2;      subsizes[1] = NX / 2;
+    substarts[0] = 2 * rank; substarts[1] = NX / 4;
+    MPI_Type_create_subarray(2, sizes, subsizes, substarts, MPI_ORDER_C,
+                             MPI_INT, &ftype);
+    MPI_Type_commit(&ftype);
+    MPI_Type_vector(NX, 1, 2, MPI_INT, &btype);
+    MPI_Type_commit(&btype);
+    for (i = 0; i < NX; i++) {
+        buf[2 * i] = (2 * rank + i / (NX / 2)) * 100 + NX / 4 + i % (NX / 2);
+        buf[2 * i + 1] = -1;
+    }
+    err = ncmpi_put_vard_all(ncid, varid[2], ftype, buf, 1, btype); CHECK_ERR
+    MPI_Type_free(&btype);
+    MPI_Type_free(&ftype);
+
+    /* vard of a darray, columns are distributed among processes */
+    gsizes[0] = 2;     gsizes[1] = 4 * np;
+    distribs[0] = MPI_DISTRIBUTE_NONE; distribs[1] = MPI_DISTRIBUTE_BLOCK;
+    dargs[0] = dargs[1] = MPI_DISTRIBUTE_DFLT_DARG;
+    psizes[0] = 1;     psizes[1] = np;
+    MPI_Type_create_darray(np, rank, 2, gsizes, distribs, dargs, psizes,
+                           MPI_ORDER_C, MPI_INT, &ftype);
+    MPI_Type_commit(&ftype);
+    for (i = 0; i < 8; i++) buf[i] = (i / 4) * 1000 + rank * 4 + i % 4;
+    err = ncmpi_put_vard_all(ncid, varid[3], ftype, buf, 8, MPI_INT); CHECK_ERR
+    MPI_Type_free(&ftype);
+
+    /* varn of single elements of records, counts is NULL */
+    for (t = 0; t < NREC; t++) {
+        range[t][0] = t; range[t][1] = rank; range[t][2] = t;
+        starts[t] = range[t];
+        buf[t] = t * 1000 + rank * 100 + t;
+    }
+    err = ncmpi_put_varn_int_all(ncid, varid[4], NREC, starts, NULL, buf); CHECK_ERR
+
+    /* vard of own row of every record, records are recsize bytes apart */
+    err = ncmpi_inq_recsize(ncid, &recsize); CHECK_ERR
+    MPI_Type_create_hvector(NREC, NX, (MPI_Aint)recsize, MPI_INT, &vtype);
+    disp = (MPI_Aint)rank * NX * sizeof(int);
+    MPI_Type_create_struct(1, &blocklen, &disp, &vtype, &ftype);
+    MPI_Type_commit(&ftype);
+    MPI_Type_free(&vtype);
+    for (i = 0; i < NREC * NX; i++) buf[i] = (i / NX) * 1000 + rank * 100 + i % NX;
+    err = ncmpi_put_vard_all(ncid, varid[5], ftype, buf, NREC * NX, MPI_INT); CHECK_ERR
+    MPI_Type_free(&ftype);
+
+    /* read back before the log is flushed */
+    nerrs += check_vars(ncid, varid, rank);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_vars(ncid, varid, rank);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
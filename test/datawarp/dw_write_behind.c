@@ -0,0 +1,147 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *********************************************************************/
+/* $Id$ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * This program tests writing the data log of DataWarp driver in the
+ * background, enabled by hint nc_dw_write_behind. Each process writes a row
+ * larger than all the data log buffers together, first by puts of mixed
+ * sizes crossing buffer boundaries and then by a single put. The data is
+ * read back from the log while buffers may still be queued, after the log is
+ * flushed by ncmpi_sync, and from the file.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pnetcdf.h>
+#include <limits.h>
+#include <testutils.h>
+#include <libgen.h>
+
+/* 3 buffers of 8 MiB hold less than a row */
+#define NBUF "3"
+#define NX (7 * 1024 * 1024 + 5)
+
+static int
+check_row(int ncid, int varid, int rank, int pass, int *rbuf)
+{
+    int err, nerrs = 0;
+    MPI_Offset i, start[2], count[2];
+
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, rbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        int expect = (int)(pass * 100000000 + rank * 10000000 + i);
+        if (rbuf[i] != expect) {
+            printf("Error at line %d in %s: pass %d M[%d][%lld] expect %d but got %d\n",
+                   __LINE__, __FILE__, pass, rank, i, expect, rbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    return nerrs;
+}
+
+int main(int argc, char *argv[]) {
+    int k, err, nerrs = 0, rank, np, ncid, varid, dimid[2], flag, *buf;
+    char filename[PATH_MAX], hint[MPI_MAX_INFO_VAL];
+    MPI_Offset i, start[2], count[2];
+    MPI_Offset chunks[4] = {1, 777, 300007, 2 * 1024 * 1024 + 3};
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc > 1) snprintf(filename, PATH_MAX, "%s", argv[1]);
+    else          snprintf(filename, PATH_MAX, "testfile.nc");
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for write-behind data log", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_dw", "enable");
+    MPI_Info_set(info, "nc_dw_overwrite", "enable");
+    MPI_Info_set(info, "nc_dw_write_behind", NBUF);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       info, &ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &info); CHECK_ERR
+    MPI_Info_get(info, "nc_dw_write_behind", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (!flag || strcmp(hint, NBUF)) {
+        printf("Error at line %d in %s: hint nc_dw_write_behind expect %s but got %s\n",
+               __LINE__, __FILE__, NBUF, (flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&info);
+
+    err = ncmpi_def_dim(ncid, "Y", np, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "M", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    buf = (int*) malloc(NX * sizeof(int));
+
+    /* puts of mixed sizes, read back from the log */
+    for (i=0; i<NX; i++) buf[i] = (int)(rank * 10000000 + i);
+    start[0] = rank; count[0] = 1;
+    for (k=0, start[1]=0; start[1]<NX; k++, start[1]+=count[1]) {
+        count[1] = chunks[k % 4];
+        if (start[1] + count[1] > NX) count[1] = NX - start[1];
+        err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf + start[1]); CHECK_ERR
+    }
+    nerrs += check_row(ncid, varid, rank, 0, buf);
+
+    /* flush the log, then overwrite the row by one put */
+    err = ncmpi_sync(ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid, rank, 0, buf);
+
+    for (i=0; i<NX; i++) buf[i] = (int)(100000000 + rank * 10000000 + i);
+    start[1] = 0; count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check the file */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_row(ncid, varid, rank, 1, buf);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(buf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n", sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR, nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+
+    return nerrs > 0;
+}
@@ -0,0 +1,201 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ * This program tests PnetCDF's own two-phase I/O for collective nonblocking
+ * writes, enabled by hint nc_num_aggrs. Each process writes every nprocs-th
+ * column of a 2D fixed-size variable, except the last row, which is left
+ * for fill values, so the aggregators must read the holes before writing.
+ * The variable is larger than one stripe per aggregator, so the writes take
+ * more than one round. Each process also writes a few records of a record
+ * variable. When run on more than one process, the last process posts no
+ * request in the second wait call, so the file range to be written is only
+ * known to the other processes.
+ *
+ *********************************************************************/
+/*  $Id$ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 1024
+#define NX 640
+#define NREC 3
+
+/*----< main() >------------------------------------------------------------*/
+int main(int argc, char **argv) {
+    char filename[256], hint[MPI_MAX_INFO_VAL];
+    int i, j, ncid, dimid[3], varid[2], err, nerrs=0, rank, nprocs, flag;
+    int dw_enabled=0;
+    int *buf, *rbuf, req[NREC], nreqs;
+    MPI_Offset start[2], count[2], stride[2], rstart[3], rcount[3], nrecs;
+    MPI_Info info, infoused;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for two-phase nonblocking put ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_num_aggrs", "2");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL-1, hint, &flag);
+    if (flag && strcasecmp(hint, "enable") == 0)
+        dw_enabled = 1;
+    MPI_Info_get(infoused, "nc_num_aggrs", MPI_MAX_INFO_VAL-1, hint, &flag);
+    if (!dw_enabled && (!flag || strcmp(hint, "2"))) {
+        printf("Error at line %d in %s: hint nc_num_aggrs expect 2 but got %s\n",
+               __LINE__,__FILE__,(flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&infoused);
+
+    err = ncmpi_def_dim(ncid, "REC", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y",   NY,           &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X",   NX,           &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "fix", NC_INT, 2, dimid+1, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "rec", NC_INT, 3, dimid,   &varid[1]); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    buf = (int*) malloc(NY * NX * sizeof(int));
+
+    /* columns rank, rank+nprocs, ... of all but the last row */
+    for (i=0; i<NY*NX; i++) buf[i] = -1;
+    start[0] = 0;    start[1] = rank;
+    count[0] = NY-1; count[1] = (NX - rank + nprocs - 1) / nprocs;
+    stride[0] = 1;   stride[1] = nprocs;
+    for (i=0; i<count[0]*count[1]; i++) buf[i] = rank * 10000000 + i;
+    err = ncmpi_iput_vars_int(ncid, varid[0], start, count, stride, buf,
+                              &req[0]); CHECK_ERR
+    err = ncmpi_wait_all(ncid, 1, req, NULL); CHECK_ERR
+
+    /* check the write buffer is not altered */
+    for (i=0; i<count[0]*count[1]; i++) {
+        if (buf[i] != rank * 10000000 + i) {
+            printf("Error at line %d in %s: put buffer[%d] altered to %d, expect %d\n",
+                   __LINE__,__FILE__,i,buf[i],rank * 10000000 + i);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* each process writes a row of NREC records, the last process writes
+     * nothing when nprocs > 1 */
+    nreqs = (nprocs > 1 && rank == nprocs - 1) ? 0 : NREC;
+    for (j=0; j<nreqs; j++) {
+        /* write row rank of record j */
+        rstart[0] = j; rstart[1] = rank; rstart[2] = 0;
+        rcount[0] = 1; rcount[1] = 1;    rcount[2] = NX;
+        for (i=0; i<NX; i++) buf[j*NX+i] = j * 1000 + i;
+        err = ncmpi_iput_vara_int(ncid, varid[1], rstart, rcount, buf + j*NX,
+                                  &req[j]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, nreqs, req, NULL); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* read back and check */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &ncid); CHECK_ERR
+
+    rbuf = (int*) malloc(NY * NX * sizeof(int));
+    err = ncmpi_get_var_int_all(ncid, varid[0], rbuf); CHECK_ERR
+    for (j=0; j<NY; j++) {
+        for (i=0; i<NX; i++) {
+            int expect, p = i % nprocs, ncols = (NX - p + nprocs - 1) / nprocs;
+            if (j == NY-1) expect = NC_FILL_INT;
+            else           expect = p * 10000000 + j * ncols + i / nprocs;
+            if (rbuf[j*NX+i] != expect) {
+                printf("Error at line %d in %s: fix[%d][%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,j,i,expect,rbuf[j*NX+i]);
+                nerrs++;
+                j = NY;
+                break;
+            }
+        }
+    }
+
+    err = ncmpi_inq_dimlen(ncid, dimid[0], &nrecs); CHECK_ERR
+    if (nrecs != NREC) {
+        printf("Error at line %d in %s: number of records expect %d but got %lld\n",
+               __LINE__,__FILE__,NREC,nrecs);
+        nerrs++;
+    }
+    free(rbuf);
+    rbuf = (int*) malloc(NREC * nprocs * NX * sizeof(int));
+    rstart[0] = 0;    rstart[1] = 0;      rstart[2] = 0;
+    rcount[0] = NREC; rcount[1] = nprocs; rcount[2] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid[1], rstart, rcount, rbuf);
+    CHECK_ERR
+    for (j=0; j<NREC; j++) {
+        int p;
+        /* skip the last process's rows, which are not written. Note record
+         * variables are not filled when new records are created. */
+        for (p=0; p<((nprocs > 1) ? nprocs - 1 : 1); p++) {
+            for (i=0; i<NX; i++) {
+                int expect = j * 1000 + i;
+                int val = rbuf[(j*nprocs+p)*NX+i];
+                if (val != expect) {
+                    printf("Error at line %d in %s: rec[%d][%d][%d] expect %d but got %d\n",
+                           __LINE__,__FILE__,j,p,i,expect,val);
+                    nerrs++;
+                    j = NREC;
+                    p = nprocs;
+                    break;
+                }
+            }
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(rbuf);
+    free(buf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
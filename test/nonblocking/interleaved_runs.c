@@ -0,0 +1,159 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ * This program tests nonblocking requests whose fileviews interleave one
+ * another, so ncmpi_wait_all() must sort the flattened offset-length
+ * segments. Each request writes (or reads) one column of a 2D variable,
+ * making a sorted run of NY segments. The requests are posted in reverse
+ * column order. A small number of requests exercises the k-way merge of
+ * sorted runs and a large number exercises the radix sort.
+ *
+ *********************************************************************/
+/*  $Id$ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 20
+
+/*----< test_columns() >-----------------------------------------------------*/
+static int
+test_columns(int ncid, int varid, int nx)
+{
+    int i, j, err, nerrs=0, rank, *buf, *req, *status;
+    MPI_Offset start[2], count[2];
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    req    = (int*) malloc(nx * 2 * sizeof(int));
+    status = req + nx;
+    buf    = (int*) malloc(nx * NY * sizeof(int));
+
+    /* column i is written from buf[i*NY] */
+    for (i=0; i<nx; i++)
+        for (j=0; j<NY; j++)
+            buf[i*NY+j] = rank * 100000 + j * nx + i;
+
+    start[0] = rank * NY; count[0] = NY;
+    count[1] = 1;
+    for (i=nx-1; i>=0; i--) {
+        start[1] = i;
+        err = ncmpi_iput_vara_int(ncid, varid, start, count, &buf[i*NY],
+                                  &req[i]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, nx, req, status); CHECK_ERR
+    for (i=0; i<nx; i++) {
+        err = status[i];
+        CHECK_ERR
+    }
+
+    /* read back the whole block in row-major order */
+    for (i=0; i<nx*NY; i++) buf[i] = -1;
+    start[1] = 0; count[1] = nx;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (i=0; i<nx*NY; i++) {
+        if (buf[i] != rank * 100000 + i) {
+            printf("Error at line %d in %s: nx=%d expect buf[%d]=%d but got %d\n",
+                   __LINE__,__FILE__,nx,i,rank * 100000 + i,buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* read back column by column with interleaved iget requests */
+    for (i=0; i<nx*NY; i++) buf[i] = -1;
+    count[1] = 1;
+    for (i=nx-1; i>=0; i--) {
+        start[1] = i;
+        err = ncmpi_iget_vara_int(ncid, varid, start, count, &buf[i*NY],
+                                  &req[i]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, nx, req, status); CHECK_ERR
+    for (i=0; i<nx; i++) {
+        for (j=0; j<NY; j++) {
+            if (buf[i*NY+j] != rank * 100000 + j * nx + i) {
+                printf("Error at line %d in %s: nx=%d expect column %d row %d = %d but got %d\n",
+                       __LINE__,__FILE__,nx,i,j,rank * 100000 + j * nx + i,
+                       buf[i*NY+j]);
+                nerrs++;
+                i = nx;
+                break;
+            }
+        }
+    }
+
+    free(buf);
+    free(req);
+    return nerrs;
+}
+
+/*----< main() >------------------------------------------------------------*/
+int main(int argc, char **argv) {
+    char filename[256];
+    int i, ncid, dimid[3], varid[2], err, nerrs=0, rank, nprocs;
+    int nx[2]={8, 300}; /* fewer and more than the runs merged by k-way merge */
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for sorting interleaved runs ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL,
+                       &ncid); CHECK_ERR
+
+    err = ncmpi_def_dim(ncid, "Y",  NY * nprocs, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X0", nx[0],       &dimid[1]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X1", nx[1],       &dimid[2]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var0", NC_INT, 2, dimid, &varid[0]); CHECK_ERR
+    dimid[1] = dimid[2];
+    err = ncmpi_def_var(ncid, "var1", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    for (i=0; i<2; i++)
+        nerrs += test_columns(ncid, varid[i], nx[i]);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
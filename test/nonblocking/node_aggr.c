@@ -0,0 +1,166 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ * This program tests intra-node aggregation of collective nonblocking
+ * writes, enabled by hint nc_node_aggr. Each process posts one request per
+ * column for every nprocs-th column of a 2D variable, so the requests of all
+ * processes interleave in the file in many small pieces, which are merged by
+ * node leaders. Some requests are posted by bput APIs. In the second wait
+ * call, only every other process posts requests.
+ *
+ *********************************************************************/
+/*  $Id$ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h> /* strcasecmp() */
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 10
+#define NCOLS 20
+
+/*----< main() >------------------------------------------------------------*/
+int main(int argc, char **argv) {
+    char filename[256], hint[MPI_MAX_INFO_VAL];
+    int i, j, ncid, dimid[2], varid[2], err, nerrs=0, rank, nprocs, flag;
+    int nx, nreqs, *buf, *rbuf, *req, dw_enabled=0;
+    MPI_Offset start[2], count[2];
+    MPI_Info info, infoused;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for intra-node aggregation ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_node_aggr", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL-1, hint, &flag);
+    if (flag && strcasecmp(hint, "enable") == 0)
+        dw_enabled = 1;
+    MPI_Info_get(infoused, "nc_node_aggr", MPI_MAX_INFO_VAL-1, hint, &flag);
+    if (!dw_enabled && (!flag || strcmp(hint, "enable"))) {
+        printf("Error at line %d in %s: hint nc_node_aggr expect enable but got %s\n",
+               __LINE__,__FILE__,(flag) ? hint : "(not set)");
+        nerrs++;
+    }
+    MPI_Info_free(&infoused);
+
+    nx = NCOLS * nprocs;
+    err = ncmpi_def_dim(ncid, "Y", NY, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", nx, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var0", NC_INT, 2, dimid, &varid[0]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var1", NC_INT, 2, dimid, &varid[1]); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    buf = (int*) malloc(NY * NCOLS * sizeof(int));
+    req = (int*) malloc(NCOLS * sizeof(int));
+    err = ncmpi_buffer_attach(ncid, NY * NCOLS * sizeof(int)); CHECK_ERR
+
+    /* column rank + i * nprocs is written from buf[i*NY], in reverse order,
+     * odd columns by bput */
+    for (i=0; i<NY*NCOLS; i++) buf[i] = rank * 1000 + i;
+    start[0] = 0; count[0] = NY;
+    count[1] = 1;
+    for (i=NCOLS-1; i>=0; i--) {
+        start[1] = rank + i * nprocs;
+        if (i % 2)
+            err = ncmpi_bput_vara_int(ncid, varid[0], start, count,
+                                      buf + i*NY, &req[i]);
+        else
+            err = ncmpi_iput_vara_int(ncid, varid[0], start, count,
+                                      buf + i*NY, &req[i]);
+        CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, NCOLS, req, NULL); CHECK_ERR
+
+    /* only even ranks write var1 */
+    nreqs = (rank % 2) ? 0 : NCOLS;
+    for (i=0; i<nreqs; i++) {
+        start[1] = rank + i * nprocs;
+        err = ncmpi_iput_vara_int(ncid, varid[1], start, count, buf + i*NY,
+                                  &req[i]); CHECK_ERR
+    }
+    err = ncmpi_wait_all(ncid, nreqs, req, NULL); CHECK_ERR
+    err = ncmpi_buffer_detach(ncid); CHECK_ERR
+
+    /* check the write buffer is not altered */
+    for (i=0; i<NY*NCOLS; i++) {
+        if (buf[i] != rank * 1000 + i) {
+            printf("Error at line %d in %s: put buffer[%d] altered to %d, expect %d\n",
+                   __LINE__,__FILE__,i,buf[i],rank * 1000 + i);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* read back and check */
+    rbuf = (int*) malloc(NY * nx * sizeof(int));
+    for (j=0; j<2; j++) {
+        err = ncmpi_get_var_int_all(ncid, varid[j], rbuf); CHECK_ERR
+        for (i=0; i<NY*nx; i++) {
+            int y = i / nx, p = (i % nx) % nprocs, c = (i % nx) / nprocs;
+            int expect = p * 1000 + c * NY + y;
+            if (j == 1 && p % 2) expect = NC_FILL_INT;
+            if (rbuf[i] != expect) {
+                printf("Error at line %d in %s: var%d[%d][%d] expect %d but got %d\n",
+                       __LINE__,__FILE__,j,y,i%nx,expect,rbuf[i]);
+                nerrs++;
+                break;
+            }
+        }
+    }
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(rbuf);
+    free(req);
+    free(buf);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,314 @@
+/*********************************************************************
+ *
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ * This program tests the file contents written by nonblocking requests whose
+ * fileviews interleave or overlap. Each process writes a block of NY rows of
+ * a 2D variable and keeps the expected contents of its block, which is
+ * checked by reading the block back after each ncmpi_wait_all(). The cases
+ * are:
+ *   1. requests of different strides and lengths interleaving not in
+ *      lockstep, so they are expanded into offset-length pairs,
+ *   2. overlapping requests, where the request posted later wins the writes
+ *      to the overlapped regions, both with runs long enough to be kept
+ *      compact and with short runs,
+ *   3. strided and non-strided requests mixed in one ncmpi_wait_all().
+ * The cases run with the default I/O, PnetCDF's two-phase I/O (hint
+ * nc_num_aggrs) and the intra-node aggregation (hint nc_node_aggr).
+ *
+ *********************************************************************/
+/*  $Id$ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NY 32
+#define NX 16
+#define MAX_REQS 8
+
+static int rank;
+
+/*----< iput() >-------------------------------------------------------------*/
+/* Post a write to a subarray of this process's block, start[0] is relative to
+ * the block. Element i is written with value + i. When stride is NULL, an
+ * iput_vara request is posted. The expected contents of the block are
+ * updated, as if the requests were carried out in the order they are posted.
+ */
+static int
+iput(int ncid, int varid, MPI_Offset *start, MPI_Offset *count,
+     MPI_Offset *stride, int value, int *buf, int *expect, int *req)
+{
+    int i, j, err, nerrs=0;
+    MPI_Offset y, x, g_start[2];
+
+    for (i=0; i<count[0]; i++) {
+        for (j=0; j<count[1]; j++) {
+            y = start[0] + i * ((stride == NULL) ? 1 : stride[0]);
+            x = start[1] + j * ((stride == NULL) ? 1 : stride[1]);
+            buf[i*count[1]+j] = value + i*count[1]+j;
+            expect[y*NX+x]    = buf[i*count[1]+j];
+        }
+    }
+
+    g_start[0] = rank * NY + start[0];
+    g_start[1] = start[1];
+    if (stride == NULL)
+        err = ncmpi_iput_vara_int(ncid, varid, g_start, count, buf, req);
+    else
+        err = ncmpi_iput_vars_int(ncid, varid, g_start, count, stride, buf,
+                                  req);
+    CHECK_ERR
+    return nerrs;
+}
+
+/*----< wait_check() >-------------------------------------------------------*/
+/* Wait for the requests and check the contents of this process's block */
+static int
+wait_check(int ncid, int varid, int nreqs, int *req, int *expect,
+           const char *name)
+{
+    int i, err, nerrs=0, status[MAX_REQS], buf[NY*NX];
+    MPI_Offset start[2], count[2];
+
+    err = ncmpi_wait_all(ncid, nreqs, req, status); CHECK_ERR
+    for (i=0; i<nreqs; i++) {
+        err = status[i];
+        CHECK_ERR
+    }
+
+    start[0] = rank * NY; count[0] = NY;
+    start[1] = 0;         count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, varid, start, count, buf); CHECK_ERR
+    for (i=0; i<NY*NX; i++) {
+        if (buf[i] != expect[i]) {
+            printf("Error at line %d in %s: %s expect [%d][%d]=%d but got %d\n",
+                   __LINE__,__FILE__,name,i/NX,i%NX,expect[i],buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    return nerrs;
+}
+
+/*----< test_interleave() >--------------------------------------------------*/
+/* Requests of different strides and lengths interleave, but do not overlap */
+static int
+test_interleave(int ncid, int varid, int *bufs, int *expect)
+{
+    int nerrs=0, nreqs=0, value, req[MAX_REQS];
+    MPI_Offset start[2], count[2], stride[2];
+
+    value = rank * 1000000 + 100000;
+
+    /* posted in a decreasing order of columns */
+    start[0] = 0; count[0] = NY;
+    start[1] = 3; count[1] = 3;
+    stride[0] = 1; stride[1] = 4;  /* columns 3, 7, 11 */
+    nerrs += iput(ncid, varid, start, count, stride, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 0; count[0] = NY/2;
+    start[1] = 2; count[1] = 1;
+    stride[0] = 2; stride[1] = 1;  /* even rows of column 2 */
+    nerrs += iput(ncid, varid, start, count, stride, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 0; count[0] = NY;
+    start[1] = 1; count[1] = 1;    /* column 1 */
+    nerrs += iput(ncid, varid, start, count, NULL, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    nerrs += wait_check(ncid, varid, nreqs, req, expect, "interleave");
+    return nerrs;
+}
+
+/*----< test_overlap() >-----------------------------------------------------*/
+/* Overlapping requests on the first nrows rows, the request posted later
+ * wins. Requests are posted in an order different from their file offsets.
+ */
+static int
+test_overlap(int ncid, int varid, int nrows, int *bufs, int *expect)
+{
+    int i, nerrs=0, nreqs=0, value, req[MAX_REQS];
+    MPI_Offset start[2], count[2];
+    MPI_Offset cols[5][2] = {{0, NX},  /* whole rows */
+                             {0, 8},   /* columns 0-7 */
+                             {4, 8},   /* columns 4-11, starts later */
+                             {2, 8},   /* columns 2-9, starts earlier */
+                             {2, 4}};  /* columns 2-5, the same start */
+
+    value = rank * 1000000 + 200000 + nrows * 10000;
+
+    start[0] = 0; count[0] = nrows;
+    for (i=0; i<5; i++) {
+        start[1] = cols[i][0];
+        count[1] = cols[i][1];
+        nerrs += iput(ncid, varid, start, count, NULL, value + nreqs * 1000,
+                      bufs + nreqs*NY*NX, expect, &req[nreqs]);
+        nreqs++;
+    }
+
+    /* a request covered entirely by an earlier one */
+    start[0] = 1; count[0] = 1;
+    start[1] = 12; count[1] = 2;
+    nerrs += iput(ncid, varid, start, count, NULL, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    nerrs += wait_check(ncid, varid, nreqs, req, expect, "overlap");
+    return nerrs;
+}
+
+/*----< test_mixed() >-------------------------------------------------------*/
+/* Strided and non-strided requests mixed in one wait_all */
+static int
+test_mixed(int ncid, int varid, int *bufs, int *expect)
+{
+    int nerrs=0, nreqs=0, value, req[MAX_REQS];
+    MPI_Offset start[2], count[2], stride[2];
+
+    value = rank * 1000000 + 300000;
+
+    start[0] = 0; count[0] = NY;
+    start[1] = 0; count[1] = NX/2;
+    stride[0] = 1; stride[1] = 2;  /* even columns */
+    nerrs += iput(ncid, varid, start, count, stride, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 4; count[0] = 4;
+    start[1] = 0; count[1] = NX;   /* rows 4-7 */
+    nerrs += iput(ncid, varid, start, count, NULL, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 0; count[0] = NY/2;
+    start[1] = 1; count[1] = NX/2;
+    stride[0] = 2; stride[1] = 2;  /* odd columns of even rows */
+    nerrs += iput(ncid, varid, start, count, stride, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 1; count[0] = NY/2;
+    start[1] = 1; count[1] = NX/2;
+    stride[0] = 2; stride[1] = 2;  /* odd columns of odd rows */
+    nerrs += iput(ncid, varid, start, count, stride, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    start[0] = 0; count[0] = NY;
+    start[1] = 1; count[1] = 1;    /* column 1 */
+    nerrs += iput(ncid, varid, start, count, NULL, value + nreqs * 1000,
+                  bufs + nreqs*NY*NX, expect, &req[nreqs]);
+    nreqs++;
+
+    nerrs += wait_check(ncid, varid, nreqs, req, expect, "mixed");
+    return nerrs;
+}
+
+/*----< test_hint() >--------------------------------------------------------*/
+static int
+test_hint(char *filename, MPI_Info info, int *bufs, int *expect)
+{
+    int i, ncid, dimid[2], varid, err, nerrs=0, nprocs;
+    MPI_Offset start[2], count[2];
+
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info,
+                       &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", NY * nprocs, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX,          &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* initialize the block */
+    for (i=0; i<NY*NX; i++) expect[i] = -1;
+    start[0] = rank * NY; count[0] = NY;
+    start[1] = 0;         count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, varid, start, count, expect); CHECK_ERR
+
+    nerrs += test_interleave(ncid, varid, bufs, expect);
+    nerrs += test_overlap(ncid, varid, NY, bufs, expect);
+    nerrs += test_overlap(ncid, varid, 4, bufs, expect);
+    nerrs += test_mixed(ncid, varid, bufs, expect);
+
+    err = ncmpi_close(ncid); CHECK_ERR
+    return nerrs;
+}
+
+/*----< main() >------------------------------------------------------------*/
+int main(int argc, char **argv) {
+    char filename[256];
+    int err, nerrs=0, *bufs, *expect;
+    MPI_Info info;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for overlapped requests ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str);
+        free(cmd_str);
+    }
+
+    bufs   = (int*) malloc(MAX_REQS * NY * NX * sizeof(int));
+    expect = (int*) malloc(NY * NX * sizeof(int));
+
+    nerrs += test_hint(filename, MPI_INFO_NULL, bufs, expect);
+
+    /* PnetCDF's two-phase I/O */
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_num_aggrs", "2");
+    nerrs += test_hint(filename, info, bufs, expect);
+    MPI_Info_free(&info);
+
+    /* intra-node aggregation */
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_node_aggr", "enable");
+    nerrs += test_hint(filename, info, bufs, expect);
+    MPI_Info_free(&info);
+
+    free(expect);
+    free(bufs);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0) {
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+            ncmpi_inq_malloc_list();
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,239 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests type conversion of arrays long enough to go through the
+ * block (vectorized) conversion kernels, including blocks that contain
+ * out-of-range values which must be reported as NC_ERANGE while all other
+ * elements are converted correctly.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o test_conversion test_conversion.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 1 test_conversion testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+/* a few full blocks plus a partial one */
+#define NELEMS 1041
+
+/* index of the element set to an out-of-range value */
+#define BAD_IDX 300
+
+static int dw_enabled;
+
+/* with DataWarp driver, NC_ERANGE of put is only reported at sync time */
+static int
+put_err(int ncid, int err)
+{
+#ifdef BUILD_DRIVER_DW
+    if (dw_enabled && err == NC_NOERR) err = ncmpi_sync(ncid);
+#endif
+    return err;
+}
+
+static int
+test_conv(char *filename)
+{
+    int i, err, nerrs=0, ncid, dimid, v_flt, v_shr, v_int, v_i64, v_ush;
+    float *fbuf;
+    double *dbuf;
+    short *sbuf;
+    signed char *cbuf;
+    long long *llbuf;
+
+    fbuf  = (float*)       malloc(NELEMS * sizeof(float));
+    dbuf  = (double*)      malloc(NELEMS * sizeof(double));
+    sbuf  = (short*)       malloc(NELEMS * sizeof(short));
+    cbuf  = (signed char*) malloc(NELEMS * sizeof(signed char));
+    llbuf = (long long*)   malloc(NELEMS * sizeof(long long));
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER|NC_64BIT_DATA,
+                       MPI_INFO_NULL, &ncid); CHECK_ERR
+
+#ifdef BUILD_DRIVER_DW
+    {
+        int flag;
+        char hint[MPI_MAX_INFO_VAL];
+        MPI_Info infoused;
+        ncmpi_inq_file_info(ncid, &infoused);
+        MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+        if (flag && strcasecmp(hint, "enable") == 0)
+            dw_enabled = 1;
+        MPI_Info_free(&infoused);
+    }
+#endif
+
+    err = ncmpi_def_dim(ncid, "x", NELEMS, &dimid); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_flt", NC_FLOAT,  1, &dimid, &v_flt); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_shr", NC_SHORT,  1, &dimid, &v_shr); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_int", NC_INT,    1, &dimid, &v_int); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_i64", NC_INT64,  1, &dimid, &v_i64); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_ush", NC_USHORT, 1, &dimid, &v_ush); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* double -> NC_FLOAT -> double, all values exactly representable */
+    for (i=0; i<NELEMS; i++) dbuf[i] = (i - NELEMS/2) * 0.25;
+    err = ncmpi_put_var_double_all(ncid, v_flt, dbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) dbuf[i] = 0;
+    err = ncmpi_get_var_double_all(ncid, v_flt, dbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) {
+        if (dbuf[i] != (i - NELEMS/2) * 0.25) {
+            printf("Error at line %d: var_flt[%d] expect %f but got %f\n",
+                   __LINE__, i, (i - NELEMS/2) * 0.25, dbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* double -> NC_FLOAT with one value out of range */
+    dbuf[BAD_IDX] = 1.0e+40;
+    err = ncmpi_put_var_double_all(ncid, v_flt, dbuf);
+    err = put_err(ncid, err); EXP_ERR(NC_ERANGE)
+    err = ncmpi_get_var_float_all(ncid, v_flt, fbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) {
+        if (i == BAD_IDX) continue;
+        if (fbuf[i] != (float)((i - NELEMS/2) * 0.25)) {
+            printf("Error at line %d: var_flt[%d] expect %f but got %f\n",
+                   __LINE__, i, (i - NELEMS/2) * 0.25, fbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* float -> NC_SHORT -> float */
+    for (i=0; i<NELEMS; i++) fbuf[i] = (float)(i * 31 - 16000);
+    err = ncmpi_put_var_float_all(ncid, v_shr, fbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) fbuf[i] = 0;
+    err = ncmpi_get_var_float_all(ncid, v_shr, fbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) {
+        if (fbuf[i] != (float)(i * 31 - 16000)) {
+            printf("Error at line %d: var_shr[%d] expect %d but got %f\n",
+                   __LINE__, i, i * 31 - 16000, fbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* NC_SHORT -> signed char, most values are out of range */
+    err = ncmpi_get_var_schar_all(ncid, v_shr, cbuf); EXP_ERR(NC_ERANGE)
+
+    /* NC_SHORT -> signed char, only one value is out of range */
+    for (i=0; i<NELEMS; i++) sbuf[i] = (short)(i % 256 - 128);
+    sbuf[BAD_IDX] = 1000;
+    err = ncmpi_put_var_short_all(ncid, v_shr, sbuf); CHECK_ERR
+    err = ncmpi_get_var_schar_all(ncid, v_shr, cbuf); EXP_ERR(NC_ERANGE)
+    for (i=0; i<NELEMS; i++) {
+        if (i == BAD_IDX) continue;
+        if (cbuf[i] != i % 256 - 128) {
+            printf("Error at line %d: var_shr[%d] expect %d but got %d\n",
+                   __LINE__, i, i % 256 - 128, cbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* short -> NC_USHORT with one negative value */
+    for (i=0; i<NELEMS; i++) sbuf[i] = (short)i;
+    sbuf[BAD_IDX] = -1;
+    err = ncmpi_put_var_short_all(ncid, v_ush, sbuf);
+    err = put_err(ncid, err); EXP_ERR(NC_ERANGE)
+
+    /* long long -> NC_INT -> double */
+    for (i=0; i<NELEMS; i++) llbuf[i] = (long long)i * 2000000 - 1000000000;
+    err = ncmpi_put_var_longlong_all(ncid, v_int, llbuf); CHECK_ERR
+    err = ncmpi_get_var_double_all(ncid, v_int, dbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) {
+        if (dbuf[i] != (double)llbuf[i]) {
+            printf("Error at line %d: var_int[%d] expect %lld but got %f\n",
+                   __LINE__, i, llbuf[i], dbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* double -> NC_INT64 -> float */
+    for (i=0; i<NELEMS; i++) dbuf[i] = (double)(i - 500);
+    err = ncmpi_put_var_double_all(ncid, v_i64, dbuf); CHECK_ERR
+    err = ncmpi_get_var_float_all(ncid, v_i64, fbuf); CHECK_ERR
+    for (i=0; i<NELEMS; i++) {
+        if (fbuf[i] != (float)(i - 500)) {
+            printf("Error at line %d: var_i64[%d] expect %d but got %f\n",
+                   __LINE__, i, i - 500, fbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    dbuf[BAD_IDX] = 1.0e+30;
+    err = ncmpi_put_var_double_all(ncid, v_i64, dbuf);
+    err = put_err(ncid, err); EXP_ERR(NC_ERANGE)
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(fbuf);
+    free(dbuf);
+    free(sbuf);
+    free(cbuf);
+    free(llbuf);
+    return nerrs;
+}
+
+int main(int argc, char* argv[])
+{
+    char filename[256];
+    int err, nerrs=0, rank;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for type conversion of long arrays ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    nerrs += test_conv(filename);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+        if (malloc_size > 0) ncmpi_inq_malloc_list();
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
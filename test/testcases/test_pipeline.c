@@ -0,0 +1,234 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the pipelined blocking put, enabled by the PnetCDF hint
+ * nc_put_pipeline_size, which type-converts and byte-swaps user buffers one
+ * chunk at a time into small staging buffers. It checks the contents written
+ * to the file, that user buffers are not modified, and that NC_ERANGE is
+ * reported. In collective mode, the last process writes nothing, so the
+ * processes make different numbers of chunks.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o test_pipeline test_pipeline.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 test_pipeline testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 1000
+
+/* small enough to split each request into many chunks */
+#define PIPELINE_SIZE "40"
+
+static int dw_enabled;
+
+/* with DataWarp driver, NC_ERANGE of put is only reported at sync time */
+static int
+put_err(int ncid, int err)
+{
+#ifdef BUILD_DRIVER_DW
+    if (dw_enabled && err == NC_NOERR) err = ncmpi_sync(ncid);
+#endif
+    return err;
+}
+
+static int
+test_pipeline(char *filename)
+{
+    int i, err, nerrs=0, rank, nprocs, ncid, dimid[2], v_int, v_flt, v_str;
+    int *ibuf, flag;
+    double *dbuf;
+    char hint[MPI_MAX_INFO_VAL];
+    MPI_Offset start[1], count[1], stride[1];
+    MPI_Info info, infoused;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    ibuf = (int*)    malloc(NX * sizeof(int));
+    dbuf = (double*) malloc(NX * sizeof(double));
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_put_pipeline_size", PIPELINE_SIZE);
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid);
+    CHECK_ERR
+    MPI_Info_free(&info);
+
+    ncmpi_inq_file_info(ncid, &infoused);
+#ifdef BUILD_DRIVER_DW
+    MPI_Info_get(infoused, "nc_dw", MPI_MAX_INFO_VAL - 1, hint, &flag);
+    if (flag && strcasecmp(hint, "enable") == 0)
+        dw_enabled = 1;
+#endif
+    if (!dw_enabled) {
+        MPI_Info_get(infoused, "nc_put_pipeline_size", MPI_MAX_INFO_VAL - 1,
+                     hint, &flag);
+        if (!flag || strcmp(hint, PIPELINE_SIZE)) {
+            printf("Error at line %d: hint nc_put_pipeline_size expect %s but got %s\n",
+                   __LINE__, PIPELINE_SIZE, (flag) ? hint : "(not set)");
+            nerrs++;
+        }
+    }
+    MPI_Info_free(&infoused);
+
+    err = ncmpi_def_dim(ncid, "x", (MPI_Offset)NX * nprocs, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "y", (MPI_Offset)NX * nprocs * 2, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_int", NC_INT,   1, &dimid[0], &v_int); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_flt", NC_FLOAT, 1, &dimid[0], &v_flt); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_str", NC_INT,   1, &dimid[1], &v_str); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    /* the last process writes nothing, when run on more than one process */
+    start[0] = (MPI_Offset)NX * rank;
+    count[0] = (nprocs > 1 && rank == nprocs - 1) ? 0 : NX;
+
+    /* int -> NC_INT, byte swap only, collective */
+    for (i=0; i<NX; i++) ibuf[i] = rank * NX + i;
+    err = ncmpi_put_vara_int_all(ncid, v_int, start, count, ibuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (ibuf[i] != rank * NX + i) {
+            printf("Error at line %d: user buffer modified ibuf[%d] expect %d but got %d\n",
+                   __LINE__, i, rank * NX + i, ibuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* double -> NC_FLOAT, type conversion, collective */
+    for (i=0; i<NX; i++) dbuf[i] = (rank * NX + i) * 0.5;
+    err = ncmpi_put_vara_double_all(ncid, v_flt, start, count, dbuf); CHECK_ERR
+
+    /* strided write, noncontiguous in file, independent */
+    err = ncmpi_begin_indep_data(ncid); CHECK_ERR
+    start[0]  = (MPI_Offset)NX * 2 * rank;
+    stride[0] = 2;
+    for (i=0; i<NX; i++) ibuf[i] = -(rank * NX + i);
+    err = ncmpi_put_vars_int(ncid, v_str, start, count, stride, ibuf); CHECK_ERR
+    err = ncmpi_end_indep_data(ncid); CHECK_ERR
+
+    /* read back and check */
+    start[0] = (MPI_Offset)NX * rank;
+    err = ncmpi_get_vara_int_all(ncid, v_int, start, count, ibuf); CHECK_ERR
+    for (i=0; i<count[0]; i++) {
+        if (ibuf[i] != rank * NX + i) {
+            printf("Error at line %d: var_int[%d] expect %d but got %d\n",
+                   __LINE__, i, rank * NX + i, ibuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_get_vara_double_all(ncid, v_flt, start, count, dbuf); CHECK_ERR
+    for (i=0; i<count[0]; i++) {
+        if (dbuf[i] != (rank * NX + i) * 0.5) {
+            printf("Error at line %d: var_flt[%d] expect %f but got %f\n",
+                   __LINE__, i, (rank * NX + i) * 0.5, dbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    start[0] = (MPI_Offset)NX * 2 * rank;
+    count[0] *= 2;
+    ibuf = (int*) realloc(ibuf, 2 * NX * sizeof(int));
+    err = ncmpi_get_vara_int_all(ncid, v_str, start, count, ibuf); CHECK_ERR
+    for (i=0; i<count[0]; i++) {
+        int expect = (i % 2) ? NC_FILL_INT : -(rank * NX + i / 2);
+        if (ibuf[i] != expect) {
+            printf("Error at line %d: var_str[%d] expect %d but got %d\n",
+                   __LINE__, i, expect, ibuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* double -> NC_FLOAT with one value out of range, all processes write */
+    start[0] = (MPI_Offset)NX * rank;
+    count[0] = NX;
+    for (i=0; i<NX; i++) dbuf[i] = i;
+    dbuf[NX/2] = 1.0e+40;
+    err = ncmpi_put_vara_double_all(ncid, v_flt, start, count, dbuf);
+    err = put_err(ncid, err); EXP_ERR(NC_ERANGE)
+    if (dbuf[NX/2] != 1.0e+40) {
+        printf("Error at line %d: user buffer modified dbuf[%d] expect %f but got %f\n",
+               __LINE__, NX/2, 1.0e+40, dbuf[NX/2]);
+        nerrs++;
+    }
+    err = ncmpi_get_vara_double_all(ncid, v_flt, start, count, dbuf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (i == NX/2) continue;
+        if (dbuf[i] != i) {
+            printf("Error at line %d: var_flt[%d] expect %d but got %f\n",
+                   __LINE__, i, i, dbuf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(ibuf);
+    free(dbuf);
+    return nerrs;
+}
+
+int main(int argc, char* argv[])
+{
+    char filename[256];
+    int err, nerrs=0, rank;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for pipelined put ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    nerrs += test_pipeline(filename);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+        if (malloc_size > 0) ncmpi_inq_malloc_list();
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
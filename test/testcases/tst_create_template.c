@@ -0,0 +1,253 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests API ncmpi_create_from_template(), which creates new files
+ * from the header of an opened file and returns them in data mode. Data is
+ * written to the new files, which are then reopened and checked against the
+ * template. The template is used both right after its enddef and after being
+ * reopened in read-only mode.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_create_template tst_create_template.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 tst_create_template testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 10
+#define NFILES 3
+
+/* compare the header of file ncid against the template's */
+static int
+check_header(int ncid, int tmpl_ncid)
+{
+    int i, err, nerrs=0, ndims[2], nvars[2], natts[2], unlimdimid[2];
+    int format[2], ncids[2];
+    char name[2][NC_MAX_NAME+1];
+    MPI_Offset len[2];
+
+    ncids[0] = tmpl_ncid;
+    ncids[1] = ncid;
+    for (i=0; i<2; i++) {
+        err = ncmpi_inq(ncids[i], &ndims[i], &nvars[i], &natts[i],
+                        &unlimdimid[i]); CHECK_ERR
+        err = ncmpi_inq_format(ncids[i], &format[i]); CHECK_ERR
+    }
+    if (ndims[0] != ndims[1] || nvars[0] != nvars[1] ||
+        natts[0] != natts[1] || unlimdimid[0] != unlimdimid[1] ||
+        format[0] != format[1]) {
+        printf("Error at line %d in %s: expect ndims %d nvars %d natts %d unlimdimid %d format %d but got %d %d %d %d %d\n",
+               __LINE__, __FILE__, ndims[0], nvars[0], natts[0],
+               unlimdimid[0], format[0], ndims[1], nvars[1], natts[1],
+               unlimdimid[1], format[1]);
+        return 1;
+    }
+
+    for (i=0; i<ndims[0]; i++) {
+        if (i == unlimdimid[0]) continue; /* no record is written yet */
+        err = ncmpi_inq_dim(tmpl_ncid, i, name[0], &len[0]); CHECK_ERR
+        err = ncmpi_inq_dim(ncid, i, name[1], &len[1]); CHECK_ERR
+        if (strcmp(name[0], name[1]) || len[0] != len[1]) {
+            printf("Error at line %d in %s: dim %d expect %s %lld but got %s %lld\n",
+                   __LINE__, __FILE__, i, name[0], len[0], name[1], len[1]);
+            nerrs++;
+        }
+    }
+    for (i=0; i<nvars[0]; i++) {
+        err = ncmpi_inq_varname(tmpl_ncid, i, name[0]); CHECK_ERR
+        err = ncmpi_inq_varname(ncid, i, name[1]); CHECK_ERR
+        if (strcmp(name[0], name[1])) {
+            printf("Error at line %d in %s: var %d expect %s but got %s\n",
+                   __LINE__, __FILE__, i, name[0], name[1]);
+            nerrs++;
+        }
+        err = ncmpi_inq_varoffset(tmpl_ncid, i, &len[0]); CHECK_ERR
+        err = ncmpi_inq_varoffset(ncid, i, &len[1]); CHECK_ERR
+        if (len[0] != len[1]) {
+            printf("Error at line %d in %s: var %d expect offset %lld but got %lld\n",
+                   __LINE__, __FILE__, i, len[0], len[1]);
+            nerrs++;
+        }
+    }
+    return nerrs;
+}
+
+/* check the data and attributes written to a file created from template */
+static int
+check_data(int ncid, int nprocs, int file_no)
+{
+    int i, err, nerrs=0, *buf;
+    char text[16];
+    MPI_Offset start[2], count[2], nrecs;
+
+    err = ncmpi_get_att_text(ncid, NC_GLOBAL, "title", text); CHECK_ERR
+    if (strncmp(text, "template", 8)) {
+        printf("Error at line %d in %s: title expect \"template\" but got \"%s\"\n",
+               __LINE__, __FILE__, text);
+        nerrs++;
+    }
+
+    err = ncmpi_inq_dimlen(ncid, 0, &nrecs); CHECK_ERR
+    if (nrecs != nprocs) {
+        printf("Error at line %d in %s: expect %d records but got %lld\n",
+               __LINE__, __FILE__, nprocs, nrecs);
+        nerrs++;
+    }
+
+    buf = (int*) malloc((size_t)nprocs * NX * sizeof(int));
+    start[0] = 0;      start[1] = 0;
+    count[0] = nprocs; count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, 1, start, count, buf); CHECK_ERR
+    for (i=0; i<nprocs*NX; i++) {
+        if (buf[i] != file_no + i) {
+            printf("Error at line %d in %s: rec_var[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, file_no + i, buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_get_var_int_all(ncid, 0, buf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (buf[i] != file_no - i) {
+            printf("Error at line %d in %s: fix_var[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, file_no - i, buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+    free(buf);
+    return nerrs;
+}
+
+/* create NFILES files from the template and write data to them */
+static int
+create_files(const char *filename, int tmpl_ncid, int rank, int nprocs)
+{
+    char path[256];
+    int i, j, err, nerrs=0, ncid, buf[NX];
+    MPI_Offset start[2], count[2];
+
+    for (j=0; j<NFILES; j++) {
+        sprintf(path, "%s.%d", filename, j);
+        err = ncmpi_create_from_template(MPI_COMM_WORLD, path, NC_CLOBBER,
+                                         tmpl_ncid, MPI_INFO_NULL, &ncid);
+        CHECK_ERR
+        if (err != NC_NOERR) continue;
+
+        nerrs += check_header(ncid, tmpl_ncid);
+
+        /* the new file is in data mode */
+        for (i=0; i<NX; i++) buf[i] = j + rank * NX + i;
+        start[0] = rank; start[1] = 0;
+        count[0] = 1;    count[1] = NX;
+        err = ncmpi_put_vara_int_all(ncid, 1, start, count, buf); CHECK_ERR
+        for (i=0; i<NX; i++) buf[i] = j - i;
+        err = ncmpi_put_var_int_all(ncid, 0, buf); CHECK_ERR
+
+        /* the header can still be changed in define mode */
+        err = ncmpi_redef(ncid); CHECK_ERR
+        err = ncmpi_put_att_int(ncid, 0, "file_no", NC_INT, 1, &j); CHECK_ERR
+        err = ncmpi_def_var(ncid, "new_var", NC_INT, 0, NULL, &i); CHECK_ERR
+        err = ncmpi_enddef(ncid); CHECK_ERR
+        err = ncmpi_close(ncid); CHECK_ERR
+
+        err = ncmpi_open(MPI_COMM_WORLD, path, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+        nerrs += check_data(ncid, nprocs, j);
+        err = ncmpi_inq_varid(ncid, "new_var", &i); CHECK_ERR
+        err = ncmpi_close(ncid); CHECK_ERR
+    }
+    return nerrs;
+}
+
+int
+main(int argc, char **argv)
+{
+    char filename[256];
+    int rank, nprocs, err, nerrs=0;
+    int ncid, tmpl_ncid, dimid[2], varid;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for create from template ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* create the template file */
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER | NC_64BIT_DATA,
+                       MPI_INFO_NULL, &tmpl_ncid); CHECK_ERR
+    err = ncmpi_def_dim(tmpl_ncid, "Y", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(tmpl_ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(tmpl_ncid, "fix_var", NC_INT, 1, &dimid[1], &varid); CHECK_ERR
+    err = ncmpi_put_att_text(tmpl_ncid, varid, "units", 6, "meters"); CHECK_ERR
+    err = ncmpi_def_var(tmpl_ncid, "rec_var", NC_INT, 2, dimid, &varid); CHECK_ERR
+    err = ncmpi_def_var(tmpl_ncid, "scalar_var", NC_UINT64, 0, NULL, &varid); CHECK_ERR
+    err = ncmpi_put_att_text(tmpl_ncid, NC_GLOBAL, "title", 8, "template"); CHECK_ERR
+
+    /* the template must be in data mode */
+    err = ncmpi_create_from_template(MPI_COMM_WORLD, filename, NC_CLOBBER,
+                                     tmpl_ncid, MPI_INFO_NULL, &ncid);
+    EXP_ERR(NC_EINDEFINE)
+    err = ncmpi_enddef(tmpl_ncid); CHECK_ERR
+
+    /* use the template right after its enddef */
+    nerrs += create_files(filename, tmpl_ncid, rank, nprocs);
+    err = ncmpi_close(tmpl_ncid); CHECK_ERR
+
+    /* use the template opened in read-only mode */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL,
+                     &tmpl_ncid); CHECK_ERR
+    nerrs += create_files(filename, tmpl_ncid, rank, nprocs);
+    err = ncmpi_close(tmpl_ncid); CHECK_ERR
+
+    /* invalid template ID */
+    err = ncmpi_create_from_template(MPI_COMM_WORLD, filename, NC_CLOBBER,
+                                     -1, MPI_INFO_NULL, &ncid);
+    EXP_ERR(NC_EBADID)
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
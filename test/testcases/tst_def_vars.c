@@ -0,0 +1,236 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests APIs ncmpi_def_vars() and ncmpi_put_atts(), which define
+ * a set of variables and put a set of attributes in one call. A call that
+ * fails, for example because one of the names is already in use or appears
+ * twice in the same call, must define none of its variables. The file is
+ * reopened and the variables and attributes are checked.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_def_vars tst_def_vars.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 tst_def_vars testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 10
+#define NVARS 100
+
+/* check the variables defined by ncmpi_def_vars() and the attributes put by
+ * ncmpi_put_atts() */
+static int
+check_header(int ncid, int dimid[2])
+{
+    int i, err, nerrs=0, nvars, varid, ndims, dimids[2], ival[2];
+    char name[NC_MAX_NAME], text[16];
+    double dval;
+    nc_type xtype;
+
+    err = ncmpi_inq_nvars(ncid, &nvars); CHECK_ERR
+    if (nvars != NVARS + 1) {
+        printf("Error at line %d in %s: expect nvars %d but got %d\n",
+               __LINE__, __FILE__, NVARS + 1, nvars);
+        nerrs++;
+    }
+
+    for (i=0; i<NVARS; i++) {
+        sprintf(name, "var_%d", i);
+        err = ncmpi_inq_varid(ncid, name, &varid); CHECK_ERR
+        if (err != NC_NOERR) continue;
+        if (varid != i + 1) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, i + 1, varid);
+            nerrs++;
+        }
+        err = ncmpi_inq_var(ncid, varid, NULL, &xtype, &ndims, dimids, NULL);
+        CHECK_ERR
+        if (xtype != ((i % 2) ? NC_FLOAT : NC_INT) || ndims != i % 3) {
+            printf("Error at line %d in %s: variable %s expect type %d ndims %d but got %d %d\n",
+                   __LINE__, __FILE__, name, (i % 2) ? NC_FLOAT : NC_INT,
+                   i % 3, xtype, ndims);
+            nerrs++;
+        }
+        else if ((ndims == 1 && dimids[0] != dimid[1]) ||
+                 (ndims == 2 && (dimids[0] != dimid[0] ||
+                                 dimids[1] != dimid[1]))) {
+            printf("Error at line %d in %s: variable %s has wrong dimids\n",
+                   __LINE__, __FILE__, name);
+            nerrs++;
+        }
+    }
+
+    /* attributes put by ncmpi_put_atts() */
+    err = ncmpi_get_att_text(ncid, NC_GLOBAL, "title", text); CHECK_ERR
+    if (strncmp(text, "def_vars", 8)) {
+        printf("Error at line %d in %s: title expect \"def_vars\" but got \"%s\"\n",
+               __LINE__, __FILE__, text);
+        nerrs++;
+    }
+    err = ncmpi_get_att_int(ncid, NC_GLOBAL, "ints", ival); CHECK_ERR
+    if (ival[0] != 1 || ival[1] != 2) {
+        printf("Error at line %d in %s: ints expect 1 2 but got %d %d\n",
+               __LINE__, __FILE__, ival[0], ival[1]);
+        nerrs++;
+    }
+    err = ncmpi_get_att_double(ncid, 1, "scale", &dval); CHECK_ERR
+    if (dval != 0.5) {
+        printf("Error at line %d in %s: scale expect 0.5 but got %f\n",
+               __LINE__, __FILE__, dval);
+        nerrs++;
+    }
+    return nerrs;
+}
+
+int
+main(int argc, char **argv)
+{
+    char filename[256], *names[NVARS], *att_names[3];
+    int i, rank, err, nerrs=0;
+    int ncid, dimid[2], varid, nvars, ndims[NVARS], bad_dimid=2;
+    int *dimids[NVARS], varids[NVARS], ival[2]={1,2};
+    double dval=0.5;
+    MPI_Offset nelems[3];
+    nc_type xtypes[NVARS], att_types[3];
+    void *att_bufs[3];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for def_vars and put_atts ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var", NC_INT, 1, &dimid[1], &varid); CHECK_ERR
+
+    /* scalar, 1D fixed-size, and 2D record variables */
+    for (i=0; i<NVARS; i++) {
+        names[i] = (char*) malloc(16);
+        sprintf(names[i], "var_%d", i);
+        xtypes[i] = (i % 2) ? NC_FLOAT : NC_INT;
+        ndims[i]  = i % 3;
+        dimids[i] = (ndims[i] == 1) ? &dimid[1] : dimid;
+    }
+
+    /* name of an existing variable */
+    strcpy(names[NVARS-1], "var");
+    err = ncmpi_def_vars(ncid, NVARS, names, xtypes, ndims, dimids, varids);
+    EXP_ERR(NC_ENAMEINUSE)
+
+    /* the same name appears twice */
+    strcpy(names[NVARS-1], "var_0");
+    err = ncmpi_def_vars(ncid, NVARS, names, xtypes, ndims, dimids, varids);
+    EXP_ERR(NC_ENAMEINUSE)
+
+    /* none of the variables of failed calls should be defined */
+    err = ncmpi_inq_nvars(ncid, &nvars); CHECK_ERR
+    if (nvars != 1) {
+        printf("Error at line %d in %s: expect nvars 1 but got %d\n",
+               __LINE__, __FILE__, nvars);
+        nerrs++;
+    }
+    err = ncmpi_inq_varid(ncid, "var_0", &varid); EXP_ERR(NC_ENOTVAR)
+
+    /* invalid dimension ID */
+    sprintf(names[NVARS-1], "var_%d", NVARS-1);
+    dimids[1] = &bad_dimid;
+    err = ncmpi_def_vars(ncid, NVARS, names, xtypes, ndims, dimids, varids);
+    EXP_ERR(NC_EBADDIM)
+    dimids[1] = &dimid[1];
+
+    err = ncmpi_def_vars(ncid, NVARS, names, xtypes, ndims, dimids, varids);
+    CHECK_ERR
+    for (i=0; i<NVARS; i++) {
+        if (varids[i] != i + 1) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, names[i], i + 1, varids[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    /* global attributes */
+    att_names[0] = "title"; att_types[0] = NC_CHAR; nelems[0] = 8;
+    att_bufs[0] = "def_vars";
+    att_names[1] = "ints";  att_types[1] = NC_INT;  nelems[1] = 2;
+    att_bufs[1] = ival;
+    err = ncmpi_put_atts(ncid, NC_GLOBAL, 2, att_names, att_types, nelems,
+                         att_bufs); CHECK_ERR
+
+    /* attribute of a variable */
+    att_names[0] = "scale"; att_types[0] = NC_DOUBLE; nelems[0] = 1;
+    att_bufs[0] = &dval;
+    err = ncmpi_put_atts(ncid, 1, 1, att_names, att_types, nelems, att_bufs);
+    CHECK_ERR
+
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    nerrs += check_header(ncid, dimid);
+
+    /* in data mode, overwrite attributes of the same sizes */
+    ival[0] = 1; ival[1] = 2;
+    att_names[0] = "ints"; att_types[0] = NC_INT; nelems[0] = 2;
+    att_bufs[0] = ival;
+    err = ncmpi_put_atts(ncid, NC_GLOBAL, 1, att_names, att_types, nelems,
+                         att_bufs); CHECK_ERR
+
+    /* define mode APIs cannot be called in data mode */
+    err = ncmpi_def_vars(ncid, 1, names, xtypes, ndims, dimids, varids);
+    EXP_ERR(NC_ENOTINDEFINE)
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* reopen and check the file header */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_header(ncid, dimid);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    for (i=0; i<NVARS; i++) free(names[i]);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,234 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests updating the file header in data mode. When a put_att,
+ * copy_att or rename API does not change the space occupied by the attribute
+ * or name in the file header, only the modified part of the header is
+ * written. Otherwise, the entire header is written. The amount written is
+ * checked through ncmpi_inq_put_size() and the file is reopened to check the
+ * header contents.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_hdr_update tst_hdr_update.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 tst_hdr_update testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 10
+#define BIG_LEN 100000
+
+/* check the amount of header written by the last API call. If partial is
+ * set, expect only part of the header is written, otherwise the entire
+ * header. */
+static int
+check_put_size(int ncid, MPI_Offset *put_size, int partial, int line)
+{
+    int err, nerrs=0;
+    MPI_Offset size, hsize, delta;
+
+    err = ncmpi_inq_put_size(ncid, &size); CHECK_ERR
+    err = ncmpi_inq_header_size(ncid, &hsize); CHECK_ERR
+
+    /* only root writes the file header */
+    delta = size - *put_size;
+    MPI_Allreduce(MPI_IN_PLACE, &delta, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+    if (partial && (delta <= 0 || delta >= hsize / 2)) {
+        printf("Error at line %d in %s: expect partial header write but got %lld of %lld bytes\n",
+               line, __FILE__, delta, hsize);
+        nerrs++;
+    }
+    else if (!partial && delta != hsize) {
+        printf("Error at line %d in %s: expect entire header write of %lld bytes but got %lld\n",
+               line, __FILE__, hsize, delta);
+        nerrs++;
+    }
+    *put_size = size;
+    return nerrs;
+}
+
+/* check the header contents after all updates */
+static int
+check_header(int ncid, int *big)
+{
+    int i, err, nerrs=0, ival[4], varid, dimid;
+    char text[16];
+    MPI_Offset len;
+
+    err = ncmpi_inq_varid(ncid, "var_xyz", &varid); CHECK_ERR
+    err = ncmpi_inq_dimid(ncid, "Y", &dimid); CHECK_ERR
+
+    err = ncmpi_get_att_int(ncid, NC_GLOBAL, "big", big); CHECK_ERR
+    for (i=0; i<BIG_LEN; i++) {
+        if (big[i] != i) {
+            printf("Error at line %d in %s: big[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, i, big[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_get_att_int(ncid, NC_GLOBAL, "stamp", ival); CHECK_ERR
+    for (i=0; i<4; i++) {
+        if (ival[i] != 200 + i) {
+            printf("Error at line %d in %s: stamp[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, 200 + i, ival[i]);
+            nerrs++;
+            break;
+        }
+    }
+    err = ncmpi_inq_attlen(ncid, NC_GLOBAL, "text", &len); CHECK_ERR
+    err = ncmpi_get_att_text(ncid, NC_GLOBAL, "text", text); CHECK_ERR
+    if (len != 2 || strncmp(text, "ab", 2)) {
+        printf("Error at line %d in %s: text expect \"ab\" but got \"%s\" of length %lld\n",
+               __LINE__, __FILE__, text, len);
+        nerrs++;
+    }
+    err = ncmpi_get_att_text(ncid, NC_GLOBAL, "units", text); CHECK_ERR
+    if (strncmp(text, "inches", 6)) {
+        printf("Error at line %d in %s: global units expect \"inches\" but got \"%s\"\n",
+               __LINE__, __FILE__, text);
+        nerrs++;
+    }
+    err = ncmpi_get_att_text(ncid, varid, "units", text); CHECK_ERR
+    if (strncmp(text, "inches", 6)) {
+        printf("Error at line %d in %s: units expect \"inches\" but got \"%s\"\n",
+               __LINE__, __FILE__, text);
+        nerrs++;
+    }
+    return nerrs;
+}
+
+int
+main(int argc, char **argv)
+{
+    char filename[256], *att_names[2];
+    int i, rank, err, nerrs=0, ncid, dimid, varid, ival[4], *big;
+    MPI_Offset put_size, nelems[2];
+    nc_type att_types[2];
+    void *att_bufs[2];
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for header update in data mode ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    /* a large attribute at the beginning of the header */
+    big = (int*) malloc(BIG_LEN * sizeof(int));
+    for (i=0; i<BIG_LEN; i++) big[i] = i;
+    for (i=0; i<4; i++) ival[i] = 100 + i;
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_put_att_int(ncid, NC_GLOBAL, "big", NC_INT, BIG_LEN, big); CHECK_ERR
+    err = ncmpi_put_att_int(ncid, NC_GLOBAL, "stamp", NC_INT, 4, ival); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "text", 8, "abcdefgh"); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "units", 6, "meters"); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid); CHECK_ERR
+    err = ncmpi_def_var(ncid, "var_abc", NC_INT, 1, &dimid, &varid); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, varid, "units", 6, "meters"); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    err = ncmpi_inq_put_size(ncid, &put_size); CHECK_ERR
+
+    /* attributes of the same size are updated in place */
+    for (i=0; i<4; i++) ival[i] = 200 + i;
+    err = ncmpi_put_att_int(ncid, NC_GLOBAL, "stamp", NC_INT, 4, ival); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    err = ncmpi_put_att_text(ncid, varid, "units", 6, "inches"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    err = ncmpi_copy_att(ncid, varid, "units", ncid, NC_GLOBAL); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    /* new names occupying the same space are updated in place */
+    err = ncmpi_rename_var(ncid, varid, "var_xyz"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    err = ncmpi_rename_dim(ncid, dimid, "Y"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "text", "txt0"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "txt0", "text"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    /* a shorter name moves the metadata following it */
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "stamp", "st"); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 0, __LINE__);
+
+    /* two attributes updated in place in one call */
+    att_names[0] = "st";   att_types[0] = NC_INT;  nelems[0] = 4;
+    att_bufs[0] = ival;
+    att_names[1] = "text"; att_types[1] = NC_CHAR; nelems[1] = 8;
+    att_bufs[1] = "ABCDEFGH";
+    err = ncmpi_put_atts(ncid, NC_GLOBAL, 2, att_names, att_types, nelems,
+                         att_bufs); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 1, __LINE__);
+
+    /* one attribute in place and one shrinks in the same call */
+    att_bufs[1] = "ab"; nelems[1] = 2;
+    err = ncmpi_put_atts(ncid, NC_GLOBAL, 2, att_names, att_types, nelems,
+                         att_bufs); CHECK_ERR
+    nerrs += check_put_size(ncid, &put_size, 0, __LINE__);
+
+    /* a longer name requires define mode */
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "st", "stamp"); EXP_ERR(NC_ENOTINDEFINE)
+    err = ncmpi_redef(ncid); CHECK_ERR
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "st", "stamp"); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* reopen and check the file header */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_header(ncid, big);
+    err = ncmpi_close(ncid); CHECK_ERR
+    free(big);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the name lookup tables of dimensions, variables and
+ * attributes with enough names to grow the tables several times. Names are
+ * looked up after def_var, rename_var, rename_att, del_att, which shifts the
+ * IDs of the attributes after the deleted one, and after the file is
+ * reopened and the tables are rebuilt from the file header.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_name_table tst_name_table.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 1 tst_name_table testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NVARS 2000
+#define NATTS 500
+
+static void var_name(char *name, int i, int renamed) {
+    if (renamed && i % 3 == 0) sprintf(name, "renamed_var_%d", i);
+    else                       sprintf(name, "var_%d", i);
+}
+
+static void att_name(char *name, int i, int renamed) {
+    if (renamed && i % 5 == 0) sprintf(name, "renamed_att_%d", i);
+    else                       sprintf(name, "att_%d", i);
+}
+
+/* attribute i is deleted if it is in the second half of a shuffled order */
+static int att_deleted(int i) {
+    return (i * 7919) % NATTS >= NATTS / 2;
+}
+
+static int
+check_names(int ncid, int renamed, int deleted, int nvars)
+{
+    int i, err, nerrs=0, id, expect;
+    char name[NC_MAX_NAME];
+
+    for (i=0; i<nvars; i++) {
+        var_name(name, i, renamed);
+        err = ncmpi_inq_varid(ncid, name, &id); CHECK_ERR
+        if (err == NC_NOERR && id != i) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, i, id);
+            nerrs++;
+        }
+        if (renamed && i % 3 == 0) {
+            var_name(name, i, 0);
+            err = ncmpi_inq_varid(ncid, name, &id); EXP_ERR(NC_ENOTVAR)
+        }
+    }
+    err = ncmpi_inq_varid(ncid, "no_such_var", &id); EXP_ERR(NC_ENOTVAR)
+
+    for (expect=0, i=0; i<NATTS; i++) {
+        att_name(name, i, renamed);
+        err = ncmpi_inq_attid(ncid, NC_GLOBAL, name, &id);
+        if (deleted && att_deleted(i)) {
+            EXP_ERR(NC_ENOTATT)
+            continue;
+        }
+        CHECK_ERR
+        if (err == NC_NOERR && id != expect) {
+            printf("Error at line %d in %s: attribute %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, expect, id);
+            nerrs++;
+        }
+        expect++;
+    }
+
+    /* attributes of a variable */
+    err = ncmpi_inq_attid(ncid, 1, "units", &id); CHECK_ERR
+    if (err == NC_NOERR && id != 1) {
+        printf("Error at line %d in %s: attribute units expect ID 1 but got %d\n",
+               __LINE__, __FILE__, id);
+        nerrs++;
+    }
+
+    return nerrs;
+}
+
+int
+main(int argc, char **argv)
+{
+    char filename[256], name[NC_MAX_NAME], newname[NC_MAX_NAME];
+    int i, rank, nprocs, err, nerrs=0;
+    int ncid, dimid, varid;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for name lookup tables ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, MPI_INFO_NULL, &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", 2, &dimid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", 2, &dimid); EXP_ERR(NC_ENAMEINUSE)
+
+    for (i=0; i<NVARS; i++) {
+        var_name(name, i, 0);
+        err = ncmpi_def_var(ncid, name, NC_INT, 1, &dimid, &varid); CHECK_ERR
+    }
+    err = ncmpi_def_var(ncid, "var_7", NC_INT, 1, &dimid, &varid); EXP_ERR(NC_ENAMEINUSE)
+    err = ncmpi_put_att_text(ncid, 1, "long_name", 3, "abc"); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, 1, "units", 1, "m"); CHECK_ERR
+
+    for (i=0; i<NATTS; i++) {
+        att_name(name, i, 0);
+        err = ncmpi_put_att_int(ncid, NC_GLOBAL, name, NC_INT, 1, &i); CHECK_ERR
+    }
+    nerrs += check_names(ncid, 0, 0, NVARS);
+
+    /* rename every 3rd variable and every 5th attribute */
+    for (i=0; i<NVARS; i+=3) {
+        var_name(name, i, 0);
+        var_name(newname, i, 1);
+        err = ncmpi_rename_var(ncid, i, newname); CHECK_ERR
+    }
+    for (i=0; i<NATTS; i+=5) {
+        att_name(name, i, 0);
+        att_name(newname, i, 1);
+        err = ncmpi_rename_att(ncid, NC_GLOBAL, name, newname); CHECK_ERR
+    }
+    nerrs += check_names(ncid, 1, 0, NVARS);
+
+    /* delete half of the attributes, not in the order they were added */
+    for (i=0; i<NATTS; i++) {
+        int j = (i * 7) % NATTS; /* 7 and NATTS are coprime */
+        if (!att_deleted(j)) continue;
+        att_name(name, j, 1);
+        err = ncmpi_del_att(ncid, NC_GLOBAL, name); CHECK_ERR
+    }
+    nerrs += check_names(ncid, 1, 1, NVARS);
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* tables are rebuilt from the file header */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_WRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_names(ncid, 1, 1, NVARS);
+
+    /* tables are duplicated when entering define mode */
+    err = ncmpi_redef(ncid); CHECK_ERR
+    for (i=NVARS; i<NVARS+100; i++) {
+        var_name(name, i, 1);
+        err = ncmpi_def_var(ncid, name, NC_INT, 1, &dimid, &varid); CHECK_ERR
+    }
+    err = ncmpi_enddef(ncid); CHECK_ERR
+    nerrs += check_names(ncid, 1, 1, NVARS+100);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}
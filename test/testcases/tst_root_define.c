@@ -0,0 +1,347 @@
+/*
+ *  Copyright (C) 2018, Northwestern University and Argonne National Laboratory
+ *  See COPYRIGHT notice in top-level directory.
+ *
+ *  $Id$
+ */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * This program tests the root-define mode, enabled by the PnetCDF hint
+ * nc_root_define, in which only root runs the define-mode APIs of variables
+ * and attributes and broadcasts the file header at enddef. After enddef, all
+ * processes must see the same variables, attributes, and fill modes. The file
+ * is entered define mode again to add more variables and attributes, which
+ * grows the header and moves the data written earlier. The file is then
+ * reopened without the hint and checked again.
+ *
+ * It also tests that non-root processes get NC_ENOTVAR when inquiring the
+ * variables defined in the current define mode, and that a def_var call
+ * failing only at root makes enddef return NC_EMULTIDEFINE at the other
+ * processes, which then use root's variables.
+ *
+ * The compile and run commands are given below.
+ *
+ *    % mpicc -g -o tst_root_define tst_root_define.c -lpnetcdf
+ *
+ *    % mpiexec -l -n 4 tst_root_define testfile.nc
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h> /* basename() */
+#include <pnetcdf.h>
+
+#include <testutils.h>
+
+#define NX 10
+#define NVARS 200
+#define NVARS_BIG 2000
+
+/* check the variables and attributes defined in the first define mode, fill
+ * modes are checked only before the file is closed, as they are not stored
+ * in the file */
+static int
+check_header(int ncid, int nvars, int check_fill)
+{
+    int i, err, nerrs=0, varid, nvars_in, natts, no_fill, ival;
+    char name[NC_MAX_NAME], text[NC_MAX_NAME];
+    MPI_Offset len;
+
+    err = ncmpi_inq_nvars(ncid, &nvars_in); CHECK_ERR
+    if (nvars_in != nvars) {
+        printf("Error at line %d in %s: expect nvars %d but got %d\n",
+               __LINE__, __FILE__, nvars, nvars_in);
+        nerrs++;
+    }
+
+    for (i=0; i<NVARS; i++) {
+        sprintf(name, (i == 5) ? "renamed_var" : "var_%d", i);
+        err = ncmpi_inq_varid(ncid, name, &varid); CHECK_ERR
+        if (err == NC_NOERR && varid != i) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, i, varid);
+            nerrs++;
+        }
+        err = ncmpi_get_att_int(ncid, i, "index", &ival); CHECK_ERR
+        if (err == NC_NOERR && ival != i) {
+            printf("Error at line %d in %s: variable %s attribute index expect %d but got %d\n",
+                   __LINE__, __FILE__, name, i, ival);
+            nerrs++;
+        }
+    }
+
+    /* var_1 is not filled, others are */
+    if (check_fill) {
+        err = ncmpi_inq_var_fill(ncid, 1, &no_fill, NULL); CHECK_ERR
+        if (no_fill != 1) {
+            printf("Error at line %d in %s: var_1 expect no_fill 1 but got %d\n",
+                   __LINE__, __FILE__, no_fill);
+            nerrs++;
+        }
+        err = ncmpi_inq_var_fill(ncid, 0, &no_fill, NULL); CHECK_ERR
+        if (no_fill != 0) {
+            printf("Error at line %d in %s: var_0 expect no_fill 0 but got %d\n",
+                   __LINE__, __FILE__, no_fill);
+            nerrs++;
+        }
+    }
+
+    /* global attribute "deleted" is gone, "history" is renamed */
+    err = ncmpi_inq_natts(ncid, &natts); CHECK_ERR
+    err = ncmpi_inq_attlen(ncid, NC_GLOBAL, "deleted", &len); EXP_ERR(NC_ENOTATT)
+    err = ncmpi_inq_attlen(ncid, NC_GLOBAL, "title", &len); CHECK_ERR
+    if (err == NC_NOERR) {
+        err = ncmpi_get_att_text(ncid, NC_GLOBAL, "title", text); CHECK_ERR
+        text[len] = '\0';
+        if (strcmp(text, "root define")) {
+            printf("Error at line %d in %s: title expect \"root define\" but got \"%s\"\n",
+                   __LINE__, __FILE__, text);
+            nerrs++;
+        }
+    }
+
+    return nerrs;
+}
+
+/* check the contents of var_0 written by all processes, and the fixed-size
+ * variable var_NVARS, which is filled at enddef */
+static int
+check_data(int ncid, int nprocs)
+{
+    int i, err, nerrs=0, *buf;
+    MPI_Offset start[2], count[2];
+
+    buf = (int*) malloc((size_t)nprocs * NX * sizeof(int));
+
+    start[0] = 0;      start[1] = 0;
+    count[0] = nprocs; count[1] = NX;
+    err = ncmpi_get_vara_int_all(ncid, 0, start, count, buf); CHECK_ERR
+    for (i=0; i<nprocs*NX; i++) {
+        if (buf[i] != i) {
+            printf("Error at line %d in %s: var_0[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, i, buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    err = ncmpi_get_var_int_all(ncid, NVARS, buf); CHECK_ERR
+    for (i=0; i<NX; i++) {
+        if (buf[i] != NC_FILL_INT) {
+            printf("Error at line %d in %s: var_NVARS[%d] expect %d but got %d\n",
+                   __LINE__, __FILE__, i, NC_FILL_INT, buf[i]);
+            nerrs++;
+            break;
+        }
+    }
+
+    free(buf);
+    return nerrs;
+}
+
+/* define many variables at once and a variable whose name is in use, which
+ * fails only at root when non-root processes skip the define calls */
+static int
+test_skipped(char *filename, MPI_Info info, int rank)
+{
+    char hint[MPI_MAX_INFO_VAL], **names;
+    int i, err, nerrs=0, flag, skipped, ncid, dimid, varid, nvars, ival;
+    int *ndims, **dimids, *varids, buf[NX];
+    nc_type xtype, *xtypes;
+    MPI_Info infoused;
+
+    names  = (char**)   malloc(NVARS_BIG * sizeof(char*));
+    names[0] = (char*)  malloc(NVARS_BIG * 16);
+    xtypes = (nc_type*) malloc(NVARS_BIG * sizeof(nc_type));
+    ndims  = (int*)     malloc(NVARS_BIG * 2 * sizeof(int));
+    varids = ndims + NVARS_BIG;
+    dimids = (int**)    malloc(NVARS_BIG * sizeof(int*));
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid); CHECK_ERR
+    for (i=0; i<NVARS_BIG; i++) {
+        names[i]  = names[0] + i * 16;
+        sprintf(names[i], "v%d", i);
+        xtypes[i] = NC_INT;
+        ndims[i]  = 1;
+        dimids[i] = &dimid;
+    }
+    err = ncmpi_def_vars(ncid, NVARS_BIG, names, xtypes, ndims, dimids, varids); CHECK_ERR
+
+    /* the hint is ignored in safe mode */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_root_define", MPI_MAX_INFO_VAL-1, hint, &flag);
+    MPI_Info_free(&infoused);
+    skipped = (flag && !strcmp(hint, "enable") && rank > 0);
+
+    /* the varid is valid in the dispatcher, but has no object yet */
+    err = ncmpi_inq_vartype(ncid, varids[NVARS_BIG-1], &xtype);
+    if (skipped) EXP_ERR(NC_ENOTVAR)
+    else CHECK_ERR
+    err = ncmpi_get_att_int(ncid, varids[NVARS_BIG-1], "index", &ival);
+    if (skipped) EXP_ERR(NC_ENOTVAR)
+    else EXP_ERR(NC_ENOTATT)
+
+    /* v0 is in use, only root detects it when non-root processes skip */
+    err = ncmpi_def_var(ncid, "v0", NC_INT, 1, &dimid, &varid);
+    if (skipped) CHECK_ERR
+    else EXP_ERR(NC_ENAMEINUSE)
+
+    /* non-root processes take root's variables */
+    err = ncmpi_enddef(ncid);
+    if (skipped) EXP_ERR(NC_EMULTIDEFINE)
+    else CHECK_ERR
+
+    err = ncmpi_inq_nvars(ncid, &nvars); CHECK_ERR
+    if (nvars != NVARS_BIG) {
+        printf("Error at line %d in %s: expect nvars %d but got %d\n",
+               __LINE__, __FILE__, NVARS_BIG, nvars);
+        nerrs++;
+    }
+    err = ncmpi_inq_vartype(ncid, varids[NVARS_BIG-1], &xtype); CHECK_ERR
+    if (err == NC_NOERR && xtype != NC_INT) {
+        printf("Error at line %d in %s: expect xtype %d but got %d\n",
+               __LINE__, __FILE__, NC_INT, xtype);
+        nerrs++;
+    }
+    err = ncmpi_inq_vartype(ncid, NVARS_BIG, &xtype); EXP_ERR(NC_ENOTVAR)
+
+    for (i=0; i<NX; i++) buf[i] = i;
+    err = ncmpi_put_var_int_all(ncid, varids[NVARS_BIG-1], buf); CHECK_ERR
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    free(dimids);
+    free(ndims);
+    free(xtypes);
+    free(names[0]);
+    free(names);
+    return nerrs;
+}
+
+int
+main(int argc, char **argv)
+{
+    char filename[256], name[NC_MAX_NAME];
+    char hint[MPI_MAX_INFO_VAL];
+    int i, rank, nprocs, err, nerrs=0, flag;
+    int ncid, dimid[2], varid, buf[NX];
+    MPI_Offset start[2], count[2];
+    MPI_Info info, infoused;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    if (argc > 2) {
+        if (!rank) printf("Usage: %s [filename]\n",argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (argc == 2) snprintf(filename, 256, "%s", argv[1]);
+    else           strcpy(filename, "testfile.nc");
+    MPI_Bcast(filename, 256, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        char *cmd_str = (char*)malloc(strlen(argv[0]) + 256);
+        sprintf(cmd_str, "*** TESTING C   %s for root-define mode ", basename(argv[0]));
+        printf("%-66s ------ ", cmd_str); fflush(stdout);
+        free(cmd_str);
+    }
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_root_define", "enable");
+
+    err = ncmpi_create(MPI_COMM_WORLD, filename, NC_CLOBBER, info, &ncid); CHECK_ERR
+    err = ncmpi_set_fill(ncid, NC_FILL, NULL); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "Y", NC_UNLIMITED, &dimid[0]); CHECK_ERR
+    err = ncmpi_def_dim(ncid, "X", NX, &dimid[1]); CHECK_ERR
+    for (i=0; i<NVARS; i++) {
+        sprintf(name, "var_%d", i);
+        err = ncmpi_def_var(ncid, name, NC_INT, 2, dimid, &varid); CHECK_ERR
+        if (err == NC_NOERR && varid != i) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, i, varid);
+            nerrs++;
+        }
+        err = ncmpi_put_att_int(ncid, varid, "index", NC_INT, 1, &i); CHECK_ERR
+    }
+
+    /* the hint is ignored in safe mode, otherwise non-root processes do not
+     * see the variables until enddef */
+    err = ncmpi_inq_file_info(ncid, &infoused); CHECK_ERR
+    MPI_Info_get(infoused, "nc_root_define", MPI_MAX_INFO_VAL-1, hint, &flag);
+    MPI_Info_free(&infoused);
+    if (flag && !strcmp(hint, "enable") && rank > 0) {
+        err = ncmpi_inq_varid(ncid, "var_0", &varid); EXP_ERR(NC_ENOTVAR)
+    }
+
+    err = ncmpi_rename_var(ncid, 5, "renamed_var"); CHECK_ERR
+    err = ncmpi_def_var_fill(ncid, 1, 1, NULL); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "history", 11, "root define"); CHECK_ERR
+    err = ncmpi_put_att_text(ncid, NC_GLOBAL, "deleted", 3, "abc"); CHECK_ERR
+    err = ncmpi_rename_att(ncid, NC_GLOBAL, "history", "title"); CHECK_ERR
+    err = ncmpi_del_att(ncid, NC_GLOBAL, "deleted"); CHECK_ERR
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    nerrs += check_header(ncid, NVARS, 1);
+
+    /* each process writes a row of var_0 */
+    for (i=0; i<NX; i++) buf[i] = rank * NX + i;
+    start[0] = rank; start[1] = 0;
+    count[0] = 1;    count[1] = NX;
+    err = ncmpi_put_vara_int_all(ncid, 0, start, count, buf); CHECK_ERR
+
+    /* the DataWarp driver, if enabled, keeps the data in its log at redef */
+    err = ncmpi_sync(ncid); CHECK_ERR
+
+    /* grow the header, so the data is moved */
+    err = ncmpi_redef(ncid); CHECK_ERR
+    for (i=NVARS; i<2*NVARS; i++) {
+        sprintf(name, "var_%d", i);
+        err = ncmpi_def_var(ncid, name, NC_INT, 1, &dimid[1], &varid); CHECK_ERR
+        if (err == NC_NOERR && varid != i) {
+            printf("Error at line %d in %s: variable %s expect ID %d but got %d\n",
+                   __LINE__, __FILE__, name, i, varid);
+            nerrs++;
+        }
+        err = ncmpi_put_att_text(ncid, varid, "long_name", strlen(name), name); CHECK_ERR
+    }
+    err = ncmpi_enddef(ncid); CHECK_ERR
+
+    nerrs += check_header(ncid, 2*NVARS, 1);
+    nerrs += check_data(ncid, nprocs);
+    err = ncmpi_close(ncid); CHECK_ERR
+    MPI_Info_free(&info);
+
+    /* reopen without the hint */
+    err = ncmpi_open(MPI_COMM_WORLD, filename, NC_NOWRITE, MPI_INFO_NULL, &ncid); CHECK_ERR
+    nerrs += check_header(ncid, 2*NVARS, 0);
+    nerrs += check_data(ncid, nprocs);
+    err = ncmpi_close(ncid); CHECK_ERR
+
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "nc_root_define", "enable");
+    nerrs += test_skipped(filename, info, rank);
+    MPI_Info_free(&info);
+
+    /* check if PnetCDF freed all internal malloc */
+    MPI_Offset malloc_size, sum_size;
+    err = ncmpi_inq_malloc_size(&malloc_size);
+    if (err == NC_NOERR) {
+        MPI_Reduce(&malloc_size, &sum_size, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && sum_size > 0)
+            printf("heap memory allocated by PnetCDF internally has %lld bytes yet to be freed\n",
+                   sum_size);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &nerrs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        if (nerrs) printf(FAIL_STR,nerrs);
+        else       printf(PASS_STR);
+    }
+
+    MPI_Finalize();
+    return (nerrs > 0);
+}